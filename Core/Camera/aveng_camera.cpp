@@ -93,4 +93,15 @@ namespace aveng {
 		};
 	}
 
+	void AvengCamera::screenRay(const glm::vec2& ndc, glm::vec3& origin, glm::vec3& direction) const
+	{
+		// Depth runs 0..1, near to far
+		const glm::mat4 inverse = glm::inverse(projectionMatrix * viewMatrix);
+		const glm::vec4 nearPoint = inverse * glm::vec4(ndc, 0.f, 1.f);
+		const glm::vec4 farPoint = inverse * glm::vec4(ndc, 1.f, 1.f);
+
+		origin = glm::vec3(nearPoint) / nearPoint.w;
+		direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+	}
+
 }
\ No newline at end of file
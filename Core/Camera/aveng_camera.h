@@ -17,6 +17,10 @@ namespace aveng {
 		const glm::mat4& getProjection() const { return projectionMatrix; }
 		const glm::mat4& getView() const { return viewMatrix; }
 		const glm::vec4 getCameraView();
+
+		// World space ray from the camera through a point on screen, in normalized device coordinates
+		// (-1..1, y down as Vulkan has it). Starts on the near plane, direction normalized.
+		void screenRay(const glm::vec2& ndc, glm::vec3& origin, glm::vec3& direction) const;
 			
 	private:
 		glm::mat4 projectionMatrix{ 1.f };
@@ -0,0 +1,97 @@
+#include "InputLog.h"
+#include "../Utils/MappedFile.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace aveng {
+
+	namespace {
+
+		constexpr char INPUT_MAGIC[4] = { 'A', 'V', 'I', 'N' };
+		constexpr uint32_t INPUT_VERSION = 1;
+
+		struct LogHeader {
+			char magic[4];
+			uint32_t version;
+			uint32_t actionCount;		// Bindings with more actions than the log can't read its bits right
+			uint32_t frameCount;
+		};
+
+		static_assert(ActionState::ACTION_COUNT <= 16, "InputLog::Frame keeps an action per bit of a uint16_t");
+
+	}
+
+	void InputLog::record(const ActionState& state, float frameTime)
+	{
+		Frame frame{};
+		frame.frameTime = frameTime;
+		for (size_t a = 0; a < ActionState::ACTION_COUNT; a++)
+		{
+			if (state.held[a]) frame.held |= static_cast<uint16_t>(1u << a);
+			if (state.pressed[a]) frame.pressed |= static_cast<uint16_t>(1u << a);
+		}
+		frame.cursor = state.cursor;
+		frames.push_back(frame);
+	}
+
+	ActionState InputLog::state(size_t frame) const
+	{
+		const Frame& recorded = frames[frame];
+
+		ActionState state{};
+		for (size_t a = 0; a < ActionState::ACTION_COUNT; a++)
+		{
+			state.held[a] = (recorded.held >> a) & 1u;
+			state.pressed[a] = (recorded.pressed >> a) & 1u;
+		}
+		state.cursor = recorded.cursor;
+		return state;
+	}
+
+	InputLog InputLog::load(const std::string& filepath)
+	{
+		MappedFile file{ filepath };
+
+		LogHeader header{};
+		if (file.size() < sizeof(header)) throw std::runtime_error(filepath + " is too short to be an input log");
+		std::memcpy(&header, file.data(), sizeof(header));
+
+		if (std::memcmp(header.magic, INPUT_MAGIC, sizeof(INPUT_MAGIC)) != 0) throw std::runtime_error(filepath + " isn't an input log");
+		if (header.version != INPUT_VERSION)
+		{
+			throw std::runtime_error(filepath + " is input log version " + std::to_string(header.version) + ", expected " + std::to_string(INPUT_VERSION));
+		}
+		if (header.actionCount != ActionState::ACTION_COUNT)
+		{
+			throw std::runtime_error(filepath + " was recorded with " + std::to_string(header.actionCount) + " actions, there are " + std::to_string(ActionState::ACTION_COUNT) + " now");
+		}
+
+		const size_t expected = sizeof(header) + static_cast<size_t>(header.frameCount) * sizeof(Frame);
+		if (file.size() != expected) throw std::runtime_error(filepath + " is " + std::to_string(file.size()) + " bytes, its header says " + std::to_string(expected));
+
+		InputLog log;
+		log.frames.resize(header.frameCount);
+		if (header.frameCount > 0) std::memcpy(log.frames.data(), file.data() + sizeof(header), header.frameCount * sizeof(Frame));
+		return log;
+	}
+
+	void InputLog::save(const std::string& filepath) const
+	{
+		LogHeader header{};
+		std::memcpy(header.magic, INPUT_MAGIC, sizeof(INPUT_MAGIC));
+		header.version = INPUT_VERSION;
+		header.actionCount = static_cast<uint32_t>(ActionState::ACTION_COUNT);
+		header.frameCount = static_cast<uint32_t>(frames.size());
+
+		std::ofstream out{ filepath, std::ios::binary | std::ios::trunc };
+		if (!out) throw std::runtime_error("Failed to write input log " + filepath);
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(frames.data()), static_cast<std::streamsize>(frames.size() * sizeof(Frame)));
+
+		if (!out) throw std::runtime_error("Failed to write input log " + filepath);
+	}
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "InputSystem.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+* A run's input, frame by frame, for playing the same run back: the ActionState each frame was sampled
+* with and the frame time it ran with. Replaying one gives the camera the same path and fires the same
+* commands on the same frames, so two builds can be timed over exactly the same run.
+*
+* On disk it's a header and then the frames as they are in memory, 16 bytes each. Little endian, like
+* everything we run on.
+*/
+namespace aveng {
+
+	class InputLog {
+
+	public:
+
+		struct Frame {
+			float frameTime;
+			uint16_t held;			// Bit per InputAction
+			uint16_t pressed;
+			glm::vec2 cursor;
+		};
+
+		void record(const ActionState& state, float frameTime);
+
+		size_t frameCount() const { return frames.size(); }
+		float frameTime(size_t frame) const { return frames[frame].frameTime; }
+
+		// The snapshot recorded for a frame, as InputSystem::sample() made it
+		ActionState state(size_t frame) const;
+
+		// Throws std::runtime_error on anything malformed
+		static InputLog load(const std::string& filepath);
+		void save(const std::string& filepath) const;
+
+	private:
+
+		std::vector<Frame> frames;
+
+	};
+
+}
@@ -0,0 +1,229 @@
+#include "InputSystem.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace aveng {
+
+	namespace {
+
+		uint64_t packVec2(const glm::vec2& v)
+		{
+			uint64_t bits;
+			std::memcpy(&bits, &v, sizeof(bits));
+			return bits;
+		}
+
+		glm::vec2 unpackVec2(uint64_t bits)
+		{
+			glm::vec2 v;
+			std::memcpy(&v, &bits, sizeof(v));
+			return v;
+		}
+
+	}
+
+	InputSystem::InputSystem()
+	{
+		keyActions.fill(UNBOUND);
+		buttonActions.fill(UNBOUND);
+	}
+
+	void InputSystem::attach(AvengWindow& window)
+	{
+		GLFWwindow* glfwWindow = window.getGLFWwindow();
+		window.setInputSystem(this);
+
+		previousKey = glfwSetKeyCallback(glfwWindow, keyCallback);
+		previousMouseButton = glfwSetMouseButtonCallback(glfwWindow, mouseButtonCallback);
+		previousCursor = glfwSetCursorPosCallback(glfwWindow, cursorCallback);
+		previousScroll = glfwSetScrollCallback(glfwWindow, scrollCallback);
+	}
+
+	void InputSystem::bindKey(int key, InputAction action)
+	{
+		if (key < 0 || key > GLFW_KEY_LAST) throw std::runtime_error("Can't bind key " + std::to_string(key));
+		keyActions[key] = static_cast<uint8_t>(action);
+	}
+
+	void InputSystem::bindMouseButton(int button, InputAction action)
+	{
+		if (button < 0 || button > GLFW_MOUSE_BUTTON_LAST) throw std::runtime_error("Can't bind mouse button " + std::to_string(button));
+		buttonActions[button] = static_cast<uint8_t>(action);
+	}
+
+	void InputSystem::bindCommand(InputAction action, std::unique_ptr<Command> command, bool whileHeld)
+	{
+		commands.push_back({ action, std::move(command), whileHeld });
+	}
+
+	void InputSystem::push(const InputEvent& event)
+	{
+		const glm::vec2 xy{ static_cast<float>(event.x), static_cast<float>(event.y) };
+
+		switch (event.type)
+		{
+		case InputEvent::Type::Cursor:
+			cursor.store(packVec2(xy), std::memory_order_relaxed);
+			cursorMoved.store(true, std::memory_order_release);
+			break;
+		case InputEvent::Type::Scroll:
+		{
+			// Only this thread adds, the loop just gets past sample() taking it meanwhile
+			uint64_t bits = scroll.load(std::memory_order_relaxed);
+			while (!scroll.compare_exchange_weak(bits, packVec2(unpackVec2(bits) + xy), std::memory_order_relaxed)) {}
+			break;
+		}
+		default:
+		{
+			if (!spilling.load(std::memory_order_acquire) && queue.push(event)) return;
+
+			std::lock_guard<std::mutex> lock(overflowMutex);
+			spilling.store(true, std::memory_order_relaxed);
+			overflow.push_back(event);
+			spilled.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		}
+
+		motionTime.store(event.time, std::memory_order_relaxed);
+		motionEvents.fetch_add(1, std::memory_order_release);
+	}
+
+	void InputSystem::apply(uint8_t& wasDown, uint8_t action, bool down)
+	{
+		if (wasDown == static_cast<uint8_t>(down)) return;
+		wasDown = static_cast<uint8_t>(down);
+		if (action == UNBOUND) return;
+
+		if (down)
+		{
+			downCount[action]++;
+			snapshot.pressed[action] = 1;
+		}
+		else if (downCount[action] > 0) {
+			downCount[action]--;
+		}
+	}
+
+	const ActionState& InputSystem::sample()
+	{
+		snapshot.pressed.fill(0);
+		snapshot.events = 0;
+		double newest = 0.0;
+
+		auto take = [this, &newest](const InputEvent& event) {
+			snapshot.events++;
+			newest = std::max(newest, event.time);
+
+			if (event.type == InputEvent::Type::Key)
+			{
+				// Keys GLFW can't name come as GLFW_KEY_UNKNOWN
+				if (event.code >= 0 && event.code <= GLFW_KEY_LAST && event.action != GLFW_REPEAT)
+				{
+					apply(keysDown[event.code], keyActions[event.code], event.action == GLFW_PRESS);
+				}
+			}
+			else if (event.code >= 0 && event.code <= GLFW_MOUSE_BUTTON_LAST) {
+				apply(buttonsDown[event.code], buttonActions[event.code], event.action == GLFW_PRESS);
+			}
+		};
+
+		// The queue first, whatever spilled came after all of it. The producer goes back to the queue once
+		// the overflow is taken, anything it pushes there from then on is newer.
+		InputEvent event;
+		std::vector<InputEvent> late;
+		{
+			std::lock_guard<std::mutex> lock(overflowMutex);
+			while (queue.pop(event)) take(event);
+			late.swap(overflow);
+			spilling.store(false, std::memory_order_release);
+		}
+		for (const InputEvent& e : late) take(e);
+
+		const uint32_t motion = motionEvents.exchange(0, std::memory_order_acquire);
+		if (motion > 0)
+		{
+			snapshot.events += motion;
+			newest = std::max(newest, motionTime.load(std::memory_order_relaxed));
+		}
+		if (snapshot.events > 0) snapshot.time = newest;
+
+		if (cursorMoved.exchange(false, std::memory_order_acquire)) snapshot.cursor = unpackVec2(cursor.load(std::memory_order_relaxed));
+		snapshot.scroll = unpackVec2(scroll.exchange(0, std::memory_order_relaxed));
+
+		for (size_t a = 0; a < ActionState::ACTION_COUNT; a++) snapshot.held[a] = downCount[a] > 0 ? 1 : 0;
+		return snapshot;
+	}
+
+	void InputSystem::dispatch(AvengAppObject& entity, float frameTime)
+	{
+		for (CommandBinding& binding : commands)
+		{
+			const bool fire = binding.whileHeld ? snapshot.isHeld(binding.action) : snapshot.wasPressed(binding.action);
+			if (fire) binding.command->execute(entity, frameTime);
+		}
+	}
+
+	InputSystem* InputSystem::from(GLFWwindow* window)
+	{
+		return reinterpret_cast<AvengWindow*>(glfwGetWindowUserPointer(window))->getInputSystem();
+	}
+
+	void InputSystem::keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+	{
+		InputSystem* input = from(window);
+		if (input->previousKey != nullptr) input->previousKey(window, key, scancode, action, mods);
+
+		InputEvent event{};
+		event.type = InputEvent::Type::Key;
+		event.code = key;
+		event.action = action;
+		event.mods = mods;
+		event.time = glfwGetTime();
+		input->push(event);
+	}
+
+	void InputSystem::mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+	{
+		InputSystem* input = from(window);
+		if (input->previousMouseButton != nullptr) input->previousMouseButton(window, button, action, mods);
+
+		InputEvent event{};
+		event.type = InputEvent::Type::MouseButton;
+		event.code = button;
+		event.action = action;
+		event.mods = mods;
+		event.time = glfwGetTime();
+		input->push(event);
+	}
+
+	void InputSystem::cursorCallback(GLFWwindow* window, double x, double y)
+	{
+		InputSystem* input = from(window);
+		if (input->previousCursor != nullptr) input->previousCursor(window, x, y);
+
+		InputEvent event{};
+		event.type = InputEvent::Type::Cursor;
+		event.x = x;
+		event.y = y;
+		event.time = glfwGetTime();
+		input->push(event);
+	}
+
+	void InputSystem::scrollCallback(GLFWwindow* window, double x, double y)
+	{
+		InputSystem* input = from(window);
+		if (input->previousScroll != nullptr) input->previousScroll(window, x, y);
+
+		InputEvent event{};
+		event.type = InputEvent::Type::Scroll;
+		event.x = x;
+		event.y = y;
+		event.time = glfwGetTime();
+		input->push(event);
+	}
+
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "../aveng_window.h"
+#include "../Player/Command.h"
+#include "../Utils/SpscQueue.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+* Input as events rather than polling. GLFW's key and mouse button callbacks push what happened, with when,
+* onto a lock free queue, and the cursor and scroll callbacks fold into the latest position and the scroll
+* so far, so a fast mouse can't crowd out a key. Once a frame sample() takes all of it into an ActionState, the
+* frame's snapshot of which actions are held and which went down since the last one. Keys and buttons are
+* bound to actions, so whatever acts on input asks about actions rather than keys, and commands
+* (Core/Player/Action.h) can be bound to actions to run when they fire.
+*
+* The callbacks run on the thread calling glfwPollEvents, sample() may run on another. There is one of each.
+*/
+namespace aveng {
+
+	enum class InputAction : uint8_t {
+		MoveForward,
+		MoveBack,
+		MoveLeft,
+		MoveRight,
+		MoveUp,
+		MoveDown,
+		LookUp,
+		LookDown,
+		LookLeft,
+		LookRight,
+		NextPipeline,
+		ToggleFlight,
+		Select,
+		Count
+	};
+
+	struct InputEvent {
+		enum class Type : uint8_t {
+			Key,
+			MouseButton,
+			Cursor,			// x, y the cursor in window coordinates
+			Scroll			// x, y the offsets
+		};
+
+		Type type = Type::Key;
+		int32_t code = 0;			// GLFW key or mouse button
+		int32_t action = 0;			// GLFW_PRESS, GLFW_RELEASE or GLFW_REPEAT
+		int32_t mods = 0;
+		double x = 0.0;
+		double y = 0.0;
+		double time = 0.0;			// glfwGetTime() when the callback ran
+	};
+
+	// What the input amounted to at one sample()
+	struct ActionState {
+		static constexpr size_t ACTION_COUNT = static_cast<size_t>(InputAction::Count);
+
+		std::array<uint8_t, ACTION_COUNT> held{};		// Down right now
+		std::array<uint8_t, ACTION_COUNT> pressed{};	// Went down since the last sample, even if it's up again
+		glm::vec2 cursor{ 0.f };						// Window coordinates
+		glm::vec2 scroll{ 0.f };						// Since the last sample
+		double time = 0.0;								// Of the newest event taken, 0 before any
+		uint32_t events = 0;							// Taken by the last sample
+
+		bool isHeld(InputAction action) const { return held[static_cast<size_t>(action)] != 0; }
+		bool wasPressed(InputAction action) const { return pressed[static_cast<size_t>(action)] != 0; }
+	};
+
+	class InputSystem {
+
+	public:
+
+		static constexpr size_t QUEUE_SIZE = 1024;
+
+		InputSystem();
+
+		InputSystem(const InputSystem&) = delete;
+		InputSystem& operator=(const InputSystem&) = delete;
+
+		// Installs the callbacks, passing every event on to whatever was installed before, ImGui's included.
+		// The window must not go away before this does.
+		void attach(AvengWindow& window);
+
+		// One action per key or button, rebinding replaces. Several may share an action.
+		void bindKey(int key, InputAction action);
+		void bindMouseButton(int button, InputAction action);
+
+		// command runs on dispatch() when the action went down, or with whileHeld at every dispatch it's held
+		void bindCommand(InputAction action, std::unique_ptr<Command> command, bool whileHeld = false);
+
+		// Producer side, what the callbacks call. Cursor and scroll events are folded in as they come; keys
+		// and buttons past QUEUE_SIZE waiting go to a locked overflow instead, none are ever dropped.
+		void push(const InputEvent& event);
+
+		// Consumer side. Drains the queue into the snapshot, the work goes with the events not the bindings.
+		const ActionState& sample();
+		const ActionState& state() const { return snapshot; }
+
+		// Replaces the snapshot with one made elsewhere, a recorded one (see InputLog), until the next sample()
+		void setState(const ActionState& state) { snapshot = state; }
+
+		// Runs the commands bound to what the last sample() saw
+		void dispatch(AvengAppObject& entity, float frameTime);
+
+		// Key and button events that found the queue full and took the overflow
+		uint32_t spilledEvents() const { return spilled.load(std::memory_order_relaxed); }
+
+	private:
+
+		static constexpr uint8_t UNBOUND = 0xff;
+
+		struct CommandBinding {
+			InputAction action;
+			std::unique_ptr<Command> command;
+			bool whileHeld;
+		};
+
+		static InputSystem* from(GLFWwindow* window);
+		static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+		static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+		static void cursorCallback(GLFWwindow* window, double x, double y);
+		static void scrollCallback(GLFWwindow* window, double x, double y);
+
+		// A key or button going down or up, once per change however many repeats GLFW sends
+		void apply(uint8_t& wasDown, uint8_t action, bool down);
+
+		SpscQueue<InputEvent, QUEUE_SIZE> queue;
+
+		// Once anything has spilled the producer keeps spilling until sample() takes the overflow, so the
+		// keys and buttons stay in order. Only spilling takes the lock.
+		std::mutex overflowMutex;
+		std::vector<InputEvent> overflow;
+		std::atomic<bool> spilling{ false };
+		std::atomic<uint32_t> spilled{ 0 };
+
+		// The cursor as it last was and the scroll since the last sample, each a pair of floats in one word
+		std::atomic<uint64_t> cursor{ 0 };
+		std::atomic<bool> cursorMoved{ false };
+		std::atomic<uint64_t> scroll{ 0 };
+		std::atomic<uint32_t> motionEvents{ 0 };	// Cursor and scroll events folded in since the last sample
+		std::atomic<double> motionTime{ 0.0 };		// Of the newest of them
+
+		std::array<uint8_t, GLFW_KEY_LAST + 1> keyActions;
+		std::array<uint8_t, GLFW_MOUSE_BUTTON_LAST + 1> buttonActions;
+		std::array<uint8_t, GLFW_KEY_LAST + 1> keysDown{};
+		std::array<uint8_t, GLFW_MOUSE_BUTTON_LAST + 1> buttonsDown{};
+
+		// Per action, how many of its keys and buttons are down
+		std::array<uint8_t, ActionState::ACTION_COUNT> downCount{};
+		ActionState snapshot;
+
+		std::vector<CommandBinding> commands;
+
+		GLFWkeyfun previousKey = nullptr;
+		GLFWmousebuttonfun previousMouseButton = nullptr;
+		GLFWcursorposfun previousCursor = nullptr;
+		GLFWscrollfun previousScroll = nullptr;
+
+	};
+
+}
@@ -0,0 +1,313 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace aveng {
+
+	namespace MeshOptimizer {
+
+		namespace {
+
+			// Forsyth's scoring, an LRU cache a little bigger than the hardware's
+			constexpr int SCORE_CACHE_SIZE = 32;
+			constexpr float CACHE_DECAY_POWER = 1.5f;
+			constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+			constexpr float VALENCE_BOOST_SCALE = 2.0f;
+			constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+			float vertexScore(int cachePosition, uint32_t remainingTriangles)
+			{
+				// Nothing left to draw with it
+				if (remainingTriangles == 0) return -1.f;
+
+				float score = 0.f;
+				if (cachePosition >= 0)
+				{
+					// The last triangle's vertices get a fixed score so its neighbours don't all look the same
+					if (cachePosition < 3) {
+						score = LAST_TRIANGLE_SCORE;
+					}
+					else {
+						const float scaler = 1.f / (SCORE_CACHE_SIZE - 3);
+						score = std::pow(1.f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+					}
+				}
+
+				// Finish off vertices with few triangles left, or they'll have to be transformed again later
+				score += VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+				return score;
+			}
+
+		}
+
+		/*
+		* A vertex is in the FIFO while fewer than cacheSize misses have happened since it was loaded.
+		*/
+		VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+		{
+			VertexCacheStats stats{};
+			if (indices.empty() || vertexCount == 0) return stats;
+
+			std::vector<uint32_t> loadedAt(vertexCount, 0);
+			std::vector<bool> referenced(vertexCount, false);
+			uint32_t misses = 0;
+			uint32_t uniqueVertices = 0;
+
+			for (uint32_t index : indices)
+			{
+				if (!referenced[index])
+				{
+					referenced[index] = true;
+					uniqueVertices++;
+				}
+
+				// loadedAt is one past the miss count, 0 means never loaded
+				if (loadedAt[index] == 0 || misses + 1 - loadedAt[index] > cacheSize)
+				{
+					misses++;
+					loadedAt[index] = misses;
+				}
+			}
+
+			stats.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+			stats.atvr = static_cast<float>(misses) / static_cast<float>(uniqueVertices);
+			return stats;
+		}
+
+		/*
+		* Each step draws the highest scoring triangle among those using a vertex in the cache, then rescores
+		* only the vertices whose cache position changed and their triangles. When the cache has nothing left
+		* to offer, the best remaining triangle overall is picked.
+		*/
+		void optimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount)
+		{
+			const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+			if (triangleCount == 0) return;
+
+			// Triangles per vertex, flattened
+			std::vector<uint32_t> remaining(vertexCount, 0);
+			for (uint32_t index : indices) remaining[index]++;
+
+			std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+			for (uint32_t v = 0; v < vertexCount; v++) adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+
+			std::vector<uint32_t> adjacency(indices.size());
+			{
+				std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+				for (uint32_t t = 0; t < triangleCount; t++)
+				{
+					for (int k = 0; k < 3; k++) adjacency[fill[indices[t * 3 + k]]++] = t;
+				}
+			}
+
+			std::vector<int> cachePosition(vertexCount, -1);
+			std::vector<float> score(vertexCount);
+			for (uint32_t v = 0; v < vertexCount; v++) score[v] = vertexScore(-1, remaining[v]);
+
+			std::vector<float> triangleScore(triangleCount);
+			std::vector<bool> emitted(triangleCount, false);
+			for (uint32_t t = 0; t < triangleCount; t++)
+			{
+				triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+			}
+
+			std::vector<uint32_t> output;
+			output.reserve(indices.size());
+
+			// Room for the cache plus the three vertices pushed in front of it
+			std::vector<uint32_t> cache;
+			std::vector<uint32_t> nextCache;
+			cache.reserve(SCORE_CACHE_SIZE + 3);
+			nextCache.reserve(SCORE_CACHE_SIZE + 3);
+
+			uint32_t scanCursor = 0;
+			int64_t best = 0;
+			for (uint32_t t = 1; t < triangleCount; t++)
+			{
+				if (triangleScore[t] > triangleScore[best]) best = t;
+			}
+
+			while (best >= 0)
+			{
+				const uint32_t t = static_cast<uint32_t>(best);
+				const uint32_t a = indices[t * 3], b = indices[t * 3 + 1], c = indices[t * 3 + 2];
+
+				emitted[t] = true;
+				output.push_back(a);
+				output.push_back(b);
+				output.push_back(c);
+
+				// Take the triangle out of its vertices' adjacency
+				for (uint32_t v : { a, b, c })
+				{
+					uint32_t* begin = &adjacency[adjacencyOffset[v]];
+					uint32_t* end = begin + remaining[v];
+					*std::find(begin, end, t) = *(end - 1);
+					remaining[v]--;
+				}
+
+				// The triangle's vertices go to the front of the LRU cache, the rest keep their order
+				nextCache.clear();
+				nextCache.push_back(a);
+				nextCache.push_back(b);
+				nextCache.push_back(c);
+				for (uint32_t v : cache)
+				{
+					if (v != a && v != b && v != c) nextCache.push_back(v);
+				}
+				std::swap(cache, nextCache);
+
+				// Whatever fell out of the cache is scored as uncached
+				for (size_t i = SCORE_CACHE_SIZE; i < cache.size(); i++)
+				{
+					cachePosition[cache[i]] = -1;
+					score[cache[i]] = vertexScore(-1, remaining[cache[i]]);
+				}
+				if (cache.size() > SCORE_CACHE_SIZE) cache.resize(SCORE_CACHE_SIZE);
+
+				// Rescore the cache and find the best triangle touching it
+				best = -1;
+				float bestScore = -1.f;
+				for (size_t i = 0; i < cache.size(); i++)
+				{
+					cachePosition[cache[i]] = static_cast<int>(i);
+					score[cache[i]] = vertexScore(static_cast<int>(i), remaining[cache[i]]);
+				}
+				for (uint32_t v : cache)
+				{
+					for (uint32_t i = 0; i < remaining[v]; i++)
+					{
+						const uint32_t n = adjacency[adjacencyOffset[v] + i];
+						triangleScore[n] = score[indices[n * 3]] + score[indices[n * 3 + 1]] + score[indices[n * 3 + 2]];
+						if (triangleScore[n] > bestScore)
+						{
+							bestScore = triangleScore[n];
+							best = n;
+						}
+					}
+				}
+
+				// Nothing in the cache is connected to anything left, start over wherever
+				if (best < 0)
+				{
+					while (scanCursor < triangleCount && emitted[scanCursor]) scanCursor++;
+					if (scanCursor < triangleCount) best = scanCursor;
+				}
+			}
+
+			indices.swap(output);
+		}
+
+		void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, float threshold)
+		{
+			const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+			if (triangleCount < 2) return;
+
+			const uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+			const uint32_t cacheSize = 16;
+			const VertexCacheStats before = analyzeVertexCache(indices, vertexCount, cacheSize);
+
+			// A cluster starts wherever a triangle misses the cache on every vertex, reordering there costs nothing
+			std::vector<uint32_t> clusterStart;
+			{
+				std::vector<uint32_t> loadedAt(vertexCount, 0);
+				uint32_t misses = 0;
+				for (uint32_t t = 0; t < triangleCount; t++)
+				{
+					uint32_t triangleMisses = 0;
+					for (int k = 0; k < 3; k++)
+					{
+						const uint32_t index = indices[t * 3 + k];
+						if (loadedAt[index] == 0 || misses + 1 - loadedAt[index] > cacheSize)
+						{
+							misses++;
+							loadedAt[index] = misses;
+							triangleMisses++;
+						}
+					}
+					if (t == 0 || triangleMisses == 3) clusterStart.push_back(t);
+				}
+			}
+			if (clusterStart.size() < 2) return;
+			clusterStart.push_back(triangleCount);
+
+			const size_t clusterCount = clusterStart.size() - 1;
+
+			// Area weighted centroid of the mesh and of each cluster, and each cluster's average normal
+			std::vector<glm::vec3> clusterCentroid(clusterCount, glm::vec3{ 0.f });
+			std::vector<glm::vec3> clusterNormal(clusterCount, glm::vec3{ 0.f });
+			glm::vec3 meshCentroid{ 0.f };
+			float meshArea = 0.f;
+
+			for (size_t c = 0; c < clusterCount; c++)
+			{
+				float clusterArea = 0.f;
+				for (uint32_t t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+				{
+					const glm::vec3& p0 = positions[indices[t * 3]];
+					const glm::vec3& p1 = positions[indices[t * 3 + 1]];
+					const glm::vec3& p2 = positions[indices[t * 3 + 2]];
+
+					const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);		// Twice the area long
+					const float area = glm::length(normal);
+					const glm::vec3 centroid = (p0 + p1 + p2) / 3.f;
+
+					clusterCentroid[c] += centroid * area;
+					clusterNormal[c] += normal;
+					clusterArea += area;
+				}
+
+				meshCentroid += clusterCentroid[c];
+				meshArea += clusterArea;
+				if (clusterArea > 0.f) clusterCentroid[c] /= clusterArea;
+			}
+			if (meshArea <= 0.f) return;
+			meshCentroid /= meshArea;
+
+			// Further out along its own normal means more likely in front of the rest
+			std::vector<float> sortKey(clusterCount);
+			for (size_t c = 0; c < clusterCount; c++)
+			{
+				const float length = glm::length(clusterNormal[c]);
+				const glm::vec3 direction = length > 0.f ? clusterNormal[c] / length : glm::vec3{ 0.f };
+				sortKey[c] = glm::dot(clusterCentroid[c] - meshCentroid, direction);
+			}
+
+			std::vector<uint32_t> order(clusterCount);
+			for (uint32_t c = 0; c < clusterCount; c++) order[c] = c;
+			std::stable_sort(order.begin(), order.end(), [&sortKey](uint32_t a, uint32_t b) { return sortKey[a] > sortKey[b]; });
+
+			std::vector<uint32_t> output;
+			output.reserve(indices.size());
+			for (uint32_t c : order)
+			{
+				output.insert(output.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+			}
+
+			const VertexCacheStats after = analyzeVertexCache(output, vertexCount, cacheSize);
+			if (after.acmr <= before.acmr * threshold)
+			{
+				indices.swap(output);
+			}
+		}
+
+		uint32_t optimizeVertexFetch(std::vector<uint32_t>& indices, uint32_t vertexCount, std::vector<uint32_t>& remap)
+		{
+			remap.assign(vertexCount, ~0u);
+			uint32_t next = 0;
+
+			for (uint32_t& index : indices)
+			{
+				assert(index < vertexCount && "Index out of range");
+				if (remap[index] == ~0u) remap[index] = next++;
+				index = remap[index];
+			}
+
+			return next;
+		}
+
+	}
+
+}
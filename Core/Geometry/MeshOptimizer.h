@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../../avpch.h"
+
+#include <cstdint>
+#include <vector>
+
+/*
+* Index and vertex reordering for meshes as they're loaded (see AvengModel::Builder). None of it
+* changes what is drawn, only the order: triangles so the GPU's post transform cache hits more often
+* and so nearer surfaces tend to come first, and vertices so they're fetched front to back.
+*/
+namespace aveng {
+
+	namespace MeshOptimizer {
+
+		// How well an index buffer uses a FIFO post transform cache of cacheSize entries
+		struct VertexCacheStats {
+			float acmr = 0.f;		// Vertices transformed per triangle. 0.5 is ideal, 3 is no reuse at all.
+			float atvr = 0.f;		// Vertices transformed per vertex referenced. 1 is ideal.
+		};
+
+		VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = 16);
+
+		// Tom Forsyth's linear speed vertex cache optimisation. Reorders the triangles in place.
+		void optimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount);
+
+		/*
+		* Reorders the (cache optimized) triangles in clusters so outward facing clusters on the outside of the
+		* mesh are drawn first and hide what's behind them from the fragment shader. Cluster boundaries are where
+		* the cache was cold anyway; the result is dropped if it makes the ACMR worse by more than threshold.
+		*/
+		void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, float threshold = 1.05f);
+
+		/*
+		* Numbers the vertices in the order the indices first use them and rewrites the indices to match.
+		* remap[old] is the new position, or ~0u for a vertex nothing references. Returns the vertex count after.
+		*/
+		uint32_t optimizeVertexFetch(std::vector<uint32_t>& indices, uint32_t vertexCount, std::vector<uint32_t>& remap);
+
+	}
+
+}
@@ -0,0 +1,329 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace aveng {
+
+	namespace MeshSimplifier {
+
+		namespace {
+
+			// Sum of weight * (distance to plane)^2 over a set of planes, as a symmetric 4x4 matrix
+			struct Quadric {
+				double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+				double b0 = 0, b1 = 0, b2 = 0;
+				double c = 0;
+				double weight = 0;
+
+				void addPlane(const glm::vec3& n, float d, double w)
+				{
+					a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z;
+					a11 += w * n.y * n.y; a12 += w * n.y * n.z; a22 += w * n.z * n.z;
+					b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+					c += w * d * d;
+					weight += w;
+				}
+
+				Quadric& operator+=(const Quadric& q)
+				{
+					a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+					b0 += q.b0; b1 += q.b1; b2 += q.b2;
+					c += q.c;
+					weight += q.weight;
+					return *this;
+				}
+
+				// Mean squared distance from p to the planes, weighted by their triangles' areas
+				double error(const glm::vec3& p) const
+				{
+					if (weight <= 0) return 0;
+					const double x = p.x, y = p.y, z = p.z;
+					const double q =
+						a00 * x * x + a11 * y * y + a22 * z * z +
+						2 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+						2 * (b0 * x + b1 * y + b2 * z) + c;
+					return std::max(q, 0.0) / weight;
+				}
+			};
+
+			// Bitwise, so the welding matches exactly the duplicates the loader made
+			struct PositionHash {
+				size_t operator()(const glm::vec3& p) const
+				{
+					uint32_t bits[3];
+					std::memcpy(bits, &p, sizeof(bits));
+					return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+				}
+			};
+
+			struct PositionEqual {
+				bool operator()(const glm::vec3& a, const glm::vec3& b) const { return std::memcmp(&a, &b, sizeof(glm::vec3)) == 0; }
+			};
+
+			struct Collapse {
+				uint32_t from;		// Position groups, see simplify()
+				uint32_t to;
+				double cost;
+			};
+
+			uint64_t edgeKey(uint32_t a, uint32_t b)
+			{
+				return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+			}
+
+		}
+
+		/*
+		* Works on position groups: every vertex is represented by the first vertex with its position, and
+		* a group can only be collapsed if it has a single vertex (no seam) and isn't on a border. Each pass
+		* sorts every edge by the cheaper of its two collapses and applies them in order, skipping any that
+		* touch a group already changed in the pass, would fold a triangle over, or would pinch the mesh.
+		*/
+		std::vector<uint32_t> simplify(
+			const std::vector<glm::vec3>& positions,
+			const std::vector<glm::vec2>& texCoords,
+			const std::vector<uint32_t>& indices,
+			size_t targetIndexCount,
+			float maxError,
+			float* error)
+		{
+			if (error) *error = 0.f;
+
+			std::vector<uint32_t> result(indices);
+			const uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+			if (result.size() <= targetIndexCount || vertexCount == 0) return result;
+
+			// group[v] is the first vertex at v's position, wedgeNext rings through all of them
+			std::vector<uint32_t> group(vertexCount);
+			std::vector<uint32_t> wedgeNext(vertexCount);
+			std::vector<uint32_t> wedgeCount(vertexCount, 0);
+			{
+				std::unordered_map<glm::vec3, uint32_t, PositionHash, PositionEqual> firstAt;
+				firstAt.reserve(vertexCount);
+				for (uint32_t v = 0; v < vertexCount; v++)
+				{
+					auto inserted = firstAt.emplace(positions[v], v);
+					const uint32_t g = inserted.first->second;
+					group[v] = g;
+					if (inserted.second) {
+						wedgeNext[v] = v;
+					}
+					else {
+						wedgeNext[v] = wedgeNext[g];
+						wedgeNext[g] = v;
+					}
+					wedgeCount[g]++;
+				}
+			}
+
+			// Edges used by anything but exactly two triangles are borders (or worse), their ends stay put
+			std::vector<bool> canMove(vertexCount);
+			for (uint32_t v = 0; v < vertexCount; v++) canMove[v] = wedgeCount[v] == 1;
+			{
+				std::unordered_map<uint64_t, uint32_t> edgeUse;
+				edgeUse.reserve(result.size());
+				for (size_t i = 0; i < result.size(); i += 3)
+				{
+					for (int k = 0; k < 3; k++)
+					{
+						edgeUse[edgeKey(group[result[i + k]], group[result[i + (k + 1) % 3]])]++;
+					}
+				}
+				for (const auto& edge : edgeUse)
+				{
+					if (edge.second == 2) continue;
+					canMove[static_cast<uint32_t>(edge.first >> 32)] = false;
+					canMove[static_cast<uint32_t>(edge.first)] = false;
+				}
+			}
+
+			std::vector<Quadric> quadrics(vertexCount);
+			for (size_t i = 0; i < result.size(); i += 3)
+			{
+				const glm::vec3& p0 = positions[result[i]];
+				const glm::vec3& p1 = positions[result[i + 1]];
+				const glm::vec3& p2 = positions[result[i + 2]];
+
+				const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+				const float length = glm::length(normal);
+				if (length <= 0.f) continue;
+
+				const glm::vec3 n = normal / length;
+				const float d = -glm::dot(n, p0);
+				for (int k = 0; k < 3; k++) quadrics[group[result[i + k]]].addPlane(n, d, 0.5 * length);
+			}
+
+			const double limit = static_cast<double>(maxError) * maxError;
+			double worst = 0;
+
+			std::vector<uint32_t> adjacencyOffset(vertexCount + 1);
+			std::vector<uint32_t> adjacency;
+			std::vector<uint32_t> collapseTo(vertexCount, ~0u);
+			std::vector<bool> touched(vertexCount);
+			std::vector<Collapse> candidates;
+			std::vector<uint32_t> collapsed;
+			std::vector<uint32_t> fromNeighbours, toNeighbours;
+
+			// Groups sharing a triangle with g
+			auto neighbours = [&](uint32_t g, std::vector<uint32_t>& out) {
+				out.clear();
+				for (uint32_t i = adjacencyOffset[g]; i < adjacencyOffset[g + 1]; i++)
+				{
+					const uint32_t t = adjacency[i];
+					for (int k = 0; k < 3; k++)
+					{
+						const uint32_t n = group[result[t * 3 + k]];
+						if (n != g && std::find(out.begin(), out.end(), n) == out.end()) out.push_back(n);
+					}
+				}
+			};
+
+			// Would moving from onto to turn any of from's remaining triangles over (or nearly)?
+			auto flips = [&](uint32_t from, uint32_t to) {
+				for (uint32_t i = adjacencyOffset[from]; i < adjacencyOffset[from + 1]; i++)
+				{
+					const uint32_t t = adjacency[i];
+					glm::vec3 before[3], after[3];
+					bool removed = false;
+					for (int k = 0; k < 3; k++)
+					{
+						const uint32_t g = group[result[t * 3 + k]];
+						removed |= g == to;
+						before[k] = positions[g];
+						after[k] = g == from ? positions[to] : positions[g];
+					}
+					if (removed) continue;
+
+					const glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+					const glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+					if (glm::dot(n0, n1) <= 0.25f * glm::length(n0) * glm::length(n1)) return true;
+				}
+				return false;
+			};
+
+			while (result.size() > targetIndexCount)
+			{
+				const uint32_t triangleCount = static_cast<uint32_t>(result.size() / 3);
+
+				// Triangles around each group
+				std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+				for (uint32_t index : result) adjacencyOffset[group[index] + 1]++;
+				for (uint32_t g = 0; g < vertexCount; g++) adjacencyOffset[g + 1] += adjacencyOffset[g];
+				adjacency.resize(result.size());
+				{
+					std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+					for (uint32_t t = 0; t < triangleCount; t++)
+					{
+						for (int k = 0; k < 3; k++) adjacency[fill[group[result[t * 3 + k]]]++] = t;
+					}
+				}
+
+				// An interior edge is a -> b in one triangle and b -> a in the other, take it once
+				candidates.clear();
+				for (uint32_t t = 0; t < triangleCount; t++)
+				{
+					for (int k = 0; k < 3; k++)
+					{
+						const uint32_t a = group[result[t * 3 + k]];
+						const uint32_t b = group[result[t * 3 + (k + 1) % 3]];
+						if (a > b || (!canMove[a] && !canMove[b])) continue;
+
+						Quadric merged = quadrics[a];
+						merged += quadrics[b];
+						const double costAB = canMove[a] ? merged.error(positions[b]) : HUGE_VAL;
+						const double costBA = canMove[b] ? merged.error(positions[a]) : HUGE_VAL;
+
+						candidates.push_back(costAB <= costBA ? Collapse{ a, b, costAB } : Collapse{ b, a, costBA });
+					}
+				}
+				std::sort(candidates.begin(), candidates.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+				std::fill(touched.begin(), touched.end(), false);
+				collapsed.clear();
+				uint32_t trianglesLeft = triangleCount;
+
+				for (const Collapse& collapse : candidates)
+				{
+					if (collapse.cost > limit || trianglesLeft * 3 <= targetIndexCount) break;
+					if (touched[collapse.from] || touched[collapse.to]) continue;
+					if (flips(collapse.from, collapse.to)) continue;
+
+					// Only the triangles on the edge may share both ends, anything else gets pinched together
+					uint32_t shared = 0;
+					for (uint32_t i = adjacencyOffset[collapse.from]; i < adjacencyOffset[collapse.from + 1]; i++)
+					{
+						const uint32_t t = adjacency[i];
+						for (int k = 0; k < 3; k++) shared += group[result[t * 3 + k]] == collapse.to;
+					}
+					neighbours(collapse.from, fromNeighbours);
+					neighbours(collapse.to, toNeighbours);
+					uint32_t common = 0;
+					for (uint32_t n : fromNeighbours) common += std::find(toNeighbours.begin(), toNeighbours.end(), n) != toNeighbours.end();
+					if (common != shared) continue;
+
+					collapseTo[collapse.from] = collapse.to;
+					collapsed.push_back(collapse.from);
+					touched[collapse.from] = true;
+					touched[collapse.to] = true;
+					for (uint32_t n : fromNeighbours) touched[n] = true;
+
+					trianglesLeft -= shared;
+					worst = std::max(worst, collapse.cost);
+				}
+
+				if (collapsed.empty()) break;
+
+				// A moved vertex takes on whichever vertex at the target has the nearest texture coordinates
+				std::vector<uint32_t> next;
+				next.reserve(static_cast<size_t>(trianglesLeft) * 3);
+				for (uint32_t t = 0; t < triangleCount; t++)
+				{
+					uint32_t tri[3];
+					for (int k = 0; k < 3; k++)
+					{
+						const uint32_t v = result[t * 3 + k];
+						const uint32_t to = collapseTo[group[v]];
+						if (to == ~0u) {
+							tri[k] = v;
+							continue;
+						}
+
+						uint32_t best = to;
+						float bestDistance = HUGE_VALF;
+						uint32_t w = to;
+						do {
+							const glm::vec2 delta = texCoords[w] - texCoords[v];
+							const float distance = glm::dot(delta, delta);
+							if (distance < bestDistance)
+							{
+								bestDistance = distance;
+								best = w;
+							}
+							w = wedgeNext[w];
+						} while (w != to);
+						tri[k] = best;
+					}
+
+					const uint32_t g0 = group[tri[0]], g1 = group[tri[1]], g2 = group[tri[2]];
+					if (g0 == g1 || g1 == g2 || g0 == g2) continue;
+					next.insert(next.end(), tri, tri + 3);
+				}
+				result.swap(next);
+
+				for (uint32_t from : collapsed)
+				{
+					quadrics[collapseTo[from]] += quadrics[from];
+					collapseTo[from] = ~0u;
+				}
+			}
+
+			if (error) *error = static_cast<float>(std::sqrt(worst));
+			return result;
+		}
+
+	}
+
+}
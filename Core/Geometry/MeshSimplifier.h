@@ -0,0 +1,35 @@
+#pragma once
+
+#include "../../avpch.h"
+
+#include <cstdint>
+#include <vector>
+
+/*
+* Quadric error metric simplification (Garland & Heckbert) by half edge collapse: a vertex is merged
+* into one of its neighbours, so the simplified mesh indexes the same vertices as the original and a
+* level of detail is nothing more than another index range.
+*
+* Vertices sharing a position are treated as one. Where they don't share texture coordinates or normals
+* (a seam), and on open borders, nothing is collapsed away; the mesh keeps its outline and its seams.
+*/
+namespace aveng {
+
+	namespace MeshSimplifier {
+
+		/*
+		* Collapse edges, cheapest first, until at most targetIndexCount indices are left or the next collapse
+		* would move the surface further than maxError (model space). Returns the new indices. error, if
+		* given, is set to the largest error any collapse introduced.
+		*/
+		std::vector<uint32_t> simplify(
+			const std::vector<glm::vec3>& positions,
+			const std::vector<glm::vec2>& texCoords,
+			const std::vector<uint32_t>& indices,
+			size_t targetIndexCount,
+			float maxError,
+			float* error = nullptr);
+
+	}
+
+}
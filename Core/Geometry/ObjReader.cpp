@@ -0,0 +1,317 @@
+#include "ObjReader.h"
+#include "VertexDedup.h"
+#include "../Utils/MappedFile.h"
+#include "../Utils/threadpool.h"
+
+#include <algorithm>
+#include <charconv>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+namespace aveng {
+
+	namespace ObjReader {
+
+		namespace {
+
+			// Below this a chunk isn't worth a thread
+			constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+
+			constexpr int32_t MISSING = INT32_MIN;
+
+			/*
+			* Indices as written, made 0 based. A negative OBJ index counts back from the last attribute read,
+			* which the chunk only knows locally, so it's kept relative to the chunk (and may point into an
+			* earlier one) until the chunk's base is known.
+			*/
+			struct Corner {
+				int32_t position = MISSING;
+				int32_t texCoord = MISSING;
+				int32_t normal = MISSING;
+				uint8_t relative = 0;		// Bit per attribute in the order above
+			};
+
+			struct Chunk {
+				const char* begin = nullptr;
+				const char* end = nullptr;
+
+				std::vector<float> positions;		// xyz
+				std::vector<float> colors;			// rgb, one per position
+				std::vector<float> texCoords;		// uv
+				std::vector<float> normals;			// xyz
+				std::vector<Corner> corners;		// Three per triangle
+
+				// Attributes in the chunks before this one
+				int64_t positionBase = 0;
+				int64_t texCoordBase = 0;
+				int64_t normalBase = 0;
+
+				// Only with parallelDedup
+				std::vector<AvengModel::Vertex> vertices;
+				std::vector<uint32_t> indices;
+
+				bool badIndex = false;				// Reported once the threads are done
+			};
+
+			bool isSpace(char c) { return c == ' ' || c == '\t'; }
+
+			const char* skipSpace(const char* p, const char* end)
+			{
+				while (p < end && isSpace(*p)) p++;
+				return p;
+			}
+
+			const char* nextLine(const char* p, const char* end)
+			{
+				while (p < end && *p != '\n') p++;
+				return p < end ? p + 1 : end;
+			}
+
+			// Leaves value alone, and returns p, if there's no number
+			const char* parseFloat(const char* p, const char* end, float& value)
+			{
+				p = skipSpace(p, end);
+				const char* start = p < end && *p == '+' ? p + 1 : p;
+				const std::from_chars_result result = std::from_chars(start, end, value);
+				return result.ec == std::errc{} ? result.ptr : p;
+			}
+
+			// One of a corner's slash separated indices
+			const char* parseIndex(const char* p, const char* end, size_t count, int32_t& index, uint8_t& relative, uint8_t bit)
+			{
+				int64_t value = 0;
+				const std::from_chars_result result = std::from_chars(p, end, value);
+				if (result.ec != std::errc{} || value == 0) return p;
+
+				if (value > 0) {
+					index = static_cast<int32_t>(value - 1);
+				}
+				else {
+					index = static_cast<int32_t>(static_cast<int64_t>(count) + value);
+					relative |= bit;
+				}
+				return result.ptr;
+			}
+
+			void parseFace(const char* p, const char* end, Chunk& chunk, std::vector<Corner>& face)
+			{
+				face.clear();
+				while (true)
+				{
+					p = skipSpace(p, end);
+					if (p >= end || *p == '\n' || *p == '\r' || *p == '#') break;
+
+					Corner corner{};
+					p = parseIndex(p, end, chunk.positions.size() / 3, corner.position, corner.relative, 1);
+					if (p < end && *p == '/')
+					{
+						p++;
+						if (p < end && *p != '/') p = parseIndex(p, end, chunk.texCoords.size() / 2, corner.texCoord, corner.relative, 2);
+						if (p < end && *p == '/') p = parseIndex(p + 1, end, chunk.normals.size() / 3, corner.normal, corner.relative, 4);
+					}
+
+					// Whatever is left of a token we couldn't read
+					while (p < end && !isSpace(*p) && *p != '\n' && *p != '\r') p++;
+
+					if (corner.position != MISSING) face.push_back(corner);
+				}
+
+				for (size_t k = 1; k + 1 < face.size(); k++)
+				{
+					chunk.corners.push_back(face[0]);
+					chunk.corners.push_back(face[k]);
+					chunk.corners.push_back(face[k + 1]);
+				}
+			}
+
+			void tokenize(Chunk& chunk)
+			{
+				std::vector<Corner> face;
+				const char* end = chunk.end;
+
+				for (const char* line = chunk.begin; line < end; line = nextLine(line, end))
+				{
+					const char* p = skipSpace(line, end);
+					if (end - p < 2) continue;
+
+					if (p[0] == 'v' && isSpace(p[1]))
+					{
+						float x = 0.f, y = 0.f, z = 0.f;
+						p = parseFloat(parseFloat(parseFloat(p + 2, end, x), end, y), end, z);
+						chunk.positions.insert(chunk.positions.end(), { x, y, z });
+
+						// Optional vertex color, white without
+						float r = 1.f, g = 1.f, b = 1.f;
+						const char* color = parseFloat(p, end, r);
+						if (color != p) parseFloat(parseFloat(color, end, g), end, b);
+						chunk.colors.insert(chunk.colors.end(), { r, g, b });
+					}
+					else if (p[0] == 'v' && p[1] == 't' && end - p > 2 && isSpace(p[2]))
+					{
+						float u = 0.f, v = 0.f;
+						parseFloat(parseFloat(p + 3, end, u), end, v);
+						chunk.texCoords.insert(chunk.texCoords.end(), { u, v });
+					}
+					else if (p[0] == 'v' && p[1] == 'n' && end - p > 2 && isSpace(p[2]))
+					{
+						float x = 0.f, y = 0.f, z = 0.f;
+						parseFloat(parseFloat(parseFloat(p + 3, end, x), end, y), end, z);
+						chunk.normals.insert(chunk.normals.end(), { x, y, z });
+					}
+					else if (p[0] == 'f' && isSpace(p[1]))
+					{
+						parseFace(p + 2, end, chunk, face);
+					}
+				}
+			}
+
+			// Everything every chunk read, in file order
+			struct Attributes {
+				std::vector<float> positions;
+				std::vector<float> colors;
+				std::vector<float> texCoords;
+				std::vector<float> normals;
+			};
+
+			// MISSING if absent, -1 if out of range
+			int64_t resolve(int32_t index, bool relative, int64_t base, size_t count)
+			{
+				if (index == MISSING) return MISSING;
+				const int64_t global = relative ? base + index : index;
+				return global >= 0 && global < static_cast<int64_t>(count) ? global : -1;
+			}
+
+			AvengModel::Vertex vertexAt(const Attributes& attributes, Chunk& chunk, const Corner& corner)
+			{
+				AvengModel::Vertex vertex{};
+
+				const int64_t p = resolve(corner.position, corner.relative & 1, chunk.positionBase, attributes.positions.size() / 3);
+				const int64_t t = resolve(corner.texCoord, corner.relative & 2, chunk.texCoordBase, attributes.texCoords.size() / 2);
+				const int64_t n = resolve(corner.normal, corner.relative & 4, chunk.normalBase, attributes.normals.size() / 3);
+				if (p == -1 || t == -1 || n == -1) chunk.badIndex = true;
+
+				if (p >= 0)
+				{
+					vertex.position = { attributes.positions[3 * p], attributes.positions[3 * p + 1], attributes.positions[3 * p + 2] };
+					vertex.color = { attributes.colors[3 * p], attributes.colors[3 * p + 1], attributes.colors[3 * p + 2] };
+				}
+				if (n >= 0) vertex.normal = { attributes.normals[3 * n], attributes.normals[3 * n + 1], attributes.normals[3 * n + 2] };
+				if (t >= 0) vertex.texCoord = { attributes.texCoords[2 * t], attributes.texCoords[2 * t + 1] };
+
+				return vertex;
+			}
+
+			template<typename T>
+			void append(std::vector<T>& to, std::vector<T>& from)
+			{
+				if (to.empty()) {
+					to.swap(from);
+				}
+				else {
+					to.insert(to.end(), from.begin(), from.end());
+					from = std::vector<T>{};
+				}
+			}
+
+		}
+
+		void read(const std::string& filepath, std::vector<AvengModel::Vertex>& vertices, std::vector<uint32_t>& indices, const Options& options)
+		{
+			MappedFile file{ filepath };
+			const char* data = file.data();
+			const size_t size = file.size();
+
+			vertices.clear();
+			indices.clear();
+			if (size == 0) return;
+
+			const uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+			const uint32_t threads = options.threads > 0 ? options.threads : hardwareThreads;
+			const size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threads, size / MIN_CHUNK_BYTES));
+
+			// Cut at the first line break past each even split
+			std::vector<Chunk> chunks(chunkCount);
+			const char* begin = data;
+			for (size_t c = 0; c < chunkCount; c++)
+			{
+				const char* end = c + 1 == chunkCount ? data + size : nextLine(std::max(begin, data + size * (c + 1) / chunkCount), data + size);
+				chunks[c].begin = begin;
+				chunks[c].end = end;
+				begin = end;
+			}
+
+			ThreadPool pool;
+			auto forEachChunk = [&](const std::function<void(Chunk&)>& work) {
+				if (chunkCount == 1)
+				{
+					work(chunks[0]);
+					return;
+				}
+				for (size_t c = 0; c < chunkCount; c++)
+				{
+					Chunk* chunk = &chunks[c];
+					pool.threads[c % pool.threads.size()]->addJob([&work, chunk] { work(*chunk); });
+				}
+				pool.wait();
+			};
+			if (chunkCount > 1) pool.setThreadCount(static_cast<uint32_t>(chunkCount));
+
+			forEachChunk(tokenize);
+
+			// Negative indices can now be made absolute, and the attributes gathered in one place
+			Attributes attributes;
+			size_t cornerCount = 0;
+			{
+				int64_t positionBase = 0, texCoordBase = 0, normalBase = 0;
+				for (Chunk& chunk : chunks)
+				{
+					chunk.positionBase = positionBase;
+					chunk.texCoordBase = texCoordBase;
+					chunk.normalBase = normalBase;
+					positionBase += static_cast<int64_t>(chunk.positions.size() / 3);
+					texCoordBase += static_cast<int64_t>(chunk.texCoords.size() / 2);
+					normalBase += static_cast<int64_t>(chunk.normals.size() / 3);
+					cornerCount += chunk.corners.size();
+
+					append(attributes.positions, chunk.positions);
+					append(attributes.colors, chunk.colors);
+					append(attributes.texCoords, chunk.texCoords);
+					append(attributes.normals, chunk.normals);
+				}
+			}
+
+			indices.reserve(cornerCount);
+
+			if (options.parallelDedup && chunkCount > 1)
+			{
+				forEachChunk([&attributes](Chunk& chunk) {
+					VertexDedup<AvengModel::Vertex> dedup{ chunk.corners.size() };
+					chunk.indices.reserve(chunk.corners.size());
+					for (const Corner& corner : chunk.corners) chunk.indices.push_back(dedup.insert(vertexAt(attributes, chunk, corner), chunk.vertices));
+				});
+
+				for (Chunk& chunk : chunks)
+				{
+					const uint32_t base = static_cast<uint32_t>(vertices.size());
+					vertices.insert(vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+					for (uint32_t index : chunk.indices) indices.push_back(base + index);
+				}
+			}
+			else {
+				VertexDedup<AvengModel::Vertex> dedup{ cornerCount };
+				for (Chunk& chunk : chunks)
+				{
+					for (const Corner& corner : chunk.corners) indices.push_back(dedup.insert(vertexAt(attributes, chunk, corner), vertices));
+				}
+			}
+
+			for (const Chunk& chunk : chunks)
+			{
+				if (chunk.badIndex) throw std::runtime_error(filepath + " has a face referring to a vertex attribute that isn't there");
+			}
+		}
+
+	}
+
+}
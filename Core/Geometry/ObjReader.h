@@ -0,0 +1,33 @@
+#pragma once
+
+#include "../aveng_model.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+* Wavefront OBJ straight to AvengModel vertices and indices. The file is mapped rather than read, cut
+* into chunks at line breaks, and each chunk is tokenized on a thread of its own with std::from_chars.
+* Once every chunk's attribute counts are known the face corners are resolved against the whole file
+* and welded (VertexDedup) into the output.
+*
+* Reads v (with the optional vertex color), vt, vn and f, fanning polygons into triangles. The engine
+* has no use for materials or groups, so mtllib, usemtl, o, g, s and anything else are skipped.
+*/
+namespace aveng {
+
+	namespace ObjReader {
+
+		struct Options {
+			uint32_t threads = 0;			// 0 for one per hardware thread. Small files get fewer regardless.
+			bool parallelDedup = false;		// Weld every chunk on its own, chunks then share no vertices
+		};
+
+		// Replaces vertices and indices. Throws std::runtime_error if the file can't be read or a face
+		// refers to an attribute the file doesn't have.
+		void read(const std::string& filepath, std::vector<AvengModel::Vertex>& vertices, std::vector<uint32_t>& indices, const Options& options = Options{});
+
+	}
+
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+/*
+* Welds identical vertices as a mesh is read. The table is flat, open addressed and sized up front for
+* every vertex that can come, so it never rehashes; each vertex is hashed once and walks one linear probe.
+* Slots keep a few bits of the hash next to the index, most mismatches are settled without touching the
+* vertices at all.
+*
+* Vertices are compared as bytes rather than with operator==: +0 and -0 are different vertices and a NaN
+* equals itself. V mustn't have padding.
+*/
+namespace aveng {
+
+	// 64 bit hash of a small blob, 8 bytes at a time with a murmur style finish
+	inline uint64_t hashBytes(const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		uint64_t h = 0x9E3779B97F4A7C15ull ^ (size * 0xFF51AFD7ED558CCDull);
+
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			uint64_t k;
+			std::memcpy(&k, bytes + i, 8);
+			k *= 0x87C37B91114253D5ull;
+			k ^= k >> 31;
+			h ^= k;
+			h = ((h << 27) | (h >> 37)) * 5 + 0x52DCE729;
+		}
+		if (i < size)
+		{
+			uint64_t k = 0;
+			std::memcpy(&k, bytes + i, size - i);
+			h ^= k * 0x87C37B91114253D5ull;
+		}
+
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53ull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	template<typename V>
+	class VertexDedup {
+		static_assert(std::is_trivially_copyable<V>::value, "Vertices are hashed and compared as bytes");
+
+	public:
+
+		// At most maxVertices calls to insert(). The table stays under three quarters full even if all of them are unique.
+		explicit VertexDedup(size_t maxVertices)
+		{
+			size_t capacity = 16;
+			while (capacity < maxVertices + maxVertices / 3) capacity <<= 1;
+			slots.assign(capacity, Slot{ EMPTY, 0 });
+			mask = capacity - 1;
+		}
+
+		// v's index in vertices. A vertex not seen before is appended.
+		uint32_t insert(const V& v, std::vector<V>& vertices)
+		{
+			const uint64_t hash = hashBytes(&v, sizeof(V));
+			const uint32_t tag = static_cast<uint32_t>(hash >> 32);
+
+			for (size_t slot = static_cast<size_t>(hash) & mask; ; slot = (slot + 1) & mask)
+			{
+				Slot& entry = slots[slot];
+				if (entry.index == EMPTY)
+				{
+					entry.index = static_cast<uint32_t>(vertices.size());
+					entry.tag = tag;
+					vertices.push_back(v);
+					return entry.index;
+				}
+				if (entry.tag == tag && std::memcmp(&vertices[entry.index], &v, sizeof(V)) == 0)
+				{
+					return entry.index;
+				}
+			}
+		}
+
+	private:
+
+		static constexpr uint32_t EMPTY = ~0u;
+
+		struct Slot {
+			uint32_t index;
+			uint32_t tag;		// High half of the hash, the low half picked the slot
+		};
+
+		std::vector<Slot> slots;
+		size_t mask = 0;
+
+	};
+
+}
@@ -25,4 +25,61 @@ namespace aveng {
 		return glm::vec3{ cos(degreesXZ), sin(degreesXZ), sin(degreesYZ) };
 	}
 
-}
+	/*
+	* Gribb/Hartmann, each plane is a sum or difference of the matrix's rows
+	*/
+	Frustum Frustum::fromMatrix(const glm::mat4& m)
+	{
+		glm::vec4 row0{ m[0][0], m[1][0], m[2][0], m[3][0] };
+		glm::vec4 row1{ m[0][1], m[1][1], m[2][1], m[3][1] };
+		glm::vec4 row2{ m[0][2], m[1][2], m[2][2], m[3][2] };
+		glm::vec4 row3{ m[0][3], m[1][3], m[2][3], m[3][3] };
+
+		Frustum frustum{};
+		frustum.planes[0] = row3 + row0;
+		frustum.planes[1] = row3 - row0;
+		frustum.planes[2] = row3 + row1;
+		frustum.planes[3] = row3 - row1;
+		frustum.planes[4] = row2;			// z >= 0
+		frustum.planes[5] = row3 - row2;
+
+		for (glm::vec4& plane : frustum.planes)
+		{
+			plane /= glm::length(glm::vec3(plane));
+		}
+
+		return frustum;
+	}
+
+	bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const
+	{
+		for (const glm::vec4& plane : planes)
+		{
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+		}
+
+		return true;
+	}
+
+	/*
+	* Per plane, the box corner furthest along the normal decides whether it's outside and the nearest
+	* whether it's straddling
+	*/
+	Frustum::Overlap Frustum::testBox(const AABB& box) const
+	{
+		Overlap overlap = Overlap::Inside;
+
+		for (const glm::vec4& plane : planes)
+		{
+			glm::vec3 normal{ plane };
+			glm::vec3 outer{ normal.x >= 0.f ? box.max.x : box.min.x, normal.y >= 0.f ? box.max.y : box.min.y, normal.z >= 0.f ? box.max.z : box.min.z };
+			glm::vec3 inner{ normal.x >= 0.f ? box.min.x : box.max.x, normal.y >= 0.f ? box.min.y : box.max.y, normal.z >= 0.f ? box.min.z : box.max.z };
+
+			if (glm::dot(normal, outer) + plane.w < 0.f) return Overlap::Outside;
+			if (glm::dot(normal, inner) + plane.w < 0.f) overlap = Overlap::Intersects;
+		}
+
+		return overlap;
+	}
+
+}
\ No newline at end of file
@@ -6,4 +6,71 @@ namespace aveng {
 	glm::vec3 unitCircleTransform_vec3(float theta, glm::vec3 viewerTranslation, float radius, float modPI, glm::vec3 playerTranslation);
 	glm::vec3 unitSphereTransform_vec3(float theta, float omega, float alpha);
 
+	/*
+	* Axis aligned box. The default one is empty, anything grown into it replaces it.
+	*/
+	struct AABB {
+		glm::vec3 min{ std::numeric_limits<float>::max() };
+		glm::vec3 max{ -std::numeric_limits<float>::max() };
+
+		static AABB fromSphere(const glm::vec3& center, float radius) { return { center - glm::vec3(radius), center + glm::vec3(radius) }; }
+
+		void grow(const glm::vec3& p) { min = glm::min(min, p); max = glm::max(max, p); }
+		void grow(const AABB& box) { min = glm::min(min, box.min); max = glm::max(max, box.max); }
+
+		glm::vec3 center() const { return (min + max) * 0.5f; }
+		glm::vec3 extent() const { return max - min; }
+
+		// Half the surface area, which is all the SAH needs
+		float halfArea() const
+		{
+			glm::vec3 e = glm::max(max - min, glm::vec3(0.f));
+			return e.x * e.y + e.y * e.z + e.z * e.x;
+		}
+
+		bool overlaps(const AABB& box) const
+		{
+			return min.x <= box.max.x && max.x >= box.min.x && min.y <= box.max.y && max.y >= box.min.y && min.z <= box.max.z && max.z >= box.min.z;
+		}
+
+		// Squared distance from p to the nearest point of the box, 0 inside
+		float distanceSquared(const glm::vec3& p) const
+		{
+			glm::vec3 d = glm::max(glm::max(min - p, p - max), glm::vec3(0.f));
+			return glm::dot(d, d);
+		}
+
+		// Where a ray with 1 / direction invDirection enters the box, if it does before tMax
+		bool intersectsRay(const glm::vec3& origin, const glm::vec3& invDirection, float tMax, float& tEnter) const
+		{
+			glm::vec3 t0 = (min - origin) * invDirection;
+			glm::vec3 t1 = (max - origin) * invDirection;
+			glm::vec3 tNear = glm::min(t0, t1);
+			glm::vec3 tFar = glm::max(t0, t1);
+			tEnter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+			float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+			return tEnter <= tExit;
+		}
+
+		bool operator==(const AABB& box) const { return min == box.min && max == box.max; }
+	};
+
+	/*
+	* The 6 planes of a view frustum, normals pointing inwards and normalized so a plane's
+	* w plus its dot with a point is the signed distance. cull.comp does the same test.
+	*/
+	struct Frustum {
+		glm::vec4 planes[6];	// left, right, top, bottom, near, far
+
+		// From projection * view, depth 0 to 1
+		static Frustum fromMatrix(const glm::mat4& projectionView);
+
+		bool intersectsSphere(const glm::vec3& center, float radius) const;
+
+		enum class Overlap { Outside, Intersects, Inside };
+
+		// Outside only if the box is wholly behind one plane, so like the sphere test it can let through a box near a corner
+		Overlap testBox(const AABB& box) const;
+	};
+
 }
\ No newline at end of file
@@ -9,24 +9,40 @@ namespace aveng{
 		: viewerObject{ _viewerObject }, data{_data}
 	{};
 
-	void KeyboardController::moveCameraXZ(GLFWwindow* window, float dt) {
+	void KeyboardController::bind(InputSystem& input) const
+	{
+		input.bindKey(keys.w, InputAction::MoveForward);
+		input.bindKey(keys.s, InputAction::MoveBack);
+		input.bindKey(keys.a, InputAction::MoveLeft);
+		input.bindKey(keys.d, InputAction::MoveRight);
+		input.bindKey(keys.q, InputAction::MoveUp);
+		input.bindKey(keys.e, InputAction::MoveDown);
+		input.bindKey(keys.lookUp, InputAction::LookUp);
+		input.bindKey(keys.lookDown, InputAction::LookDown);
+		input.bindKey(keys.left, InputAction::LookLeft);
+		input.bindKey(keys.right, InputAction::LookRight);
+		input.bindKey(keys.nextPipeline, InputAction::NextPipeline);
+		input.bindKey(keys.flightMode, InputAction::ToggleFlight);
+	}
+
+	void KeyboardController::moveCameraXZ(const ActionState& input, float dt) {
 		
 		glm::vec3 rotate{ 0 };
 
-		if (glfwGetKey(window, keys.lookUp) == GLFW_PRESS)
+		if (input.isHeld(InputAction::LookUp))
 		{
 			rotate.x += 1.f;
 		}
-		if (glfwGetKey(window, keys.lookDown) == GLFW_PRESS)
+		if (input.isHeld(InputAction::LookDown))
 		{
 			rotate.x -= 1.f;
 		}		
 		
-		if (glfwGetKey(window, keys.left) == GLFW_PRESS)
+		if (input.isHeld(InputAction::LookLeft))
 		{
 			rotate.y -= 1.f;
 		}
-		if (glfwGetKey(window, keys.right) == GLFW_PRESS)
+		if (input.isHeld(InputAction::LookRight))
 		{
 			rotate.y += 1.f;
 		}
@@ -49,27 +65,27 @@ namespace aveng{
 		const glm::vec3 upDir{ 0.f, -1.f, 0.f };
 
 		glm::vec3 moveDir{ 0.f };
-		if (glfwGetKey(window, keys.w) == GLFW_PRESS)
+		if (input.isHeld(InputAction::MoveForward))
 		{
 			moveDir += forwardDir;
 		}
-		if (glfwGetKey(window, keys.s) == GLFW_PRESS)
+		if (input.isHeld(InputAction::MoveBack))
 		{
 			moveDir -= forwardDir;
 		}
-		if (glfwGetKey(window, keys.a) == GLFW_PRESS)
+		if (input.isHeld(InputAction::MoveLeft))
 		{
 			moveDir -= rightDir;
 		}
-		if (glfwGetKey(window, keys.d) == GLFW_PRESS)
+		if (input.isHeld(InputAction::MoveRight))
 		{
 			moveDir += rightDir;
 		}
-		if (glfwGetKey(window, keys.q) == GLFW_PRESS)
+		if (input.isHeld(InputAction::MoveUp))
 		{
 			moveDir -= upDir;
 		}
-		if (glfwGetKey(window, keys.e) == GLFW_PRESS)
+		if (input.isHeld(InputAction::MoveDown))
 		{
 			moveDir += upDir;
 		}
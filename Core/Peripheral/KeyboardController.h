@@ -3,6 +3,7 @@
 #include "../Scene/app_object.h"
 #include "../aveng_window.h"
 #include "../Player/Action.h"
+#include "../Events/InputSystem.h"
 #include "../data.h"
 
 
@@ -21,11 +22,16 @@ namespace aveng {
             int lookUp = GLFW_KEY_UP;
             int right = GLFW_KEY_RIGHT;
             int lookDown = GLFW_KEY_DOWN;
+            int nextPipeline = GLFW_KEY_SPACE;
+            int flightMode = GLFW_KEY_PERIOD;
         };
 
         KeyboardController(AvengAppObject& _viewerObject, Data& data);
 
-        void moveCameraXZ(GLFWwindow* window, float dt);
+        // Binds keys to the actions moveCameraXZ reads, and to the pipeline and flight mode toggles
+        void bind(InputSystem& input) const;
+
+        void moveCameraXZ(const ActionState& input, float dt);
 
         KeyMappings keys{};
         glm::vec3 velocity{ 0.0f, 0.0f, 8.0f };
@@ -1,6 +1,7 @@
 #pragma once
 #include "Command.h"
 #include "../Scene/app_object.h"
+#include "../data.h"
 
 namespace aveng {
 
@@ -51,4 +52,25 @@ namespace aveng {
 	//	virtual void execute(AvengAppObject& entity, float time) { return; }
 	//};
 
+	// Cycles the object render system through its shading pipelines
+	class NextPipelineCommand : public Command
+	{
+	public:
+		explicit NextPipelineCommand(Data& data) : data{ data } {}
+		virtual void execute(AvengAppObject& entity, float fTime) { data.cur_pipe = (data.cur_pipe + 1) % MAX_PIPELINES; }
+
+	private:
+		Data& data;
+	};
+
+	class ToggleFlightCommand : public Command
+	{
+	public:
+		explicit ToggleFlightCommand(Data& data) : data{ data } {}
+		virtual void execute(AvengAppObject& entity, float fTime) { data.fly_mode = !data.fly_mode; }
+
+	private:
+		Data& data;
+	};
+
 }
\ No newline at end of file
@@ -39,13 +39,17 @@ namespace aveng {
 
 	ImageSystem::~ImageSystem() 
 	{
-		for (int i=0; i < images.size(); i++) 
-		{
-			vkDestroyImage(engineDevice.device(), images[i], nullptr);
-			vkDestroyImageView(engineDevice.device(), textureImageViews[i], nullptr);
-			vkFreeMemory(engineDevice.device(), allImageMemory[i], nullptr);
-		}
-		vkDestroySampler(engineDevice.device(), textureSampler, nullptr);
+		// Textures may still be sampled by a frame in flight
+		EngineDevice& device = engineDevice;
+		engineDevice.deferDestroy([&device, images = images, views = textureImageViews, memory = allImageMemory, sampler = textureSampler] {
+			for (size_t i = 0; i < images.size(); i++)
+			{
+				vkDestroyImageView(device.device(), views[i], nullptr);
+				vkDestroyImage(device.device(), images[i], nullptr);
+				vkFreeMemory(device.device(), memory[i], nullptr);
+			}
+			vkDestroySampler(device.device(), sampler, nullptr);
+		});
 	}
 
 	void ImageSystem::createTextureImage(const char* filepath, size_t i)
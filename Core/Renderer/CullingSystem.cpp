@@ -0,0 +1,290 @@
+#include "CullingSystem.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace aveng {
+
+	CullingSystem::CullingSystem(EngineDevice& device, ShaderLibrary& library)
+		: engineDevice{ device }, shaderLibrary{ library }
+	{
+		expected.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+	}
+
+	CullingSystem::~CullingSystem()
+	{
+		pipeline.reset();
+		if (pipelineLayout != VK_NULL_HANDLE)
+		{
+			vkDestroyPipelineLayout(engineDevice.device(), pipelineLayout, nullptr);
+		}
+	}
+
+	void CullingSystem::initialize(FrameArena& arena)
+	{
+		frameArena = &arena;
+		createDescriptorSets();
+		createPipelineLayout();
+	}
+
+	/*
+	* Three views of the same frame arena buffer: the cull inputs, the object table and a
+	* plain word array for the commands and counts.
+	*/
+	void CullingSystem::createDescriptorSets()
+	{
+		setLayout = AvengDescriptorSetLayout::Builder(engineDevice)
+			.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)	// CullObjects
+			.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)	// Object table
+			.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)	// Commands and counts
+			.build();
+
+		pool = AvengDescriptorPool::Builder(engineDevice)
+			.setMaxSets(SwapChain::MAX_FRAMES_IN_FLIGHT)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, SwapChain::MAX_FRAMES_IN_FLIGHT * 3)
+			.build();
+
+		descriptorSets.resize(SwapChain::MAX_FRAMES_IN_FLIGHT, VK_NULL_HANDLE);
+		setGenerations.resize(SwapChain::MAX_FRAMES_IN_FLIGHT, 0);
+		for (int i = 0; i < SwapChain::MAX_FRAMES_IN_FLIGHT; i++)
+		{
+			writeDescriptorSet(i);
+		}
+	}
+
+	// Again whenever the arena has replaced the slot's buffer
+	void CullingSystem::writeDescriptorSet(int frameIndex)
+	{
+		auto arenaInfo = frameArena->descriptorInfo(frameIndex, VK_WHOLE_SIZE);
+		AvengDescriptorSetWriter writer(*setLayout, *pool);
+		writer.writeBuffer(0, &arenaInfo)
+			.writeBuffer(1, &arenaInfo)
+			.writeBuffer(2, &arenaInfo);
+
+		if (descriptorSets[frameIndex] == VK_NULL_HANDLE) {
+			writer.build(descriptorSets[frameIndex]);
+		}
+		else {
+			writer.overwrite(descriptorSets[frameIndex]);
+		}
+		setGenerations[frameIndex] = frameArena->getGeneration(frameIndex);
+	}
+
+	void CullingSystem::createPipelineLayout()
+	{
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(Push);	// Within the 128 bytes every device offers
+
+		VkDescriptorSetLayout descriptorSetLayout = setLayout->getDescriptorSetLayout();
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(engineDevice.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create culling pipeline layout!");
+		}
+	}
+
+	bool CullingSystem::ready()
+	{
+		if (pipeline) return true;
+		if (failed) return false;
+
+		// Built on first use so a missing cull.comp.spv only turns GPU culling off
+		try {
+			ShaderLibrary::ScopedModule compModule{ shaderLibrary, shaderPath };
+			pipeline = std::make_unique<ComputePipeline>(engineDevice, compModule.get(), pipelineLayout);
+		}
+		catch (const std::exception& e) {
+			std::cerr << "GPU culling unavailable: " << e.what() << std::endl;
+			failed = true;
+		}
+
+		return pipeline != nullptr;
+	}
+
+	void CullingSystem::reloadShaders(const std::vector<std::string>& changedFiles)
+	{
+		const std::string path = ShaderLibrary::normalizePath(shaderPath);
+		for (const std::string& file : changedFiles)
+		{
+			if (ShaderLibrary::normalizePath(file) == path)
+			{
+				// Frames already recorded keep the old one alive, see ComputePipeline's destructor
+				pipeline.reset();
+				failed = false;
+				return;
+			}
+		}
+	}
+
+	void CullingSystem::record(VkCommandBuffer commandBuffer, int frameIndex, const Frustum& frustum, const Dispatch& dispatch, bool verify)
+	{
+		assert(pipeline != nullptr && "Cannot record culling before ready()");
+
+		Push push{};
+		for (int i = 0; i < 6; i++)
+		{
+			push.planes[i] = frustum.planes[i];
+		}
+		push.objectCount = dispatch.objectCount;
+		push.firstCull = static_cast<uint32_t>(dispatch.cullOffset / sizeof(CullObject));
+		push.firstObject = static_cast<uint32_t>(dispatch.objectOffset / dispatch.objectSize);
+		push.countWord = static_cast<uint32_t>(dispatch.countOffset / sizeof(uint32_t));
+		push.commandWord = static_cast<uint32_t>(dispatch.commandOffset[0] / sizeof(uint32_t));
+		push.compact = dispatch.compact ? 1 : 0;
+
+		if (setGenerations[frameIndex] != frameArena->getGeneration(frameIndex)) writeDescriptorSet(frameIndex);
+
+		pipeline->bind(commandBuffer);
+		vkCmdBindDescriptorSets(
+			commandBuffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			pipelineLayout,
+			0,
+			1,
+			&descriptorSets[frameIndex],
+			0,
+			nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Push), &push);
+		vkCmdDispatch(commandBuffer, ComputePipeline::groupCount(dispatch.objectCount, LOCAL_SIZE), 1, 1);
+
+		// The draws read the commands, and collect() reads them back on the host
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+			0,
+			1, &barrier,
+			0, nullptr,
+			0, nullptr);
+
+		Expected& slot = expected[frameIndex];
+		slot.pending = verify;
+		if (!verify) return;
+
+		// Cull the very inputs the GPU is about to read, they're still in the mapped arena
+		slot.dispatch = dispatch;
+		const char* base = static_cast<const char*>(frameArena->getMappedMemory(frameIndex));
+		const CullObject* cullObjects = reinterpret_cast<const CullObject*>(base + dispatch.cullOffset);
+
+		for (auto& visible : slot.visible) visible.clear();
+		for (auto& either : slot.either) either.clear();
+		for (uint32_t i = 0; i < dispatch.objectCount; i++)
+		{
+			// The model matrix leads each object table entry
+			const glm::mat4& modelMatrix = *reinterpret_cast<const glm::mat4*>(base + dispatch.objectOffset + i * dispatch.objectSize);
+			const uint32_t batch = cullObjects[i].drawSlot >> BATCH_SHIFT;
+			switch (classify(frustum, modelMatrix, cullObjects[i].sphere))
+			{
+			case Verdict::Kept:
+				slot.visible[batch].push_back(push.firstObject + i);
+				break;
+			case Verdict::Either:
+				slot.either[batch].push_back(push.firstObject + i);
+				break;
+			case Verdict::Culled:
+				break;
+			}
+		}
+	}
+
+	void CullingSystem::collect(int frameIndex)
+	{
+		Expected& slot = expected[frameIndex];
+		if (!slot.pending) return;
+		slot.pending = false;
+
+		frameArena->invalidate(frameIndex);
+		const char* base = static_cast<const char*>(frameArena->getMappedMemory(frameIndex));
+		const Dispatch& dispatch = slot.dispatch;
+
+		uint32_t mismatches = 0;
+		visibleCount = 0;
+
+		for (uint32_t b = 0; b < BATCH_COUNT; b++)
+		{
+			uint32_t count = dispatch.compact
+				? reinterpret_cast<const uint32_t*>(base + dispatch.countOffset)[b]
+				: dispatch.commandCapacity[b];
+
+			// The commands land in whatever order the invocations finished, compare them as sets
+			gpuVisible.clear();
+			const VkDrawIndexedIndirectCommand* commands = reinterpret_cast<const VkDrawIndexedIndirectCommand*>(base + dispatch.commandOffset[b]);
+			for (uint32_t c = 0; c < std::min(count, dispatch.commandCapacity[b]); c++)
+			{
+				if (commands[c].instanceCount > 0) gpuVisible.push_back(commands[c].firstInstance);
+			}
+			std::sort(gpuVisible.begin(), gpuVisible.end());
+			visibleCount += static_cast<uint32_t>(gpuVisible.size());
+
+			// Everything the CPU clearly kept has to be there, and nothing it clearly culled
+			const std::vector<uint32_t>& visible = slot.visible[b];
+			const std::vector<uint32_t>& either = slot.either[b];
+			size_t kept = 0;
+			size_t wrong = 0;
+			for (uint32_t object : gpuVisible)
+			{
+				if (std::binary_search(visible.begin(), visible.end(), object)) kept++;
+				else if (!std::binary_search(either.begin(), either.end(), object)) wrong++;
+			}
+			wrong += visible.size() - kept;
+
+			if (count > dispatch.commandCapacity[b] || wrong > 0)
+			{
+				std::cerr << "GPU culling mismatch, batch " << b << ": GPU kept " << gpuVisible.size()
+					<< " of " << dispatch.commandCapacity[b] << ", CPU kept " << visible.size() << " and " << either.size()
+					<< " on a plane, " << wrong << " wrong" << std::endl;
+				mismatches++;
+			}
+		}
+
+		verifiedFrames++;
+		if (mismatches > 0) mismatchedFrames++;
+	}
+
+	bool CullingSystem::isVisible(const Frustum& frustum, const glm::mat4& modelMatrix, const glm::vec4& sphere)
+	{
+		glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(glm::vec3(sphere), 1.f));
+
+		// Non-uniform scale stretches the sphere by the largest axis
+		float scale = std::max(
+			glm::length(glm::vec3(modelMatrix[0])),
+			std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+
+		return frustum.intersectsSphere(center, sphere.w * scale);
+	}
+
+	CullingSystem::Verdict CullingSystem::classify(const Frustum& frustum, const glm::mat4& modelMatrix, const glm::vec4& sphere)
+	{
+		glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(glm::vec3(sphere), 1.f));
+		float scale = std::max(
+			glm::length(glm::vec3(modelMatrix[0])),
+			std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+		float radius = sphere.w * scale;
+
+		Verdict verdict = Verdict::Kept;
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			const float distance = glm::dot(glm::vec3(plane), center) + plane.w + radius;
+			const float tolerance = VERIFY_TOLERANCE * (glm::length(center) + std::abs(plane.w) + radius);
+
+			if (distance < -tolerance) return Verdict::Culled;
+			if (distance < tolerance) verdict = Verdict::Either;
+		}
+
+		return verdict;
+	}
+
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "../Math/aveng_math.h"
+#include "../../CoreVK/EngineDevice.h"
+#include "../../CoreVK/ComputePipeline.h"
+#include "../../CoreVK/ShaderLibrary.h"
+#include "../../CoreVK/FrameArena.h"
+#include "../../CoreVK/aveng_descriptors.h"
+#include "../../CoreVK/swapchain.h"
+
+#include "../../avpch.h"
+
+namespace aveng {
+
+	/*
+	* Frustum culling on the GPU for the indirect draw path (see ObjectRenderSystem). cull.comp tests one
+	* object's bounding sphere per invocation and writes its VkDrawIndexedIndirectCommand straight into the
+	* frame arena, so the CPU only ever writes the object table and never looks at visibility.
+	*
+	* Everything cull.comp reads and writes lives in the frame arena; its descriptors cover the whole frame
+	* buffer and the push constants say where in it this frame's data is.
+	*/
+	class CullingSystem {
+
+	public:
+
+		// 32 bytes, one per object next to the object table. Model space sphere, the object's transform is read from the table.
+		struct CullObject {
+			glm::vec4 sphere;
+			uint32_t indexCount;
+			uint32_t firstIndex;
+			int32_t vertexOffset;
+			uint32_t drawSlot;		// Top three bits are the batch (pipeline), the rest the command slot, or when compacting the batch's first
+		};
+
+		static constexpr uint32_t BATCH_SHIFT = 29;
+		static constexpr uint32_t BATCH_COUNT = 8;
+
+		// Where one frame's culling reads and writes, byte offsets into the frame arena
+		struct Dispatch {
+			uint32_t objectCount = 0;
+			VkDeviceSize cullOffset = 0;					// CullObject[objectCount], aligned to sizeof(CullObject)
+			VkDeviceSize objectOffset = 0;					// The object table, aligned to its element size
+			VkDeviceSize objectSize = 0;					// sizeof one object table entry
+			VkDeviceSize commandOffset[BATCH_COUNT]{};		// Room for every object of the batch, the batches back to back
+			uint32_t commandCapacity[BATCH_COUNT]{};
+			VkDeviceSize countOffset = 0;					// uint32_t per batch, zeroed. Unused when not compacting.
+
+			// Compact: visible commands are packed at the front and counted, for vkCmdDrawIndexedIndirectCount.
+			// Otherwise every object keeps its slot and culled ones get instanceCount 0.
+			bool compact = false;
+		};
+
+		CullingSystem(EngineDevice& device, ShaderLibrary& library);
+		~CullingSystem();
+
+		CullingSystem(const CullingSystem&) = delete;
+		CullingSystem& operator=(const CullingSystem&) = delete;
+
+		void initialize(FrameArena& arena);
+
+		// Builds the pipeline the first time. False if cull.comp couldn't be built.
+		bool ready();
+
+		// Record the dispatch and the barrier in front of the indirect draws. Outside of a render pass.
+		// With verify set the CPU culls the same inputs too, and collect() compares the two.
+		void record(VkCommandBuffer commandBuffer, int frameIndex, const Frustum& frustum, const Dispatch& dispatch, bool verify);
+
+		// Compare what the GPU wrote for this frame slot last time with what the CPU expected. Call once the
+		// slot's fence has signaled and before its arena is reset. Nothing to do unless it was recorded with verify.
+		void collect(int frameIndex);
+
+		uint32_t framesVerified() const { return verifiedFrames; }
+		uint32_t framesMismatched() const { return mismatchedFrames; }
+		uint32_t lastVisible() const { return visibleCount; }		// Objects the GPU kept in the last verified frame
+
+		void reloadShaders(const std::vector<std::string>& changedFiles);
+
+		// The CPU side of cull.comp, the same math in the same order
+		static bool isVisible(const Frustum& frustum, const glm::mat4& modelMatrix, const glm::vec4& sphere);
+
+		// isVisible with a margin. The GPU rounds and contracts differently, so a sphere grazing a plane may
+		// land on either side of it there; Either is a sphere within that margin of a plane.
+		enum class Verdict { Culled, Kept, Either };
+		static Verdict classify(const Frustum& frustum, const glm::mat4& modelMatrix, const glm::vec4& sphere);
+
+	private:
+
+		struct Push {
+			glm::vec4 planes[6];
+			uint32_t objectCount;
+			uint32_t firstCull;
+			uint32_t firstObject;
+			uint32_t countWord;
+			uint32_t commandWord;		// Batch 0's first command, drawSlot counts from here
+			uint32_t compact;
+		};
+
+		// What a frame slot asked of the GPU, and the CPU's answer
+		struct Expected {
+			bool pending = false;
+			Dispatch dispatch{};
+			std::vector<uint32_t> visible[BATCH_COUNT];		// Object table indices, sorted
+			std::vector<uint32_t> either[BATCH_COUNT];		// Too near a plane to hold the GPU to an answer, sorted
+		};
+
+		// Of a plane's distance, relative to the size of the terms that went into it
+		static constexpr float VERIFY_TOLERANCE = 1e-4f;
+
+		void createPipelineLayout();
+		void createDescriptorSets();
+		void writeDescriptorSet(int frameIndex);
+
+		EngineDevice& engineDevice;
+		ShaderLibrary& shaderLibrary;
+		FrameArena* frameArena = nullptr;
+
+		std::unique_ptr<AvengDescriptorSetLayout> setLayout;
+		std::unique_ptr<AvengDescriptorPool> pool;
+		std::vector<VkDescriptorSet> descriptorSets;
+		std::vector<uint32_t> setGenerations;		// The arena generation each set was written for
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+
+		std::unique_ptr<ComputePipeline> pipeline;
+		bool failed = false;
+
+		std::vector<Expected> expected;
+		std::vector<uint32_t> gpuVisible;
+		uint32_t visibleCount = 0;
+		uint32_t verifiedFrames = 0;
+		uint32_t mismatchedFrames = 0;
+
+		const std::string shaderPath = "shaders/cull.comp.spv";
+		static constexpr uint32_t LOCAL_SIZE = 64;		// cull.comp local_size_x
+
+	};
+
+}
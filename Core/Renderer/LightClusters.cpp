@@ -0,0 +1,231 @@
+#include "LightClusters.h"
+
+#include <algorithm>
+
+namespace aveng {
+
+	LightClusters::LightClusters()
+	{
+		clusters.resize(CLUSTER_COUNT);
+		clusterBounds.resize(CLUSTER_COUNT);
+		sliceDepths.resize(CLUSTER_Z + 1);
+		lightIndices.reserve(MAX_LIGHT_INDICES);
+
+		// Workers each take a band of depth slices, so they never write to the same cluster
+		uint32_t cores = std::thread::hardware_concurrency();
+		threadPool.setThreadCount(std::max(1u, std::min(cores, 4u)));
+		ranges.resize(threadPool.threads.size());
+
+		uint32_t slicesPerRange = (CLUSTER_Z + static_cast<uint32_t>(ranges.size()) - 1) / static_cast<uint32_t>(ranges.size());
+		for (uint32_t i = 0; i < ranges.size(); i++)
+		{
+			ranges[i].firstSlice = std::min(i * slicesPerRange, CLUSTER_Z);
+			ranges[i].lastSlice = std::min((i + 1) * slicesPerRange, CLUSTER_Z);	// exclusive
+		}
+	}
+
+	/*
+	* The projection is AvengCamera's perspective: +z forward, y down.
+	* x_ndc = P[0][0] * x / z, y_ndc = P[1][1] * y / z, and near/far can be recovered from P[2][2] and P[3][2].
+	*/
+	void LightClusters::updateFrustum(const glm::mat4& projection)
+	{
+		assert(projection[2][3] == 1.f && "Clustered lighting needs a perspective projection");
+
+		float n = -projection[3][2] / projection[2][2];
+		float f = n * projection[2][2] / (projection[2][2] - 1.f);
+
+		if (projection[0][0] == xScale && projection[1][1] == yScale && n == nearPlane && f == farPlane) return;
+
+		xScale = projection[0][0];
+		yScale = projection[1][1];
+		nearPlane = n;
+		farPlane = f;
+
+		// Exponential slices, so each froxel is roughly as deep as it is wide
+		float logRatio = std::log(farPlane / nearPlane);
+		for (uint32_t k = 0; k <= CLUSTER_Z; k++)
+		{
+			sliceDepths[k] = nearPlane * std::pow(farPlane / nearPlane, static_cast<float>(k) / CLUSTER_Z);
+		}
+
+		params.depth = glm::vec4{
+			CLUSTER_Z / logRatio,
+			-static_cast<float>(CLUSTER_Z) * std::log(nearPlane) / logRatio,
+			nearPlane,
+			farPlane
+		};
+
+		// View space bounds of every froxel
+		for (uint32_t z = 0; z < CLUSTER_Z; z++)
+		{
+			float zNear = sliceDepths[z];
+			float zFar = sliceDepths[z + 1];
+
+			for (uint32_t y = 0; y < CLUSTER_Y; y++)
+			{
+				float y0 = -1.f + 2.f * y / CLUSTER_Y;
+				float y1 = -1.f + 2.f * (y + 1) / CLUSTER_Y;
+
+				for (uint32_t x = 0; x < CLUSTER_X; x++)
+				{
+					float x0 = -1.f + 2.f * x / CLUSTER_X;
+					float x1 = -1.f + 2.f * (x + 1) / CLUSTER_X;
+
+					Bounds& b = clusterBounds[x + CLUSTER_X * (y + CLUSTER_Y * z)];
+					b.min = glm::vec3{
+						std::min(x0 * zNear, x0 * zFar) / xScale,
+						std::min(y0 * zNear, y0 * zFar) / yScale,
+						zNear };
+					b.max = glm::vec3{
+						std::max(x1 * zNear, x1 * zFar) / xScale,
+						std::max(y1 * zNear, y1 * zFar) / yScale,
+						zFar };
+				}
+			}
+		}
+	}
+
+	uint32_t LightClusters::slice(float viewZ) const
+	{
+		float z = std::min(std::max(viewZ, nearPlane), farPlane);
+		int k = static_cast<int>(std::floor(std::log(z) * params.depth.x + params.depth.y));
+		return static_cast<uint32_t>(std::min(std::max(k, 0), static_cast<int>(CLUSTER_Z) - 1));
+	}
+
+	void LightClusters::build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection, VkExtent2D extent)
+	{
+		updateFrustum(projection);
+
+		params.screen = glm::vec4{ static_cast<float>(extent.width), static_cast<float>(extent.height), 0.f, 0.f };
+
+		size_t lightCount = std::min(lights.size(), static_cast<size_t>(MAX_LIGHTS));
+		params.counts.w = static_cast<uint32_t>(lightCount);
+
+		viewLights.resize(lightCount);
+		for (size_t i = 0; i < lightCount; i++)
+		{
+			glm::vec4 p = view * glm::vec4(glm::vec3(lights[i].position), 1.f);
+			viewLights[i] = glm::vec4(glm::vec3(p), lights[i].position.w);
+		}
+
+		for (size_t i = 0; i < ranges.size(); i++)
+		{
+			SliceRange* range = &ranges[i];
+			threadPool.threads[i]->addJob([this, range] { assign(*range); });
+		}
+		threadPool.wait();
+
+		// Stitch the bands together. Offsets were local to each band's index list.
+		lightIndices.clear();
+		overflowed = 0;
+		for (auto& range : ranges)
+		{
+			uint32_t first = range.firstSlice * CLUSTER_X * CLUSTER_Y;
+			uint32_t last = range.lastSlice * CLUSTER_X * CLUSTER_Y;
+
+			for (uint32_t c = first; c < last; c++)
+			{
+				Cluster& cluster = clusters[c];
+				uint32_t room = MAX_LIGHT_INDICES - static_cast<uint32_t>(lightIndices.size());
+				uint32_t count = std::min(cluster.count, room);
+				overflowed += cluster.count - count;
+
+				auto begin = range.indices.begin() + cluster.offset;
+				cluster.offset = static_cast<uint32_t>(lightIndices.size());
+				cluster.count = count;
+				lightIndices.insert(lightIndices.end(), begin, begin + count);
+			}
+		}
+	}
+
+	/*
+	* For each light, walk the slices its depth range covers. In each slice, find the tiles covered
+	* by the light's bounding box (clipped to that slice), then keep the froxels the sphere actually touches.
+	*/
+	void LightClusters::assign(SliceRange& range)
+	{
+		range.pairs.clear();
+		range.indices.clear();
+		if (range.firstSlice >= range.lastSlice) return;
+
+		for (uint32_t l = 0; l < viewLights.size(); l++)
+		{
+			glm::vec3 center{ viewLights[l] };
+			float radius = viewLights[l].w;
+
+			if (center.z + radius < nearPlane || center.z - radius > farPlane) continue;
+
+			uint32_t k0 = std::max(slice(center.z - radius), range.firstSlice);
+			uint32_t k1 = std::min(slice(center.z + radius), range.lastSlice - 1);
+
+			for (uint32_t k = k0; k <= k1; k++)
+			{
+				float zNear = std::max(center.z - radius, sliceDepths[k]);
+				float zFar = std::min(center.z + radius, sliceDepths[k + 1]);
+				if (zNear > zFar) continue;
+
+				// Project the corners of the light's box, clipped to this slice
+				float xMin = std::min((center.x - radius) / zNear, (center.x - radius) / zFar) * xScale;
+				float xMax = std::max((center.x + radius) / zNear, (center.x + radius) / zFar) * xScale;
+				float yMin = std::min((center.y - radius) / zNear, (center.y - radius) / zFar) * yScale;
+				float yMax = std::max((center.y + radius) / zNear, (center.y + radius) / zFar) * yScale;
+
+				if (xMax < -1.f || xMin > 1.f || yMax < -1.f || yMin > 1.f) continue;
+
+				auto tile = [](float ndc, uint32_t tiles) {
+					int t = static_cast<int>(std::floor((ndc + 1.f) * 0.5f * tiles));
+					return static_cast<uint32_t>(std::min(std::max(t, 0), static_cast<int>(tiles) - 1));
+				};
+
+				uint32_t x0 = tile(xMin, CLUSTER_X), x1 = tile(xMax, CLUSTER_X);
+				uint32_t y0 = tile(yMin, CLUSTER_Y), y1 = tile(yMax, CLUSTER_Y);
+
+				for (uint32_t y = y0; y <= y1; y++)
+				{
+					for (uint32_t x = x0; x <= x1; x++)
+					{
+						uint32_t c = x + CLUSTER_X * (y + CLUSTER_Y * k);
+						const Bounds& b = clusterBounds[c];
+
+						glm::vec3 closest = glm::clamp(center, b.min, b.max);
+						glm::vec3 d = closest - center;
+						if (glm::dot(d, d) <= radius * radius)
+						{
+							range.pairs.emplace_back(c, l);
+						}
+					}
+				}
+			}
+		}
+
+		// Counting sort by cluster. Lights stay in ascending order within each cluster.
+		uint32_t first = range.firstSlice * CLUSTER_X * CLUSTER_Y;
+		uint32_t last = range.lastSlice * CLUSTER_X * CLUSTER_Y;
+
+		for (uint32_t c = first; c < last; c++)
+		{
+			clusters[c] = { 0, 0 };
+		}
+		for (const auto& pair : range.pairs)
+		{
+			clusters[pair.first].count++;
+		}
+
+		uint32_t offset = 0;
+		for (uint32_t c = first; c < last; c++)
+		{
+			clusters[c].offset = offset;
+			offset += clusters[c].count;
+			clusters[c].count = 0;
+		}
+
+		range.indices.resize(offset);
+		for (const auto& pair : range.pairs)
+		{
+			Cluster& cluster = clusters[pair.first];
+			range.indices[cluster.offset + cluster.count++] = pair.second;
+		}
+	}
+
+}
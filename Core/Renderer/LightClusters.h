@@ -0,0 +1,110 @@
+#pragma once
+
+#include "../Utils/threadpool.h"
+#include "../../avpch.h"
+
+#include <vulkan/vulkan.h>
+#include <utility>
+#include <vector>
+
+/**
+* @class LightClusters
+* CPU side clustered light assignment. The view frustum is cut into CLUSTER_X * CLUSTER_Y screen tiles
+* and CLUSTER_Z exponentially spaced depth slices ("froxels"). Every frame each light is assigned to the
+* froxels its sphere of influence touches, and the fragment shader only walks the list for its own froxel.
+*
+* Output layout, matching simple_shader.frag:
+*	grid[cluster]	= { offset, count } into indices
+*	indices[]		= light indices, grouped by cluster
+* with cluster = x + CLUSTER_X * (y + CLUSTER_Y * z)
+*/
+namespace aveng {
+
+	// std430, shared with the shaders
+	struct PointLight {
+		glm::vec4 position{ 0.f };	// xyz world position, w radius of influence
+		glm::vec4 color{ 1.f };		// w is intensity
+	};
+
+	class LightClusters {
+
+	public:
+
+		static constexpr uint32_t CLUSTER_X = 16;
+		static constexpr uint32_t CLUSTER_Y = 9;
+		static constexpr uint32_t CLUSTER_Z = 24;
+		static constexpr uint32_t CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+
+		static constexpr uint32_t MAX_LIGHTS = 1024;
+		static constexpr uint32_t MAX_LIGHT_INDICES = CLUSTER_COUNT * 32;
+
+		// Everything the shaders need to find their cluster. Lives in the GlobalUbo, std140.
+		struct ShaderParams {
+			glm::uvec4 counts{ CLUSTER_X, CLUSTER_Y, CLUSTER_Z, 0 };	// w is the light count
+			glm::vec4 depth{ 0.f };		// x slice scale, y slice bias, z near, w far
+			glm::vec4 screen{ 1.f };	// xy framebuffer size
+		};
+
+		struct Cluster {
+			uint32_t offset;
+			uint32_t count;
+		};
+
+		LightClusters();
+
+		LightClusters(const LightClusters&) = delete;
+		LightClusters& operator=(const LightClusters&) = delete;
+
+		/*
+		* Assign lights to clusters. projection must be a perspective projection from AvengCamera.
+		* Writes at most MAX_LIGHT_INDICES indices; the rest are dropped and counted in overflow().
+		*/
+		void build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection, VkExtent2D extent);
+
+		const std::vector<Cluster>& grid() const { return clusters; }
+		const std::vector<uint32_t>& indices() const { return lightIndices; }
+		const ShaderParams& shaderParams() const { return params; }
+		uint32_t overflow() const { return overflowed; }
+
+	private:
+
+		struct Bounds {
+			glm::vec3 min;
+			glm::vec3 max;
+		};
+
+		// Per worker output, for a contiguous range of depth slices
+		struct SliceRange {
+			uint32_t firstSlice;
+			uint32_t lastSlice;
+			std::vector<uint32_t> indices;
+			std::vector<std::pair<uint32_t, uint32_t>> pairs;	// cluster, light
+		};
+
+		void updateFrustum(const glm::mat4& projection);
+		void assign(SliceRange& range);
+		uint32_t slice(float viewZ) const;
+
+		ShaderParams params{};
+
+		// Cached from the projection, the cluster bounds only change when it does
+		float xScale = 0.f;
+		float yScale = 0.f;
+		float nearPlane = 0.f;
+		float farPlane = 0.f;
+		std::vector<Bounds> clusterBounds;
+		std::vector<float> sliceDepths;
+
+		// View space lights for this frame
+		std::vector<glm::vec4> viewLights;
+
+		std::vector<Cluster> clusters;
+		std::vector<uint32_t> lightIndices;
+		uint32_t overflowed = 0;
+
+		std::vector<SliceRange> ranges;
+		ThreadPool threadPool;
+
+	};
+
+}
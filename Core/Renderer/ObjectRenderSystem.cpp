@@ -1,31 +1,37 @@
 #include "ObjectRenderSystem.h"
 #include "../Math/aveng_math.h"
-#include "../Events/window_callbacks.h"
+#include "../data.h"
 #include "../Player/GameplayFunctions.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace aveng {
 
 	struct SimplePushConstantData
 	{
 		glm::mat4 modelMatrix{ 1.f };
-		glm::mat4 normalMatrix{ 1.f };
+		glm::mat4 normalMatrix{ 1.f };	// The 3x3 is the normal matrix, [3][0] the texture index (simple_shader.vert)
 	};
 
-	ObjectRenderSystem::ObjectRenderSystem(EngineDevice& device, AvengAppObject& viewer)
-		: engineDevice{ device }, viewerObject{ viewer }
+	ObjectRenderSystem::ObjectRenderSystem(EngineDevice& device, ShaderLibrary& library, AvengAppObject& viewer)
+		: engineDevice{ device }, shaderLibrary{ library }, viewerObject{ viewer }
 	{
 
 	}
 
-	void ObjectRenderSystem::initialize( VkRenderPass renderPass, VkDescriptorSetLayout globalDescriptorSetLayout, VkDescriptorSetLayout fragDescriptorSetLayout)
+	void ObjectRenderSystem::initialize( VkRenderPass renderPass, VkDescriptorSetLayout globalDescriptorSetLayout, FrameArena& frameArena)
 	{
-		VkDescriptorSetLayout descriptorSetLayouts[2] = { globalDescriptorSetLayout , fragDescriptorSetLayout };
+		VkDescriptorSetLayout descriptorSetLayouts[1] = { globalDescriptorSetLayout };
 		createPipelineLayout(descriptorSetLayouts);
 		createPipeline(renderPass);
+		culling.initialize(frameArena);
 	}
 
 	ObjectRenderSystem::~ObjectRenderSystem()
 	{
+		// A variant may still be compiling against this layout
+		pipelineRegistry.wait();
 		vkDestroyPipelineLayout(engineDevice.device(), pipelineLayout, nullptr);
 	}
 
@@ -45,7 +51,7 @@ namespace aveng {
 
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = 2;										// How many descriptor set layouts are to be hooked into the pipeline
+		pipelineLayoutInfo.setLayoutCount = 1;										// How many descriptor set layouts are to be hooked into the pipeline
 		pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts;						// a pointer to an array of VkDescriptorSetLayout objects.
 		pipelineLayoutInfo.pushConstantRangeCount = 1;
 		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
@@ -72,35 +78,133 @@ namespace aveng {
 		pipelineConfig.renderPass = renderPass;		
 		pipelineConfig.pipelineLayout = pipelineLayout;
 
-		// A GFXPipeline
-		gfxPipeline = std::make_unique<GFXPipeline>(
-			engineDevice,
-			"shaders/simple_shader.vert.spv",
-			"shaders/simple_shader.frag.spv",
-			pipelineConfig
-		);
+		// Indexed by data.cur_pipe
+		pipelineVariants.push_back(addShadingVariants("shaders/simple_shader.vert.spv", "shaders/simple_shader.frag.spv", pipelineConfig));
+		pipelineVariants.push_back(addShadingVariants("shaders/simple_shader2.vert.spv", "shaders/simple_shader2.frag.spv", pipelineConfig));
+
+		// Also indexed by data.cur_pipe, only built once the indirect path is switched on
+		indirectVariants.push_back(addShadingVariants("shaders/object_table.vert.spv", "shaders/simple_shader.frag.spv", pipelineConfig));
+		indirectVariants.push_back(addShadingVariants("shaders/object_table2.vert.spv", "shaders/simple_shader2.frag.spv", pipelineConfig));
+
+		// The lit untextured variant is safe for every object with Full vertices, so it's built now and stands in
+		// for the rest. Start on the other defaults right away, packed meshes have nothing to fall back on.
+		const uint32_t full = static_cast<uint32_t>(AvengModel::VertexFormat::Full);
+		pipelineRegistry.setFallback(pipelineVariants[0].shading[LIT_UNTEXTURED][full]);
+		for (uint32_t shading = 0; shading < SHADING_COUNT; shading++)
+		{
+			for (uint32_t f = 0; f < AvengModel::VERTEX_FORMAT_COUNT; f++)
+			{
+				pipelineRegistry.get(pipelineVariants[0].shading[shading][f]);
+			}
+		}
+	}
+
+	/*
+	* Specialization constants (see simple_shader.frag and .vert):
+	*	0 TEXTURED, 1 GAMMA, 2 LIGHT_COUNT, 3 PACKED_NORMALS
+	* Shaders which don't declare them ignore them. The unlit variants set GAMMA 1 and LIGHT_COUNT 0,
+	* which drops the pow and the whole cluster walk from the fragment shader.
+	*/
+	ObjectRenderSystem::ShadingVariants ObjectRenderSystem::addShadingVariants(const std::string& vertFilepath, const std::string& fragFilepath, PipelineConfig& config)
+	{
+		ShadingVariants variants{};
+
+		// Upper bound on the lights a fragment walks in its cluster
+		const uint32_t lightCount = 256;
+		const uint32_t gamma = GFXPipeline::specializationFloat(1.1f);
+		const uint32_t noGamma = GFXPipeline::specializationFloat(1.f);
+
+		for (uint32_t f = 0; f < AvengModel::VERTEX_FORMAT_COUNT; f++)
+		{
+			const AvengModel::VertexFormat format = static_cast<AvengModel::VertexFormat>(f);
+			const uint32_t packed = format == AvengModel::VertexFormat::Packed ? VK_TRUE : VK_FALSE;
+			config.bindingDescriptions = AvengModel::Vertex::getBindingDescriptions(format);
+			config.attributeDescriptions = AvengModel::Vertex::getAttributeDescriptions(format);
+
+			config.specializationConstants = { VK_FALSE, gamma, lightCount, packed };
+			variants.shading[LIT_UNTEXTURED][f] = pipelineRegistry.add(vertFilepath, fragFilepath, config);
+
+			config.specializationConstants = { VK_TRUE, gamma, lightCount, packed };
+			variants.shading[LIT_TEXTURED][f] = pipelineRegistry.add(vertFilepath, fragFilepath, config);
+
+			config.specializationConstants = { VK_FALSE, noGamma, 0u, packed };
+			variants.shading[UNLIT_UNTEXTURED][f] = pipelineRegistry.add(vertFilepath, fragFilepath, config);
+
+			config.specializationConstants = { VK_TRUE, noGamma, 0u, packed };
+			variants.shading[UNLIT_TEXTURED][f] = pipelineRegistry.add(vertFilepath, fragFilepath, config);
+		}
+
+		config.bindingDescriptions = AvengModel::Vertex::getBindingDescriptions();
+		config.attributeDescriptions = AvengModel::Vertex::getAttributeDescriptions();
+		config.specializationConstants.clear();
+		return variants;
+	}
+
+	void ObjectRenderSystem::update(FrameContent& frame_content, Data& data)
+	{
+		// Pick up any pipelines rebuilt from recompiled shaders
+		pipelineRegistry.swapReloaded();
+
+		updateData(frame_content.appObjects.size(), frame_content.frameTime, data);
+		selectLods(frame_content, data);
+
+		indirectFrame = IndirectFrame{};
+		directObjects.clear();
 
-		// Another GFXPipeline
-		gfxPipeline2 = std::make_unique<GFXPipeline>(
-			engineDevice,
-			"shaders/simple_shader2.vert.spv",
-			"shaders/simple_shader2.frag.spv",
-			pipelineConfig
-		);
+		// Whatever the indirect path can't take is drawn one by one in render()
+		if (!data.indirect_draw || !prepareIndirect(frame_content, data))
+		{
+			directObjects.clear();
+			for (auto& kv : frame_content.appObjects)
+			{
+				directObjects.push_back(&kv.second);
+			}
+		}
 	}
 
-	void ObjectRenderSystem::render(FrameContent& frame_content, Data& data, AvengBuffer& fragBuffer)
+	/*
+	* A level's error projected to the screen is error * scale * projectionScale / distance pixels, measured
+	* from the nearest point of the bounding sphere. The coarsest level under data.lod_pixels is drawn. Going
+	* coarser needs some room to spare and going finer some margin over, so an object sitting right at the
+	* threshold doesn't switch back and forth every frame.
+	*/
+	void ObjectRenderSystem::selectLods(FrameContent& frame_content, Data& data)
 	{
+		const glm::vec3 eye = glm::vec3(glm::inverse(frame_content.camera.getView())[3]);
+		const float projectionScale = std::abs(frame_content.camera.getProjection()[1][1]) * frame_content.extent.height * 0.5f;
+		const float coarser = data.lod_pixels * (1.f - LOD_HYSTERESIS);
+		const float finer = data.lod_pixels * (1.f + LOD_HYSTERESIS);
 
-		// Bind our current pipeline configuration
-		switch (data.cur_pipe)
+		data.triangles = 0;
+		for (auto& kv : frame_content.appObjects)
 		{
-			case 98: gfxPipeline->bind(frame_content.commandBuffer);  break;
-			case 99: gfxPipeline2->bind(frame_content.commandBuffer); break;
-			default:
-				gfxPipeline->bind(frame_content.commandBuffer); // 0
+			AvengAppObject& obj = kv.second;
+			const AvengModel& model = *obj.model;
+			uint32_t lod = std::min(static_cast<uint32_t>(std::max(obj.visual.lod, 0)), model.lodCount() - 1);
+
+			if (!data.lod_select) {
+				lod = 0;
+			}
+			else if (model.lodCount() > 1) {
+				const glm::mat4 transform = obj.transform._mat4();
+				const glm::vec4& sphere = model.getBoundingSphere();
+				const float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+				const glm::vec3 center = glm::vec3(transform * glm::vec4(glm::vec3(sphere), 1.f));
+				const float distance = std::max(glm::length(center - eye) - sphere.w * scale, 0.001f);
+
+				const float pixelsPerError = scale * projectionScale / distance;
+				while (lod + 1 < model.lodCount() && model.getLod(lod + 1).error * pixelsPerError < coarser) lod++;
+				while (lod > 0 && model.getLod(lod).error * pixelsPerError > finer) lod--;
+			}
+
+			obj.visual.lod = static_cast<int>(lod);
+			data.triangles += static_cast<int>(model.getLod(lod).indexCount / 3);
 		}
-		
+	}
+
+	void ObjectRenderSystem::render(FrameContent& frame_content, Data& data)
+	{
+
 		vkCmdBindDescriptorSets(
 			frame_content.commandBuffer,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
@@ -108,22 +212,78 @@ namespace aveng {
 			0,
 			1,
 			&frame_content.globalDescriptorSet,
-			0,
-			nullptr);
+			1,
+			&frame_content.globalUboOffset);
 
-		updateData(frame_content.appObjects.size(), frame_content.frameTime, data);
+		// Every model's geometry lives in the arena, one bind covers the indirect and the direct draws
+		frame_content.meshArena.bind(frame_content.commandBuffer);
+
+		data.draw_calls = 0;
+
+		if (indirectFrame.active)
+		{
+			drawIndirect(frame_content, data);
+		}
+
+		renderDirect(frame_content, data, directObjects);
+	}
+
+	void ObjectRenderSystem::verifyCulling(int frameIndex, Data& data)
+	{
+		culling.collect(frameIndex);
+		data.cull_verified = culling.framesVerified();
+		data.cull_mismatches = culling.framesMismatched();
+		if (culling.framesVerified() > 0) data.visible_objs = culling.lastVisible();
+	}
+
+	VkDeviceSize ObjectRenderSystem::frameArenaBytes(size_t objectCount)
+	{
+		// Drawn one by one nothing per object lands in the arena. Indirect, the object table, the cull inputs and a
+		// command per object. The GPU culled path takes all three, the CPU culled one less. Then the counts and
+		// each allocation's alignment, which no device asks more than 256 bytes of.
+		const VkDeviceSize perObject = sizeof(ObjectData) + sizeof(CullingSystem::CullObject) + sizeof(VkDrawIndexedIndirectCommand);
+		return objectCount * perObject
+			+ sizeof(ObjectData) + sizeof(CullingSystem::CullObject) + CullingSystem::BATCH_COUNT * sizeof(uint32_t) + 4 * 256;
+	}
+
+	void ObjectRenderSystem::renderDirect(FrameContent& frame_content, Data& data, const std::vector<AvengAppObject*>& objects)
+	{
+		// Our current pipeline configuration, bound per object below since it depends on the object's shading and vertex format
+		const ShadingVariants& variants = pipelineVariants[static_cast<size_t>(data.cur_pipe) % pipelineVariants.size()];
+		GFXPipeline* pipelines[AvengModel::VERTEX_FORMAT_COUNT][SHADING_COUNT];
+		for (uint32_t f = 0; f < AvengModel::VERTEX_FORMAT_COUNT; f++)
+		{
+			for (uint32_t shading = 0; shading < SHADING_COUNT; shading++)
+			{
+				pipelines[f][shading] = pipelineRegistry.get(variants.shading[shading][f]);
+			}
+
+			// The registry's fallback reads Full vertices. Packed meshes make do with their lit untextured variant, or wait.
+			if (static_cast<AvengModel::VertexFormat>(f) != AvengModel::VertexFormat::Full)
+			{
+				if (!pipelineRegistry.isReady(variants.shading[LIT_UNTEXTURED][f])) pipelines[f][LIT_UNTEXTURED] = nullptr;
+				for (uint32_t shading = LIT_TEXTURED; shading < SHADING_COUNT; shading++)
+				{
+					if (!pipelineRegistry.isReady(variants.shading[shading][f])) pipelines[f][shading] = pipelines[f][LIT_UNTEXTURED];
+				}
+			}
+		}
+		GFXPipeline* bound = nullptr;
 
 		/*
 		* Thread object bind/draw calls here
 		*/
-		for (auto& kv : frame_content.appObjects)
+		for (AvengAppObject* object : objects)
 		{
-			AvengAppObject& obj = kv.second;
+			AvengAppObject& obj = *object;
 
-			// This object's texture's dynamic offset in the Dynamic UBOs memory
-			uint32_t dynamicOffset = obj.get_texture() * static_cast<uint32_t>(deviceAlignment);
-
-			FragUbo fubo{ obj.get_texture() };	// Texture information -- within our dynamic UBO (FragUbo is a bad name for this, but that's its only usecase right now)
+			// Only rebind when the variant changes, the descriptor sets stay bound across compatible layouts
+			GFXPipeline* pipeline = pipelines[static_cast<uint32_t>(obj.model->getFormat())][shadingOf(obj)];
+			if (pipeline == nullptr) continue;
+			if (pipeline != bound) {
+				pipeline->bind(frame_content.commandBuffer);
+				bound = pipeline;
+			}
 
 			SimplePushConstantData push{};
 			
@@ -132,29 +292,13 @@ namespace aveng {
 				last_sec  = data.sec;
 			}
 
-			// The matrix describing this model's current orientation
-			push.modelMatrix  = obj.transform._mat4();
+			// The matrix describing this model's current orientation, from however its vertices are stored
+			push.modelMatrix  = obj.transform._mat4() * obj.model->vertexTransform();
 			push.normalMatrix = obj.transform.normalMatrix();
 
-			{
-				if (dynamicOffset > engineDevice.properties.limits.maxUniformBufferRange) {
-					DEBUG("Max Uniform Buffer Range Exceeded.");
-					throw std::runtime_error("Attempting to allocate buffer beyond device uniform buffer memory limit.");
-				}
-				
-				// Bind the descriptor set for our pixel (fragment) shader
-				fragBuffer.writeToBuffer(&fubo, sizeof(FragUbo), dynamicOffset);
-				fragBuffer.flush();
-				vkCmdBindDescriptorSets(
-					frame_content.commandBuffer,
-					VK_PIPELINE_BIND_POINT_GRAPHICS,
-					pipelineLayout,
-					1,
-					1,
-					&frame_content.fragDescriptorSet,
-					1,
-					&dynamicOffset);
-			}
+			// The texture rides in the normal matrix's unused column rather than a per object uniform
+			const bool textured = obj.get_texture() != NO_TEXTURE;
+			push.normalMatrix[3][0] = static_cast<float>(textured ? obj.get_texture() : 0);
 
 			vkCmdPushConstants(
 				frame_content.commandBuffer,
@@ -164,9 +308,269 @@ namespace aveng {
 				sizeof(SimplePushConstantData),
 				&push);
 
-			obj.model->bind(frame_content.commandBuffer);
-			obj.model->draw(frame_content.commandBuffer);
+			obj.model->draw(frame_content.commandBuffer, obj.visual.lod);
+			data.draw_calls++;
+
+		}
+	}
+
+	/*
+	* The object table and the draw commands are written into the frame arena. firstInstance is
+	* the object's index in the table (object_table.vert reads gl_InstanceIndex), and each pipeline
+	* gets one indirect draw however many objects there are.
+	*/
+	bool ObjectRenderSystem::prepareIndirect(FrameContent& frame_content, Data& data)
+	{
+		// firstInstance carries the object index, without it every command would read object 0
+		if (!engineDevice.enabledFeatures.drawIndirectFirstInstance) return false;
 
+		// Until they're built get() hands back the fallback, which reads push constants rather than the table
+		const ShadingVariants& variants = indirectVariants[static_cast<size_t>(data.cur_pipe) % indirectVariants.size()];
+		bool ready = true;
+		for (uint32_t f = 0; f < AvengModel::VERTEX_FORMAT_COUNT; f++)
+		{
+			const AvengModel::VertexFormat format = static_cast<AvengModel::VertexFormat>(f);
+			for (uint32_t shading = 0; shading < SHADING_COUNT; shading++)
+			{
+				indirectFrame.pipelines[batchOf(format, shading)] = pipelineRegistry.get(variants.shading[shading][f]);
+				ready = ready && pipelineRegistry.isReady(variants.shading[shading][f]);
+			}
+		}
+		if (!ready) return false;
+
+		Frustum frustum = Frustum::fromMatrix(frame_content.camera.getProjection() * frame_content.camera.getView());
+		const bool gpuCull = data.gpu_cull && culling.ready();
+
+		auto addItem = [this](AvengAppObject& obj) {
+			const MeshArena::Mesh mesh = obj.model->lodMesh(obj.visual.lod);
+			const bool textured = obj.get_texture() != NO_TEXTURE;
+			indirectItems.push_back({ batchOf(obj.model->getFormat(), shadingOf(obj)), mesh.firstIndex, textured ? static_cast<uint32_t>(obj.get_texture()) : 0u, &obj });
+		};
+
+		// The GPU culls every object. The CPU only looks at those the object index finds near the frustum.
+		indirectItems.clear();
+		if (gpuCull) {
+			for (auto& kv : frame_content.appObjects) addItem(kv.second);
+		}
+		else {
+			candidates.clear();
+			frame_content.objectIndex.queryFrustum(frustum, candidates);
+			for (AvengAppObject* obj : candidates) addItem(*obj);
+		}
+
+		indirectFrame.active = true;
+		if (indirectItems.empty())
+		{
+			if (!gpuCull) data.visible_objs = 0;
+			return true;
+		}
+
+		// The count path reads how many commands to draw from the arena too, which is what lets the GPU decide
+		indirectFrame.multiDraw = engineDevice.enabledFeatures.multiDrawIndirect == VK_TRUE;
+		indirectFrame.useCount = indirectFrame.multiDraw && engineDevice.cmdDrawIndexedIndirectCount != nullptr;
+
+		if (gpuCull) {
+			prepareGpuCulled(frame_content, data, frustum);
+		}
+		else {
+			prepareCpuCulled(frame_content, data, frustum);
+		}
+
+		return true;
+	}
+
+	void ObjectRenderSystem::writeObject(ObjectData& object, AvengAppObject& obj, uint32_t texture)
+	{
+		glm::mat3 normalMatrix = obj.transform.normalMatrix();
+		object.modelMatrix = obj.transform._mat4() * obj.model->vertexTransform();
+		object.normalMatrix[0] = glm::vec4(normalMatrix[0], 0.f);
+		object.normalMatrix[1] = glm::vec4(normalMatrix[1], 0.f);
+		object.normalMatrix[2] = glm::vec4(normalMatrix[2], 0.f);
+		object.params = glm::uvec4(texture, 0u, 0u, 0u);
+	}
+
+	/*
+	* The object index only goes as far as boxes around the bounding spheres, the spheres are tested here.
+	* What's left is sorted by pipeline, mesh and texture so every run of objects sharing those becomes a
+	* single instanced command.
+	*/
+	void ObjectRenderSystem::prepareCpuCulled(FrameContent& frame_content, Data& data, const Frustum& frustum)
+	{
+		indirectItems.erase(
+			std::remove_if(indirectItems.begin(), indirectItems.end(), [&frustum](const IndirectItem& item) {
+				return !CullingSystem::isVisible(frustum, item.object->transform._mat4(), item.object->model->getBoundingSphere());
+			}),
+			indirectItems.end());
+
+		data.visible_objs = static_cast<int>(indirectItems.size());
+		if (indirectItems.empty()) return;
+
+		std::sort(indirectItems.begin(), indirectItems.end(), [](const IndirectItem& a, const IndirectItem& b) {
+			if (a.batch != b.batch) return a.batch < b.batch;
+			if (a.firstIndex != b.firstIndex) return a.firstIndex < b.firstIndex;
+			return a.texture < b.texture;
+		});
+
+		const uint32_t objectCount = static_cast<uint32_t>(indirectItems.size());
+		const VkDeviceSize stride = sizeof(VkDrawIndexedIndirectCommand);
+
+		// Aligned to its own size so the table starts on a whole element of the arena wide binding
+		FrameArena::Allocation table = frame_content.frameArena.allocate(objectCount * sizeof(ObjectData), sizeof(ObjectData));
+		FrameArena::Allocation commands = frame_content.frameArena.allocate(objectCount * stride, sizeof(uint32_t));
+		const uint32_t firstObject = static_cast<uint32_t>(table.offset / sizeof(ObjectData));
+
+		ObjectData* objects = static_cast<ObjectData*>(table.data);
+		VkDrawIndexedIndirectCommand* cmds = static_cast<VkDrawIndexedIndirectCommand*>(commands.data);
+
+		uint32_t drawCount = 0;
+
+		for (uint32_t i = 0; i < objectCount; i++)
+		{
+			const IndirectItem& item = indirectItems[i];
+			AvengAppObject& obj = *item.object;
+			writeObject(objects[i], obj, item.texture);
+
+			// Same pipeline, mesh and texture as the last object, which sits right before this one in the table
+			const IndirectItem* previous = i > 0 ? &indirectItems[i - 1] : nullptr;
+			if (previous && item.batch == previous->batch && item.firstIndex == previous->firstIndex && item.texture == previous->texture)
+			{
+				cmds[drawCount - 1].instanceCount++;
+				continue;
+			}
+
+			const MeshArena::Mesh mesh = obj.model->lodMesh(obj.visual.lod);
+			cmds[drawCount++] = { mesh.indexCount, 1, mesh.firstIndex, mesh.vertexOffset, firstObject + i };
+			indirectFrame.commandCount[item.batch]++;
+		}
+
+		// Sorted by batch, so the batches' commands follow one another
+		VkDeviceSize commandOffset = commands.offset;
+		for (uint32_t b = 0; b < CullingSystem::BATCH_COUNT; b++)
+		{
+			indirectFrame.commandOffset[b] = commandOffset;
+			commandOffset += indirectFrame.commandCount[b] * stride;
+		}
+
+		if (indirectFrame.useCount)
+		{
+			FrameArena::Allocation counts = frame_content.frameArena.allocate(sizeof(indirectFrame.commandCount), sizeof(uint32_t));
+			std::memcpy(counts.data, indirectFrame.commandCount, sizeof(indirectFrame.commandCount));
+			indirectFrame.countOffset = counts.offset;
+		}
+	}
+
+	/*
+	* Every object goes in the table in whatever order, cull.comp decides what gets drawn. One
+	* command per visible object; nothing here looks at visibility.
+	*/
+	void ObjectRenderSystem::prepareGpuCulled(FrameContent& frame_content, Data& data, const Frustum& frustum)
+	{
+		FrameArena& arena = frame_content.frameArena;
+		const uint32_t objectCount = static_cast<uint32_t>(indirectItems.size());
+		const VkDeviceSize stride = sizeof(VkDrawIndexedIndirectCommand);
+
+		uint32_t batchSizes[CullingSystem::BATCH_COUNT]{};
+		for (const IndirectItem& item : indirectItems)
+		{
+			batchSizes[item.batch]++;
+		}
+
+		FrameArena::Allocation table = arena.allocate(objectCount * sizeof(ObjectData), sizeof(ObjectData));
+		FrameArena::Allocation cull = arena.allocate(objectCount * sizeof(CullingSystem::CullObject), sizeof(CullingSystem::CullObject));
+		FrameArena::Allocation commands = arena.allocate(objectCount * stride, sizeof(uint32_t));
+
+		CullingSystem::Dispatch dispatch{};
+		dispatch.objectCount = objectCount;
+		dispatch.cullOffset = cull.offset;
+		dispatch.objectOffset = table.offset;
+		dispatch.objectSize = sizeof(ObjectData);
+		dispatch.compact = indirectFrame.useCount;
+
+		// Each batch gets room for all of its objects, one after the other
+		uint32_t batchStart[CullingSystem::BATCH_COUNT];
+		uint32_t firstSlot = 0;
+		for (uint32_t b = 0; b < CullingSystem::BATCH_COUNT; b++)
+		{
+			batchStart[b] = firstSlot;
+			dispatch.commandOffset[b] = commands.offset + firstSlot * stride;
+			dispatch.commandCapacity[b] = batchSizes[b];
+			firstSlot += batchSizes[b];
+		}
+
+		if (dispatch.compact)
+		{
+			FrameArena::Allocation counts = arena.allocate(sizeof(uint32_t) * CullingSystem::BATCH_COUNT, sizeof(uint32_t));
+			std::memset(counts.data, 0, sizeof(uint32_t) * CullingSystem::BATCH_COUNT);
+			dispatch.countOffset = counts.offset;
+		}
+
+		ObjectData* objects = static_cast<ObjectData*>(table.data);
+		CullingSystem::CullObject* cullObjects = static_cast<CullingSystem::CullObject*>(cull.data);
+		uint32_t slots[CullingSystem::BATCH_COUNT]{};
+
+		for (uint32_t i = 0; i < objectCount; i++)
+		{
+			const IndirectItem& item = indirectItems[i];
+			AvengAppObject& obj = *item.object;
+			writeObject(objects[i], obj, item.texture);
+
+			// Compacting, cull.comp appends to the batch. Otherwise every object has its own slot.
+			const uint32_t slot = dispatch.compact ? batchStart[item.batch] : batchStart[item.batch] + slots[item.batch]++;
+
+			// The table's model matrix includes vertexTransform(), so the sphere has to be in the same space
+			const MeshArena::Mesh mesh = obj.model->lodMesh(obj.visual.lod);
+			cullObjects[i] = {
+				obj.model->getStoredBoundingSphere(),
+				mesh.indexCount,
+				mesh.firstIndex,
+				mesh.vertexOffset,
+				(item.batch << CullingSystem::BATCH_SHIFT) | slot
+			};
+		}
+
+		culling.record(frame_content.commandBuffer, frame_content.frameIndex, frustum, dispatch, data.verify_cull);
+
+		for (uint32_t b = 0; b < CullingSystem::BATCH_COUNT; b++)
+		{
+			indirectFrame.commandOffset[b] = dispatch.commandOffset[b];
+			indirectFrame.commandCount[b] = dispatch.commandCapacity[b];
+		}
+		indirectFrame.countOffset = dispatch.countOffset;
+
+		// Only known once the frame is back, see verifyCulling
+		if (!data.verify_cull) data.visible_objs = -1;
+	}
+
+	void ObjectRenderSystem::drawIndirect(FrameContent& frame_content, Data& data)
+	{
+		VkCommandBuffer commandBuffer = frame_content.commandBuffer;
+		VkBuffer arenaBuffer = frame_content.frameArena.getBuffer(frame_content.frameIndex);
+		const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+		for (uint32_t batch = 0; batch < CullingSystem::BATCH_COUNT; batch++)
+		{
+			const uint32_t count = indirectFrame.commandCount[batch];
+			if (count == 0) continue;
+
+			indirectFrame.pipelines[batch]->bind(commandBuffer);
+			const VkDeviceSize offset = indirectFrame.commandOffset[batch];
+
+			if (indirectFrame.useCount) {
+				engineDevice.cmdDrawIndexedIndirectCount(
+					commandBuffer, arenaBuffer, offset, arenaBuffer, indirectFrame.countOffset + batch * sizeof(uint32_t), count, stride);
+				data.draw_calls++;
+			}
+			else if (indirectFrame.multiDraw) {
+				vkCmdDrawIndexedIndirect(commandBuffer, arenaBuffer, offset, count, stride);
+				data.draw_calls++;
+			}
+			else {
+				// Without multiDrawIndirect each call may only read one command
+				for (uint32_t c = 0; c < count; c++) {
+					vkCmdDrawIndexedIndirect(commandBuffer, arenaBuffer, offset + c * stride, 1, stride);
+				}
+				data.draw_calls += count;
+			}
 		}
 	}
 
@@ -174,7 +578,6 @@ namespace aveng {
 	{
 
 		data.num_objs = size;
-		data.cur_pipe = WindowCallbacks::getCurPipeline();
 		data.dt = frameTime;
 		data.camera_modPI = viewerObject.transform.modPI;
 
@@ -5,6 +5,8 @@
 #include "../Peripheral/KeyboardController.h"
 #include "../../CoreVK/EngineDevice.h"
 #include "../../CoreVK/GFXPipeline.h"
+#include "../../CoreVK/PipelineRegistry.h"
+#include "CullingSystem.h"
 #include "../data.h"
 
 #include "../../avpch.h"
@@ -15,36 +17,127 @@ namespace aveng {
 
 	public:
 
-		struct FragUbo {
-			alignas(sizeof(int)) int imDex;
+		// One entry of the object table (set 0 binding 5) read by object_table.vert. 128 bytes, so an
+		// allocation aligned to its size sits at a whole element index of the frame arena.
+		struct ObjectData {
+			glm::mat4 modelMatrix{ 1.f };
+			glm::vec4 normalMatrix[3]{};	// Columns of the 3x3 normal matrix
+			glm::uvec4 params{};			// x texture index
 		};
 
-		ObjectRenderSystem(EngineDevice& device, AvengAppObject& viewer);
+		ObjectRenderSystem(EngineDevice& device, ShaderLibrary& library, AvengAppObject& viewer);
 		~ObjectRenderSystem();
 
 		ObjectRenderSystem(const ObjectRenderSystem&) = delete;
-		void initialize(VkRenderPass renderPass, VkDescriptorSetLayout globalDescriptorSetLayout, VkDescriptorSetLayout fragDescriptorSetLayouts);
+		void initialize(VkRenderPass renderPass, VkDescriptorSetLayout globalDescriptorSetLayout, FrameArena& frameArena);
 		ObjectRenderSystem& operator=(const ObjectRenderSystem&) = delete;
-		void render(FrameContent& frame_content, Data& data, AvengBuffer& fragBuffer);
+
+		// Before the render pass. Lays out this frame's indirect draws and, with GPU culling, records the cull dispatch.
+		void update(FrameContent& frame_content, Data& data);
+		void render(FrameContent& frame_content, Data& data);
 		VkPipelineLayout getPipelineLayout() { return pipelineLayout; }
 
+		// Rebuild the pipelines using any of these recompiled shaders
+		void reloadShaders(const std::vector<std::string>& changedFiles)
+		{
+			pipelineRegistry.reload(changedFiles);
+			culling.reloadShaders(changedFiles);
+		}
+
+		// Check the GPU culling of this slot's last frame against the CPU. Before the slot's FrameArena::begin.
+		void verifyCulling(int frameIndex, Data& data);
+
+		// The most a frame takes from the frame arena for this many objects, whichever way they're drawn
+		static VkDeviceSize frameArenaBytes(size_t objectCount);
+
 	private:
 
 		void createPipelineLayout(VkDescriptorSetLayout* descriptorSetLayouts);
 		void updateData(size_t size, float frameTime, Data& data);
 		void createPipeline(VkRenderPass renderPass);
 
+		// Picks every object's level of detail for this frame (visual.lod) and counts the triangles
+		void selectLods(FrameContent& frame_content, Data& data);
+
+		// Fraction of data.lod_pixels a level has to clear by before an object switches to it
+		static constexpr float LOD_HYSTERESIS = 0.2f;
+
+		// One draw per object, its transforms and texture index in the push constants
+		void renderDirect(FrameContent& frame_content, Data& data, const std::vector<AvengAppObject*>& objects);
+
+		// Every object is drawn from the object table with a couple of indirect draws. False if the device
+		// or pipelines can't do it yet, and the objects are drawn one by one instead.
+		bool prepareIndirect(FrameContent& frame_content, Data& data);
+		void prepareCpuCulled(FrameContent& frame_content, Data& data, const Frustum& frustum);
+		void prepareGpuCulled(FrameContent& frame_content, Data& data, const Frustum& frustum);
+		void drawIndirect(FrameContent& frame_content, Data& data);
+		void writeObject(ObjectData& object, AvengAppObject& obj, uint32_t texture);
+
 		int last_sec;
 		EngineDevice &engineDevice;
+		ShaderLibrary& shaderLibrary;
 		AvengAppObject& viewerObject;
 
 		size_t deviceAlignment = engineDevice.properties.limits.minUniformBufferOffsetAlignment;
 
-		// Rendering Pipelines - Heap Allocated
-		std::unique_ptr<GFXPipeline> gfxPipeline;
-		std::unique_ptr<GFXPipeline> gfxPipeline2;
+		// How an object is shaded, each a specialization of the fragment shader. BACKDROP objects are drawn
+		// as authored, without lights or gamma; the rest are lit.
+		enum Shading : uint32_t {
+			LIT_UNTEXTURED = 0,
+			LIT_TEXTURED,
+			UNLIT_UNTEXTURED,
+			UNLIT_TEXTURED,
+			SHADING_COUNT
+		};
+		static uint32_t shadingOf(AvengAppObject& obj)
+		{
+			const bool textured = obj.get_texture() != NO_TEXTURE;
+			return (obj.meta.type == BACKDROP ? UNLIT_UNTEXTURED : LIT_UNTEXTURED) + (textured ? 1u : 0u);
+		}
+
+		// One set per selectable pipeline. Every shading uses different specializations, and every vertex
+		// format its own vertex input. Indexed by Shading, then AvengModel::VertexFormat.
+		struct ShadingVariants {
+			PipelineHandle shading[SHADING_COUNT][AvengModel::VERTEX_FORMAT_COUNT];
+		};
+
+		// Indirect draws are grouped by pipeline: vertex format and shading
+		static uint32_t batchOf(AvengModel::VertexFormat format, uint32_t shading) { return static_cast<uint32_t>(format) * SHADING_COUNT + shading; }
+		static_assert(AvengModel::VERTEX_FORMAT_COUNT * SHADING_COUNT == CullingSystem::BATCH_COUNT, "Every pipeline needs a batch of its own");
+
+		ShadingVariants addShadingVariants(const std::string& vertFilepath, const std::string& fragFilepath, PipelineConfig& config);
+
+		// Rendering Pipelines - Variants are built in the background, the untextured simple_shader stands in until they're ready
+		PipelineRegistry pipelineRegistry{ engineDevice, shaderLibrary, PipelineRegistry::CreationMode::OnFirstUse };
+		std::vector<ShadingVariants> pipelineVariants;
+		std::vector<ShadingVariants> indirectVariants;	// The same shading as pipelineVariants, reading the object table
 		VkPipelineLayout pipelineLayout;
 
+		// Rebuilt every frame, kept to reuse their storage
+		struct IndirectItem {
+			uint32_t batch;			// See batchOf
+			uint32_t firstIndex;	// Identifies the mesh, and its level of detail, within the arena
+			uint32_t texture;		// Sampler array indices must be uniform within a draw, so part of the key
+			AvengAppObject* object;
+		};
+		std::vector<IndirectItem> indirectItems;
+		std::vector<AvengAppObject*> directObjects;
+		std::vector<AvengAppObject*> candidates;		// From the object index, for CPU culling
+
+		// Laid out by update(), drawn by render(). Indexed by batch, see batchOf.
+		struct IndirectFrame {
+			bool active = false;
+			bool multiDraw = false;
+			bool useCount = false;			// vkCmdDrawIndexedIndirectCount, commandCount is then an upper bound
+			GFXPipeline* pipelines[CullingSystem::BATCH_COUNT]{};
+			VkDeviceSize commandOffset[CullingSystem::BATCH_COUNT]{};
+			uint32_t commandCount[CullingSystem::BATCH_COUNT]{};
+			VkDeviceSize countOffset = 0;
+		};
+		IndirectFrame indirectFrame;
+
+		CullingSystem culling{ engineDevice, shaderLibrary };
+
 	};
 
 }
\ No newline at end of file
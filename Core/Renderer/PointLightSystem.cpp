@@ -1,6 +1,6 @@
 #include "PointLightSystem.h"
 #include "../Math/aveng_math.h"
-#include "../Events/window_callbacks.h"
+#include "../data.h"
 #include "../Player/GameplayFunctions.h"
 
 #define exe GameplayFunctions
@@ -10,8 +10,10 @@
 
 namespace aveng {
 
-	PointLightSystem::PointLightSystem(EngineDevice& device) : engineDevice{ device } 
-	{}
+	PointLightSystem::PointLightSystem(EngineDevice& device, ShaderLibrary& library) : engineDevice{ device }, shaderLibrary{ library } 
+	{
+		createLightBuffers();
+	}
 
 	void PointLightSystem::initialize(VkRenderPass renderPass, VkDescriptorSetLayout globalDescriptorSetLayouts)
 	{
@@ -22,9 +24,70 @@ namespace aveng {
 
 	PointLightSystem::~PointLightSystem()
 	{
+		// A reload may still be compiling against this layout
+		pipelineRegistry.wait();
 		vkDestroyPipelineLayout(engineDevice.device(), pipelineLayout, nullptr);
 	}
 
+	/*
+	* Storage buffers for the light list and the cluster lookup, sized for the worst case
+	* so they never need to be rebuilt. Host visible, rewritten every frame.
+	*/
+	void PointLightSystem::createLightBuffers()
+	{
+		lightBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+		clusterBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+		lightIndexBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+
+		for (int i = 0; i < SwapChain::MAX_FRAMES_IN_FLIGHT; i++)
+		{
+			lightBuffers[i] = std::make_unique<AvengBuffer>(engineDevice,
+				sizeof(PointLight),
+				LightClusters::MAX_LIGHTS,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+			lightBuffers[i]->map();
+
+			clusterBuffers[i] = std::make_unique<AvengBuffer>(engineDevice,
+				sizeof(LightClusters::Cluster),
+				LightClusters::CLUSTER_COUNT,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+			clusterBuffers[i]->map();
+
+			lightIndexBuffers[i] = std::make_unique<AvengBuffer>(engineDevice,
+				sizeof(uint32_t),
+				LightClusters::MAX_LIGHT_INDICES,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+			lightIndexBuffers[i]->map();
+		}
+	}
+
+	void PointLightSystem::update(FrameContent& frame_content, const std::vector<PointLight>& lights, VkExtent2D extent)
+	{
+		lightClusters.build(lights, frame_content.camera.getView(), frame_content.camera.getProjection(), extent);
+		lightCount = lightClusters.shaderParams().counts.w;
+
+		int i = frame_content.frameIndex;
+		if (lightCount > 0)
+		{
+			lightBuffers[i]->writeToBuffer((void*)lights.data(), sizeof(PointLight) * lightCount);
+			lightBuffers[i]->flush();
+		}
+
+		const auto& grid = lightClusters.grid();
+		clusterBuffers[i]->writeToBuffer((void*)grid.data(), sizeof(LightClusters::Cluster) * grid.size());
+		clusterBuffers[i]->flush();
+
+		const auto& indices = lightClusters.indices();
+		if (!indices.empty())
+		{
+			lightIndexBuffers[i]->writeToBuffer((void*)indices.data(), sizeof(uint32_t) * indices.size());
+			lightIndexBuffers[i]->flush();
+		}
+	}
+
 	/*
 	 * Setup of the pipeline layout.
 	 * Here we include our Push Constant information
@@ -71,12 +134,12 @@ namespace aveng {
 		pipelineConfig.pipelineLayout = pipelineLayout;
 
 		// A GFXPipeline
-		gfxPipeline = std::make_unique<GFXPipeline>(
-			engineDevice,
+		lightPipeline = pipelineRegistry.add(
 			"shaders/point_light.vert.spv",
 			"shaders/point_light.frag.spv",
 			pipelineConfig
 		);
+		pipelineRegistry.compileAll();
 
 		// Another GFXPipeline
 		//gfxPipeline2 = std::make_unique<GFXPipeline>(
@@ -90,7 +153,8 @@ namespace aveng {
 	void PointLightSystem::render(FrameContent& frame_content)
 	{
 
-		gfxPipeline->bind(frame_content.commandBuffer); // 0
+		pipelineRegistry.swapReloaded();
+		pipelineRegistry.get(lightPipeline)->bind(frame_content.commandBuffer); // 0
 	
 		vkCmdBindDescriptorSets(
 			frame_content.commandBuffer,
@@ -99,10 +163,14 @@ namespace aveng {
 			0,
 			1,
 			&frame_content.globalDescriptorSet,
-			0,
-			nullptr);
+			1,
+			&frame_content.globalUboOffset);
 
-		vkCmdDraw(frame_content.commandBuffer, 6, 1, 0, 0);
+		// One billboard per light, the vertex shader reads its light by gl_InstanceIndex
+		if (lightCount > 0)
+		{
+			vkCmdDraw(frame_content.commandBuffer, 6, lightCount, 0, 0);
+		}
 
 	}
 
@@ -7,6 +7,10 @@
 #include "../Peripheral/KeyboardController.h"
 #include "../../CoreVK/EngineDevice.h"
 #include "../../CoreVK/GFXPipeline.h"
+#include "../../CoreVK/PipelineRegistry.h"
+#include "../../CoreVK/aveng_buffer.h"
+#include "../../CoreVK/swapchain.h"
+#include "LightClusters.h"
 #include "../data.h"
 
 #include "../../avpch.h"
@@ -21,7 +25,7 @@ namespace aveng {
 			alignas(sizeof(int)) int imDex;
 		};
 
-		PointLightSystem(EngineDevice& device);
+		PointLightSystem(EngineDevice& device, ShaderLibrary& library);
 		~PointLightSystem();
 		void initialize(VkRenderPass renderPass, VkDescriptorSetLayout globalDescriptorSetLayout);
 		PointLightSystem(const PointLightSystem&) = delete;
@@ -29,20 +33,43 @@ namespace aveng {
 		void render(FrameContent& frame_content);
 		VkPipelineLayout getPipelineLayout() { return pipelineLayout; }
 
+		// Cluster this frame's lights and upload them. Call before the frame's GlobalUbo is written.
+		void update(FrameContent& frame_content, const std::vector<PointLight>& lights, VkExtent2D extent);
+		const LightClusters::ShaderParams& clusterParams() const { return lightClusters.shaderParams(); }
+		uint32_t clusterOverflow() const { return lightClusters.overflow(); }
+
+		// Global set bindings 2, 3 and 4
+		VkDescriptorBufferInfo lightsInfo(int frameIndex) { return lightBuffers[frameIndex]->descriptorInfo(); }
+		VkDescriptorBufferInfo clustersInfo(int frameIndex) { return clusterBuffers[frameIndex]->descriptorInfo(); }
+		VkDescriptorBufferInfo lightIndicesInfo(int frameIndex) { return lightIndexBuffers[frameIndex]->descriptorInfo(); }
+
+		// Rebuild the pipeline if one of its shaders was recompiled
+		void reloadShaders(const std::vector<std::string>& changedFiles) { pipelineRegistry.reload(changedFiles); }
+
 	private:
 
 		void createPipelineLayout(VkDescriptorSetLayout* descriptorSetLayouts);
 		void createPipeline(VkRenderPass renderPass);
+		void createLightBuffers();
 
 		int last_sec;
 		EngineDevice& engineDevice;
+		ShaderLibrary& shaderLibrary;
 		size_t deviceAlignment = engineDevice.properties.limits.minUniformBufferOffsetAlignment;
 
-		// Rendering Pipelines - Heap Allocated
-		std::unique_ptr<GFXPipeline> gfxPipeline;
-		std::unique_ptr<GFXPipeline> gfxPipeline2;
+		// Rendering Pipelines
+		PipelineRegistry pipelineRegistry{ engineDevice, shaderLibrary };
+		PipelineHandle lightPipeline;
 		VkPipelineLayout pipelineLayout;
 
+		LightClusters lightClusters;
+		uint32_t lightCount = 0;
+
+		// One of each per frame in flight, written by update()
+		std::vector<std::unique_ptr<AvengBuffer>> lightBuffers;
+		std::vector<std::unique_ptr<AvengBuffer>> clusterBuffers;
+		std::vector<std::unique_ptr<AvengBuffer>> lightIndexBuffers;
+
 	};
 
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <stdexcept>
 #include <cassert>
 #include <array>
+#include <thread>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
 
@@ -27,6 +28,16 @@ namespace aveng {
 		// Gety current window size
 		auto extent = aveng_window.getExtent();
 
+		// Headless targets never resize, they're created once at the requested size
+		if (aveng_window.isHeadless())
+		{
+			if (offscreenTarget == nullptr)
+			{
+				offscreenTarget = std::make_unique<OffscreenTarget>(engineDevice, extent);
+			}
+			return;
+		}
+
 		// If the program has at least 1 dimension of 0 size (it's minimized); wait
 		while (extent.width == 0 || extent.height == 0)
 		{
@@ -34,27 +45,26 @@ namespace aveng {
 			glfwWaitEvents();
 		}
 
-		// Wait until the current swap chain isn't being used before we attempt to construct the next one.
-		vkDeviceWaitIdle(engineDevice.device());
-
-	
-		aveng_swapchain = nullptr;
-
 		if (aveng_swapchain == nullptr) {
 			// Create the new swapchain object
-			aveng_swapchain = std::make_unique<SwapChain>(engineDevice, extent);
+			aveng_swapchain = std::make_unique<SwapChain>(engineDevice, extent, presentPolicy.mode);
+			aveng_swapchain->setFramesInFlight(framesInFlight);
 
 		}
 		else {
-			// 
+			// No device idle. The old swapchain hands its handle to the new one (oldSwapchain) along with the
+			// frame fences, so frame slots carry on where they were. Its images, framebuffers and semaphores may
+			// still be in use by frames in flight.
 			std::shared_ptr<SwapChain> oldSwapChain = std::move(aveng_swapchain);
-			aveng_swapchain = std::make_unique<SwapChain>(engineDevice, extent, oldSwapChain);
+			aveng_swapchain = std::make_unique<SwapChain>(engineDevice, extent, oldSwapChain, presentPolicy.mode);
 
 			if (!oldSwapChain->compareSwapFormats(*aveng_swapchain.get()))
 			{
 				throw std::runtime_error("Swap chain image format or depth format has changed.");
 			}
 
+			// Released through the deletion queue once the frames that used it are done
+			engineDevice.deferDestroy([retired = std::move(oldSwapChain)]() mutable { retired.reset(); });
 		}
 
 		// Reinitialize ImGui
@@ -95,12 +105,101 @@ namespace aveng {
 		commandBuffers.clear();
 	}
 
+	void Renderer::setPresentPolicy(const PresentPolicy& policy)
+	{
+		assert(policy.framesInFlight >= 1 && policy.framesInFlight <= SwapChain::MAX_FRAMES_IN_FLIGHT && "Frames in flight out of range");
+
+		presentModeChanged |= policy.mode != presentPolicy.mode && !isHeadless();
+		presentPolicy = policy;
+	}
+
+	// Fewer frames in flight: the renderer and its target both wrap to the same slot
+	void Renderer::applyFramesInFlight()
+	{
+		if (presentPolicy.framesInFlight == framesInFlight) return;
+
+		framesInFlight = presentPolicy.framesInFlight;
+		currentFrameIndex %= framesInFlight;
+		if (offscreenTarget) offscreenTarget->setFramesInFlight(framesInFlight);
+		else aveng_swapchain->setFramesInFlight(framesInFlight);
+	}
+
+	void Renderer::recordLatency(float& average, Clock::time_point from, Clock::time_point to)
+	{
+		float ms = std::chrono::duration<float, std::milli>(to - from).count();
+		average = average == 0.f ? ms : average + (ms - average) * .05f;
+	}
+
+	// See which submitted frames have finished without blocking on any of them
+	void Renderer::pollFrameFences()
+	{
+		for (size_t i = 0; i < slotSubmitted.size(); i++)
+		{
+			if (!slotSubmitted[i] || vkGetFenceStatus(engineDevice.device(), frameFence(i)) != VK_SUCCESS) continue;
+
+			slotSubmitted[i] = false;
+			engineDevice.deletionQueue().frameCompleted(slotFrameNumbers[i]);
+
+			if (slotAwaitingGpu[i])
+			{
+				recordLatency(latency.inputToGpuDone, slotInputTimes[i], Clock::now());
+				slotAwaitingGpu[i] = false;
+			}
+		}
+	}
+
+	void Renderer::waitForFrame()
+	{
+		assert(!isFrameStarted && "Can't wait for the next frame while one is in progress.");
+		if (frameWaited) return;
+
+		if (presentModeChanged)
+		{
+			presentModeChanged = false;
+			recreateSwapChain();
+		}
+		applyFramesInFlight();
+
+		// Frame limiter. Sleep most of the way, then yield for the last stretch since sleep is coarse on Windows.
+		auto limiterStart = Clock::now();
+		if (presentPolicy.fpsLimit > 0.f)
+		{
+			auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(1.f / presentPolicy.fpsLimit));
+			if (nextFrameDeadline > limiterStart)
+			{
+				auto coarse = nextFrameDeadline - limiterStart - std::chrono::milliseconds(2);
+				if (coarse > Clock::duration::zero()) std::this_thread::sleep_for(coarse);
+				while (Clock::now() < nextFrameDeadline) std::this_thread::yield();
+			}
+			// Don't try to catch up after a long frame
+			auto now = Clock::now();
+			nextFrameDeadline = nextFrameDeadline + period > now ? nextFrameDeadline + period : now + period;
+		}
+
+		auto fenceStart = Clock::now();
+		pollFrameFences();
+		if (offscreenTarget) offscreenTarget->waitForFrameFence();
+		else aveng_swapchain->waitForFrameFence();
+		pollFrameFences();
+		auto fenceEnd = Clock::now();
+
+		recordLatency(latency.limiterWait, limiterStart, fenceStart);
+		recordLatency(latency.fenceWait, fenceStart, fenceEnd);
+
+		frameWaited = true;
+	}
+
 	// Return a command buffer for the current frame index
 	VkCommandBuffer Renderer::beginFrame() 
 	{
 		assert(!isFrameStarted && "Can't call beginFrame while already in progress.");
 
-		auto result = aveng_swapchain->acquireNextImage(&currentImageIndex);
+		waitForFrame();
+		frameWaited = false;
+
+		auto result = offscreenTarget
+			? offscreenTarget->acquireNextImage(&currentImageIndex)
+			: aveng_swapchain->acquireNextImage(&currentImageIndex);
 
 		// This error will occur after window resize
 		if (result == VK_ERROR_OUT_OF_DATE_KHR)
@@ -126,6 +225,8 @@ namespace aveng {
 			throw std::runtime_error("Command Buffer failed to begin recording.");
 		}
 
+		engineDevice.deletionQueue().frameBegun();
+
 		return commandBuffer;
 
 	}
@@ -135,12 +236,32 @@ namespace aveng {
 	{
 		assert(isFrameStarted && "Can't call endFrame while frame is not in progress.");
 		auto commandBuffer = getCurrentCommandBuffer();
+
+		if (offscreenTarget && offscreenTarget->wantsReadback())
+		{
+			offscreenTarget->recordReadback(commandBuffer, currentImageIndex);
+		}
+
 		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
 		{
 			throw std::runtime_error("Failed to record command buffer.");
 		}
+
+		if (offscreenTarget)
+		{
+			offscreenTarget->submitCommandBuffers(&commandBuffer, &currentImageIndex);
+			trackSubmittedFrame();
+			isFrameStarted = false;
+			currentFrameIndex = (currentFrameIndex + 1) % framesInFlight;
+			return;
+		}
+
 		// Submit to graphics queue while handling cpu and gpu sync, executing the command buffers
 		auto result = aveng_swapchain->submitCommandBuffers(&commandBuffer, &currentImageIndex);
+		trackSubmittedFrame();
+
+		isFrameStarted = false;
+		currentFrameIndex = (currentFrameIndex + 1) % framesInFlight;
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || aveng_window.wasWindowResized())
 		{
@@ -152,11 +273,34 @@ namespace aveng {
 			throw std::runtime_error("Failed to present swap chain image.");
 		}
 
-		isFrameStarted = false;
-		currentFrameIndex = (currentFrameIndex + 1) % SwapChain::MAX_FRAMES_IN_FLIGHT;
+	}
+
+	void Renderer::trackSubmittedFrame()
+	{
+		DeletionQueue& deletionQueue = engineDevice.deletionQueue();
+		slotFrameNumbers[currentFrameIndex] = deletionQueue.currentFrame();
+		slotSubmitted[currentFrameIndex] = true;
+		deletionQueue.frameSubmitted();
+
+		if (!inputSampled) return;
+		inputSampled = false;
+
+		recordLatency(latency.inputToPresent, inputSampledAt, Clock::now());
+		slotInputTimes[currentFrameIndex] = inputSampledAt;
+		slotAwaitingGpu[currentFrameIndex] = true;
+	}
 
+
+	void Renderer::setReadbackCallback(OffscreenTarget::ReadbackCallback callback)
+	{
+		assert(offscreenTarget != nullptr && "Frames can only be read back when headless");
+		offscreenTarget->setReadbackCallback(std::move(callback));
 	}
 
+	void Renderer::flushReadbacks()
+	{
+		if (offscreenTarget) offscreenTarget->flushReadbacks();
+	}
 
 	void  Renderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer)
 	{
@@ -174,12 +318,15 @@ namespace aveng {
 		// 1. Begin a render pass
 		VkRenderPassBeginInfo renderPassInfo{};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = aveng_swapchain->getRenderPass();
-		renderPassInfo.framebuffer = aveng_swapchain->getFrameBuffer(currentImageIndex);
+		renderPassInfo.renderPass = getSwapChainRenderPass();
+		renderPassInfo.framebuffer = offscreenTarget
+			? offscreenTarget->getFrameBuffer(currentImageIndex)
+			: aveng_swapchain->getFrameBuffer(currentImageIndex);
 
 		// The area where shader loading and storing takes place.
+		VkExtent2D extent = getSwapChainExtent();
 		renderPassInfo.renderArea.offset = { 0,0 };
-		renderPassInfo.renderArea.extent = aveng_swapchain->getSwapChainExtent();
+		renderPassInfo.renderArea.extent = extent;
 
 		std::array<VkClearValue, 2> clearValues{};
 		clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
@@ -198,11 +345,11 @@ namespace aveng {
 		VkViewport viewport{};
 		viewport.x = 0.0f;
 		viewport.y = 0.0f;
-		viewport.width = static_cast<float>(aveng_swapchain->getSwapChainExtent().width);
-		viewport.height = static_cast<float>(aveng_swapchain->getSwapChainExtent().height);
+		viewport.width = static_cast<float>(extent.width);
+		viewport.height = static_cast<float>(extent.height);
 		viewport.minDepth = 0.0f;
 		viewport.maxDepth = 1.0f;
-		VkRect2D scissor{ {0, 0}, aveng_swapchain->getSwapChainExtent() };
+		VkRect2D scissor{ {0, 0}, extent };
 		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
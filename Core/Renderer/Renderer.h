@@ -1,11 +1,14 @@
 #pragma once
 
+#include <array>
+#include <chrono>
 #include <memory>
 #include <vector>
 #include <cassert>
 #include "../aveng_window.h"
 #include "../../CoreVK/EngineDevice.h"
 #include "../../CoreVK/swapchain.h"
+#include "../../CoreVK/OffscreenTarget.h"
 #include "../../GUI/imgui.h"
 #include "../../GUI/imgui_impl_glfw.h"
 #include "../../GUI/imgui_impl_vulkan.h"
@@ -20,6 +23,14 @@ namespace aveng {
 
 	public:
 
+		// Smoothed over the last few dozen frames, in milliseconds
+		struct FrameLatency {
+			float inputToPresent = 0.f;	// Input sampled -> vkQueuePresentKHR returned
+			float inputToGpuDone = 0.f;	// Input sampled -> the frame's fence was seen signaled. An upper bound.
+			float fenceWait = 0.f;		// CPU time blocked on the frame fence
+			float limiterWait = 0.f;	// CPU time slept by the frame limiter
+		};
+
 		Renderer(AvengWindow &window, EngineDevice &device);
 		~Renderer();
 
@@ -27,9 +38,12 @@ namespace aveng {
 		Renderer &operator=(const Renderer&) = delete;
 
 		// Our app needs to be able to access the swap chain render pass in order to configure any pipelines it creates
-		VkRenderPass getSwapChainRenderPass() const { return aveng_swapchain->getRenderPass(); }
-		float getAspectRatio() const { return aveng_swapchain->extentAspectRatio(); }
+		// When headless these all refer to the offscreen target instead
+		VkRenderPass getSwapChainRenderPass() const { return offscreenTarget ? offscreenTarget->getRenderPass() : aveng_swapchain->getRenderPass(); }
+		float getAspectRatio() const { return offscreenTarget ? offscreenTarget->extentAspectRatio() : aveng_swapchain->extentAspectRatio(); }
+		VkExtent2D getSwapChainExtent() const { return offscreenTarget ? offscreenTarget->getSwapChainExtent() : aveng_swapchain->getSwapChainExtent(); }
 		bool isFrameInProgress() const { return isFrameStarted; }
+		bool isHeadless() const { return offscreenTarget != nullptr; }
 
 		VkCommandBuffer getCurrentCommandBuffer() const 
 		{
@@ -44,9 +58,27 @@ namespace aveng {
 		}
 
 		// SwapChain getters
-		uint32_t getImageCount() const { return aveng_swapchain->imageCount(); }
-		VkImage& getImage(int index) { return aveng_swapchain->getImage(index); }
-		VkFormat getSwapChainImageFormat() { return aveng_swapchain->getSwapChainImageFormat(); }
+		uint32_t getImageCount() const { return static_cast<uint32_t>(offscreenTarget ? offscreenTarget->imageCount() : aveng_swapchain->imageCount()); }
+		VkImage& getImage(int index) { return offscreenTarget ? offscreenTarget->getImage(index) : aveng_swapchain->getImage(index); }
+		VkFormat getSwapChainImageFormat() { return offscreenTarget ? offscreenTarget->getSwapChainImageFormat() : aveng_swapchain->getSwapChainImageFormat(); }
+
+		// Headless only. Called with each finished frame, a frame or two after it was submitted.
+		void setReadbackCallback(OffscreenTarget::ReadbackCallback callback);
+		// Headless only. Waits for the frames still in flight and delivers their readbacks.
+		void flushReadbacks();
+
+		// Present mode changes recreate the swapchain at the next beginFrame, the rest apply from the next frame
+		void setPresentPolicy(const PresentPolicy& policy);
+		const PresentPolicy& getPresentPolicy() const { return presentPolicy; }
+		const FrameLatency& getLatency() const { return latency; }
+
+		/*
+		* Throttle (frame limiter + the frame slot's fence). beginFrame calls this itself if it hasn't been;
+		* call it before polling input instead to sample input as late as possible (PresentPolicy::lateInputSampling).
+		*/
+		void waitForFrame();
+		// The moment this frame's input was read, for latency measurement
+		void markInputSampled() { inputSampledAt = Clock::now(); inputSampled = true; }
 
 		VkCommandBuffer beginFrame();
 		void endFrame();
@@ -55,8 +87,16 @@ namespace aveng {
 
 	private:
 
+		using Clock = std::chrono::steady_clock;
+
 		VkResult err;
 
+		void applyFramesInFlight();
+		void pollFrameFences();
+		void trackSubmittedFrame();
+		void recordLatency(float& average, Clock::time_point from, Clock::time_point to);
+		VkFence frameFence(size_t frame) { return offscreenTarget ? offscreenTarget->getFrameFence(frame) : aveng_swapchain->getFrameFence(frame); }
+
 		void createCommandBuffers();
 		void freeCommandBuffers();
 		void recreateSwapChain();
@@ -70,11 +110,30 @@ namespace aveng {
 
 		// SwapChain aveng_swapchain{ engineDevice, aveng_window.getExtent() };	// previous stack allocated. Ptr makes it easier to rebuild when the window resizes
 		std::unique_ptr<SwapChain> aveng_swapchain;
+		// Replaces the swapchain when the window is headless. Exactly one of the two exists.
+		std::unique_ptr<OffscreenTarget> offscreenTarget;
 		
 		uint32_t currentImageIndex{0};
-		int currentFrameIndex; // Not tied to the image index
+		int currentFrameIndex{0}; // Not tied to the image index
 		bool isFrameStarted{ false };
 
+		PresentPolicy presentPolicy{};
+		uint32_t framesInFlight = SwapChain::MAX_FRAMES_IN_FLIGHT;
+		bool presentModeChanged = false;
+		bool frameWaited = false;
+		Clock::time_point nextFrameDeadline{};
+
+		// The deletion queue frame number each slot last submitted, released once its fence is seen signaled
+		std::array<uint64_t, SwapChain::MAX_FRAMES_IN_FLIGHT> slotFrameNumbers{};
+		std::array<bool, SwapChain::MAX_FRAMES_IN_FLIGHT> slotSubmitted{};
+
+		// Latency bookkeeping, per frame slot
+		FrameLatency latency{};
+		Clock::time_point inputSampledAt{};
+		bool inputSampled = false;
+		std::array<Clock::time_point, SwapChain::MAX_FRAMES_IN_FLIGHT> slotInputTimes{};
+		std::array<bool, SwapChain::MAX_FRAMES_IN_FLIGHT> slotAwaitingGpu{};
+
 	};
 
 }
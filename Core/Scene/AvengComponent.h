@@ -45,6 +45,7 @@ namespace aveng {
 		int pendulum_row;
 		float pendulum_delta;
 		float pendulum_extent;
+		int lod;				// Level of detail drawn last frame, see ObjectRenderSystem::selectLods
 	};
 
 	struct ResistanceComponent {
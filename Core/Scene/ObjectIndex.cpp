@@ -0,0 +1,142 @@
+#include "ObjectIndex.h"
+#include "../data.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace aveng {
+
+	namespace {
+
+		// Where the ray enters the sphere, or leaves it when it starts inside. tMax if it misses.
+		float sphereHit(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& center, float radius, float tMax)
+		{
+			const glm::vec3 oc = origin - center;
+			const float a = glm::dot(direction, direction);
+			const float b = glm::dot(oc, direction);
+			const float c = glm::dot(oc, oc) - radius * radius;
+			const float discriminant = b * b - a * c;
+			if (discriminant < 0.f) return tMax;
+
+			const float root = std::sqrt(discriminant);
+			float t = (-b - root) / a;
+			if (t < 0.f) t = (-b + root) / a;
+			return t >= 0.f && t < tMax ? t : tMax;
+		}
+
+	}
+
+	ObjectIndex::ObjectIndex()
+	{
+		const uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+		if (threads > 1) pool.setThreadCount(threads);
+	}
+
+	AABB ObjectIndex::worldBounds(AvengAppObject& obj)
+	{
+		const glm::mat4 transform = obj.transform._mat4();
+		const glm::vec4& sphere = obj.model->getBoundingSphere();
+		const float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+		return AABB::fromSphere(glm::vec3(transform * glm::vec4(glm::vec3(sphere), 1.f)), sphere.w * scale);
+	}
+
+	void ObjectIndex::rebuild(AvengAppObject::Map& map)
+	{
+		objects.clear();
+		moving.clear();
+
+		std::vector<AABB> bounds;
+		bounds.reserve(map.size());
+		objects.reserve(map.size());
+
+		for (auto& kv : map)
+		{
+			AvengAppObject& obj = kv.second;
+			const int type = obj.meta.type;
+			if (type == PLAYER || type == ENEMY || type == DYNAMIC) moving.push_back(static_cast<uint32_t>(objects.size()));
+
+			objects.push_back(&obj);
+			bounds.push_back(worldBounds(obj));
+		}
+
+		bvh.build(bounds, &pool);
+		refits = 0;
+	}
+
+	void ObjectIndex::update(AvengAppObject::Map& map)
+	{
+		// Nothing yet removes an object and adds another in the same frame, so the count says whether the set changed
+		if (map.size() != objects.size())
+		{
+			rebuild(map);
+			return;
+		}
+
+		if (moving.empty()) return;
+
+		for (uint32_t item : moving) bvh.setBounds(item, worldBounds(*objects[item]));
+		bvh.refit();
+
+		if (++refits % QUALITY_INTERVAL == 0 && bvh.quality() > REBUILD_QUALITY) rebuild(map);
+	}
+
+	void ObjectIndex::collect(std::vector<AvengAppObject*>& out) const
+	{
+		out.reserve(out.size() + items.size());
+		for (uint32_t item : items) out.push_back(objects[item]);
+	}
+
+	void ObjectIndex::queryFrustum(const Frustum& frustum, std::vector<AvengAppObject*>& out) const
+	{
+		items.clear();
+		bvh.queryFrustum(frustum, items);
+		collect(out);
+	}
+
+	void ObjectIndex::queryAABB(const AABB& region, std::vector<AvengAppObject*>& out) const
+	{
+		items.clear();
+		bvh.queryAABB(region, items);
+		collect(out);
+	}
+
+	void ObjectIndex::querySphere(const glm::vec3& center, float radius, std::vector<AvengAppObject*>& out) const
+	{
+		items.clear();
+		bvh.querySphere(center, radius, items);
+		collect(out);
+	}
+
+	bool ObjectIndex::raycast(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit, float maxDistance) const
+	{
+		float t = maxDistance;
+		const uint32_t item = bvh.raycast(origin, direction, t, [&](uint32_t candidate, float tMax) {
+			AvengAppObject& obj = *objects[candidate];
+			const glm::mat4 transform = obj.transform._mat4();
+			const TriangleBVH* triangles = obj.model->getTriangles();
+
+			if (triangles == nullptr)
+			{
+				const glm::vec4& sphere = obj.model->getBoundingSphere();
+				const float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+				return sphereHit(origin, direction, glm::vec3(transform * glm::vec4(glm::vec3(sphere), 1.f)), sphere.w * scale, tMax);
+			}
+
+			// Into model space. The transform is affine, so t means the same distance there as here.
+			const glm::mat4 inverse = glm::inverse(transform);
+			float tModel = tMax;
+			triangles->raycast(glm::vec3(inverse * glm::vec4(origin, 1.f)), glm::vec3(inverse * glm::vec4(direction, 0.f)), tModel);
+			return tModel;
+		});
+
+		if (item == BVH::NONE) return false;
+
+		hit.object = objects[item];
+		hit.point = origin + t * direction;
+		hit.distance = t;
+		return true;
+	}
+
+}
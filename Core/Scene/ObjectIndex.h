@@ -0,0 +1,69 @@
+#pragma once
+
+#include "app_object.h"
+#include "../Spatial/BVH.h"
+
+#include <vector>
+
+/*
+* The scene's objects in a BVH (Core/Spatial/BVH.h) over their world space bounds, for any question of
+* the form "which objects are in here" without looking at all of them.
+*
+* Kept up to date once a frame by update(). Objects of the types that move (PLAYER, ENEMY, DYNAMIC) are
+* refit every frame, the rest are assumed to stay where the scene put them. The tree is rebuilt when
+* objects come or go, or when refitting has let it get too loose.
+*/
+namespace aveng {
+
+	class ObjectIndex {
+
+	public:
+
+		struct RayHit {
+			AvengAppObject* object = nullptr;
+			glm::vec3 point{ 0.f };		// World space
+			float distance = 0.f;		// Along the ray, in its direction's units
+		};
+
+		ObjectIndex();
+
+		void update(AvengAppObject::Map& objects);
+
+		// Objects whose bounds may be in the frustum, a superset of what CullingSystem::isVisible passes
+		void queryFrustum(const Frustum& frustum, std::vector<AvengAppObject*>& out) const;
+		void queryAABB(const AABB& region, std::vector<AvengAppObject*>& out) const;
+		void querySphere(const glm::vec3& center, float radius, std::vector<AvengAppObject*>& out) const;
+
+		/*
+		* The nearest object along a world space ray, false if there's none within maxDistance. Models holding
+		* their triangles (AvengModel::LoadOptions::retainGeometry) are hit on their surface, the rest on their
+		* bounding sphere.
+		*/
+		bool raycast(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit, float maxDistance = 1000.f) const;
+
+		const BVH& tree() const { return bvh; }
+		AvengAppObject& object(uint32_t item) const { return *objects[item]; }
+
+		// The bounding sphere CullingSystem::isVisible tests, boxed
+		static AABB worldBounds(AvengAppObject& obj);
+
+	private:
+
+		void rebuild(AvengAppObject::Map& objects);
+		void collect(std::vector<AvengAppObject*>& out) const;
+
+		// Refits between looking at the tree's quality, which costs a pass over every node
+		static constexpr uint32_t QUALITY_INTERVAL = 60;
+		static constexpr float REBUILD_QUALITY = 2.f;
+
+		BVH bvh;
+		ThreadPool pool;						// Rebuilds happen whenever the scene changes, the workers stay between them
+		std::vector<AvengAppObject*> objects;	// By item. Map values don't move until they're erased.
+		std::vector<uint32_t> moving;			// Items refit every update
+		uint32_t refits = 0;
+
+		mutable std::vector<uint32_t> items;	// Query scratch
+
+	};
+
+}
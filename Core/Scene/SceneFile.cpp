@@ -0,0 +1,288 @@
+#include "SceneFile.h"
+#include "../data.h"
+#include "../Utils/MappedFile.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace aveng {
+
+	namespace {
+
+		constexpr char SCENE_MAGIC[4] = { 'A', 'V', 'S', 'C' };
+		constexpr uint32_t SCENE_VERSION = 1;
+
+		/*
+		* Followed by the mesh paths, each null terminated and the lot padded to a multiple of 4, then the
+		* arrays in Scene's order, objectCount entries each. Little endian, like everything we run on.
+		*/
+		struct BinaryHeader {
+			char magic[4];
+			uint32_t version;
+			uint32_t meshCount;
+			uint32_t objectCount;
+			uint32_t pathBytes;
+		};
+
+		constexpr size_t OBJECT_BYTES = sizeof(uint32_t) + 2 * sizeof(int32_t) + 3 * sizeof(glm::vec3);
+
+		const char* const TEXTURE_NAMES[] = {
+			"SURFACE_GRID_1", "THEME_1", "THEME_2", "THEME_3", "THEME_4", "RAND_1", "RAND_2", "RAND_3", "NO_TEXTURE"
+		};
+		const char* const TYPE_NAMES[] = { "GROUND", "PLAYER", "ENEMY", "SCENE", "STATIC", "DYNAMIC", "BACKDROP" };
+		constexpr int32_t TYPE_COUNT = static_cast<int32_t>(sizeof(TYPE_NAMES) / sizeof(TYPE_NAMES[0]));
+		static_assert(TYPE_COUNT == BACKDROP + 1, "Every object type needs a name");
+
+		// An enum value by name or number
+		template<size_t N>
+		bool parseName(const std::string& token, const char* const (&names)[N], int32_t& value)
+		{
+			for (size_t i = 0; i < N; i++)
+			{
+				if (token == names[i])
+				{
+					value = static_cast<int32_t>(i);
+					return true;
+				}
+			}
+
+			std::istringstream number{ token };
+			return static_cast<bool>(number >> value) && number.eof();
+		}
+
+		// One of texSampler's 8 entries, or NO_TEXTURE for none
+		bool validTexture(int32_t index)
+		{
+			return index >= 0 && index <= NO_TEXTURE;
+		}
+
+		// The renderer picks shading by type, see ObjectRenderSystem::shadingOf
+		bool validType(int32_t type)
+		{
+			return type >= 0 && type < TYPE_COUNT;
+		}
+
+		bool readVec3(std::istringstream& line, glm::vec3& v)
+		{
+			return static_cast<bool>(line >> v.x >> v.y >> v.z);
+		}
+
+		// One of the arrays after the header, entries of T
+		template<typename T>
+		const char* readArray(const char* cursor, size_t count, std::vector<T>& out)
+		{
+			out.resize(count);
+			if (count > 0) std::memcpy(out.data(), cursor, count * sizeof(T));
+			return cursor + count * sizeof(T);
+		}
+
+		template<typename T>
+		void writeArray(std::ofstream& out, const std::vector<T>& in)
+		{
+			out.write(reinterpret_cast<const char*>(in.data()), static_cast<std::streamsize>(in.size() * sizeof(T)));
+		}
+
+	}
+
+	void Scene::addObject(uint32_t objectMesh, int32_t objectTexture, int32_t objectType, const glm::vec3& objectTranslation, const glm::vec3& objectRotation, const glm::vec3& objectScale)
+	{
+		mesh.push_back(objectMesh);
+		texture.push_back(objectTexture);
+		type.push_back(objectType);
+		translation.push_back(objectTranslation);
+		rotation.push_back(objectRotation);
+		scale.push_back(objectScale);
+	}
+
+	Scene Scene::load(const std::string& filepath)
+	{
+		char magic[sizeof(SCENE_MAGIC)]{};
+		std::ifstream file{ filepath, std::ios::binary };
+		if (!file) throw std::runtime_error("Failed to open scene " + filepath);
+		file.read(magic, sizeof(magic));
+
+		const bool binary = file.gcount() == sizeof(magic) && std::memcmp(magic, SCENE_MAGIC, sizeof(magic)) == 0;
+		file.close();
+		return binary ? loadBinary(filepath) : loadText(filepath);
+	}
+
+	Scene Scene::loadText(const std::string& filepath)
+	{
+		std::ifstream file{ filepath };
+		if (!file) throw std::runtime_error("Failed to open scene " + filepath);
+
+		Scene scene;
+		std::string text;
+		int lineNumber = 0;
+
+		while (std::getline(file, text))
+		{
+			lineNumber++;
+			auto fail = [&](const std::string& what) {
+				throw std::runtime_error(filepath + ":" + std::to_string(lineNumber) + ": " + what);
+			};
+
+			const size_t comment = text.find('#');
+			if (comment != std::string::npos) text.resize(comment);
+
+			std::istringstream line{ text };
+			std::string directive;
+			if (!(line >> directive)) continue;
+
+			if (directive == "mesh")
+			{
+				std::string path;
+				if (!(line >> path)) fail("mesh needs a path");
+				scene.meshes.push_back(path);
+				continue;
+			}
+
+			if (directive != "object" && directive != "grid") fail("unknown directive " + directive);
+
+			uint32_t objectMesh = 0;
+			std::string textureName, typeName;
+			int32_t objectTexture = 0, objectType = 0;
+			if (!(line >> objectMesh >> textureName >> typeName)) fail(directive + " needs a mesh, a texture and a type");
+			if (objectMesh >= scene.meshes.size()) fail("no mesh " + std::to_string(objectMesh) + " declared yet");
+			if (!parseName(textureName, TEXTURE_NAMES, objectTexture)) fail("unknown texture " + textureName);
+			if (!validTexture(objectTexture)) fail("texture " + textureName + " out of range");
+			if (!parseName(typeName, TYPE_NAMES, objectType)) fail("unknown type " + typeName);
+			if (!validType(objectType)) fail("type " + typeName + " out of range");
+
+			glm::vec3 objectRotation{ 0.f };
+			glm::vec3 objectScale{ 1.f };
+
+			if (directive == "object")
+			{
+				glm::vec3 objectTranslation{ 0.f };
+				if (!readVec3(line, objectTranslation)) fail("object needs a translation");
+				if (readVec3(line, objectRotation)) readVec3(line, objectScale);
+				scene.addObject(objectMesh, objectTexture, objectType, objectTranslation, objectRotation, objectScale);
+				continue;
+			}
+
+			int64_t nx = 0, ny = 0, nz = 0;
+			glm::vec3 origin{ 0.f }, step{ 0.f };
+			if (!(line >> nx >> ny >> nz) || nx < 0 || ny < 0 || nz < 0) fail("grid needs three counts");
+			if (!readVec3(line, origin) || !readVec3(line, step)) fail("grid needs an origin and a step");
+			readVec3(line, objectScale);
+
+			const size_t count = static_cast<size_t>(nx * ny * nz);
+			scene.mesh.reserve(scene.mesh.size() + count);
+			scene.texture.reserve(scene.texture.size() + count);
+			scene.type.reserve(scene.type.size() + count);
+			scene.translation.reserve(scene.translation.size() + count);
+			scene.rotation.reserve(scene.rotation.size() + count);
+			scene.scale.reserve(scene.scale.size() + count);
+
+			for (int64_t i = 0; i < nx; i++)
+			{
+				for (int64_t j = 0; j < ny; j++)
+				{
+					for (int64_t k = 0; k < nz; k++)
+					{
+						const glm::vec3 cell{ static_cast<float>(i), static_cast<float>(j), static_cast<float>(k) };
+						scene.addObject(objectMesh, objectTexture, objectType, origin + cell * step, objectRotation, objectScale);
+					}
+				}
+			}
+		}
+
+		return scene;
+	}
+
+	Scene Scene::loadBinary(const std::string& filepath)
+	{
+		MappedFile file{ filepath };
+		const char* data = file.data();
+		const size_t size = file.size();
+
+		BinaryHeader header{};
+		if (size < sizeof(header)) throw std::runtime_error(filepath + " is too short to be a scene");
+		std::memcpy(&header, data, sizeof(header));
+
+		if (std::memcmp(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC)) != 0) throw std::runtime_error(filepath + " isn't a binary scene");
+		if (header.version != SCENE_VERSION)
+		{
+			throw std::runtime_error(filepath + " is scene version " + std::to_string(header.version) + ", expected " + std::to_string(SCENE_VERSION));
+		}
+
+		const size_t expected = sizeof(header) + header.pathBytes + static_cast<size_t>(header.objectCount) * OBJECT_BYTES;
+		if (size != expected) throw std::runtime_error(filepath + " is " + std::to_string(size) + " bytes, its header says " + std::to_string(expected));
+
+		Scene scene;
+		const char* cursor = data + sizeof(header);
+
+		// Paths, each up to its null
+		const char* paths = cursor;
+		const char* pathsEnd = cursor + header.pathBytes;
+		for (uint32_t m = 0; m < header.meshCount; m++)
+		{
+			const char* end = static_cast<const char*>(std::memchr(paths, '\0', pathsEnd - paths));
+			if (end == nullptr) throw std::runtime_error(filepath + " has fewer mesh paths than its header says");
+			scene.meshes.emplace_back(paths, end);
+			paths = end + 1;
+		}
+		cursor = pathsEnd;
+
+		const size_t count = header.objectCount;
+		cursor = readArray(cursor, count, scene.mesh);
+		cursor = readArray(cursor, count, scene.texture);
+		cursor = readArray(cursor, count, scene.type);
+		cursor = readArray(cursor, count, scene.translation);
+		cursor = readArray(cursor, count, scene.rotation);
+		readArray(cursor, count, scene.scale);
+
+		for (uint32_t m : scene.mesh)
+		{
+			if (m >= header.meshCount) throw std::runtime_error(filepath + " has an object using mesh " + std::to_string(m) + " of " + std::to_string(header.meshCount));
+		}
+
+		for (int32_t t : scene.texture)
+		{
+			if (!validTexture(t)) throw std::runtime_error(filepath + " has an object using texture " + std::to_string(t) + " of " + std::to_string(NO_TEXTURE));
+		}
+
+		for (int32_t t : scene.type)
+		{
+			if (!validType(t)) throw std::runtime_error(filepath + " has an object of type " + std::to_string(t) + " of " + std::to_string(TYPE_COUNT));
+		}
+
+		return scene;
+	}
+
+	void Scene::saveBinary(const std::string& filepath) const
+	{
+		std::string paths;
+		for (const std::string& path : meshes)
+		{
+			paths += path;
+			paths += '\0';
+		}
+		paths.resize((paths.size() + 3) / 4 * 4, '\0');
+
+		BinaryHeader header{};
+		std::memcpy(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC));
+		header.version = SCENE_VERSION;
+		header.meshCount = static_cast<uint32_t>(meshes.size());
+		header.objectCount = static_cast<uint32_t>(objectCount());
+		header.pathBytes = static_cast<uint32_t>(paths.size());
+
+		std::ofstream out{ filepath, std::ios::binary | std::ios::trunc };
+		if (!out) throw std::runtime_error("Failed to write scene " + filepath);
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(paths.data(), static_cast<std::streamsize>(paths.size()));
+		writeArray(out, mesh);
+		writeArray(out, texture);
+		writeArray(out, type);
+		writeArray(out, translation);
+		writeArray(out, rotation);
+		writeArray(out, scale);
+
+		if (!out) throw std::runtime_error("Failed to write scene " + filepath);
+	}
+
+}
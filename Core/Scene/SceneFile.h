@@ -0,0 +1,52 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+* Scenes as data rather than code. A scene is a list of meshes plus, for every object, the mesh it draws,
+* its texture, its object type and its transform, each kept in an array of its own.
+*
+* The text form is for writing by hand, one directive per line, '#' to the end of a line is a comment:
+*
+*	mesh <path>
+*	object <mesh> <texture> <type> <tx ty tz> [<rx ry rz> [<sx sy sz>]]
+*	grid <mesh> <texture> <type> <nx ny nz> <origin xyz> <step xyz> [<sx sy sz>]
+*
+* Meshes are numbered in the order they're declared. Textures and types are names from the texture and
+* types enums (data.h) or plain numbers. A grid is nx * ny * nz objects at origin + (i, j, k) * step.
+*
+* The binary form (.avscene) is the text compiled: a header, the mesh paths and then every array written
+* out whole, so loading it is a few copies out of the mapped file however many objects there are.
+*/
+namespace aveng {
+
+	struct Scene {
+
+		std::vector<std::string> meshes;
+
+		// Indexed by object
+		std::vector<uint32_t> mesh;
+		std::vector<int32_t> texture;
+		std::vector<int32_t> type;
+		std::vector<glm::vec3> translation;
+		std::vector<glm::vec3> rotation;
+		std::vector<glm::vec3> scale;
+
+		size_t objectCount() const { return mesh.size(); }
+
+		void addObject(uint32_t objectMesh, int32_t objectTexture, int32_t objectType, const glm::vec3& objectTranslation, const glm::vec3& objectRotation, const glm::vec3& objectScale);
+
+		// Either form, the binary one is recognised by its header. Throws std::runtime_error on anything malformed.
+		static Scene load(const std::string& filepath);
+		static Scene loadText(const std::string& filepath);
+		static Scene loadBinary(const std::string& filepath);
+
+		void saveBinary(const std::string& filepath) const;
+
+	};
+
+}
@@ -0,0 +1,153 @@
+#include "Simulation.h"
+#include "../data.h"
+
+#include <algorithm>
+
+namespace aveng {
+
+	void Simulation::init(AvengAppObject::Map& objects, std::vector<PointLight>& pointLights, float hz, Step stepFunction)
+	{
+		stop();
+
+		dt = 1.f / std::max(hz, 1.f);
+		step = std::move(stepFunction);
+		lights = &pointLights;
+		tick = 0;
+		accumulator = 0.f;
+
+		bodies.clear();
+		state = State{};
+		for (auto& kv : objects)
+		{
+			AvengAppObject& obj = kv.second;
+			const int type = obj.meta.type;
+			if (type != PLAYER && type != ENEMY && type != DYNAMIC) continue;
+
+			bodies.push_back(&obj);
+			state.translation.push_back(obj.transform.translation);
+			state.rotation.push_back(obj.transform.rotation);
+			state.velocity.push_back(obj.transform.velocity);
+		}
+
+		state.lights.reserve(pointLights.size());
+		for (const PointLight& light : pointLights) state.lights.push_back(light.position);
+
+		// Every slot starts out at rest on the initial state
+		previous = state;
+		for (Snapshot& slot : slots)
+		{
+			slot.previous = state;
+			slot.current = state;
+			slot.tick = 0;
+			slot.stamp = Clock::now();
+		}
+		writeSlot = 0;
+		readSlot = 1;
+		readySlot.store(2, std::memory_order_release);
+	}
+
+	void Simulation::start()
+	{
+		if (isRunning()) return;
+		quit.store(false, std::memory_order_release);
+		worker = std::thread([this] { loop(); });
+	}
+
+	void Simulation::stop()
+	{
+		if (!isRunning()) return;
+		quit.store(true, std::memory_order_release);
+		worker.join();
+	}
+
+	void Simulation::stepAndPublish(Clock::time_point due)
+	{
+		const auto start = Clock::now();
+
+		previous = state;
+		step(state, dt);
+		tick++;
+
+		Snapshot& slot = slots[writeSlot];
+		slot.previous = previous;
+		slot.current = state;
+		slot.tick = tick;
+		slot.stamp = due;
+
+		// Hand the slot over and take whichever the reader isn't holding
+		writeSlot = readySlot.exchange(writeSlot | FRESH, std::memory_order_acq_rel) & SLOT_MASK;
+
+		stepMicros.store(std::chrono::duration<float, std::micro>(Clock::now() - start).count(), std::memory_order_relaxed);
+	}
+
+	/*
+	* Steps at the start of each period and sleeps out the rest. A step that overruns eats into the next
+	* period rather than moving the schedule, so the rate holds on average; falling more than MAX_BEHIND steps
+	* behind drops them instead of running flat out to catch up.
+	*/
+	void Simulation::loop()
+	{
+		const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(dt));
+		auto next = Clock::now();
+
+		while (!quit.load(std::memory_order_acquire))
+		{
+			stepAndPublish(next);
+			next += period;
+
+			const auto now = Clock::now();
+			if (now - next > period * MAX_BEHIND)
+			{
+				skippedSteps.fetch_add(static_cast<uint32_t>((now - next) / period), std::memory_order_relaxed);
+				next = now;
+			}
+
+			std::this_thread::sleep_until(next);
+		}
+	}
+
+	void Simulation::advance(float frameTime)
+	{
+		// A hair under a whole step still counts, so a frame time equal to the step always makes one
+		accumulator += frameTime;
+		uint32_t steps = 0;
+		while (accumulator >= dt * 0.9999f && steps++ < MAX_BEHIND)
+		{
+			accumulator -= dt;
+			stepAndPublish(Clock::now());
+		}
+		accumulator = std::clamp(accumulator, 0.f, dt);
+	}
+
+	void Simulation::apply()
+	{
+		if (lights == nullptr) return;
+
+		if (readySlot.load(std::memory_order_acquire) & FRESH)
+		{
+			readSlot = readySlot.exchange(readSlot, std::memory_order_acq_rel) & SLOT_MASK;
+		}
+
+		// One step behind: current was due at stamp, so at stamp + dt the blend reaches it
+		const Snapshot& snapshot = reading();
+		const float progress = isRunning()
+			? std::chrono::duration<float>(Clock::now() - snapshot.stamp).count() / dt
+			: accumulator / dt;
+		alpha = std::clamp(progress, 0.f, 1.f);
+
+		for (size_t i = 0; i < bodies.size(); i++)
+		{
+			TransformComponent& transform = bodies[i]->transform;
+			transform.translation = glm::mix(snapshot.previous.translation[i], snapshot.current.translation[i], alpha);
+			transform.rotation = glm::mix(snapshot.previous.rotation[i], snapshot.current.rotation[i], alpha);
+			transform.velocity = snapshot.current.velocity[i];
+		}
+
+		std::vector<PointLight>& pointLights = *lights;
+		for (size_t i = 0; i < pointLights.size() && i < snapshot.current.lights.size(); i++)
+		{
+			pointLights[i].position = glm::mix(snapshot.previous.lights[i], snapshot.current.lights[i], alpha);
+		}
+	}
+
+}
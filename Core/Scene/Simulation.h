@@ -0,0 +1,119 @@
+#pragma once
+
+#include "app_object.h"
+#include "../Renderer/LightClusters.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/*
+* Whatever moves on its own, stepped at a fixed rate on a thread of its own rather than once per rendered
+* frame. The simulation keeps its own copy of the moving objects (PLAYER, ENEMY, DYNAMIC) and the lights,
+* and after every step publishes the last two states through a triple buffer: one slot being written, one
+* the renderer holds, one ready to swap for the newest. Neither side ever waits on the other.
+*
+* The renderer shows the world one step behind, blending the two states by how far it is into that step,
+* so motion stays smooth whatever the two rates are. The camera isn't simulated, it follows input on the
+* render thread.
+*
+* Without the thread (headless runs, where frames must be reproducible) advance() steps on the calling
+* thread instead, as many fixed steps as the frame time covers.
+*/
+namespace aveng {
+
+	class Simulation {
+
+	public:
+
+		struct State {
+			// Per moving object
+			std::vector<glm::vec3> translation;
+			std::vector<glm::vec3> rotation;
+			std::vector<glm::vec3> velocity;
+			// Per light, PointLight::position
+			std::vector<glm::vec4> lights;
+		};
+
+		// Moves the state on by dt seconds. Runs on the simulation thread, it may only touch the state.
+		using Step = std::function<void(State& state, float dt)>;
+
+		Simulation() = default;
+		~Simulation() { stop(); }
+
+		Simulation(const Simulation&) = delete;
+		Simulation& operator=(const Simulation&) = delete;
+
+		// Takes the moving objects and the lights as they are now. The objects and the light vector have to
+		// stay where they are, apply() writes back into them.
+		void init(AvengAppObject::Map& objects, std::vector<PointLight>& lights, float hz, Step step);
+
+		void start();
+		void stop();
+		bool isRunning() const { return worker.joinable(); }
+
+		// Without the thread, steps as many times as frameTime covers
+		void advance(float frameTime);
+
+		// Render thread. Blends the newest two states into the objects and lights.
+		void apply();
+
+		float getRate() const { return 1.f / dt; }
+		float getAlpha() const { return alpha; }
+		uint64_t getTick() const { return reading().tick; }
+		float getStepMicros() const { return stepMicros.load(std::memory_order_relaxed); }
+		uint32_t getSkippedSteps() const { return skippedSteps.load(std::memory_order_relaxed); }
+
+	private:
+
+		using Clock = std::chrono::steady_clock;
+
+		// Steps the simulation was allowed to fall behind before it gives up catching up
+		static constexpr uint32_t MAX_BEHIND = 5;
+
+		struct Snapshot {
+			State previous;
+			State current;
+			uint64_t tick = 0;
+			Clock::time_point stamp{};	// When current was due, previous was due one step before
+		};
+
+		// Low bits the slot, FRESH when the writer has published since the reader last swapped
+		static constexpr uint32_t SLOT_MASK = 3;
+		static constexpr uint32_t FRESH = 4;
+
+		void loop();
+		void stepAndPublish(Clock::time_point due);
+		const Snapshot& reading() const { return slots[readSlot]; }
+
+		float dt = 1.f / 60.f;
+		Step step;
+
+		std::vector<AvengAppObject*> bodies;
+		std::vector<PointLight>* lights = nullptr;
+
+		// The simulation's own, only touched by whoever steps
+		State state;
+		State previous;
+		uint64_t tick = 0;
+		float accumulator = 0.f;		// advance() only
+
+		std::array<Snapshot, 3> slots;
+		uint32_t writeSlot = 0;
+		uint32_t readSlot = 1;
+		std::atomic<uint32_t> readySlot{ 2 };
+
+		std::thread worker;
+		std::atomic<bool> quit{ false };
+		std::atomic<float> stepMicros{ 0.f };
+		std::atomic<uint32_t> skippedSteps{ 0 };
+
+		float alpha = 1.f;
+
+	};
+
+}
@@ -28,7 +28,7 @@ namespace aveng {
 		AvengAppObject& operator=(AvengAppObject&&) = default;
 
 		const id_t getId() { return id; }
-		std::unique_ptr<AvengModel> model{};
+		std::shared_ptr<AvengModel> model{};	// Objects drawing the same mesh share one
 
 		int get_texture() { return texture_id; }
 		void set_texture(int texture) { texture_id = texture; }
@@ -0,0 +1,586 @@
+#include "BVH.h"
+#include "../Utils/BenchTimer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+namespace aveng {
+
+	namespace {
+
+		constexpr uint32_t BIN_COUNT = 16;
+
+		// Below this many items a thread costs more than it saves
+		constexpr uint32_t PARALLEL_MIN_ITEMS = 16384;
+
+		// Relative to testing one item
+		constexpr float TRAVERSAL_COST = 1.f;
+
+	}
+
+	void BVH::clear()
+	{
+		nodes.clear();
+		parents.clear();
+		bounds.clear();
+		refs.clear();
+		order.clear();
+		itemLeaf.clear();
+		dirty.clear();
+		dirtyLeaf.clear();
+		builtCost = 0.f;
+	}
+
+	BVH::Node BVH::makeNode(uint32_t first, uint32_t count) const
+	{
+		AABB box;
+		for (uint32_t i = first; i < first + count; i++) box.grow(refs[i].box);
+
+		Node node{};
+		node.setBox(box);
+		node.first = first;
+		node.count = count;
+		return node;
+	}
+
+	AABB BVH::rangeBounds(uint32_t first, uint32_t count) const
+	{
+		AABB box;
+		for (uint32_t i = first; i < first + count; i++) box.grow(bounds[order[i]]);
+		return box;
+	}
+
+	/*
+	* Item centers are dropped into BIN_COUNT bins along each axis and every boundary between bins is
+	* costed as area(left) * items(left) + area(right) * items(right). Leaves of up to MAX_LEAF stay leaves
+	* unless a split beats testing their items.
+	*/
+	uint32_t BVH::split(const Node& node, uint32_t depth)
+	{
+		const uint32_t first = node.first;
+		const uint32_t count = node.count;
+		if (count <= 1) return 0;
+
+		AABB centerBox;
+		for (uint32_t i = first; i < first + count; i++) centerBox.grow(refs[i].center);
+
+		const glm::vec3 extent = centerBox.extent();
+		const int widest = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+		auto halve = [&](int axis) {
+			if (extent[axis] > 0.f)
+			{
+				std::nth_element(refs.begin() + first, refs.begin() + first + count / 2, refs.begin() + first + count,
+					[axis](const BuildRef& a, const BuildRef& b) { return a.center[axis] < b.center[axis]; });
+			}
+			return count / 2;
+		};
+
+		// Every center in one place, no plane separates them
+		if (extent[widest] <= 0.f) return count > MAX_LEAF ? halve(widest) : 0;
+		if (depth >= MEDIAN_DEPTH) return halve(widest);
+
+		struct Bin {
+			AABB box;
+			uint32_t count = 0;
+		};
+
+		// Small nodes, most of them, don't need every bin and spend most of their time sweeping empty ones
+		const uint32_t binCount = std::min(BIN_COUNT, std::max(count, 4u));
+
+		float bestCost = std::numeric_limits<float>::max();
+		int bestAxis = -1;
+		uint32_t bestBin = 0;
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (extent[axis] <= 0.f) continue;
+
+			Bin bins[BIN_COUNT];
+			const float scale = binCount / extent[axis];
+			for (uint32_t i = first; i < first + count; i++)
+			{
+				const BuildRef& ref = refs[i];
+				const uint32_t b = std::min(binCount - 1, static_cast<uint32_t>((ref.center[axis] - centerBox.min[axis]) * scale));
+				bins[b].box.grow(ref.box);
+				bins[b].count++;
+			}
+
+			// Right to left first, so the sweep the other way can cost each boundary as it goes
+			float rightArea[BIN_COUNT];
+			uint32_t rightCount[BIN_COUNT];
+			AABB right;
+			uint32_t rightItems = 0;
+			for (uint32_t b = binCount - 1; b > 0; b--)
+			{
+				right.grow(bins[b].box);
+				rightItems += bins[b].count;
+				rightArea[b] = right.halfArea();
+				rightCount[b] = rightItems;
+			}
+
+			AABB left;
+			uint32_t leftItems = 0;
+			for (uint32_t b = 0; b + 1 < binCount; b++)
+			{
+				left.grow(bins[b].box);
+				leftItems += bins[b].count;
+				if (leftItems == 0 || rightCount[b + 1] == 0) continue;
+
+				const float cost = left.halfArea() * leftItems + rightArea[b + 1] * rightCount[b + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b;
+				}
+			}
+		}
+
+		if (bestAxis < 0) return halve(widest);
+
+		const float area = node.box().halfArea();
+		const float splitCost = TRAVERSAL_COST + (area > 0.f ? bestCost / area : 0.f);
+		if (count <= MAX_LEAF && splitCost >= static_cast<float>(count)) return 0;
+
+		const float scale = binCount / extent[bestAxis];
+		const float low = centerBox.min[bestAxis];
+		auto middle = std::partition(refs.begin() + first, refs.begin() + first + count, [&](const BuildRef& ref) {
+			return std::min(binCount - 1, static_cast<uint32_t>((ref.center[bestAxis] - low) * scale)) <= bestBin;
+		});
+
+		const uint32_t leftCount = static_cast<uint32_t>(middle - (refs.begin() + first));
+		return leftCount > 0 && leftCount < count ? leftCount : halve(widest);
+	}
+
+	void BVH::buildSubtree(std::vector<Node>& into, uint32_t root, uint32_t depth)
+	{
+		std::vector<Range> stack{ { root, depth } };
+
+		while (!stack.empty())
+		{
+			const Range range = stack.back();
+			stack.pop_back();
+
+			const uint32_t first = into[range.node].first;
+			const uint32_t count = into[range.node].count;
+			const uint32_t leftCount = split(into[range.node], range.depth);
+			if (leftCount == 0) continue;
+
+			const uint32_t left = static_cast<uint32_t>(into.size());
+			into.push_back(makeNode(first, leftCount));
+			into.push_back(makeNode(first + leftCount, count - leftCount));
+			into[range.node].left = left;
+
+			stack.push_back({ left, range.depth + 1 });
+			stack.push_back({ left + 1, range.depth + 1 });
+		}
+	}
+
+	/*
+	* In parallel the top of the tree is split here until every unsplit range is small enough to be one
+	* thread's work. Each range is then built into an array of its own, and the arrays are appended to the
+	* tree with their child indices shifted. The ranges are disjoint stretches of the refs, so the threads
+	* never reorder the same items.
+	*/
+	void BVH::build(const std::vector<AABB>& itemBounds, ThreadPool* pool)
+	{
+		clear();
+		bounds = itemBounds;
+
+		const uint32_t count = static_cast<uint32_t>(bounds.size());
+		if (count == 0) return;
+
+		refs.resize(count);
+		for (uint32_t i = 0; i < count; i++) refs[i] = { bounds[i], bounds[i].center(), i };
+
+		const uint32_t threads = pool != nullptr ? static_cast<uint32_t>(pool->threads.size()) : 1;
+
+		nodes.reserve(2 * static_cast<size_t>(count));
+		nodes.push_back(makeNode(0, count));
+
+		if (threads <= 1 || count < PARALLEL_MIN_ITEMS)
+		{
+			buildSubtree(nodes, 0, 0);
+		}
+		else {
+			const uint32_t taskItems = std::max(count / (threads * 4), PARALLEL_MIN_ITEMS / 4);
+
+			std::vector<Range> tasks;
+			std::vector<Range> pending{ { 0, 0 } };
+			while (!pending.empty())
+			{
+				const Range range = pending.back();
+				pending.pop_back();
+
+				const uint32_t first = nodes[range.node].first;
+				const uint32_t rangeCount = nodes[range.node].count;
+				if (rangeCount <= taskItems)
+				{
+					tasks.push_back(range);
+					continue;
+				}
+
+				const uint32_t leftCount = split(nodes[range.node], range.depth);
+				if (leftCount == 0) continue;
+
+				const uint32_t left = static_cast<uint32_t>(nodes.size());
+				nodes.push_back(makeNode(first, leftCount));
+				nodes.push_back(makeNode(first + leftCount, rangeCount - leftCount));
+				nodes[range.node].left = left;
+
+				pending.push_back({ left, range.depth + 1 });
+				pending.push_back({ left + 1, range.depth + 1 });
+			}
+
+			std::vector<std::vector<Node>> subtrees(tasks.size());
+			for (size_t t = 0; t < tasks.size(); t++)
+			{
+				subtrees[t].push_back(nodes[tasks[t].node]);
+				pool->threads[t % threads]->addJob([this, &subtrees, &tasks, t] { buildSubtree(subtrees[t], 0, tasks[t].depth); });
+			}
+			pool->wait();
+
+			for (size_t t = 0; t < tasks.size(); t++)
+			{
+				const std::vector<Node>& subtree = subtrees[t];
+				const uint32_t base = static_cast<uint32_t>(nodes.size());
+
+				// The subtree's root takes the place of the task's node, the rest move up by one
+				auto placed = [base](Node node) {
+					if (node.left != 0) node.left = base + node.left - 1;
+					return node;
+				};
+
+				nodes[tasks[t].node] = placed(subtree[0]);
+				for (size_t i = 1; i < subtree.size(); i++) nodes.push_back(placed(subtree[i]));
+			}
+		}
+
+		order.resize(count);
+		for (uint32_t i = 0; i < count; i++) order[i] = refs[i].item;
+		refs = std::vector<BuildRef>{};
+
+		parents.assign(nodes.size(), NONE);
+		itemLeaf.assign(count, NONE);
+		for (uint32_t n = 0; n < nodes.size(); n++)
+		{
+			const Node& node = nodes[n];
+			if (node.left != 0)
+			{
+				parents[node.left] = n;
+				parents[node.left + 1] = n;
+			}
+			else {
+				for (uint32_t i = node.first; i < node.first + node.count; i++) itemLeaf[order[i]] = n;
+			}
+		}
+		dirtyLeaf.assign(nodes.size(), 0);
+
+		builtCost = cost();
+	}
+
+	void BVH::setBounds(uint32_t item, const AABB& box)
+	{
+		bounds[item] = box;
+
+		const uint32_t leaf = itemLeaf[item];
+		if (!dirtyLeaf[leaf])
+		{
+			dirtyLeaf[leaf] = 1;
+			dirty.push_back(leaf);
+		}
+	}
+
+	/*
+	* Each changed leaf is refit and the change carried up until a node comes out the same as before, past
+	* there nothing above can have changed either.
+	*/
+	void BVH::refit()
+	{
+		for (uint32_t leaf : dirty)
+		{
+			dirtyLeaf[leaf] = 0;
+
+			Node& node = nodes[leaf];
+			const AABB box = rangeBounds(node.first, node.count);
+			bool changed = !(box == node.box());
+			node.setBox(box);
+
+			for (uint32_t n = parents[leaf]; changed && n != NONE; n = parents[n])
+			{
+				AABB merged = nodes[nodes[n].left].box();
+				merged.grow(nodes[nodes[n].left + 1].box());
+				changed = !(merged == nodes[n].box());
+				nodes[n].setBox(merged);
+			}
+		}
+		dirty.clear();
+	}
+
+	float BVH::cost() const
+	{
+		if (nodes.empty()) return 0.f;
+
+		float total = 0.f;
+		for (const Node& node : nodes)
+		{
+			total += node.box().halfArea() * (node.left != 0 ? TRAVERSAL_COST : static_cast<float>(node.count));
+		}
+
+		const float rootArea = nodes[0].box().halfArea();
+		return rootArea > 0.f ? total / rootArea : total;
+	}
+
+	float BVH::quality() const
+	{
+		return builtCost > 0.f ? cost() / builtCost : 1.f;
+	}
+
+	template<typename Test, typename TestItem>
+	void BVH::query(std::vector<uint32_t>& out, Test&& test, TestItem&& testItem) const
+	{
+		if (nodes.empty()) return;
+
+		uint32_t stack[MAX_DEPTH];
+		uint32_t top = 0;
+		stack[top++] = 0;
+
+		while (top > 0)
+		{
+			const Node& node = nodes[stack[--top]];
+
+			const Frustum::Overlap overlap = test(node.box());
+			if (overlap == Frustum::Overlap::Outside) continue;
+
+			if (overlap == Frustum::Overlap::Inside)
+			{
+				out.insert(out.end(), order.begin() + node.first, order.begin() + node.first + node.count);
+			}
+			else if (node.left == 0) {
+				for (uint32_t i = node.first; i < node.first + node.count; i++)
+				{
+					if (testItem(bounds[order[i]])) out.push_back(order[i]);
+				}
+			}
+			else {
+				stack[top++] = node.left + 1;
+				stack[top++] = node.left;
+			}
+		}
+	}
+
+	void BVH::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& out) const
+	{
+		query(out,
+			[&frustum](const AABB& box) { return frustum.testBox(box); },
+			[&frustum](const AABB& box) { return frustum.testBox(box) != Frustum::Overlap::Outside; });
+	}
+
+	void BVH::queryAABB(const AABB& region, std::vector<uint32_t>& out) const
+	{
+		query(out,
+			[&region](const AABB& box) {
+				if (!region.overlaps(box)) return Frustum::Overlap::Outside;
+				const bool inside = glm::min(box.min, region.min) == region.min && glm::max(box.max, region.max) == region.max;
+				return inside ? Frustum::Overlap::Inside : Frustum::Overlap::Intersects;
+			},
+			[&region](const AABB& box) { return region.overlaps(box); });
+	}
+
+	void BVH::querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& out) const
+	{
+		const float radiusSquared = radius * radius;
+		query(out,
+			[&](const AABB& box) {
+				if (box.distanceSquared(center) > radiusSquared) return Frustum::Overlap::Outside;
+
+				// Inside when the corner furthest from the center is
+				const glm::vec3 furthest = glm::max(glm::abs(box.min - center), glm::abs(box.max - center));
+				return glm::dot(furthest, furthest) <= radiusSquared ? Frustum::Overlap::Inside : Frustum::Overlap::Intersects;
+			},
+			[&](const AABB& box) { return box.distanceSquared(center) <= radiusSquared; });
+	}
+
+	void BVH::queryRay(const glm::vec3& origin, const glm::vec3& direction, float tMax, std::vector<uint32_t>& out) const
+	{
+		const glm::vec3 invDirection = 1.f / direction;
+		auto crosses = [&](const AABB& box) {
+			float tEnter;
+			return box.intersectsRay(origin, invDirection, tMax, tEnter);
+		};
+
+		query(out,
+			[&](const AABB& box) { return crosses(box) ? Frustum::Overlap::Intersects : Frustum::Overlap::Outside; },
+			crosses);
+	}
+
+	/*
+	* Boxes of 0.5 to 4 units scattered through a 1000 unit cube, about what a large scene of props looks like
+	*/
+	void BVH::benchmark(uint32_t count, uint32_t runs)
+	{
+		using Clock = std::chrono::high_resolution_clock;
+		constexpr uint32_t QUERIES = 1000;
+
+		std::mt19937 random{ 1234 };
+		std::uniform_real_distribution<float> position{ -500.f, 500.f };
+		std::uniform_real_distribution<float> size{ 0.5f, 4.f };
+		std::uniform_real_distribution<float> unit{ -1.f, 1.f };
+
+		std::vector<AABB> boxes(count);
+		for (AABB& box : boxes)
+		{
+			const glm::vec3 center{ position(random), position(random), position(random) };
+			const glm::vec3 half = 0.5f * glm::vec3{ size(random), size(random), size(random) };
+			box = { center - half, center + half };
+		}
+
+		const uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+		ThreadPool pool;
+		pool.setThreadCount(threads);
+
+		BVH bvh;
+		const double serialMs = bestOf(runs, [&] { bvh.build(boxes); });
+		const double parallelMs = bestOf(runs, [&] { bvh.build(boxes, &pool); });
+
+		std::cout << "BVH over " << count << " boxes, " << bvh.nodeCount() << " nodes" << std::endl;
+		std::cout << "  build, 1 thread       " << serialMs << " ms" << std::endl;
+		std::cout << "  build, " << threads << " threads" << (threads < 10 ? "      " : "     ") << parallelMs << " ms" << std::endl;
+
+		// A query and the scan it replaces, over the same inputs, have to agree
+		auto compare = [&](const char* name, const std::function<void(uint32_t, std::vector<uint32_t>&)>& treeQuery, const std::function<bool(uint32_t, const AABB&)>& scanTest) {
+			std::vector<uint32_t> found, scanned;
+			size_t hits = 0;
+
+			const double treeMs = bestOf(runs, [&] {
+				hits = 0;
+				for (uint32_t q = 0; q < QUERIES; q++)
+				{
+					found.clear();
+					treeQuery(q, found);
+					hits += found.size();
+				}
+			});
+			const double scanMs = bestOf(runs, [&] {
+				for (uint32_t q = 0; q < QUERIES; q++)
+				{
+					scanned.clear();
+					for (uint32_t i = 0; i < count; i++)
+					{
+						if (scanTest(q, boxes[i])) scanned.push_back(i);
+					}
+				}
+			});
+
+			for (uint32_t q = 0; q < QUERIES; q++)
+			{
+				found.clear();
+				scanned.clear();
+				treeQuery(q, found);
+				for (uint32_t i = 0; i < count; i++)
+				{
+					if (scanTest(q, boxes[i])) scanned.push_back(i);
+				}
+				std::sort(found.begin(), found.end());
+				if (found != scanned) throw std::runtime_error(std::string("BVH ") + name + " query " + std::to_string(q) + " disagrees with the scan");
+			}
+
+			std::cout << "  " << name << " x" << QUERIES << ": " << treeMs << " ms, scan " << scanMs << " ms, "
+				<< scanMs / treeMs << "x, " << static_cast<double>(hits) / QUERIES << " found per query" << std::endl;
+		};
+
+		// Cameras anywhere in the cube looking anywhere, 60 degrees and 300 units deep
+		std::vector<Frustum> frusta(QUERIES);
+		std::vector<AABB> regions(QUERIES);
+		std::vector<glm::vec4> spheres(QUERIES);
+		std::vector<glm::vec3> origins(QUERIES), directions(QUERIES);
+		for (uint32_t q = 0; q < QUERIES; q++)
+		{
+			const glm::vec3 eye{ position(random), position(random), position(random) };
+			const glm::vec3 forward = glm::normalize(glm::vec3{ unit(random), unit(random), unit(random) } + glm::vec3(0.f, 0.f, 1e-3f));
+			const glm::vec3 up = std::abs(forward.y) < 0.99f ? glm::vec3{ 0.f, 1.f, 0.f } : glm::vec3{ 1.f, 0.f, 0.f };
+			frusta[q] = Frustum::fromMatrix(glm::perspective(glm::radians(60.f), 4.f / 3.f, 0.1f, 300.f) * glm::lookAt(eye, eye + forward, up));
+
+			const glm::vec3 corner{ position(random), position(random), position(random) };
+			regions[q] = { corner, corner + glm::vec3(20.f + 40.f * std::abs(unit(random))) };
+			spheres[q] = glm::vec4(position(random), position(random), position(random), 10.f + 30.f * std::abs(unit(random)));
+
+			origins[q] = { position(random), position(random), position(random) };
+			directions[q] = glm::normalize(glm::vec3{ unit(random), unit(random), unit(random) } + glm::vec3(0.f, 0.f, 1e-3f));
+		}
+
+		compare("frustum",
+			[&](uint32_t q, std::vector<uint32_t>& out) { bvh.queryFrustum(frusta[q], out); },
+			[&](uint32_t q, const AABB& box) { return frusta[q].testBox(box) != Frustum::Overlap::Outside; });
+		compare("aabb   ",
+			[&](uint32_t q, std::vector<uint32_t>& out) { bvh.queryAABB(regions[q], out); },
+			[&](uint32_t q, const AABB& box) { return regions[q].overlaps(box); });
+		compare("sphere ",
+			[&](uint32_t q, std::vector<uint32_t>& out) { bvh.querySphere(glm::vec3(spheres[q]), spheres[q].w, out); },
+			[&](uint32_t q, const AABB& box) { return box.distanceSquared(glm::vec3(spheres[q])) <= spheres[q].w * spheres[q].w; });
+		compare("ray    ",
+			[&](uint32_t q, std::vector<uint32_t>& out) { bvh.queryRay(origins[q], directions[q], 2000.f, out); },
+			[&](uint32_t q, const AABB& box) { float t; return box.intersectsRay(origins[q], 1.f / directions[q], 2000.f, t); });
+
+		// Nearest hit, with the boxes themselves as what's hit
+		{
+			auto boxHit = [&](const glm::vec3& origin, const glm::vec3& invDirection, uint32_t item, float tMax) {
+				float t;
+				return boxes[item].intersectsRay(origin, invDirection, tMax, t) ? t : tMax;
+			};
+
+			uint32_t hits = 0;
+			const double treeMs = bestOf(runs, [&] {
+				hits = 0;
+				for (uint32_t q = 0; q < QUERIES; q++)
+				{
+					float t = 2000.f;
+					const glm::vec3 invDirection = 1.f / directions[q];
+					if (bvh.raycast(origins[q], directions[q], t, [&](uint32_t item, float tMax) { return boxHit(origins[q], invDirection, item, tMax); }) != NONE) hits++;
+				}
+			});
+
+			for (uint32_t q = 0; q < QUERIES; q++)
+			{
+				const glm::vec3 invDirection = 1.f / directions[q];
+				float t = 2000.f;
+				bvh.raycast(origins[q], directions[q], t, [&](uint32_t item, float tMax) { return boxHit(origins[q], invDirection, item, tMax); });
+
+				float nearest = 2000.f;
+				for (uint32_t i = 0; i < count; i++) nearest = boxHit(origins[q], invDirection, i, nearest);
+				if (t != nearest) throw std::runtime_error("BVH raycast " + std::to_string(q) + " disagrees with the scan");
+			}
+
+			std::cout << "  nearest hit x" << QUERIES << ": " << treeMs << " ms, " << hits << " hit" << std::endl;
+		}
+
+		// A tenth of the boxes wander up to 20 units
+		std::uniform_int_distribution<uint32_t> pick{ 0, count - 1 };
+		std::vector<uint32_t> moved(count / 10);
+		for (uint32_t& item : moved) item = pick(random);
+
+		const auto refitStart = Clock::now();
+		for (uint32_t item : moved)
+		{
+			const glm::vec3 offset = 20.f * glm::vec3{ unit(random), unit(random), unit(random) };
+			boxes[item] = { boxes[item].min + offset, boxes[item].max + offset };
+			bvh.setBounds(item, boxes[item]);
+		}
+		bvh.refit();
+		const double refitMs = std::chrono::duration<double, std::milli>(Clock::now() - refitStart).count();
+
+		std::cout << "  refit " << moved.size() << " moved  " << refitMs << " ms, quality " << bvh.quality() << std::endl;
+
+		compare("aabb after refit",
+			[&](uint32_t q, std::vector<uint32_t>& out) { bvh.queryAABB(regions[q], out); },
+			[&](uint32_t q, const AABB& box) { return regions[q].overlaps(box); });
+	}
+
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "../Math/aveng_math.h"
+#include "../Utils/threadpool.h"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/*
+* Bounding volume hierarchy over a set of boxes, the items, each known by its index in the array it was
+* built from. Built top down with a binned surface area heuristic; the upper levels are split on the
+* calling thread and the subtrees below them built in parallel, on a pool the caller keeps.
+*
+* Items that move get their new box through setBounds() and refit() walks up from their leaves, so the
+* tree stays valid without a rebuild. It does get looser as things wander, quality() says by how much.
+*
+* Nodes sit in one array with both children of a node next to each other and always after their parent.
+* Every node covers a contiguous run of the item order, which lets a query take a whole subtree without
+* visiting it once the subtree is known to be inside.
+*/
+namespace aveng {
+
+	class BVH {
+
+	public:
+
+		static constexpr uint32_t NONE = ~0u;
+
+		// On the pool's threads when there is one and the set isn't small, else on the calling thread. Only
+		// one build at a time may use a pool.
+		void build(const std::vector<AABB>& bounds, ThreadPool* pool = nullptr);
+		void clear();
+
+		uint32_t itemCount() const { return static_cast<uint32_t>(bounds.size()); }
+		uint32_t nodeCount() const { return static_cast<uint32_t>(nodes.size()); }
+		const AABB& getBounds(uint32_t item) const { return bounds[item]; }
+
+		// Takes effect at the next refit()
+		void setBounds(uint32_t item, const AABB& box);
+		void refit();
+
+		// SAH cost now over its cost when built, 1 straight after a build. Worth rebuilding somewhere past 2.
+		float quality() const;
+
+		// Each appends the items it finds to out, in no particular order
+		void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& out) const;
+		void queryAABB(const AABB& region, std::vector<uint32_t>& out) const;
+		void querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& out) const;
+		void queryRay(const glm::vec3& origin, const glm::vec3& direction, float tMax, std::vector<uint32_t>& out) const;
+
+		/*
+		* Nearest hit along a ray. hit(item, t) is asked about items whose box the ray enters before t, the
+		* nearest hit so far, and returns where the ray really hits the item or something >= t if it doesn't.
+		* Nearer subtrees are visited first so most boxes behind a hit are never looked at.
+		*
+		* Returns the item hit, or NONE, and t the distance to it. t goes in as the furthest to look.
+		*/
+		template<typename Hit>
+		uint32_t raycast(const glm::vec3& origin, const glm::vec3& direction, float& t, Hit&& hit) const
+		{
+			uint32_t nearest = NONE;
+			if (nodes.empty()) return nearest;
+
+			const glm::vec3 invDirection = 1.f / direction;
+			uint32_t stack[MAX_DEPTH];
+			uint32_t top = 0;
+
+			float tEnter;
+			if (!nodes[0].box().intersectsRay(origin, invDirection, t, tEnter)) return nearest;
+			stack[top++] = 0;
+
+			while (top > 0)
+			{
+				const Node& node = nodes[stack[--top]];
+
+				// Pushed when it was nearer than the best so far, which may have moved since
+				if (!node.box().intersectsRay(origin, invDirection, t, tEnter)) continue;
+
+				if (node.left == 0)
+				{
+					for (uint32_t i = node.first; i < node.first + node.count; i++)
+					{
+						const uint32_t item = order[i];
+						if (!bounds[item].intersectsRay(origin, invDirection, t, tEnter)) continue;
+
+						const float tHit = hit(item, t);
+						if (tHit < t)
+						{
+							t = tHit;
+							nearest = item;
+						}
+					}
+					continue;
+				}
+
+				float tLeft, tRight;
+				const bool left = nodes[node.left].box().intersectsRay(origin, invDirection, t, tLeft);
+				const bool right = nodes[node.left + 1].box().intersectsRay(origin, invDirection, t, tRight);
+
+				// The nearer child goes on top
+				if (left && right)
+				{
+					const bool leftFirst = tLeft <= tRight;
+					stack[top++] = leftFirst ? node.left + 1 : node.left;
+					stack[top++] = leftFirst ? node.left : node.left + 1;
+				}
+				else if (left) {
+					stack[top++] = node.left;
+				}
+				else if (right) {
+					stack[top++] = node.left + 1;
+				}
+			}
+
+			return nearest;
+		}
+
+		/*
+		* Times building, refitting and the queries above against scanning every box, on count random boxes,
+		* and checks every query finds what the scan does. Prints as it goes, throws std::runtime_error if a
+		* query disagrees with the scan.
+		*/
+		static void benchmark(uint32_t count = 100000, uint32_t runs = 5);
+
+	private:
+
+		// Past MEDIAN_DEPTH every split halves its items, so no tree is deeper than MEDIAN_DEPTH + 32. A walk
+		// pushes both children of each node it opens, its stack never holds more than the depth plus one.
+		static constexpr uint32_t MEDIAN_DEPTH = 48;
+		static constexpr uint32_t MAX_DEPTH = 96;
+
+		// Items a leaf may hold, splits are made past this even when the SAH would rather not
+		static constexpr uint32_t MAX_LEAF = 4;
+
+		struct Node {
+			glm::vec3 min;
+			uint32_t first;			// Items order[first, first + count), for inner nodes too
+			glm::vec3 max;
+			uint32_t count;
+			uint32_t left;			// 0 for a leaf, else the left child with the right one after it
+
+			AABB box() const { return { min, max }; }
+			void setBox(const AABB& b) { min = b.min; max = b.max; }
+		};
+
+		// An item as the build sees it, so a split reads the items it's splitting one after another
+		struct BuildRef {
+			AABB box;
+			glm::vec3 center;
+			uint32_t item;
+		};
+
+		// Some of the order waiting to become a subtree
+		struct Range {
+			uint32_t node;
+			uint32_t depth;
+		};
+
+		// Over order[first, first + count), from the build refs or the item bounds
+		Node makeNode(uint32_t first, uint32_t count) const;
+		AABB rangeBounds(uint32_t first, uint32_t count) const;
+
+		// Reorders node's refs and returns how many go left, or 0 to make a leaf
+		uint32_t split(const Node& node, uint32_t depth);
+
+		// Splits nodes[root] all the way down within nodes, root at the given depth
+		void buildSubtree(std::vector<Node>& into, uint32_t root, uint32_t depth);
+
+		float cost() const;
+
+		// Each query is a walk over the nodes deciding, per node, to skip it, take everything under it or look closer
+		template<typename Test, typename TestItem>
+		void query(std::vector<uint32_t>& out, Test&& test, TestItem&& testItem) const;
+
+		std::vector<Node> nodes;
+		std::vector<uint32_t> parents;		// Per node, NONE for the root
+		std::vector<AABB> bounds;			// Per item
+		std::vector<BuildRef> refs;			// In the order's order, only while building
+		std::vector<uint32_t> order;		// Items, leaves point into this
+		std::vector<uint32_t> itemLeaf;		// Per item
+		std::vector<uint32_t> dirty;		// Leaves to refit
+		std::vector<uint8_t> dirtyLeaf;		// Per node, so a leaf is queued once
+
+		float builtCost = 0.f;
+
+	};
+
+}
@@ -0,0 +1,328 @@
+#include "Broadphase.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+namespace aveng {
+
+	namespace {
+
+		// Below this many a thread costs more than it saves
+		constexpr uint32_t PARALLEL_MIN = 4096;
+
+		// Keeps cell coordinates well inside int32_t however far out something wanders
+		constexpr float MAX_CELL = 1e9f;
+
+		int32_t cellOf(float v, float invCellSize)
+		{
+			return static_cast<int32_t>(std::floor(std::min(std::max(v * invCellSize, -MAX_CELL), MAX_CELL)));
+		}
+
+	}
+
+	Broadphase::Broadphase(float cellSize, uint32_t threads) : cellSize{ cellSize }
+	{
+		threadCount = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+		if (threadCount > 1) pool.setThreadCount(threadCount);
+		chunkPairs.resize(threadCount);
+	}
+
+	Broadphase::Handle Broadphase::add(const TransformComponent& transform, float radius)
+	{
+		if (!freeHandles.empty())
+		{
+			const Handle handle = freeHandles.back();
+			freeHandles.pop_back();
+			transforms[handle] = &transform;
+			radii[handle] = radius;
+			alive[handle] = 1;
+			return handle;
+		}
+
+		transforms.push_back(&transform);
+		radii.push_back(radius);
+		alive.push_back(1);
+		return static_cast<Handle>(transforms.size() - 1);
+	}
+
+	void Broadphase::remove(Handle handle)
+	{
+		transforms[handle] = nullptr;
+		alive[handle] = 0;
+		freeHandles.push_back(handle);
+	}
+
+	template<typename Fn>
+	void Broadphase::parallelFor(uint32_t count, Fn&& fn)
+	{
+		if (threadCount <= 1 || count < PARALLEL_MIN)
+		{
+			fn(0u, count, 0u);
+			return;
+		}
+
+		for (uint32_t c = 0; c < threadCount; c++)
+		{
+			const uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(count) * c / threadCount);
+			const uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(count) * (c + 1) / threadCount);
+			pool.threads[c]->addJob([&fn, begin, end, c] { fn(begin, end, c); });
+		}
+		pool.wait();
+	}
+
+	uint32_t Broadphase::bucketOf(int32_t cx, int32_t cy, int32_t cz) const
+	{
+		return (static_cast<uint32_t>(cx) * 73856093u ^ static_cast<uint32_t>(cy) * 19349663u ^ static_cast<uint32_t>(cz) * 83492791u) & bucketMask;
+	}
+
+	bool Broadphase::overlaps(Handle i, Handle j) const
+	{
+		const float reach = r[i] + r[j];
+		const float dx = x[j] - x[i];
+		const float dy = y[j] - y[i];
+		const float dz = z[j] - z[i];
+
+		return x[j] - r[j] <= x[i] + r[i] && x[i] - r[i] <= x[j] + r[j]
+			&& y[j] - r[j] <= y[i] + r[i] && y[i] - r[i] <= y[j] + r[j]
+			&& z[j] - r[j] <= z[i] + r[i] && z[i] - r[i] <= z[j] + r[j]
+			&& dx * dx + dy * dy + dz * dz <= reach * reach;
+	}
+
+	void Broadphase::update()
+	{
+		const uint32_t count = static_cast<uint32_t>(transforms.size());
+		const float invCellSize = 1.f / cellSize;
+
+		for (auto* v : { &x, &y, &z, &r }) v->resize(count);
+		for (auto* v : { &loX, &loY, &loZ, &hiX, &hiY, &hiZ }) v->resize(count);
+		entryCount.resize(count);
+		entryOffset.resize(count);
+
+		// Every sphere and the block of cells its box covers
+		parallelFor(count, [&](uint32_t begin, uint32_t end, uint32_t) {
+			for (Handle h = begin; h < end; h++)
+			{
+				entryCount[h] = 0;
+				if (!alive[h]) continue;
+
+				const TransformComponent& transform = *transforms[h];
+				const glm::vec3 scale = glm::abs(transform.scale);
+				x[h] = transform.translation.x;
+				y[h] = transform.translation.y;
+				z[h] = transform.translation.z;
+				r[h] = radii[h] * std::max(scale.x, std::max(scale.y, scale.z));
+
+				loX[h] = cellOf(x[h] - r[h], invCellSize);
+				loY[h] = cellOf(y[h] - r[h], invCellSize);
+				loZ[h] = cellOf(z[h] - r[h], invCellSize);
+				hiX[h] = cellOf(x[h] + r[h], invCellSize);
+				hiY[h] = cellOf(y[h] + r[h], invCellSize);
+				hiZ[h] = cellOf(z[h] + r[h], invCellSize);
+
+				const uint64_t cells = static_cast<uint64_t>(hiX[h] - loX[h] + 1) * (hiY[h] - loY[h] + 1) * (hiZ[h] - loZ[h] + 1);
+				entryCount[h] = cells <= MAX_CELLS ? static_cast<uint32_t>(cells) : 0;
+			}
+		});
+
+		large.clear();
+		uint32_t entries = 0;
+		for (Handle h = 0; h < count; h++)
+		{
+			if (alive[h] && entryCount[h] == 0) large.push_back(h);
+			entryOffset[h] = entries;
+			entries += entryCount[h];
+		}
+
+		// Twice the entries, so most occupied buckets hold one cell
+		uint32_t bucketCount = 64;
+		while (bucketCount < 2 * entries) bucketCount <<= 1;
+		bucketMask = bucketCount - 1;
+
+		entryBucket.resize(entries);
+		entryHandle.resize(entries);
+		parallelFor(count, [&](uint32_t begin, uint32_t end, uint32_t) {
+			for (Handle h = begin; h < end; h++)
+			{
+				if (entryCount[h] == 0) continue;
+
+				uint32_t e = entryOffset[h];
+				for (int32_t cx = loX[h]; cx <= hiX[h]; cx++)
+				{
+					for (int32_t cy = loY[h]; cy <= hiY[h]; cy++)
+					{
+						for (int32_t cz = loZ[h]; cz <= hiZ[h]; cz++)
+						{
+							entryBucket[e] = bucketOf(cx, cy, cz);
+							entryHandle[e] = h;
+							e++;
+						}
+					}
+				}
+			}
+		});
+
+		// Counting sort into cell order. Entries are scattered in order, so each bucket's stay in handle order.
+		cellStart.assign(bucketCount + 1, 0);
+		for (uint32_t e = 0; e < entries; e++) cellStart[entryBucket[e] + 1]++;
+		for (uint32_t b = 0; b < bucketCount; b++) cellStart[b + 1] += cellStart[b];
+
+		cellHandle.resize(entries);
+		for (auto* v : { &cellX, &cellY, &cellZ, &cellR }) v->resize(entries);
+		cellCursor.assign(cellStart.begin(), cellStart.end() - 1);
+		for (uint32_t e = 0; e < entries; e++)
+		{
+			const Handle h = entryHandle[e];
+			const uint32_t slot = cellCursor[entryBucket[e]]++;
+			cellHandle[slot] = h;
+			cellX[slot] = x[h];
+			cellY[slot] = y[h];
+			cellZ[slot] = z[h];
+			cellR[slot] = r[h];
+		}
+
+		for (std::vector<Pair>& chunk : chunkPairs) chunk.clear();
+
+		// Within a bucket a sphere can appear more than once when two of its cells hash together, the repeats are next to each other
+		parallelFor(bucketCount, [&](uint32_t begin, uint32_t end, uint32_t chunk) {
+			std::vector<Pair>& out = chunkPairs[chunk];
+			for (uint32_t b = begin; b < end; b++)
+			{
+				const uint32_t first = cellStart[b];
+				const uint32_t last = cellStart[b + 1];
+				for (uint32_t i = first; i + 1 < last; i++)
+				{
+					const Handle hi = cellHandle[i];
+					if (i > first && cellHandle[i - 1] == hi) continue;
+
+					for (uint32_t j = i + 1; j < last; j++)
+					{
+						const Handle hj = cellHandle[j];
+						if (cellHandle[j - 1] == hj) continue;
+
+						// Cheap reject on the cell's own copy before touching the per handle arrays
+						const float reach = cellR[i] + cellR[j];
+						const float dx = cellX[j] - cellX[i];
+						const float dy = cellY[j] - cellY[i];
+						const float dz = cellZ[j] - cellZ[i];
+						if (dx * dx + dy * dy + dz * dz > reach * reach) continue;
+						if (!overlaps(hi, hj)) continue;
+
+						// Only from the cell at the low corner of where the two boxes overlap
+						if (bucketOf(std::max(loX[hi], loX[hj]), std::max(loY[hi], loY[hj]), std::max(loZ[hi], loZ[hj])) != b) continue;
+
+						out.push_back({ hi, hj });
+					}
+				}
+			}
+		});
+
+		// Handles are in order within a bucket, so hi < hj above. The big ones against everything:
+		std::vector<Pair>& out = chunkPairs[0];
+		for (Handle l : large)
+		{
+			for (Handle h = 0; h < count; h++)
+			{
+				if (!alive[h] || h == l) continue;
+				if (entryCount[h] == 0 && h < l) continue;		// Both big, found from h's side
+				if (overlaps(l, h)) out.push_back({ std::min(l, h), std::max(l, h) });
+			}
+		}
+
+		pairs.clear();
+		for (const std::vector<Pair>& chunk : chunkPairs) pairs.insert(pairs.end(), chunk.begin(), chunk.end());
+	}
+
+	void Broadphase::bruteForce(std::vector<Pair>& out) const
+	{
+		out.clear();
+		const uint32_t count = static_cast<uint32_t>(transforms.size());
+		for (Handle i = 0; i < count; i++)
+		{
+			if (!alive[i]) continue;
+			for (Handle j = i + 1; j < count; j++)
+			{
+				if (alive[j] && overlaps(i, j)) out.push_back({ i, j });
+			}
+		}
+	}
+
+	/*
+	* Spheres of radius 0.25 to 1 at about one per 16 cubic units, the density holding however many there are,
+	* each drifting up to half a unit a frame. A few big ones go through the slow path too.
+	*/
+	void Broadphase::benchmark(uint32_t count, uint32_t frames)
+	{
+		using Clock = std::chrono::high_resolution_clock;
+
+		const float side = std::cbrt(16.f * count);
+		std::mt19937 random{ 1234 };
+		std::uniform_real_distribution<float> position{ 0.f, side };
+		std::uniform_real_distribution<float> radius{ 0.25f, 1.f };
+		std::uniform_real_distribution<float> drift{ -0.5f, 0.5f };
+
+		std::vector<TransformComponent> transforms(count);
+		std::vector<float> radii(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			transforms[i].translation = { position(random), position(random), position(random) };
+			radii[i] = i % 1000 == 999 ? 10.f : radius(random);
+		}
+
+		const uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+		Broadphase serial{ 2.f, 1 };
+		Broadphase parallel{ 2.f, threads };
+		for (uint32_t i = 0; i < count; i++)
+		{
+			serial.add(transforms[i], radii[i]);
+			parallel.add(transforms[i], radii[i]);
+		}
+
+		double serialMs = 0.0, parallelMs = 0.0, bruteMs = 0.0;
+		size_t pairCount = 0;
+		std::vector<Pair> grid, brute;
+
+		for (uint32_t frame = 0; frame < frames; frame++)
+		{
+			for (TransformComponent& transform : transforms)
+			{
+				transform.translation += glm::vec3{ drift(random), drift(random), drift(random) };
+			}
+
+			auto start = Clock::now();
+			serial.update();
+			serialMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			start = Clock::now();
+			parallel.update();
+			parallelMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			start = Clock::now();
+			serial.bruteForce(brute);
+			bruteMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			for (const Broadphase* broadphase : { &serial, &parallel })
+			{
+				grid = broadphase->getPairs();
+				std::sort(grid.begin(), grid.end());
+				if (grid != brute)
+				{
+					throw std::runtime_error("Broadphase frame " + std::to_string(frame) + ": " + std::to_string(grid.size())
+						+ " pairs from the grid, " + std::to_string(brute.size()) + " by brute force");
+				}
+			}
+			pairCount += brute.size();
+		}
+
+		std::cout << "Broadphase: " << count << " spheres, " << frames << " frames, "
+			<< static_cast<double>(pairCount) / frames << " pairs a frame, all matching brute force" << std::endl;
+		std::cout << "  grid, 1 thread        " << serialMs / frames << " ms a frame" << std::endl;
+		std::cout << "  grid, " << threads << " threads" << (threads < 10 ? "      " : "     ") << parallelMs / frames << " ms a frame" << std::endl;
+		std::cout << "  brute force           " << bruteMs / frames << " ms a frame, " << bruteMs / serialMs << "x" << std::endl;
+	}
+
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "../Scene/AvengComponent.h"
+#include "../Utils/threadpool.h"
+
+#include <cstdint>
+#include <vector>
+
+/*
+* Which registered spheres touch, without testing every pair. Each frame the spheres are dropped into the
+* cells of a uniform grid they overlap, the grid hashed into a table sized for the frame, and only spheres
+* sharing a cell are tested, so the work goes with how crowded the neighbourhood is rather than with n^2.
+* A pair sharing several cells is only reported from the one holding the low corner of where their boxes
+* overlap.
+*
+* Cells are stored as structure of arrays, the spheres of one cell next to each other, so the pair tests
+* stream through memory. Binning and pair tests run on the pool's threads; the one serial step is the
+* counting sort putting entries in cell order.
+*
+* Spheres too big for the grid (more than MAX_CELLS cells) skip it and are tested against everything.
+*/
+namespace aveng {
+
+	class Broadphase {
+
+	public:
+
+		using Handle = uint32_t;
+
+		struct Pair {
+			Handle a;		// a < b
+			Handle b;
+
+			bool operator==(const Pair& p) const { return a == p.a && b == p.b; }
+			bool operator<(const Pair& p) const { return a != p.a ? a < p.a : b < p.b; }
+		};
+
+		// cellSize around the diameter of a typical sphere. threads 0 for one per hardware thread.
+		explicit Broadphase(float cellSize = 2.f, uint32_t threads = 1);
+
+		Broadphase(const Broadphase&) = delete;
+		Broadphase& operator=(const Broadphase&) = delete;
+
+		/*
+		* The sphere around transform.translation of radius times the largest of transform.scale. The transform
+		* is read at every update() and has to stay where it is until the handle is removed.
+		*/
+		Handle add(const TransformComponent& transform, float radius);
+		void remove(Handle handle);
+		void setRadius(Handle handle, float radius) { radii[handle] = radius; }
+
+		uint32_t size() const { return static_cast<uint32_t>(transforms.size() - freeHandles.size()); }
+		float getCellSize() const { return cellSize; }
+		void setCellSize(float size) { cellSize = size; }
+
+		// Reads every transform and finds the pairs, getPairs() has them until the next update
+		void update();
+		const std::vector<Pair>& getPairs() const { return pairs; }
+
+		// The pairs update() found last, by testing every sphere against every other
+		void bruteForce(std::vector<Pair>& out) const;
+
+		/*
+		* count spheres wandering a cube over a number of frames, each frame's pairs checked against
+		* bruteForce(). Prints the times, throws std::runtime_error if the two ever disagree.
+		*/
+		static void benchmark(uint32_t count = 20000, uint32_t frames = 10);
+
+	private:
+
+		static constexpr uint32_t MAX_CELLS = 64;
+
+		// Touching spheres whose boxes overlap too, so rounding can't make the grid and the brute force disagree
+		bool overlaps(Handle i, Handle j) const;
+
+		uint32_t bucketOf(int32_t x, int32_t y, int32_t z) const;
+
+		// fn(begin, end, chunk) over [0, count), a chunk per thread
+		template<typename Fn>
+		void parallelFor(uint32_t count, Fn&& fn);
+
+		float cellSize;
+		uint32_t threadCount;
+		ThreadPool pool;
+
+		// Per handle, as registered
+		std::vector<const TransformComponent*> transforms;
+		std::vector<float> radii;
+		std::vector<uint8_t> alive;
+		std::vector<Handle> freeHandles;
+
+		// Per handle, this frame's sphere and the cells its box covers
+		std::vector<float> x, y, z, r;
+		std::vector<int32_t> loX, loY, loZ, hiX, hiY, hiZ;
+		std::vector<uint32_t> entryCount, entryOffset;
+		std::vector<Handle> large;
+
+		// Per entry, a sphere in a cell, in handle order
+		std::vector<uint32_t> entryBucket;
+		std::vector<Handle> entryHandle;
+
+		// The cells, each bucket's entries [cellStart[b], cellStart[b + 1]) in handle order
+		uint32_t bucketMask = 0;
+		std::vector<uint32_t> cellStart;
+		std::vector<uint32_t> cellCursor;		// Where the sort puts each bucket's next entry
+		std::vector<Handle> cellHandle;
+		std::vector<float> cellX, cellY, cellZ, cellR;
+
+		std::vector<std::vector<Pair>> chunkPairs;
+		std::vector<Pair> pairs;
+
+	};
+
+}
@@ -0,0 +1,161 @@
+#include "TriangleBVH.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+namespace aveng {
+
+	void TriangleBVH::build(std::vector<glm::vec3> trianglePositions, std::vector<uint32_t> triangleIndices, ThreadPool* pool)
+	{
+		positions = std::move(trianglePositions);
+		indices = std::move(triangleIndices);
+		indices.resize(indices.size() / 3 * 3);
+
+		std::vector<AABB> boxes(triangleCount());
+		bounds = AABB{};
+		for (uint32_t i = 0; i < triangleCount(); i++)
+		{
+			AABB& box = boxes[i];
+			box.grow(positions[indices[3 * i]]);
+			box.grow(positions[indices[3 * i + 1]]);
+			box.grow(positions[indices[3 * i + 2]]);
+			bounds.grow(box);
+		}
+
+		bvh.build(boxes, pool);
+	}
+
+	float TriangleBVH::intersect(uint32_t triangle, const glm::vec3& origin, const glm::vec3& direction, float tMax) const
+	{
+		const glm::vec3& a = positions[indices[3 * triangle]];
+		const glm::vec3 ab = positions[indices[3 * triangle + 1]] - a;
+		const glm::vec3 ac = positions[indices[3 * triangle + 2]] - a;
+
+		// Both faces count, a pick shouldn't go through a mesh seen from inside
+		const glm::vec3 p = glm::cross(direction, ac);
+		const float det = glm::dot(ab, p);
+		if (std::abs(det) < 1e-12f) return tMax;
+
+		const float invDet = 1.f / det;
+		const glm::vec3 s = origin - a;
+		const float u = glm::dot(s, p) * invDet;
+		if (u < 0.f || u > 1.f) return tMax;
+
+		const glm::vec3 q = glm::cross(s, ab);
+		const float v = glm::dot(direction, q) * invDet;
+		if (v < 0.f || u + v > 1.f) return tMax;
+
+		const float t = glm::dot(ac, q) * invDet;
+		return t >= 0.f && t < tMax ? t : tMax;
+	}
+
+	uint32_t TriangleBVH::raycast(const glm::vec3& origin, const glm::vec3& direction, float& t) const
+	{
+		return bvh.raycast(origin, direction, t, [&](uint32_t triangle, float tMax) {
+			return intersect(triangle, origin, direction, tMax);
+		});
+	}
+
+	uint32_t TriangleBVH::raycastAll(const glm::vec3& origin, const glm::vec3& direction, float& t) const
+	{
+		uint32_t nearest = NONE;
+		for (uint32_t i = 0; i < triangleCount(); i++)
+		{
+			const float tHit = intersect(i, origin, direction, t);
+			if (tHit < t)
+			{
+				t = tHit;
+				nearest = i;
+			}
+		}
+		return nearest;
+	}
+
+	void TriangleBVH::benchmark(uint32_t count, uint32_t rays)
+	{
+		using Clock = std::chrono::high_resolution_clock;
+
+		// A unit sphere of stacks * slices * 2 triangles, slices twice the stacks
+		const uint32_t stacks = std::max(2u, static_cast<uint32_t>(std::sqrt(count / 4.f)));
+		const uint32_t slices = 2 * stacks;
+
+		std::vector<glm::vec3> positions;
+		positions.reserve((stacks + 1) * (slices + 1));
+		for (uint32_t i = 0; i <= stacks; i++)
+		{
+			const float theta = glm::pi<float>() * i / stacks;
+			for (uint32_t j = 0; j <= slices; j++)
+			{
+				const float phi = glm::two_pi<float>() * j / slices;
+				positions.push_back({ std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) });
+			}
+		}
+
+		std::vector<uint32_t> indices;
+		indices.reserve(6 * stacks * slices);
+		for (uint32_t i = 0; i < stacks; i++)
+		{
+			for (uint32_t j = 0; j < slices; j++)
+			{
+				const uint32_t a = i * (slices + 1) + j;
+				const uint32_t b = a + slices + 1;
+				indices.insert(indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+			}
+		}
+
+		ThreadPool pool;
+		pool.setThreadCount(std::max(1u, std::thread::hardware_concurrency()));
+
+		TriangleBVH mesh;
+		const auto buildStart = Clock::now();
+		mesh.build(std::move(positions), std::move(indices), &pool);
+		const double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - buildStart).count();
+
+		// From a shell around the sphere towards somewhere near it, so some miss
+		std::mt19937 random{ 1234 };
+		std::uniform_real_distribution<float> unit{ -1.f, 1.f };
+		auto somewhere = [&](float radius) {
+			return radius * glm::normalize(glm::vec3{ unit(random), unit(random), unit(random) } + glm::vec3(0.f, 0.f, 1e-3f));
+		};
+
+		std::vector<glm::vec3> origins(rays), directions(rays);
+		for (uint32_t r = 0; r < rays; r++)
+		{
+			origins[r] = somewhere(3.f);
+			directions[r] = glm::normalize(somewhere(1.2f * std::abs(unit(random))) - origins[r]);
+		}
+
+		std::vector<float> treeT(rays, 10.f), allT(rays, 10.f);
+		uint32_t hits = 0;
+
+		const auto treeStart = Clock::now();
+		for (uint32_t r = 0; r < rays; r++)
+		{
+			if (mesh.raycast(origins[r], directions[r], treeT[r]) != NONE) hits++;
+		}
+		const double treeMs = std::chrono::duration<double, std::milli>(Clock::now() - treeStart).count();
+
+		// Testing everything is slow enough that a hundred rays make the point
+		const uint32_t scanned = std::min(rays, 100u);
+		const auto scanStart = Clock::now();
+		for (uint32_t r = 0; r < scanned; r++) mesh.raycastAll(origins[r], directions[r], allT[r]);
+		const double scanMs = std::chrono::duration<double, std::milli>(Clock::now() - scanStart).count() * rays / std::max(scanned, 1u);
+
+		// The same test on the same triangles, so the distances match exactly. Neighbours sharing an edge may
+		// both be hit, so which of them is reported may not.
+		for (uint32_t r = 0; r < scanned; r++)
+		{
+			if (treeT[r] != allT[r]) throw std::runtime_error("TriangleBVH ray " + std::to_string(r) + " disagrees with testing every triangle");
+		}
+
+		std::cout << "TriangleBVH over " << mesh.triangleCount() << " triangles, built in " << buildMs << " ms" << std::endl;
+		std::cout << "  " << rays << " rays, " << hits << " hits: " << treeMs << " ms (" << 1000.0 * treeMs / rays << " us per ray), every triangle "
+			<< scanMs << " ms, " << scanMs / treeMs << "x" << std::endl;
+	}
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "BVH.h"
+
+#include <cstdint>
+#include <vector>
+
+/*
+* A mesh's triangles kept on the CPU under a BVH (Core/Spatial/BVH.h) over their boxes, for asking where a
+* ray first meets the surface without testing every triangle. Everything is in the space the positions were
+* given in, which for a model is model space; rays from elsewhere have to be brought over first.
+*/
+namespace aveng {
+
+	class TriangleBVH {
+
+	public:
+
+		static constexpr uint32_t NONE = BVH::NONE;
+
+		// Every three indices a triangle. On the pool's threads when there is one, see BVH::build.
+		void build(std::vector<glm::vec3> positions, std::vector<uint32_t> indices, ThreadPool* pool = nullptr);
+
+		uint32_t triangleCount() const { return static_cast<uint32_t>(indices.size() / 3); }
+		uint32_t vertexCount() const { return static_cast<uint32_t>(positions.size()); }
+		const AABB& getBounds() const { return bounds; }
+
+		/*
+		* The nearest triangle the ray hits, or NONE. direction needn't be normalized, t is in its units:
+		* the hit is at origin + t * direction. t goes in as the furthest to look and comes out as the hit.
+		*/
+		uint32_t raycast(const glm::vec3& origin, const glm::vec3& direction, float& t) const;
+
+		// The same by testing every triangle
+		uint32_t raycastAll(const glm::vec3& origin, const glm::vec3& direction, float& t) const;
+
+		/*
+		* Builds a sphere of about count triangles and casts rays at it, through the tree and by testing
+		* every triangle. Prints both times, throws std::runtime_error if they ever find different hits.
+		*/
+		static void benchmark(uint32_t count = 1000000, uint32_t rays = 10000);
+
+	private:
+
+		// Moller-Trumbore. Where the ray meets the triangle, or tMax if it doesn't before then.
+		float intersect(uint32_t triangle, const glm::vec3& origin, const glm::vec3& direction, float tMax) const;
+
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+		AABB bounds;
+		BVH bvh;
+
+	};
+
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+/*
+* Timing for the --bench-* runs. The best of several runs rather than the mean, so one run that lost
+* its core to something else doesn't count against what's being measured.
+*/
+namespace aveng {
+
+	// Milliseconds the fastest of runs calls to work took. Always runs it at least once.
+	template<typename Work>
+	double bestOf(uint32_t runs, Work&& work)
+	{
+		using Clock = std::chrono::high_resolution_clock;
+
+		double best = std::numeric_limits<double>::max();
+		for (uint32_t run = 0; run < std::max(runs, 1u); run++)
+		{
+			const auto start = Clock::now();
+			work();
+			best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+		return best;
+	}
+
+}
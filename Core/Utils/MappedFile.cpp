@@ -0,0 +1,95 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace aveng {
+
+#ifdef _WIN32
+
+	MappedFile::MappedFile(const std::string& filepath)
+	{
+		HANDLE handle = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (handle == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error("Failed to open " + filepath);
+		}
+		file = handle;
+
+		LARGE_INTEGER fileSize{};
+		if (!GetFileSizeEx(handle, &fileSize))
+		{
+			CloseHandle(handle);
+			throw std::runtime_error("Failed to get the size of " + filepath);
+		}
+		length = static_cast<size_t>(fileSize.QuadPart);
+
+		// A mapping of nothing is an error, an empty file simply has no view
+		if (length == 0) return;
+
+		mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping != nullptr) view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (view == nullptr)
+		{
+			if (mapping != nullptr) CloseHandle(mapping);
+			CloseHandle(handle);
+			throw std::runtime_error("Failed to map " + filepath);
+		}
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (view != nullptr) UnmapViewOfFile(view);
+		if (mapping != nullptr) CloseHandle(mapping);
+		if (file != nullptr) CloseHandle(file);
+	}
+
+#else
+
+	MappedFile::MappedFile(const std::string& filepath)
+	{
+		file = open(filepath.c_str(), O_RDONLY);
+		if (file < 0)
+		{
+			throw std::runtime_error("Failed to open " + filepath);
+		}
+
+		struct stat info{};
+		if (fstat(file, &info) != 0)
+		{
+			close(file);
+			throw std::runtime_error("Failed to get the size of " + filepath);
+		}
+		length = static_cast<size_t>(info.st_size);
+
+		if (length == 0) return;
+
+		void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+		if (address == MAP_FAILED)
+		{
+			close(file);
+			throw std::runtime_error("Failed to map " + filepath);
+		}
+		view = static_cast<const char*>(address);
+		madvise(address, length, MADV_SEQUENTIAL);
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (view != nullptr) munmap(const_cast<char*>(view), length);
+		if (file >= 0) close(file);
+	}
+
+#endif
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/*
+* A file mapped read only into memory, for readers that would rather scan it in place than copy it
+* into a buffer first. Throws std::runtime_error if the file can't be opened or mapped.
+*/
+namespace aveng {
+
+	class MappedFile {
+	public:
+
+		explicit MappedFile(const std::string& filepath);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const char* data() const { return view; }
+		size_t size() const { return length; }
+
+	private:
+
+		const char* view = nullptr;		// nullptr for an empty file
+		size_t length = 0;
+
+#ifdef _WIN32
+		void* file = nullptr;			// HANDLEs
+		void* mapping = nullptr;
+#else
+		int file = -1;
+#endif
+
+	};
+
+}
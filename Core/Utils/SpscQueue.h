@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace aveng {
+
+	/*
+	* Fixed size ring buffer for exactly one thread pushing and one thread popping, without locks. Each side
+	* only writes its own index, and reads the other's with acquire so the items it publishes are visible.
+	* The indices only ever grow, the slot is the index modulo Capacity.
+	*/
+	template<typename T, size_t Capacity>
+	class SpscQueue {
+
+		static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+	public:
+
+		// Producer. False, and nothing pushed, when the queue is full.
+		bool push(const T& item)
+		{
+			const size_t h = head.load(std::memory_order_relaxed);
+			if (h - tail.load(std::memory_order_acquire) == Capacity) return false;
+
+			items[h & (Capacity - 1)] = item;
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer. False when the queue is empty.
+		bool pop(T& item)
+		{
+			const size_t t = tail.load(std::memory_order_relaxed);
+			if (t == head.load(std::memory_order_acquire)) return false;
+
+			item = items[t & (Capacity - 1)];
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Either side, already out of date by the time it returns
+		size_t size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+	private:
+
+		// On lines of their own, so the two threads don't fight over one
+		alignas(64) std::atomic<size_t> head{ 0 };
+		alignas(64) std::atomic<size_t> tail{ 0 };
+		std::array<T, Capacity> items{};
+
+	};
+
+}
@@ -7,6 +7,7 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#include <memory>
 #include <vector>
 #include <thread>
 #include <queue>
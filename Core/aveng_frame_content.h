@@ -2,6 +2,9 @@
 
 #include "Camera/aveng_camera.h"
 #include "Scene/app_object.h"
+#include "Scene/ObjectIndex.h"
+#include "../CoreVK/FrameArena.h"
+#include "../CoreVK/MeshArena.h"
 
 namespace aveng {
 	struct FrameContent {
@@ -11,8 +14,12 @@ namespace aveng {
 		VkCommandBuffer commandBuffer;
 		AvengCamera& camera;
 		VkDescriptorSet globalDescriptorSet;
-		VkDescriptorSet fragDescriptorSet;
 		AvengAppObject::Map& appObjects;
+		FrameArena& frameArena;				// Already begun for this frame
+		uint32_t globalUboOffset;			// Dynamic offset of this frame's GlobalUbo, set 0 binding 0
+		MeshArena& meshArena;				// Geometry of every model, bound once per frame
+		VkExtent2D extent;					// Of the image being rendered, for anything sized in pixels
+		ObjectIndex& objectIndex;			// appObjects by where they are, up to date for this frame
 
 	};
 }
\ No newline at end of file
@@ -1,13 +1,26 @@
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdio>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <thread>
 #include <unordered_map>
 #include "aveng_model.h"
 #include "Utils/aveng_utils.h"
+#include "Utils/BenchTimer.h"
+#include "Geometry/MeshOptimizer.h"
+#include "Geometry/MeshSimplifier.h"
+#include "Geometry/ObjReader.h"
+#include "Geometry/VertexDedup.h"
+#include "Utils/threadpool.h"
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_object_loader.h>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 namespace std {
 
@@ -34,6 +47,108 @@ namespace aveng {
 		std::vector<tinyobj::material_t> materials;
 	};
 
+	namespace {
+
+		// The vertex at one corner of an OBJ face, zero wherever the file has nothing
+		AvengModel::Vertex objVertex(const tinyobj::attrib_t& attrib, const tinyobj::index_t& index)
+		{
+			AvengModel::Vertex vertex{};
+			if (index.vertex_index >= 0) 
+			{
+				vertex.position = {
+					attrib.vertices[3 * index.vertex_index + 0],
+					attrib.vertices[3 * index.vertex_index + 1],	// The calculations here just mean we're always looking at values in groups of 3
+					attrib.vertices[3 * index.vertex_index + 2],
+				};
+
+				vertex.color = {
+					attrib.colors[3 * index.vertex_index + 0],
+					attrib.colors[3 * index.vertex_index + 1],
+					attrib.colors[3 * index.vertex_index + 2],
+				};
+			}
+
+			if (index.normal_index >= 0) 
+			{
+				vertex.normal = {
+					attrib.normals[3 * index.normal_index + 0],
+					attrib.normals[3 * index.normal_index + 1],
+					attrib.normals[3 * index.normal_index + 2],
+				};
+			}
+
+			if (index.texcoord_index >= 0) 
+			{
+				vertex.texCoord = {
+					attrib.texcoords[2 * index.texcoord_index + 0],
+					attrib.texcoords[2 * index.texcoord_index + 1],
+				};
+			}
+
+			return vertex;
+		}
+
+		size_t cornerCount(const std::vector<tinyobj::shape_t>& shapes)
+		{
+			size_t corners = 0;
+			for (const auto& shape : shapes) corners += shape.mesh.indices.size();
+			return corners;
+		}
+
+		/*
+		* Every face corner becomes an index into the unique vertices, see VertexDedup. In parallel each shape
+		* is welded on a thread of its own and appended after the others, so a vertex two shapes have in
+		* common is stored once for each. What loadModel did with tinyobjloader's output, the benchmarks
+		* still measure against it.
+		*/
+		void weldVertices(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes, bool parallel, std::vector<AvengModel::Vertex>& vertices, std::vector<uint32_t>& indices)
+		{
+			vertices.clear();
+			indices.clear();
+			indices.reserve(cornerCount(shapes));
+
+			const uint32_t threads = std::min(std::thread::hardware_concurrency(), static_cast<uint32_t>(shapes.size()));
+			if (!parallel || threads < 2)
+			{
+				VertexDedup<AvengModel::Vertex> dedup{ indices.capacity() };
+				for (const auto& shape : shapes)
+				{
+					for (const auto& index : shape.mesh.indices) indices.push_back(dedup.insert(objVertex(attrib, index), vertices));
+				}
+				return;
+			}
+
+			struct Part {
+				std::vector<AvengModel::Vertex> vertices;
+				std::vector<uint32_t> indices;
+			};
+			std::vector<Part> parts(shapes.size());
+
+			ThreadPool pool;
+			pool.setThreadCount(threads);
+			for (size_t s = 0; s < shapes.size(); s++)
+			{
+				pool.threads[s % threads]->addJob([&attrib, &shapes, &parts, s] {
+					const auto& corners = shapes[s].mesh.indices;
+					Part& part = parts[s];
+					part.indices.reserve(corners.size());
+
+					VertexDedup<AvengModel::Vertex> dedup{ corners.size() };
+					for (const auto& index : corners) part.indices.push_back(dedup.insert(objVertex(attrib, index), part.vertices));
+				});
+			}
+			pool.wait();
+
+			for (const Part& part : parts)
+			{
+				const uint32_t base = static_cast<uint32_t>(vertices.size());
+				vertices.insert(vertices.end(), part.vertices.begin(), part.vertices.end());
+				for (uint32_t index : part.indices) indices.push_back(base + index);
+			}
+		}
+
+	}
+
 	//AvengModel::AvengModel(EngineDevice& device, const AvengModel::Builder& builder) 
 	//	: engineDevice{ device }
 	//{
@@ -41,25 +156,96 @@ namespace aveng {
 	//	createIndexBuffers(builder.indices);
 	//}
 
-	AvengModel::AvengModel(EngineDevice& device, std::vector<AvengModel::Vertex> vertices, std::vector<uint32_t> indices)
-		: engineDevice{ device }
+	AvengModel::AvengModel(EngineDevice& device, MeshArena& arena, const std::vector<AvengModel::Vertex>& vertices, std::vector<uint32_t> indices, const std::string& key)
+		: engineDevice{ device }, arena{ arena }
+	{
+		computeBoundingSphere(vertices);
+		storedBoundingSphere = boundingSphere;
+		place(vertices.data(), static_cast<uint32_t>(vertices.size()), std::move(indices), key);
+	}
+
+	AvengModel::AvengModel(EngineDevice& device, MeshArena& arena, const AvengModel::Builder& builder, const std::string& key)
+		: engineDevice{ device }, arena{ arena }, format{ builder.format }, lods{ builder.lods }
 	{
-		createVertexBuffers(vertices); // The vertex shader takes input from a vertex buffer from `layout(location = n) in vec3 vertexAttribute`. The vertexAttribute is defined by the vertex Buffer
-		createIndexBuffers(indices);
+		computeBoundingSphere(builder.vertices);
+		storedBoundingSphere = boundingSphere;
+
+		if (format == VertexFormat::Packed)
+		{
+			const glm::vec3 bias = glm::vec3(builder.dequantize);
+			const float scale = builder.dequantize.w;
+			dequantize = glm::scale(glm::translate(glm::mat4{ 1.f }, bias), glm::vec3(scale));
+
+			// The scale is uniform, so the sphere maps over exactly
+			storedBoundingSphere = glm::vec4((glm::vec3(boundingSphere) - bias) / scale, boundingSphere.w / scale);
+			place(builder.packedVertices.data(), static_cast<uint32_t>(builder.packedVertices.size()), builder.indices, key);
+		}
+		else {
+			place(builder.vertices.data(), static_cast<uint32_t>(builder.vertices.size()), builder.indices, key);
+		}
+	}
+
+	void AvengModel::place(const void* vertices, uint32_t vertexCount, std::vector<uint32_t> indices, const std::string& key)
+	{
+		assert(vertexCount >= 3 && "Vertex count must be at least 3");
+
+		// Everything in the arena is drawn indexed
+		if (indices.empty())
+		{
+			indices.resize(vertexCount);
+			for (uint32_t i = 0; i < vertexCount; i++) indices[i] = i;
+		}
+
+		if (lods.empty()) lods.push_back(Lod{ 0, static_cast<uint32_t>(indices.size()), 0.f });
+
+		// The vertex shader takes input from the arena's vertex buffer, `layout(location = n) in vec3 vertexAttribute` as described by Vertex
+		meshHandle = arena.add(key, vertices, vertexCount, Vertex::stride(format), indices);
 	}
 
 	AvengModel::~AvengModel() 
 	{
+		arena.release(meshHandle);
 	}
 
-	std::unique_ptr<AvengModel> AvengModel::createModelFromFile(EngineDevice& device, const std::string& filepath)
+	std::unique_ptr<AvengModel> AvengModel::createModelFromFile(EngineDevice& device, MeshArena& arena, const std::string& filepath, const LoadOptions& options)
 	{
 		Builder builder{};
-		builder.loadModel(filepath);
-		return std::make_unique<AvengModel>(device, builder.vertices, builder.indices);
+		builder.loadModel(filepath, options);
+
+		// The key carries the format and whatever else changes the vertices, indices or LOD chain, so a file
+		// loaded two ways gets two meshes. report and retainGeometry only change what stays on the CPU.
+		std::string key = builder.format == VertexFormat::Packed ? filepath + "#packed" : filepath;
+		if (options.optimize) key += options.optimizeOverdraw ? "#overdraw" : "#optimized";
+		if (options.parallelDedup) key += "#parallel";
+		key += "#lods" + std::to_string(options.lods);
+		auto model = std::make_unique<AvengModel>(device, arena, builder, key);
+		if (options.retainGeometry) model->retainGeometry(builder);
+		return model;
+	}
+
+	void AvengModel::retainGeometry(const Builder& builder)
+	{
+		// The builder's vertices are in model space whatever the arena got
+		std::vector<glm::vec3> positions(builder.vertices.size());
+		for (size_t i = 0; i < positions.size(); i++) positions[i] = builder.vertices[i].position;
+
+		const uint32_t first = builder.lods.empty() ? 0 : builder.lods[0].firstIndex;
+		const uint32_t count = builder.lods.empty() ? static_cast<uint32_t>(builder.indices.size()) : builder.lods[0].indexCount;
+		std::vector<uint32_t> indices(builder.indices.begin() + first, builder.indices.begin() + first + count);
+
+		// Drawn in order when there are no indices
+		if (indices.empty())
+		{
+			indices.resize(positions.size());
+			for (uint32_t i = 0; i < indices.size(); i++) indices[i] = i;
+		}
+
+		// On the loading thread, a pool per mesh would sit idle for as long as the model lives
+		triangles = std::make_unique<TriangleBVH>();
+		triangles->build(std::move(positions), std::move(indices));
 	}
 
-	std::unique_ptr<AvengModel> AvengModel::drawTriangle(EngineDevice& device, glm::vec3 pos)
+	std::unique_ptr<AvengModel> AvengModel::drawTriangle(EngineDevice& device, MeshArena& arena, glm::vec3 pos)
 	{
 		std::vector<AvengModel::Vertex> vertices { // vector
 			{ { pos.x, pos.y, pos.z }, {1.0f, 1.0f, 1.0f }, {1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f } },
@@ -68,118 +254,178 @@ namespace aveng {
 		};
 
 		std::vector<uint32_t> indices = { 0,1,2 };
-		return std::make_unique<AvengModel>(device, vertices, indices);
+		return std::make_unique<AvengModel>(device, arena, vertices, indices);
 	}
 
-	/*
-		@function createVertexBuffers
-		Create a vertex buffer in our device memory
-		These buffers are used to write information to device memory
-		- vkMapMemory maps a buffer on the host to a buffer on the device
-	*/
-	void AvengModel::createVertexBuffers(const std::vector<Vertex>& vertices)
+	void AvengModel::benchmarkDedup(const std::string& filepath, uint32_t runs)
 	{
-		vertexCount = static_cast<uint32_t>(vertices.size());
-		assert(vertexCount >= 3 && "Vertex count must be at least 3");
-		// Size of a vertex * number of vertices
-		VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
-		uint32_t vertexSize = sizeof(vertices[0]);
-
-		// Used to map data from the CPU to the GPU via staging buffer which will then copy the data to the device's optimal memory location
-		AvengBuffer stagingBuffer{
-			engineDevice,
-			vertexSize,
-			vertexCount,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			// Host Coherent bit ensures the *data buffer is flushed to the device's buffer automatically, so we dont have to call the VkFlushMappedMemoryRanges
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-		};
-
-		// This takes care of vkMapMemory -> memcpy(vertices.data() ...) -> vkUnmapMemory
-		stagingBuffer.map();
-		stagingBuffer.writeToBuffer((void*)vertices.data());
-
-		vertexBuffer = std::make_unique<AvengBuffer>(
-			engineDevice,
-			vertexSize,
-			vertexCount,
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			// Host Coherent bit ensures the *data buffer is flushed automatically so we dont have to call the VkFlushMappedMemoryRanges
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT // Memory properties - This is GPU heap allocated and super fast
-		);
-
-		// Copy memory from the staging buffer to the vertex buffer
-		engineDevice.copyBuffer(stagingBuffer.getBuffer(), vertexBuffer->getBuffer(), bufferSize); // (src buffer, dst buffer, bufferSize)
-
-		// Note:
-		// The staging buffer is stack allocated, and does not need to be freed
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+		std::string warn, err;
+		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.c_str()))
+		{
+			throw std::runtime_error(warn + err);
+		}
 
+		// What loadModel did before: count(), then operator[] to insert and operator[] again to read back
+		std::vector<Vertex> mapVertices;
+		std::vector<uint32_t> mapIndices;
+		const double mapMs = bestOf(runs, [&] {
+			mapVertices.clear();
+			mapIndices.clear();
+			std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+			for (const auto& shape : shapes)
+			{
+				for (const auto& index : shape.mesh.indices)
+				{
+					const Vertex vertex = objVertex(attrib, index);
+					if (uniqueVertices.count(vertex) == 0)
+					{
+						uniqueVertices[vertex] = static_cast<uint32_t>(mapVertices.size());
+						mapVertices.push_back(vertex);
+					}
+					mapIndices.push_back(uniqueVertices[vertex]);
+				}
+			}
+		});
+
+		std::vector<Vertex> flatVertices, parallelVertices;
+		std::vector<uint32_t> flatIndices, parallelIndices;
+		const double flatMs = bestOf(runs, [&] { weldVertices(attrib, shapes, false, flatVertices, flatIndices); });
+		const double parallelMs = bestOf(runs, [&] { weldVertices(attrib, shapes, true, parallelVertices, parallelIndices); });
+
+		// Only a -0 somewhere tells the two apart, see VertexDedup
+		const bool same = flatIndices == mapIndices && flatVertices.size() == mapVertices.size();
+
+		std::cout << filepath << ": " << cornerCount(shapes) / 3 << " triangles in " << shapes.size() << " shapes, "
+			<< mapVertices.size() << " unique vertices" << std::endl;
+		std::cout << "  unordered_map       " << mapMs << " ms" << std::endl;
+		std::cout << "  flat                " << flatMs << " ms, " << mapMs / flatMs << "x, "
+			<< (same ? "same output" : "output differs") << std::endl;
+		std::cout << "  flat, per shape     " << parallelMs << " ms, " << mapMs / parallelMs << "x, "
+			<< parallelVertices.size() << " vertices" << std::endl;
 	}
 
-	/*
-		Create an index buffer in our device memory
-		These buffers are used to write information to device memory
-		- vkMapMemory maps a buffer on the host to a buffer on the device
-	*/
-	void AvengModel::createIndexBuffers(const std::vector<uint32_t>& indices)
+	void AvengModel::benchmarkObjReader(const std::string& filepath, uint32_t runs)
 	{
-		indexCount = static_cast<uint32_t>(indices.size());
-		hasIndexBuffer = indexCount > 0;
-
-		if (!hasIndexBuffer) return;
-
-		// Size of a vertex * number of vertices
-		VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount;
-		uint32_t indexSize = sizeof(indices[0]);
-
-		AvengBuffer stagingBuffer{
-			engineDevice,
-			indexSize,
-			indexCount,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			// Host Coherent bit ensures the *data buffer is flushed to the device's buffer automatically, so we dont have to call the VkFlushMappedMemoryRanges
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		};
-
-		stagingBuffer.map();
-		stagingBuffer.writeToBuffer((void*)indices.data());
-
-		indexBuffer = std::make_unique<AvengBuffer>(
-			engineDevice,
-			indexSize,
-			indexCount,
-			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			// Transfer bit ensures that this buffer's location in device memory will receive data from our transfer source bit
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT // // Memory properties - This is GPU heap allocated and super fast
-		);
-
-		engineDevice.copyBuffer(stagingBuffer.getBuffer(), indexBuffer->getBuffer(), bufferSize);
+		if (!std::ifstream{ filepath }.good())
+		{
+			// 708 x 708 quads, every vertex with a normal and texture coordinates of its own
+			const int grid = 708;
+			std::ofstream out{ filepath, std::ios::binary };
+			if (!out) throw std::runtime_error("Failed to write " + filepath);
 
-	}
+			char line[160];
+			for (int y = 0; y <= grid; y++)
+			{
+				for (int x = 0; x <= grid; x++)
+				{
+					const float height = std::sin(x * 0.05f) * std::cos(y * 0.05f);
+					std::snprintf(line, sizeof(line), "v %d %.6f %d\nvt %.6f %.6f\nvn %.6f 1 %.6f\n",
+						x, height, y, x / static_cast<float>(grid), y / static_cast<float>(grid), -height * 0.05f, height * 0.05f);
+					out << line;
+				}
+			}
+			for (int y = 0; y < grid; y++)
+			{
+				for (int x = 0; x < grid; x++)
+				{
+					const int a = y * (grid + 1) + x + 1, b = a + 1, c = a + grid + 1, d = c + 1;
+					std::snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d\nf %d/%d/%d %d/%d/%d %d/%d/%d\n",
+						a, a, a, b, b, b, d, d, d, a, a, a, d, d, d, c, c, c);
+					out << line;
+				}
+			}
+			std::cout << "Wrote " << filepath << std::endl;
+		}
 
+		std::vector<Vertex> tinyVertices, vertices, parallelVertices;
+		std::vector<uint32_t> tinyIndices, indices, parallelIndices;
 
-	void AvengModel::draw(VkCommandBuffer commandBuffer) 
-	{
-		if (hasIndexBuffer) 
+		const double tinyMs = bestOf(runs, [&] {
+			tinyobj::attrib_t attrib;
+			std::vector<tinyobj::shape_t> shapes;
+			std::vector<tinyobj::material_t> materials;
+			std::string warn, err;
+			if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.c_str()))
+			{
+				throw std::runtime_error(warn + err);
+			}
+			weldVertices(attrib, shapes, false, tinyVertices, tinyIndices);
+		});
+
+		ObjReader::Options single{};
+		single.threads = 1;
+		ObjReader::Options parallel{};
+		parallel.parallelDedup = true;
+
+		const double singleMs = bestOf(runs, [&] { ObjReader::read(filepath, vertices, indices, single); });
+		const double allMs = bestOf(runs, [&] { ObjReader::read(filepath, vertices, indices); });
+		const double parallelMs = bestOf(runs, [&] { ObjReader::read(filepath, parallelVertices, parallelIndices, parallel); });
+
+		// The two float parsers may round the last digit differently
+		float maxDifference = 0.f;
+		const bool sameTopology = tinyIndices == indices && tinyVertices.size() == vertices.size();
+		if (sameTopology)
 		{
-			vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+			for (size_t i = 0; i < vertices.size(); i++)
+			{
+				const glm::vec3 d = glm::abs(vertices[i].position - tinyVertices[i].position);
+				maxDifference = std::max(maxDifference, std::max(d.x, std::max(d.y, d.z)));
+			}
+		}
+
+		std::cout << filepath << ": " << indices.size() / 3 << " triangles, " << vertices.size() << " vertices" << std::endl;
+		std::cout << "  tinyobjloader + weld   " << tinyMs << " ms" << std::endl;
+		std::cout << "  ObjReader, 1 thread    " << singleMs << " ms, " << tinyMs / singleMs << "x" << std::endl;
+		std::cout << "  ObjReader, " << std::max(1u, std::thread::hardware_concurrency()) << " threads   " << allMs << " ms, " << tinyMs / allMs << "x" << std::endl;
+		std::cout << "  and parallel weld      " << parallelMs << " ms, " << tinyMs / parallelMs << "x, " << parallelVertices.size() << " vertices" << std::endl;
+		if (sameTopology) {
+			std::cout << "  Same triangles and vertices, positions within " << maxDifference << std::endl;
 		}
 		else {
-			vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+			std::cout << "  Output differs from tinyobjloader's" << std::endl;
 		}
 	}
 
-	void AvengModel::bind(VkCommandBuffer commandBuffer)
+	/*
+		Centered on the bounding box rather than the tightest fit, which is plenty for culling
+	*/
+	void AvengModel::computeBoundingSphere(const std::vector<Vertex>& vertices)
 	{
-		VkBuffer buffers[] = { vertexBuffer->getBuffer() };
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+		glm::vec3 boundsMin{ std::numeric_limits<float>::max() };
+		glm::vec3 boundsMax{ std::numeric_limits<float>::lowest() };
+		for (const Vertex& vertex : vertices)
+		{
+			boundsMin = glm::min(boundsMin, vertex.position);
+			boundsMax = glm::max(boundsMax, vertex.position);
+		}
 
-		if (hasIndexBuffer) 
+		glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+		float radiusSquared = 0.f;
+		for (const Vertex& vertex : vertices)
 		{
-			vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32); // This index type can store up to 2^32 vertices
+			glm::vec3 d = vertex.position - center;
+			radiusSquared = std::max(radiusSquared, glm::dot(d, d));
 		}
 
+		boundingSphere = glm::vec4(center, std::sqrt(radiusSquared));
+	}
+
+	void AvengModel::draw(VkCommandBuffer commandBuffer, uint32_t lod) 
+	{
+		const MeshArena::Mesh mesh = lodMesh(lod);
+		vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, mesh.firstIndex, mesh.vertexOffset, 0);
+	}
+
+	MeshArena::Mesh AvengModel::lodMesh(uint32_t lod) const
+	{
+		assert(lod < lods.size() && "Level of detail out of range");
+		MeshArena::Mesh mesh = arena.get(meshHandle);
+		mesh.firstIndex += lods[lod].firstIndex;
+		mesh.indexCount = lods[lod].indexCount;
+		return mesh;
 	}
 
 	/*
@@ -187,7 +433,7 @@ namespace aveng {
 	* 1 of 2 requirements for describing how Vulkan
 	* should pass data into the vertex shader
 	*/
-	std::vector<VkVertexInputBindingDescription> AvengModel::Vertex::getBindingDescriptions()
+	std::vector<VkVertexInputBindingDescription> AvengModel::Vertex::getBindingDescriptions(VertexFormat format)
 	{
 		// This VkVertexInputBindingDescription corresponds to a single vertex buffer
 		// it will occupy the binding at index 0.
@@ -199,7 +445,7 @@ namespace aveng {
 		*/
 		std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
 		bindingDescriptions[0].binding = 0;
-		bindingDescriptions[0].stride = sizeof(Vertex);
+		bindingDescriptions[0].stride = stride(format);
 		bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;		// Can be per vertex or per instance
 		return bindingDescriptions;
 	}
@@ -209,7 +455,7 @@ namespace aveng {
 	* 2 of 2 required functions for describing how Vulkan
 	* should pass data into the vertex shader
 	*/
-	std::vector<VkVertexInputAttributeDescription> AvengModel::Vertex::getAttributeDescriptions()
+	std::vector<VkVertexInputAttributeDescription> AvengModel::Vertex::getAttributeDescriptions(VertexFormat format)
 	{
 		 /*
 			uint32_t    location;	-- This specifies the location as assigned in the vertex shader i.e. layout( location = 0 ) 
@@ -220,6 +466,16 @@ namespace aveng {
 		// return { {0, 0, VK_FORMAT_R32G32_SFLOAT, 0} };
 		std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
 
+		if (format == VertexFormat::Packed)
+		{
+			// Normalized formats arrive in the shader as floats, missing components as 0
+			attributeDescriptions.push_back({ 0, 0, VK_FORMAT_R16G16B16A16_SNORM,	offsetof(PackedVertex, position) });
+			attributeDescriptions.push_back({ 1, 0, VK_FORMAT_R8G8B8A8_UNORM,		offsetof(PackedVertex, color) });
+			attributeDescriptions.push_back({ 2, 0, VK_FORMAT_R16G16_SNORM,			offsetof(PackedVertex, normal) });		// Octahedral, decoded in the shader
+			attributeDescriptions.push_back({ 3, 0, VK_FORMAT_R16G16_UNORM,			offsetof(PackedVertex, texCoord) });
+			return attributeDescriptions;
+		}
+
 		attributeDescriptions.push_back({ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position) });		// Vertex Positions
 		attributeDescriptions.push_back({ 1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color) });			// Vertex colors
 		attributeDescriptions.push_back({ 2, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal) });		// Defines a surface's normal (the non-culled side)
@@ -229,80 +485,185 @@ namespace aveng {
 
 	}
 
-	void AvengModel::Builder::loadModel(const std::string& filepath)
+	uint32_t AvengModel::Vertex::stride(VertexFormat format)
 	{
-		tinyobj::attrib_t attrib;				// This stores the position, color, normal and texture coord
-		std::vector<tinyobj::shape_t> shapes;	// Index values for each face element
-		std::vector<tinyobj::material_t> materials;
-		std::string warn, err;
+		return format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex);
+	}
 
-		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.c_str()))
+	void AvengModel::Builder::loadModel(const std::string& filepath, const LoadOptions& options)
+	{
+		packedVertices.clear();
+		format = VertexFormat::Full;
+
+		// Straight into vertices and indices, welded
+		ObjReader::Options readOptions{};
+		readOptions.parallelDedup = options.parallelDedup;
+		ObjReader::read(filepath, vertices, indices, readOptions);
+
+		if (options.optimize) optimize(options.optimizeOverdraw, options.report, filepath);
+
+		lods.clear();
+		if (options.lods > 1)
 		{
-			throw std::runtime_error(warn + err);
+			buildLods(options.lods, options.optimize);
+			if (options.report)
+			{
+				std::cout << filepath << ": LOD triangles";
+				for (const Lod& lod : lods) std::cout << " " << lod.indexCount / 3;
+				std::cout << std::endl;
+			}
 		}
 
-		vertices.clear();
-		indices.clear();
+		// Most meshes fit the packed format, which is well under half the vertex bandwidth
+		if (options.pack) pack();
+	}
 
-		// Will track which vertices have been added to the Builder.vertices vector and store the position at which the vertex wwas originally added
-		std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+	void AvengModel::Builder::optimize(bool overdraw, bool report, const std::string& name)
+	{
+		const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+		const MeshOptimizer::VertexCacheStats before = MeshOptimizer::analyzeVertexCache(indices, vertexCount);
 
-		// For every face of our mesh
-		for (const auto& shape : shapes) 
+		MeshOptimizer::optimizeVertexCache(indices, vertexCount);
+
+		if (overdraw)
 		{
-			// For every vertex of the face
-			for (const auto& index : shape.mesh.indices) 
-			{
-				Vertex vertex{};
-				if (index.vertex_index >= 0) 
-				{
-					vertex.position = {
-						attrib.vertices[3 * index.vertex_index + 0],
-						attrib.vertices[3 * index.vertex_index + 1],	// The calculations here just mean we're always looking at values in groups of 3
-						attrib.vertices[3 * index.vertex_index + 2],
-					};
-
-					vertex.color = {
-						attrib.colors[3 * index.vertex_index + 0],
-						attrib.colors[3 * index.vertex_index + 1],
-						attrib.colors[3 * index.vertex_index + 2],
-					};
+			std::vector<glm::vec3> positions(vertexCount);
+			for (uint32_t i = 0; i < vertexCount; i++) positions[i] = vertices[i].position;
+			MeshOptimizer::optimizeOverdraw(indices, positions);
+		}
 
-				}
+		// Last, so the vertices follow the final triangle order
+		std::vector<uint32_t> remap;
+		const uint32_t used = MeshOptimizer::optimizeVertexFetch(indices, vertexCount, remap);
+		std::vector<Vertex> reordered(used);
+		for (uint32_t i = 0; i < vertexCount; i++)
+		{
+			if (remap[i] != ~0u) reordered[remap[i]] = vertices[i];
+		}
+		vertices.swap(reordered);
 
-				if (index.normal_index >= 0) 
-				{
+		if (report)
+		{
+			const MeshOptimizer::VertexCacheStats after = MeshOptimizer::analyzeVertexCache(indices, used);
+			std::cout << name << ": " << indices.size() / 3 << " triangles, ACMR " << before.acmr << " -> " << after.acmr
+				<< ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+		}
+	}
 
-					vertex.normal = {
-						attrib.normals[3 * index.normal_index + 0],
-						attrib.normals[3 * index.normal_index + 1],
-						attrib.normals[3 * index.normal_index + 2],
-					};
-				}
+	/*
+	* Each level is simplified from the one before it to a quarter of its triangles, and carries the sum of
+	* the errors on the way there. The chain ends when a level would save too little to be worth drawing, or
+	* when getting there would move the surface by more than a quarter of the bounding radius.
+	*/
+	void AvengModel::Builder::buildLods(uint32_t maxLods, bool optimizeLevels)
+	{
+		const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
 
-				if (index.texcoord_index >= 0) 
-				{
-					
-					vertex.texCoord = {
-						attrib.texcoords[2 * index.texcoord_index + 0],
-						attrib.texcoords[2 * index.texcoord_index + 1],
-					};
-				}
+		lods.clear();
+		lods.push_back(Lod{ 0, static_cast<uint32_t>(indices.size()), 0.f });
+		if (vertexCount == 0) return;
+
+		std::vector<glm::vec3> positions(vertexCount);
+		std::vector<glm::vec2> texCoords(vertexCount);
+		glm::vec3 boundsMin{ std::numeric_limits<float>::max() };
+		glm::vec3 boundsMax{ std::numeric_limits<float>::lowest() };
+		for (uint32_t i = 0; i < vertexCount; i++)
+		{
+			positions[i] = vertices[i].position;
+			texCoords[i] = vertices[i].texCoord;
+			boundsMin = glm::min(boundsMin, positions[i]);
+			boundsMax = glm::max(boundsMax, positions[i]);
+		}
+		const float maxError = glm::length(boundsMax - boundsMin) * 0.5f * 0.25f;
+
+		std::vector<uint32_t> source = indices;
+		for (uint32_t level = 1; level < maxLods; level++)
+		{
+			// Too few triangles left to be worth a cheaper version
+			if (source.size() / 3 <= 32) break;
 
-				// If the vertex is new, we add it to the unique vertices map
-				if (uniqueVertices.count(vertex) == 0) 
+			float error = 0.f;
+			std::vector<uint32_t> simplified = MeshSimplifier::simplify(positions, texCoords, source, source.size() / 12 * 3, maxError, &error);
+			if (simplified.size() * 5 > source.size() * 4) break;
+
+			if (optimizeLevels) MeshOptimizer::optimizeVertexCache(simplified, vertexCount);
+
+			lods.push_back(Lod{ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(simplified.size()), lods.back().error + error });
+			indices.insert(indices.end(), simplified.begin(), simplified.end());
+			source.swap(simplified);
+		}
+	}
+
+	/*
+	* Positions are scaled into -1..1 around the center of the bounding box, by the same factor on every
+	* axis so the bounding sphere still fits after dequantizing. Normals are projected onto the octahedron
+	* and unfolded into a square.
+	*/
+	bool AvengModel::Builder::pack()
+	{
+		if (vertices.empty()) return false;
+
+		glm::vec3 boundsMin{ std::numeric_limits<float>::max() };
+		glm::vec3 boundsMax{ std::numeric_limits<float>::lowest() };
+		for (const Vertex& vertex : vertices)
+		{
+			if (glm::any(glm::lessThan(vertex.texCoord, glm::vec2(0.f))) || glm::any(glm::greaterThan(vertex.texCoord, glm::vec2(1.f))))
+			{
+				return false;		// Tiling texture coordinates don't fit unorm16
+			}
+			boundsMin = glm::min(boundsMin, vertex.position);
+			boundsMax = glm::max(boundsMax, vertex.position);
+		}
+
+		const glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+		const glm::vec3 halfExtent = (boundsMax - boundsMin) * 0.5f;
+		float scale = std::max(halfExtent.x, std::max(halfExtent.y, halfExtent.z));
+		if (scale <= 0.f) scale = 1.f;		// A single point
+
+		auto snorm16 = [](float v) { return static_cast<int16_t>(std::round(glm::clamp(v, -1.f, 1.f) * 32767.f)); };
+		auto unorm16 = [](float v) { return static_cast<uint16_t>(std::round(glm::clamp(v, 0.f, 1.f) * 65535.f)); };
+		auto unorm8 = [](float v) { return static_cast<uint8_t>(std::round(glm::clamp(v, 0.f, 1.f) * 255.f)); };
+
+		packedVertices.resize(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			const Vertex& vertex = vertices[i];
+			PackedVertex& packed = packedVertices[i];
+
+			const glm::vec3 position = (vertex.position - center) / scale;
+			packed.position[0] = snorm16(position.x);
+			packed.position[1] = snorm16(position.y);
+			packed.position[2] = snorm16(position.z);
+			packed.position[3] = 0;
+
+			// Octahedral: project onto |x| + |y| + |z| = 1 and fold the lower half over the diagonals
+			glm::vec3 n = vertex.normal;
+			const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+			glm::vec2 octahedral{ 0.f };
+			if (l1 > 0.f)
+			{
+				n /= l1;
+				octahedral = glm::vec2(n.x, n.y);
+				if (n.z < 0.f)
 				{
-					// The vertex's position in the Builder.vertices vector is given by the vertices vector's current size
-					uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-					// Add it to the unique vertices map
-					vertices.push_back(vertex);
+					octahedral = (1.f - glm::abs(glm::vec2(n.y, n.x))) * glm::vec2(n.x >= 0.f ? 1.f : -1.f, n.y >= 0.f ? 1.f : -1.f);
 				}
+			}
+			packed.normal[0] = snorm16(octahedral.x);
+			packed.normal[1] = snorm16(octahedral.y);
 
-				// Add the position of the vertex to the Builder's indices vector
-				indices.push_back(uniqueVertices[vertex]);
+			packed.texCoord[0] = unorm16(vertex.texCoord.x);
+			packed.texCoord[1] = unorm16(vertex.texCoord.y);
 
-			}
+			packed.color[0] = unorm8(vertex.color.r);
+			packed.color[1] = unorm8(vertex.color.g);
+			packed.color[2] = unorm8(vertex.color.b);
+			packed.color[3] = 255;
 		}
+
+		dequantize = glm::vec4(center, scale);
+		format = VertexFormat::Packed;
+		return true;
 	}
 
 }
\ No newline at end of file
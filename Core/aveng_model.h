@@ -1,14 +1,17 @@
 #pragma once
 
 #include "../CoreVK/EngineDevice.h"
-#include "../CoreVK/aveng_buffer.h"
+#include "../CoreVK/MeshArena.h"
+#include "Spatial/TriangleBVH.h"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 
 #include <array>
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace aveng {
@@ -18,6 +21,13 @@ namespace aveng {
 
 	public:
 
+		// How a mesh's vertices are laid out in the MeshArena. Every format needs its own pipelines.
+		enum class VertexFormat : uint32_t {
+			Full,		// Vertex, 44 bytes
+			Packed		// PackedVertex, 20 bytes
+		};
+		static constexpr uint32_t VERTEX_FORMAT_COUNT = 2;
+
 		struct Vertex {
 			// These 4 items get packed into our vertex buffers
 			glm::vec3 position{};		// Position of the vertex
@@ -28,9 +38,12 @@ namespace aveng {
 			/*
 			* Required to communicate with the vertex shader.
 			* Descriptions of our vertex buffers and how they are to be bound.
+			* The shaders read every format into the same vec3/vec2 inputs, see PackedVertex.
 			*/
-			static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
-			static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+			static std::vector<VkVertexInputBindingDescription> getBindingDescriptions(VertexFormat format = VertexFormat::Full);
+			static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(VertexFormat format = VertexFormat::Full);
+
+			static uint32_t stride(VertexFormat format);
 
 			// This is used with our hashing function to generate keys in our ordered map of vertices
 			bool operator==(const Vertex& other) const 
@@ -40,46 +53,128 @@ namespace aveng {
 
 		};
 
+		/*
+		* Vertex at less than half the size. The position is snorm16 within the mesh's bounds, so the model
+		* matrix has to be multiplied by the mesh's vertexTransform(). The normal is octahedral encoded and
+		* decoded in the vertex shader (PACKED_NORMALS), the texture coordinates must lie within 0..1.
+		*/
+		struct PackedVertex {
+			int16_t position[4];		// snorm16, w unused
+			int16_t normal[2];			// snorm16 octahedral
+			uint16_t texCoord[2];		// unorm16
+			uint8_t color[4];			// unorm8, white unless the file has vertex colors
+		};
+
+		// How Builder::loadModel prepares a mesh
+		struct LoadOptions {
+			bool pack = true;				// PackedVertex, if the mesh fits it
+			bool optimize = false;			// Reorder for the post transform cache and vertex fetch, see MeshOptimizer
+			bool optimizeOverdraw = false;	// With optimize, also order the triangles against overdraw
+			bool report = false;			// Print the ACMR/ATVR before and after optimizing, and the LOD chain
+			uint32_t lods = 4;				// Levels of detail to generate at most, the full mesh included. 1 for none.
+			bool parallelDedup = false;		// Weld each chunk of the file on a thread of its own, chunks then share no vertices
+			bool retainGeometry = false;	// Keep the full mesh's triangles on the CPU too, for picking, see getTriangles()
+		};
+
+		// One level of detail, a range of the model's indices over the same vertices as every other level
+		struct Lod {
+			uint32_t firstIndex = 0;		// Relative to the model's range in the arena
+			uint32_t indexCount = 0;
+			float error = 0.f;				// How far (model space) the surface may be from the full mesh's
+		};
+
 		// Vertex and index information to be sent to the model's vertex and index buffer memory
 		struct Builder {
 			std::vector<Vertex> vertices{};
 			std::vector<uint32_t> indices{};
 
-			void loadModel(const std::string& filepath);
+			// Chosen by loadModel. With Packed, packedVertices holds the vertices the arena gets and
+			// dequantize the bias (xyz) and scale (w) taking them back to model space.
+			VertexFormat format = VertexFormat::Full;
+			std::vector<PackedVertex> packedVertices{};
+			glm::vec4 dequantize{ 0.f, 0.f, 0.f, 1.f };
+
+			// Filled by buildLods(), after which indices holds every level one after the other. Empty is one level.
+			std::vector<Lod> lods{};
+
+			void loadModel(const std::string& filepath, const LoadOptions& options = LoadOptions{});
+
+			// Reorders indices and vertices, see MeshOptimizer. Before pack().
+			void optimize(bool overdraw, bool report, const std::string& name);
+
+			// Appends simplified copies of the mesh to indices, see MeshSimplifier. After optimize(), which
+			// would reorder across the levels.
+			void buildLods(uint32_t maxLods, bool optimizeLevels);
+
+			// False, and nothing changed, if some texture coordinate lies outside 0..1
+			bool pack();
 		};
 
-		//AvengModel(EngineDevice& device, const AvengModel::Builder& builder);
-		AvengModel(EngineDevice& device, std::vector<AvengModel::Vertex> vertices, std::vector<uint32_t> indices);
+		// The geometry goes into the arena, shared with every other model added under the same key. Without indices
+		// the vertices are drawn in order.
+		AvengModel(EngineDevice& device, MeshArena& arena, const std::vector<AvengModel::Vertex>& vertices, std::vector<uint32_t> indices, const std::string& key = "");
+		AvengModel(EngineDevice& device, MeshArena& arena, const AvengModel::Builder& builder, const std::string& key = "");
 		~AvengModel();
 
 		AvengModel(const AvengModel&) = delete;
 		AvengModel& operator=(const AvengModel&) = delete;
 
-		static std::unique_ptr<AvengModel> createModelFromFile(EngineDevice& device, const std::string& filepath);
-		static std::unique_ptr<AvengModel> drawTriangle(EngineDevice& device, glm::vec3 pos);
-		
-		void bind(VkCommandBuffer commandBuffer);
-		void draw(VkCommandBuffer commandBuffer);
+		// Every model of one file shares its geometry in the arena
+		static std::unique_ptr<AvengModel> createModelFromFile(EngineDevice& device, MeshArena& arena, const std::string& filepath, const LoadOptions& options = LoadOptions{});
+		static std::unique_ptr<AvengModel> drawTriangle(EngineDevice& device, MeshArena& arena, glm::vec3 pos);
+
+		// Times welding the file's vertices with a std::unordered_map, as the loader used to, against VertexDedup
+		// on one thread and per shape on several. Best of runs, printed to stdout.
+		static void benchmarkDedup(const std::string& filepath, uint32_t runs = 5);
+
+		// Times tinyobjloader plus welding, the loader before ObjReader, against ObjReader on one thread and on
+		// all of them. A file that doesn't exist is first written, a million triangle grid, so runs compare.
+		static void benchmarkObjReader(const std::string& filepath, uint32_t runs = 5);
+
+		// The arena must be bound (MeshArena::bind), once for any number of models
+		void draw(VkCommandBuffer commandBuffer, uint32_t lod = 0);
+
+		// This model's range in the arena, every level of detail in it. Don't hold on to it, defragmenting the arena moves it.
+		const MeshArena::Mesh& arenaMesh() const { return arena.get(meshHandle); }
+
+		// The range to draw for one level of detail, 0 being the full mesh. Same caveat as arenaMesh().
+		MeshArena::Mesh lodMesh(uint32_t lod) const;
+
+		uint32_t lodCount() const { return static_cast<uint32_t>(lods.size()); }
+		const Lod& getLod(uint32_t lod) const { return lods[lod]; }
+
+		VertexFormat getFormat() const { return format; }
+
+		// From the space the vertices are stored in to model space. Identity unless packed.
+		const glm::mat4& vertexTransform() const { return dequantize; }
+
+		// Model space, xyz center and w radius. Encloses every vertex.
+		const glm::vec4& getBoundingSphere() const { return boundingSphere; }
+
+		// The same sphere in the space the vertices are stored in, for a model matrix multiplied by vertexTransform()
+		const glm::vec4& getStoredBoundingSphere() const { return storedBoundingSphere; }
+
+		// The full mesh in model space, or null unless it was loaded with LoadOptions::retainGeometry
+		const TriangleBVH* getTriangles() const { return triangles.get(); }
 	
 	private:
 
-		void createVertexBuffers(const std::vector<Vertex>& vertices);
-		void createIndexBuffers(const std::vector<uint32_t>& indices);
+		// Level 0 of the builder's mesh into triangles
+		void retainGeometry(const Builder& builder);
+
+		void computeBoundingSphere(const std::vector<Vertex>& vertices);
+		void place(const void* vertices, uint32_t vertexCount, std::vector<uint32_t> indices, const std::string& key);
 
 		EngineDevice& engineDevice;
-		uint32_t vertexCount;
-		bool hasIndexBuffer = false;
-		uint32_t indexCount;
-
-		/*VkBuffer vertexBuffer;		OLD
-		VkDeviceMemory vertexBufferMemory;*/
-		// NEW
-		std::unique_ptr<AvengBuffer> vertexBuffer;
-
-		/*VkBuffer indexBuffer;			OLD
-		VkDeviceMemory indexBufferMemory;*/
-		// NEW
-		std::unique_ptr<AvengBuffer> indexBuffer;
+		MeshArena& arena;
+		MeshArena::Handle meshHandle = MeshArena::INVALID_HANDLE;
+
+		VertexFormat format = VertexFormat::Full;
+		glm::mat4 dequantize{ 1.f };
+		glm::vec4 boundingSphere{ 0.f };
+		glm::vec4 storedBoundingSphere{ 0.f };
+		std::vector<Lod> lods;
+		std::unique_ptr<TriangleBVH> triangles;
 
 	};
 
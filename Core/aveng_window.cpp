@@ -4,13 +4,14 @@
 
 namespace aveng {
 
-	AvengWindow::AvengWindow(int w, int h, std::string name) : width{ w }, height{ h }, windowName{ name }
+	AvengWindow::AvengWindow(int w, int h, std::string name, bool headless) : width{ w }, height{ h }, windowName{ name }, headless{ headless }
 	{
-		initWindow();
+		if (!headless) initWindow();
 	}
 
 	AvengWindow::~AvengWindow()
 	{
+		if (headless) return;
 		glfwDestroyWindow(window);
 		glfwTerminate();
 	}
@@ -44,12 +45,21 @@ namespace aveng {
 
 	void AvengWindow::createWindowSurface(VkInstance instance, VkSurfaceKHR* surface)
 	{
+		if (headless)
+		{
+			throw std::runtime_error("a headless window has no surface");
+		}
+
 		if (glfwCreateWindowSurface(instance, window, nullptr, surface) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to create window surface");
 		}
 	}
-	bool AvengWindow::shouldClose() { return glfwWindowShouldClose(window); }
+	bool AvengWindow::shouldClose() 
+	{
+		if (headless) return closeRequested;
+		return closeRequested || glfwWindowShouldClose(window);
+	}
 
 	void AvengWindow::framebufferResizedCallback(GLFWwindow* window, int width, int height)
 	{
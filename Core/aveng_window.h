@@ -5,17 +5,26 @@
 
 namespace aveng {
 
+	class InputSystem;
+
 	class AvengWindow {
 		std::string windowName;
-		GLFWwindow* window;
+		GLFWwindow* window = nullptr;
 
 		bool framebufferResized = false;
 		int width;
 		int height;
 
+		// No GLFW window at all, the renderer draws into offscreen images
+		bool headless = false;
+		bool closeRequested = false;
+
+		// Where the window's input callbacks send events, see InputSystem::attach
+		InputSystem* inputSystem = nullptr;
+
 	public:
 
-		AvengWindow(int w, int h, std::string name);
+		AvengWindow(int w, int h, std::string name, bool headless = false);
 		~AvengWindow();
 
 		// Removal of copy construction
@@ -23,6 +32,8 @@ namespace aveng {
 		AvengWindow& operator=(const AvengWindow&) = delete;
 
 		bool shouldClose();
+		void requestClose() { closeRequested = true; }
+		bool isHeadless() const { return headless; }
 
 		VkExtent2D getExtent() { return { static_cast<uint32_t>(width), static_cast<uint32_t>(height) }; }
 
@@ -34,6 +45,9 @@ namespace aveng {
 
 		GLFWwindow* getGLFWwindow() const { return window; }
 
+		void setInputSystem(InputSystem* input) { inputSystem = input; }
+		InputSystem* getInputSystem() const { return inputSystem; }
+
 	private:
 		static void framebufferResizedCallback(GLFWwindow* window, int width, int height);
 		void initWindow();
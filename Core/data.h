@@ -6,6 +6,7 @@ namespace aveng {
 	const int LEFT = 1;
 	const int PI = 3.14159265f; // 3589793238462643383279502884197969399375105820974944592 check yo'self
 	const float viewRadius{ .5f };	// Radius of the invisible sphere for which our viewer is at the origin
+	const int MAX_PIPELINES = 2;	// Shading pipelines data.cur_pipe cycles through
 	
 
 	enum texture {
@@ -27,14 +28,17 @@ namespace aveng {
 		ENEMY,
 		SCENE,
 		STATIC,
-		DYNAMIC
+		DYNAMIC,
+		BACKDROP		// Drawn as authored, no lights, see ObjectRenderSystem::shadingOf
 	};
 
 	// Debug info for GUI, also contains player state data ...oops
 	struct Data {
 		int			num_objs;
+		int			num_lights;
+		int			light_overflow;		// Cluster light indices dropped last frame
 		float		dt;
-		int			cur_pipe;
+		int			cur_pipe = 0;			// Shading pipeline, see NextPipelineCommand
 		int			sec;
 		int			pn;
 		glm::vec3	cameraView;
@@ -58,6 +62,40 @@ namespace aveng {
 		float		speed;
 		glm::vec3	velocity;
 
+		// Presentation, edited from the GUI. See PresentPolicy.
+		int			present_mode = 0;		// PresentPolicy::Mode
+		int			frames_in_flight = 2;
+		float		fps_limit = 0.f;
+		bool		late_input = false;
+		float		input_to_present_ms;
+		float		input_to_gpu_ms;
+		float		fence_wait_ms;
+		float		frame_arena_kb;			// Transient per frame memory used last frame
+
+		// Object rendering
+		bool		indirect_draw = false;	// Draw from the object table with indirect commands, see ObjectRenderSystem
+		int			draw_calls;				// Draw commands recorded by ObjectRenderSystem last frame
+		bool		gpu_cull = true;		// Indirect path only, cull.comp rather than the CPU decides what's drawn
+		bool		verify_cull = false;	// Check every GPU culled frame against the CPU, see CullingSystem
+		int			visible_objs = -1;		// -1 when the GPU culled and nobody checked
+		int			cull_verified = 0;		// Frames checked / frames where GPU and CPU disagreed
+		int			cull_mismatches = 0;
+		bool		lod_select = true;		// Draw each object at the coarsest level of detail that passes for the full mesh
+		float		lod_pixels = 1.f;		// How far (pixels) a level may stray from the full mesh on screen
+		int			triangles;				// At the levels of detail picked last frame, before culling
+		int			broadphase_pairs;		// Objects touching this frame, see Broadphase
+
+		// Picking, a left click on the scene selects what's under the cursor. See ObjectIndex::raycast.
+		int			picked_id = -1;			// AvengAppObject id, -1 for nothing
+		glm::vec3	picked_point;			// World space
+		float		pick_us;				// How long the last pick took
+
+		// Fixed rate simulation, see Simulation
+		float		sim_hz;
+		float		sim_alpha;				// How far between the last two steps the frame was drawn
+		float		sim_step_us;			// The last step
+		int			sim_skipped;			// Steps dropped because the simulation fell behind
+
 	};
 
 }
\ No newline at end of file
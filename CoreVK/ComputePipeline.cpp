@@ -0,0 +1,96 @@
+#include "ComputePipeline.h"
+#include "GFXPipeline.h"
+
+#include <cassert>
+#include <stdexcept>
+
+namespace aveng {
+
+	ComputePipeline::ComputePipeline(
+		EngineDevice& device,
+		const std::string& compFilepath,
+		VkPipelineLayout pipelineLayout,
+		const std::vector<uint32_t>& specializationConstants
+	)
+		: engDevice{ device }
+	{
+		auto compCode = GFXPipeline::readFile(compFilepath);
+		GFXPipeline::createShaderModule(engDevice, compCode, &compShaderModule);
+
+		createComputePipeline(pipelineLayout, specializationConstants);
+	}
+
+	ComputePipeline::ComputePipeline(
+		EngineDevice& device,
+		VkShaderModule compModule,
+		VkPipelineLayout pipelineLayout,
+		const std::vector<uint32_t>& specializationConstants
+	)
+		: engDevice{ device }, compShaderModule{ compModule }, ownsShaderModule{ false }
+	{
+		createComputePipeline(pipelineLayout, specializationConstants);
+	}
+
+	ComputePipeline::~ComputePipeline()
+	{
+		if (ownsShaderModule)
+		{
+			vkDestroyShaderModule(engDevice.device(), compShaderModule, nullptr);
+		}
+
+		// A frame in flight may still be dispatching it
+		EngineDevice& device = engDevice;
+		VkPipeline pipeline = computePipeline;
+		engDevice.deferDestroy([&device, pipeline] {
+			vkDestroyPipeline(device.device(), pipeline, nullptr);
+		});
+	}
+
+	void ComputePipeline::createComputePipeline(VkPipelineLayout pipelineLayout, const std::vector<uint32_t>& specializationConstants)
+	{
+		assert(
+			pipelineLayout != VK_NULL_HANDLE &&
+			"Cannot create compute pipeline: no pipelineLayout provided");
+
+		// Map constant_id i to the i'th word of our constants
+		std::vector<VkSpecializationMapEntry> specializationEntries(specializationConstants.size());
+		for (uint32_t i = 0; i < specializationEntries.size(); i++)
+		{
+			specializationEntries[i].constantID = i;
+			specializationEntries[i].offset		= i * sizeof(uint32_t);
+			specializationEntries[i].size		= sizeof(uint32_t);
+		}
+
+		VkSpecializationInfo specializationInfo{};
+		specializationInfo.mapEntryCount	= static_cast<uint32_t>(specializationEntries.size());
+		specializationInfo.pMapEntries		= specializationEntries.data();
+		specializationInfo.dataSize			= specializationConstants.size() * sizeof(uint32_t);
+		specializationInfo.pData			= specializationConstants.data();
+
+		VkPipelineShaderStageCreateInfo shaderStage{};
+		shaderStage.sType				= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStage.stage				= VK_SHADER_STAGE_COMPUTE_BIT;
+		shaderStage.module				= compShaderModule;
+		shaderStage.pName				= "main";
+		shaderStage.pSpecializationInfo = specializationEntries.empty() ? nullptr : &specializationInfo;
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType				= VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage				= shaderStage;
+		pipelineInfo.layout				= pipelineLayout;
+		pipelineInfo.basePipelineIndex	= -1;
+		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+		// Shares the device's pipeline cache with the graphics pipelines
+		if (vkCreateComputePipelines(engDevice.device(), engDevice.pipelineCache(), 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create compute pipeline");
+		}
+	}
+
+	void ComputePipeline::bind(VkCommandBuffer commandBuffer)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+	}
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "EngineDevice.h"
+
+#include <string>
+#include <vector>
+
+/**
+* @class ComputePipeline
+* GFXPipeline's counterpart for a single compute shader. There's no fixed function state to
+* configure, so instead of a PipelineConfig it takes the layout and the specialization constants.
+*/
+namespace aveng {
+
+	class ComputePipeline {
+
+		EngineDevice& engDevice;
+		VkPipeline computePipeline;
+		VkShaderModule compShaderModule;
+		bool ownsShaderModule = true;		// False when the module is shared with other pipelines
+
+	public:
+
+		// Specialization constants as in PipelineConfig, entry i is constant_id = i
+		ComputePipeline(
+			EngineDevice& device,
+			const std::string& compFilepath,
+			VkPipelineLayout pipelineLayout,
+			const std::vector<uint32_t>& specializationConstants = {}
+		);
+
+		// Build from a shader module owned elsewhere (see ShaderLibrary). The module is not destroyed with the pipeline.
+		ComputePipeline(
+			EngineDevice& device,
+			VkShaderModule compModule,
+			VkPipelineLayout pipelineLayout,
+			const std::vector<uint32_t>& specializationConstants = {}
+		);
+
+		~ComputePipeline();
+		ComputePipeline(const ComputePipeline&) = delete;
+		ComputePipeline& operator=(const ComputePipeline&) = delete;
+
+		void bind(VkCommandBuffer commandBuffer);
+
+		// Workgroups needed for count invocations at localSize invocations per group
+		static uint32_t groupCount(uint32_t count, uint32_t localSize) { return (count + localSize - 1) / localSize; }
+
+	private:
+
+		void createComputePipeline(VkPipelineLayout pipelineLayout, const std::vector<uint32_t>& specializationConstants);
+
+	};
+
+} // NS
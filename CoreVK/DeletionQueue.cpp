@@ -0,0 +1,77 @@
+#include "DeletionQueue.h"
+
+// std
+#include <vector>
+
+namespace aveng {
+
+    void DeletionQueue::push(std::function<void()>&& destroy)
+    {
+        std::lock_guard<std::mutex> lock{ mutex };
+        entries.push_back({ frame, std::move(destroy) });
+    }
+
+    void DeletionQueue::frameBegun()
+    {
+        std::lock_guard<std::mutex> lock{ mutex };
+        recording = true;
+    }
+
+    void DeletionQueue::frameSubmitted()
+    {
+        std::lock_guard<std::mutex> lock{ mutex };
+        recording = false;
+        frame++;
+    }
+
+    void DeletionQueue::frameCompleted(uint64_t completed)
+    {
+        collect(completed);
+    }
+
+    void DeletionQueue::queueIdle()
+    {
+        // A frame being recorded hasn't been submitted, so it may still reference what was pushed during it.
+        // Outside of a frame (loading, say) everything pushed so far is free to go.
+        uint64_t completed;
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            if (recording && frame == 0) return;
+            completed = recording ? frame - 1 : frame;
+        }
+        collect(completed);
+    }
+
+    void DeletionQueue::flush()
+    {
+        collect(UINT64_MAX);
+    }
+
+    size_t DeletionQueue::size()
+    {
+        std::lock_guard<std::mutex> lock{ mutex };
+        return entries.size();
+    }
+
+    /*
+    * Run the callbacks outside the lock; a destructor is free to push more entries.
+    */
+    void DeletionQueue::collect(uint64_t lastCompleted)
+    {
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            while (!entries.empty() && entries.front().frame <= lastCompleted)
+            {
+                ready.push_back(std::move(entries.front().destroy));
+                entries.pop_front();
+            }
+        }
+
+        for (auto& destroy : ready)
+        {
+            destroy();
+        }
+    }
+
+}  // namespace aveng
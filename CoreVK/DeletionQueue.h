@@ -0,0 +1,70 @@
+#pragma once
+
+// std lib headers
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+/**
+* @class DeletionQueue
+* Defers destruction of Vulkan objects until the GPU can no longer be using them, so they can be
+* released mid-run without a vkDeviceWaitIdle. Owned by EngineDevice.
+*
+* Every entry is tagged with the frame being recorded when it was pushed. The Renderer reports each
+* frame as it is submitted and again once its fence has been seen signaled; fences on one queue signal
+* in submission order, so completing frame N releases every entry tagged N or earlier.
+*
+* Entries run in the order they were pushed, so e.g. descriptor sets are always freed before their pool.
+*/
+namespace aveng {
+
+    class DeletionQueue {
+    public:
+
+        // EngineDevice flushes it before the device goes away
+        DeletionQueue() = default;
+
+        DeletionQueue(const DeletionQueue&) = delete;
+        DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+        // Safe from any thread
+        void push(std::function<void()>&& destroy);
+
+        // The frame being recorded, used to tag new entries
+        uint64_t currentFrame() const { return frame; }
+
+        // A frame's command buffer started recording. Until it's submitted it may reference new entries.
+        void frameBegun();
+
+        // The current frame was submitted; entries pushed from now on belong to the next one
+        void frameSubmitted();
+
+        // frame's fence has signaled. Runs everything tagged with it or earlier.
+        void frameCompleted(uint64_t frame);
+
+        // The queue went idle. Everything submitted so far is done.
+        void queueIdle();
+
+        // The device is idle or going away. Runs everything.
+        void flush();
+
+        size_t size();
+
+    private:
+
+        struct Entry {
+            uint64_t frame;
+            std::function<void()> destroy;
+        };
+
+        void collect(uint64_t lastCompleted);
+
+        std::mutex mutex;
+        std::deque<Entry> entries;
+        uint64_t frame = 0;
+        bool recording = false;
+
+    };
+
+}  // namespace aveng
@@ -1,6 +1,8 @@
 #include "EngineDevice.h"
 
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <set>
 #include <unordered_set>
@@ -61,6 +63,22 @@ namespace aveng {
         }
     }
 
+    /*
+     * Our pipeline cache file is prefixed with this header so a blob written by a different
+     * GPU or driver is thrown away instead of handed to the driver. Drivers validate the
+     * blob themselves too, but not all of them do it gracefully.
+     */
+    struct PipelineCacheFileHeader {
+        uint32_t magic;
+        uint32_t dataSize;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+    };
+
+    static constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x43505641; // "AVPC"
+
     /**
      * Class Functions
      */
@@ -77,7 +95,14 @@ namespace aveng {
         // The surface is Vulkan's connection to our Window from GLFW.
         // This calls createWindowSurface from our _window class which is why
         // you will find it included in EnginDevice.hpp
-        createSurface();
+        // Headless runs have nothing to present to, so there's no surface and no swapchain.
+        if (headless())
+        {
+            deviceExtensions.clear();
+        }
+        else {
+            createSurface();
+        }
 
         // Choose your weapon (GPU), or multiple of them (super advanced)
         pickPhysicalDevice();
@@ -87,11 +112,20 @@ namespace aveng {
 
         // For command buffer allocation
         createCommandPool();
+
+        // Shared by every pipeline we create, seeded from the last run if possible
+        createPipelineCache();
     }
 
     // Destructor
     EngineDevice::~EngineDevice() 
     {
+        // Anything still waiting on a frame goes now
+        vkDeviceWaitIdle(_device);
+        _deletionQueue.flush();
+
+        savePipelineCache();
+        vkDestroyPipelineCache(_device, _pipelineCache, nullptr);
         vkDestroyCommandPool(_device, _commandPool, nullptr);
         vkDestroyDevice(_device, nullptr);
 
@@ -100,7 +134,10 @@ namespace aveng {
             DestroyDebugUtilsMessengerEXT(_instance, debugMessenger, nullptr);
         }
 
-          vkDestroySurfaceKHR(_instance, _surface, nullptr);
+          if (_surface != VK_NULL_HANDLE)
+          {
+              vkDestroySurfaceKHR(_instance, _surface, nullptr);
+          }
           vkDestroyInstance(_instance, nullptr);
     }
 
@@ -221,9 +258,25 @@ namespace aveng {
         }
 
         // Config - Device features
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(_physicalDevice, &supportedFeatures);
+
         VkPhysicalDeviceFeatures deviceFeatures = {};
         deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+        // Optional, used by the indirect draw path when present (see ObjectRenderSystem::renderIndirect)
+        deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+        deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+        enabledFeatures = deviceFeatures;
+
+        // Optional extensions go on top of the required ones
+        std::vector<const char*> extensions = deviceExtensions;
+        const bool drawIndirectCount = hasDeviceExtension(_physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        if (drawIndirectCount)
+        {
+            extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        }
+
         // Config - Core
         VkDeviceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -232,8 +285,8 @@ namespace aveng {
 
         // Enable features and extensions
         createInfo.pEnabledFeatures = &deviceFeatures;
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
 
         // This might not really be necessary anymore because
         // device specific validation layers have been deprecated
@@ -254,6 +307,12 @@ namespace aveng {
         // Get a queue handle for each queue family
         vkGetDeviceQueue(_device, indices.graphicsFamily, 0, &_graphicsQueue);
         vkGetDeviceQueue(_device, indices.presentFamily, 0, &_presentQueue);
+
+        if (drawIndirectCount)
+        {
+            cmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+                vkGetDeviceProcAddr(_device, "vkCmdDrawIndexedIndirectCountKHR"));
+        }
     }
 
     void EngineDevice::createCommandPool() {
@@ -273,6 +332,101 @@ namespace aveng {
         }
     }
 
+    /*
+    * Load the pipeline cache from the last run. The blob is only used if it was written
+    * by this exact GPU and driver, otherwise we start with an empty cache.
+    */
+    void EngineDevice::createPipelineCache()
+    {
+        std::vector<char> initialData;
+
+        std::ifstream file{ pipelineCachePath, std::ios::ate | std::ios::binary };
+        if (file.is_open())
+        {
+            size_t fileSize = static_cast<size_t>(file.tellg());
+            PipelineCacheFileHeader header{};
+
+            if (fileSize >= sizeof(header))
+            {
+                file.seekg(0);
+                file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+                bool valid =
+                    header.magic == PIPELINE_CACHE_MAGIC &&
+                    header.dataSize == fileSize - sizeof(header) &&
+                    header.vendorID == properties.vendorID &&
+                    header.deviceID == properties.deviceID &&
+                    header.driverVersion == properties.driverVersion &&
+                    memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+
+                if (valid)
+                {
+                    initialData.resize(header.dataSize);
+                    file.read(initialData.data(), header.dataSize);
+                    if (!file) initialData.clear();
+                }
+            }
+
+            std::cout << "Pipeline cache: " << (initialData.empty() ? "discarding stale " : "loaded ") << pipelineCachePath << std::endl;
+        }
+
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = initialData.size();
+        cacheInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+        if (vkCreatePipelineCache(_device, &cacheInfo, nullptr, &_pipelineCache) != VK_SUCCESS)
+        {
+            // A rejected blob shouldn't keep us from starting, retry with an empty cache
+            cacheInfo.initialDataSize = 0;
+            cacheInfo.pInitialData = nullptr;
+            if (vkCreatePipelineCache(_device, &cacheInfo, nullptr, &_pipelineCache) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create pipeline cache!");
+            }
+        }
+    }
+
+    /*
+    * Write the pipeline cache to a temporary file and rename it over the old one,
+    * so a crash mid-write never leaves a truncated cache behind.
+    */
+    void EngineDevice::savePipelineCache()
+    {
+        if (_pipelineCache == VK_NULL_HANDLE) return;
+
+        size_t dataSize = 0;
+        if (vkGetPipelineCacheData(_device, _pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) return;
+
+        std::vector<char> data(dataSize);
+        if (vkGetPipelineCacheData(_device, _pipelineCache, &dataSize, data.data()) != VK_SUCCESS) return;
+
+        PipelineCacheFileHeader header{};
+        header.magic = PIPELINE_CACHE_MAGIC;
+        header.dataSize = static_cast<uint32_t>(dataSize);
+        header.vendorID = properties.vendorID;
+        header.deviceID = properties.deviceID;
+        header.driverVersion = properties.driverVersion;
+        memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+        const std::string tmpPath = pipelineCachePath + ".tmp";
+        {
+            std::ofstream file{ tmpPath, std::ios::binary | std::ios::trunc };
+            if (!file.is_open()) return;
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(data.data(), dataSize);
+            if (!file) return;
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tmpPath, pipelineCachePath, ec);
+        if (ec)
+        {
+            std::cerr << "Failed to write pipeline cache: " << ec.message() << std::endl;
+            std::filesystem::remove(tmpPath, ec);
+        }
+    }
+
     /**
     * Call to our _window class to create the window surface with GLFW
     */
@@ -290,9 +444,9 @@ namespace aveng {
         // Ensure required extensions are available
         bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-        bool swapChainAdequate = false;
+        bool swapChainAdequate = headless();
         // Query for swapchain support so we can draw to our surface accordingly
-        if (extensionsSupported) 
+        if (extensionsSupported && !headless()) 
         {
             SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
             swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
@@ -382,10 +536,13 @@ namespace aveng {
     {
 
         uint32_t glfwExtensionCount = 0;
-        const char **glfwExtensions;
+        const char **glfwExtensions = nullptr;
 
-        // Collect a list of our required extensions
-        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        // Collect a list of our required extensions. Headless needs no window system extensions at all.
+        if (!headless())
+        {
+            glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        }
 
         std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
 
@@ -464,6 +621,21 @@ namespace aveng {
         return requiredExtensions.empty();
     }
 
+    bool EngineDevice::hasDeviceExtension(VkPhysicalDevice device, const char* name)
+    {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+        for (const auto& extension : availableExtensions) {
+            if (std::strcmp(extension.extensionName, name) == 0) return true;
+        }
+
+        return false;
+    }
+
     /**
     * Figure out the queue families supported by the device.
     */
@@ -493,7 +665,14 @@ namespace aveng {
 
             VkBool32 presentSupport = false;
             //  Look for a queue family that has the capability of presenting to our window surface
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, _surface, &presentSupport);
+            //  Headless never presents; the graphics queue stands in so the rest of the code needn't care.
+            if (headless())
+            {
+                presentSupport = queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT ? VK_TRUE : VK_FALSE;
+            }
+            else {
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, _surface, &presentSupport);
+            }
 
             // Find a presentation queue. This could very well be the same thing as the graphics queue
             if (queueFamily.queueCount > 0 && presentSupport) 
@@ -675,15 +854,18 @@ namespace aveng {
         vkQueueWaitIdle(_graphicsQueue);
 
         vkFreeCommandBuffers(_device, _commandPool, 1, &commandBuffer);
+
+        // We just waited on the whole queue, so staging buffers and friends needn't wait for a frame
+        _deletionQueue.queueIdle();
     }
 
-    void EngineDevice::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) 
+    void EngineDevice::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize dstOffset) 
     {
         VkCommandBuffer commandBuffer = beginSingleTimeCommands();
 
         VkBufferCopy copyRegion{};
         //copyRegion.srcOffset = 0;  // Optional
-        //copyRegion.dstOffset = 0;  // Optional
+        copyRegion.dstOffset = dstOffset;   // Sub-allocations, see MeshArena
         copyRegion.size = size;
         vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
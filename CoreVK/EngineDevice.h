@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../Core/aveng_window.h"
+#include "DeletionQueue.h"
 
 // std lib headers
 #include <string>
@@ -33,9 +34,11 @@ namespace aveng {
         AvengWindow&    window;
         VkCommandPool   _commandPool;
         VkDevice        _device;
-        VkSurfaceKHR    _surface;
+        VkSurfaceKHR    _surface = VK_NULL_HANDLE;
         VkQueue         _graphicsQueue;
         VkQueue         _presentQueue;
+        VkPipelineCache _pipelineCache = VK_NULL_HANDLE;
+        DeletionQueue   _deletionQueue;
 
     public:
 
@@ -62,6 +65,14 @@ namespace aveng {
         VkSurfaceKHR surface()                  { return _surface; }
         VkQueue graphicsQueue()                 { return _graphicsQueue; }
         VkQueue presentQueue()                  { return _presentQueue; }
+        VkPipelineCache pipelineCache()         { return _pipelineCache; }
+
+        // Destroy GPU objects once the frames that may use them have finished. See DeletionQueue.
+        DeletionQueue& deletionQueue()          { return _deletionQueue; }
+        void deferDestroy(std::function<void()>&& destroy) { _deletionQueue.push(std::move(destroy)); }
+
+        // No surface, no present queue and no swapchain extension. See OffscreenTarget.
+        bool headless() const                   { return window.isHeadless(); }
 
 
         SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(_physicalDevice); }
@@ -82,7 +93,7 @@ namespace aveng {
         VkCommandBuffer beginSingleTimeCommands();
 
         void endSingleTimeCommands(VkCommandBuffer commandBuffer);
-        void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+        void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize dstOffset = 0);
         void copyBufferToImage(
             VkBuffer buffer, 
             VkImage image, 
@@ -98,8 +109,17 @@ namespace aveng {
             VkDeviceMemory &imageMemory
         );
 
+        // Write the pipeline cache back to disk. Called on shutdown, safe to call at any time.
+        void savePipelineCache();
+
         VkPhysicalDeviceProperties properties;
 
+        // What createLogicalDevice turned on. Anything past samplerAnisotropy is optional, check before relying on it.
+        VkPhysicalDeviceFeatures enabledFeatures{};
+
+        // VK_KHR_draw_indirect_count, null when the device doesn't have it
+        PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr;
+
     private:
         void createInstance();
         void setupDebugMessenger();
@@ -107,6 +127,7 @@ namespace aveng {
         void pickPhysicalDevice();
         void createLogicalDevice();
         void createCommandPool();
+        void createPipelineCache();
 
         // helper functions
         bool isDeviceSuitable(VkPhysicalDevice device);
@@ -116,6 +137,7 @@ namespace aveng {
         void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo);
         void hasGflwRequiredInstanceExtensions();
         bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+        bool hasDeviceExtension(VkPhysicalDevice device, const char* name);
         SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
         /*
@@ -124,8 +146,11 @@ namespace aveng {
 
         // Validation layer to be enabled
         const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
-        // Extensions to be enabled
-        const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+        // Extensions to be enabled. Emptied when headless.
+        std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+
+        // Pipeline cache blob, relative to the working directory like our shaders/ and textures/
+        const std::string pipelineCachePath = "pipeline_cache.bin";
     };
 
 }  // namespace lve
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "FrameArena.h"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace aveng {
+
+    FrameArena::FrameArena(EngineDevice& device, VkDeviceSize size, VkBufferUsageFlags bufferUsage)
+        : engineDevice{ device }, usage{ bufferUsage }
+    {
+        const VkPhysicalDeviceLimits& limits = engineDevice.properties.limits;
+        minAlignment = std::max(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment);
+
+        buffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+        sizes.resize(SwapChain::MAX_FRAMES_IN_FLIGHT, 0);
+        generations.resize(SwapChain::MAX_FRAMES_IN_FLIGHT, 0);
+        for (int i = 0; i < SwapChain::MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            createBuffer(i, size);
+        }
+    }
+
+    void FrameArena::createBuffer(int frameIndex, VkDeviceSize size)
+    {
+        // The buffer it replaces may still be read by the slot's last frame, its destructor defers the destruction
+        buffers[frameIndex] = std::make_unique<AvengBuffer>(
+            engineDevice,
+            size,
+            1,
+            usage,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+
+        // Mapped for the life of the buffer
+        buffers[frameIndex]->map();
+        sizes[frameIndex] = size;
+    }
+
+    void FrameArena::begin(int frameIndex, VkDeviceSize minimumSize)
+    {
+        assert(frameIndex >= 0 && frameIndex < static_cast<int>(buffers.size()) && "Frame index out of range");
+        currentFrame = frameIndex;
+        head = 0;
+
+        if (minimumSize > sizes[frameIndex])
+        {
+            // Half again as much, so a scene that keeps growing doesn't replace the buffer every frame
+            createBuffer(frameIndex, std::max(minimumSize, sizes[frameIndex] + sizes[frameIndex] / 2));
+            generations[frameIndex]++;
+        }
+    }
+
+    void FrameArena::flush()
+    {
+        if (head > 0)
+        {
+            buffers[currentFrame]->flush();
+        }
+    }
+
+    FrameArena::Allocation FrameArena::allocate(VkDeviceSize size, VkDeviceSize alignment)
+    {
+        if (alignment == 0) alignment = minAlignment;
+
+        // Alignments are powers of two
+        VkDeviceSize offset = (head + alignment - 1) & ~(alignment - 1);
+        if (offset + size > sizes[currentFrame])
+        {
+            throw std::runtime_error("Frame arena exhausted, ask begin() for more.");
+        }
+
+        head = offset + size;
+
+        char* base = static_cast<char*>(buffers[currentFrame]->getMappedMemory());
+        return { offset, base + offset };
+    }
+
+    VkDescriptorBufferInfo FrameArena::descriptorInfo(int frameIndex, VkDeviceSize range) const
+    {
+        return VkDescriptorBufferInfo{ buffers[frameIndex]->getBuffer(), 0, range };
+    }
+
+}  // namespace aveng
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "EngineDevice.h"
+#include "aveng_buffer.h"
+#include "swapchain.h"
+
+// std lib headers
+#include <cstring>
+#include <memory>
+#include <vector>
+
+/**
+* @class FrameArena
+* Transient per frame memory for uniforms, instance data and anything else that's rewritten every frame.
+* One persistently mapped buffer per frame in flight; allocations are a pointer bump aligned for use as a
+* dynamic uniform/storage buffer offset, and the whole thing is reset when the frame slot comes around
+* again (its fence has signaled by then, see Renderer::beginFrame).
+*
+* Descriptors point at the frame's buffer once, with the range of a single element. Each draw then
+* binds with the allocation's offset as the dynamic offset. Indirect draw commands and their counts
+* are read straight out of the arena as well.
+*
+* A slot grows when begin() is asked for more than it has. Its buffer is replaced, the old one waits
+* in the deletion queue, and the slot's generation goes up so descriptors over it get written again.
+*/
+namespace aveng {
+
+    class FrameArena {
+    public:
+
+        struct Allocation {
+            VkDeviceSize offset;
+            void* data;
+
+            uint32_t dynamicOffset() const { return static_cast<uint32_t>(offset); }
+        };
+
+        FrameArena(
+            EngineDevice& device,
+            VkDeviceSize bytesPerFrame,
+            VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+        );
+
+        FrameArena(const FrameArena&) = delete;
+        FrameArena& operator=(const FrameArena&) = delete;
+
+        // Start handing out this frame slot's memory from the top. Only after the slot's fence has been waited on.
+        // A slot smaller than minimumSize is replaced by a bigger one first.
+        void begin(int frameIndex, VkDeviceSize minimumSize = 0);
+
+        // Make this frame's writes visible to the device. Call before the frame is submitted.
+        void flush();
+
+        // alignment 0 uses the device's uniform/storage offset alignment. Throws if the frame runs out of room.
+        Allocation allocate(VkDeviceSize size, VkDeviceSize alignment = 0);
+
+        template<typename T>
+        Allocation push(const T& value)
+        {
+            Allocation allocation = allocate(sizeof(T));
+            std::memcpy(allocation.data, &value, sizeof(T));
+            return allocation;
+        }
+
+        VkBuffer getBuffer(int frameIndex) const { return buffers[frameIndex]->getBuffer(); }
+
+        // For reading back what the device wrote into a slot. Only after its fence, and invalidate first.
+        void* getMappedMemory(int frameIndex) const { return buffers[frameIndex]->getMappedMemory(); }
+        void invalidate(int frameIndex) { buffers[frameIndex]->invalidate(); }
+
+        // For a descriptor over one element of size range, the offset is supplied at bind time
+        VkDescriptorBufferInfo descriptorInfo(int frameIndex, VkDeviceSize range) const;
+
+        // Goes up every time the slot's buffer is replaced. Descriptors written for another generation point at a dead buffer.
+        uint32_t getGeneration(int frameIndex) const { return generations[frameIndex]; }
+
+        VkDeviceSize used() const { return head; }
+        VkDeviceSize capacity() const { return sizes[currentFrame]; }
+
+    private:
+
+        void createBuffer(int frameIndex, VkDeviceSize size);
+
+        EngineDevice& engineDevice;
+        VkBufferUsageFlags usage;
+        VkDeviceSize minAlignment;
+
+        std::vector<std::unique_ptr<AvengBuffer>> buffers;
+        std::vector<VkDeviceSize> sizes;
+        std::vector<uint32_t> generations;
+        int currentFrame = 0;
+        VkDeviceSize head = 0;
+
+    };
+
+}  // namespace aveng
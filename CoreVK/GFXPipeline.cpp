@@ -2,6 +2,7 @@
 #include "../Core/aveng_model.h"
 
 #include <cassert>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <stdexcept>
@@ -17,25 +18,55 @@ namespace aveng {
 	) 
 		: engDevice {device}
 	{
-		createGFXPipeline(vertFilepath, fragFilepath, config);
+		/**
+		 *	Read our vertex and fragment code
+		 */
+		auto vertCode = readFile(vertFilepath);
+		auto fragCode = readFile(fragFilepath);
+
+		// Debug vectors
+		//std::cout << "Vertex Shader: " << vertCode.size() << std::endl;
+		//std::cout << "FragmentShader: " << fragCode.size() << std::endl;
+
+		// Initialize shader modules!
+		createShaderModule(engDevice, vertCode, &vertShaderModule);
+		createShaderModule(engDevice, fragCode, &fragShaderModule);
+
+		createGFXPipeline(config);
+	}
+
+	GFXPipeline::GFXPipeline(
+		EngineDevice& device,
+		VkShaderModule vertModule,
+		VkShaderModule fragModule,
+		const PipelineConfig& config
+	)
+		: engDevice{ device }, vertShaderModule{ vertModule }, fragShaderModule{ fragModule }, ownsShaderModules{ false }
+	{
+		createGFXPipeline(config);
 	}
 
 	GFXPipeline::~GFXPipeline()
 	{
-		// Destroy!
-		vkDestroyShaderModule(engDevice.device(), vertShaderModule, nullptr);
-		vkDestroyShaderModule(engDevice.device(), fragShaderModule, nullptr);
-		vkDestroyPipeline(engDevice.device(), graphicsPipeline, nullptr);
+		// Destroy! Modules are only needed to create the pipeline, so they can go right away.
+		if (ownsShaderModules)
+		{
+			vkDestroyShaderModule(engDevice.device(), vertShaderModule, nullptr);
+			vkDestroyShaderModule(engDevice.device(), fragShaderModule, nullptr);
+		}
+
+		// The pipeline may still be bound in a frame in flight, e.g. after a hot reload
+		EngineDevice& device = engDevice;
+		VkPipeline pipeline = graphicsPipeline;
+		engDevice.deferDestroy([&device, pipeline] {
+			vkDestroyPipeline(device.device(), pipeline, nullptr);
+		});
 	}
 
 	/**
-	 *	Read our vertex and fragment code
+	 *	Build the pipeline from our shader modules and the provided config
 	 */
-	void GFXPipeline::createGFXPipeline(
-		const std::string& vertFilepath,
-		const std::string& fragFilepath,
-		const PipelineConfig& configInfo
-	)
+	void GFXPipeline::createGFXPipeline(const PipelineConfig& configInfo)
 	{
 		assert(
 			configInfo.pipelineLayout != VK_NULL_HANDLE &&
@@ -44,16 +75,22 @@ namespace aveng {
 			configInfo.renderPass != VK_NULL_HANDLE &&
 			"Cannot create graphics pipeline: no renderPass provided in configInfo");
 
-		auto vertCode = readFile(vertFilepath);
-		auto fragCode = readFile(fragFilepath);
+		// Map constant_id i to the i'th word of our constants
+		std::vector<VkSpecializationMapEntry> specializationEntries(configInfo.specializationConstants.size());
+		for (uint32_t i = 0; i < specializationEntries.size(); i++)
+		{
+			specializationEntries[i].constantID = i;
+			specializationEntries[i].offset		= i * sizeof(uint32_t);
+			specializationEntries[i].size		= sizeof(uint32_t);
+		}
 
-		// Debug vectors
-		//std::cout << "Vertex Shader: " << vertCode.size() << std::endl;
-		//std::cout << "FragmentShader: " << fragCode.size() << std::endl;
+		VkSpecializationInfo specializationInfo{};
+		specializationInfo.mapEntryCount	= static_cast<uint32_t>(specializationEntries.size());
+		specializationInfo.pMapEntries		= specializationEntries.data();
+		specializationInfo.dataSize			= configInfo.specializationConstants.size() * sizeof(uint32_t);
+		specializationInfo.pData			= configInfo.specializationConstants.data();
 
-		// Initialize shader modules!
-		createShaderModule(vertCode, &vertShaderModule);
-		createShaderModule(fragCode, &fragShaderModule);
+		const VkSpecializationInfo* pSpecializationInfo = specializationEntries.empty() ? nullptr : &specializationInfo;
 
 		VkPipelineShaderStageCreateInfo shaderStages[2];
 
@@ -64,7 +101,7 @@ namespace aveng {
 		shaderStages[0].pName = "main";		// Name of the entry function in our vertex shader
 		shaderStages[0].flags = 0;
 		shaderStages[0].pNext = nullptr;
-		shaderStages[0].pSpecializationInfo = nullptr;
+		shaderStages[0].pSpecializationInfo = pSpecializationInfo;
 
 		// Fragment
 		shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -74,7 +111,7 @@ namespace aveng {
 		shaderStages[1].pName = "main";		// Name of the entry function in our fragment shader
 		shaderStages[1].flags = 0;
 		shaderStages[1].pNext = nullptr;
-		shaderStages[1].pSpecializationInfo = nullptr;
+		shaderStages[1].pSpecializationInfo = pSpecializationInfo;
 
 		auto& bindingDescriptions = configInfo.bindingDescriptions;
 		auto& attributeDescriptions = configInfo.attributeDescriptions;
@@ -124,7 +161,8 @@ namespace aveng {
 		pipelineInfo.basePipelineIndex = -1;
 		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-		if (vkCreateGraphicsPipelines(engDevice.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
+		// The device's pipeline cache is shared by every pipeline and persisted between runs
+		if (vkCreateGraphicsPipelines(engDevice.device(), engDevice.pipelineCache(), 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to create graphics pipeline");
 		}
@@ -169,7 +207,7 @@ namespace aveng {
 		return buffer;
 	}
 
-	void GFXPipeline::createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule)
+	void GFXPipeline::createShaderModule(EngineDevice& engDevice, const std::vector<char>& code, VkShaderModule* shaderModule)
 	{
 		// Struct which carries our parameters
 		VkShaderModuleCreateInfo createInfo{};
@@ -273,4 +311,38 @@ namespace aveng {
 		
 	}
 
+	/**
+	* PipelineConfig points into itself (blend attachment, dynamic states), so a
+	* member-wise copy would leave dst pointing at src. Copy, then fix those up.
+	*/
+	void GFXPipeline::copyPipelineConfig(const PipelineConfig& src, PipelineConfig& dst)
+	{
+		dst.attributeDescriptions	= src.attributeDescriptions;
+		dst.bindingDescriptions		= src.bindingDescriptions;
+		dst.viewportInfo			= src.viewportInfo;
+		dst.inputAssemblyInfo		= src.inputAssemblyInfo;
+		dst.rasterizationInfo		= src.rasterizationInfo;
+		dst.multisampleInfo			= src.multisampleInfo;
+		dst.colorBlendAttachment	= src.colorBlendAttachment;
+		dst.colorBlendInfo			= src.colorBlendInfo;
+		dst.depthStencilInfo		= src.depthStencilInfo;
+		dst.dynamicStateEnables		= src.dynamicStateEnables;
+		dst.dynamicStateInfo		= src.dynamicStateInfo;
+		dst.pipelineLayout			= src.pipelineLayout;
+		dst.renderPass				= src.renderPass;
+		dst.subpass					= src.subpass;
+		dst.specializationConstants	= src.specializationConstants;
+
+		dst.colorBlendInfo.pAttachments = &dst.colorBlendAttachment;
+		dst.dynamicStateInfo.pDynamicStates = dst.dynamicStateEnables.data();
+		dst.dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(dst.dynamicStateEnables.size());
+	}
+
+	uint32_t GFXPipeline::specializationFloat(float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
 }
\ No newline at end of file
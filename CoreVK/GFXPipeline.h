@@ -33,6 +33,10 @@ namespace aveng {
 		VkPipelineLayout pipelineLayout = nullptr;
 		VkRenderPass renderPass = nullptr;
 		uint32_t subpass = 0;
+
+		// Specialization constants, 4 bytes each. Entry i is constant_id = i and is offered to both stages;
+		// a stage which doesn't declare that id ignores it. Floats go in through GFXPipeline::specializationFloat.
+		std::vector<uint32_t> specializationConstants{};
 	};
 	
 	/**
@@ -45,6 +49,7 @@ namespace aveng {
 		VkPipeline graphicsPipeline;		// typedef pointer
 		VkShaderModule vertShaderModule;	// typedef pointer
 		VkShaderModule fragShaderModule;	// typedef pointer
+		bool ownsShaderModules = true;		// False when the modules are shared with other pipelines
 
 	public:
 
@@ -55,18 +60,32 @@ namespace aveng {
 			const PipelineConfig& config
 		);
 
+		// Build from shader modules owned elsewhere (see PipelineRegistry). The modules are not destroyed with the pipeline.
+		GFXPipeline(
+			EngineDevice& device,
+			VkShaderModule vertModule,
+			VkShaderModule fragModule,
+			const PipelineConfig& config
+		);
+
 		~GFXPipeline();
 		GFXPipeline(const GFXPipeline&) = delete;
 		GFXPipeline& operator=(const GFXPipeline&) = delete;
 		void bind(VkCommandBuffer commandBuffer);
 		static void defaultPipelineConfig(PipelineConfig& configInfo);
 
-	private:
+		// The bit pattern of a float specialization constant
+		static uint32_t specializationFloat(float value);
+
+		// Deep copy, re-pointing the create infos at dst's own members
+		static void copyPipelineConfig(const PipelineConfig& src, PipelineConfig& dst);
 
-		// These are both public now...
 		static std::vector<char> readFile(const std::string& filepath);
-		void createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule);
-		void createGFXPipeline(const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfig& config);
+		static void createShaderModule(EngineDevice& device, const std::vector<char>& code, VkShaderModule* shaderModule);
+
+	private:
+
+		void createGFXPipeline(const PipelineConfig& config);
 
 	};
 
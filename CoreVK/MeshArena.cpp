@@ -0,0 +1,295 @@
+#include "MeshArena.h"
+
+// std
+#include <cassert>
+#include <stdexcept>
+
+namespace aveng {
+
+    MeshArena::MeshArena(EngineDevice& device, VkDeviceSize vertexBytes, uint32_t indices)
+        : engineDevice{ device }, vertexUnits{ static_cast<uint32_t>(vertexBytes / VERTEX_UNIT) }, maxIndices{ indices }
+    {
+        ranges = std::make_shared<Ranges>(Ranges{ RangeAllocator{ vertexUnits }, RangeAllocator{ maxIndices } });
+        createBuffers(vertexBuffer, indexBuffer);
+    }
+
+    void MeshArena::createBuffers(std::unique_ptr<AvengBuffer>& vertices, std::unique_ptr<AvengBuffer>& indices)
+    {
+        // Transfer source too, defragment() copies out of them
+        vertices = std::make_unique<AvengBuffer>(
+            engineDevice,
+            VERTEX_UNIT,
+            vertexUnits,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        indices = std::make_unique<AvengBuffer>(
+            engineDevice,
+            sizeof(uint32_t),
+            maxIndices,
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+
+    MeshArena::Handle MeshArena::add(const std::string& key, const void* vertices, uint32_t vertexCount, uint32_t vertexStride, const std::vector<uint32_t>& indices)
+    {
+        if (!key.empty())
+        {
+            auto it = byKey.find(key);
+            if (it != byKey.end())
+            {
+                entries[it->second].refs++;
+                return it->second;
+            }
+        }
+
+        if (indices.empty() || vertexCount == 0)
+        {
+            throw std::runtime_error("Mesh arena only takes indexed meshes, " + (key.empty() ? std::string("unnamed mesh") : key) + " has none");
+        }
+
+        assert(vertexStride > 0 && vertexStride % VERTEX_UNIT == 0 && "Vertex stride must be a multiple of 4");
+        const uint32_t indexCount = static_cast<uint32_t>(indices.size());
+
+        Mesh mesh{};
+        if (!allocate(vertexCount, vertexStride, indexCount, mesh))
+        {
+            // There may be room in total, just not in one piece. Packing also reclaims ranges still waiting on the GPU.
+            if (!defragment() || !allocate(vertexCount, vertexStride, indexCount, mesh))
+            {
+                throw std::runtime_error("Mesh arena is full, can't add " + key);
+            }
+        }
+
+        // Indices stay relative to the mesh, vertexOffset rebases them at draw time
+        upload(*vertexBuffer, static_cast<VkDeviceSize>(mesh.vertexOffset) * vertexStride, vertices, vertexCount * vertexStride);
+        upload(*indexBuffer, mesh.firstIndex * sizeof(uint32_t), indices.data(), indexCount * sizeof(uint32_t));
+
+        Handle handle;
+        if (!freeHandles.empty())
+        {
+            handle = freeHandles.back();
+            freeHandles.pop_back();
+        }
+        else {
+            handle = static_cast<Handle>(entries.size());
+            entries.emplace_back();
+        }
+
+        entries[handle] = Entry{ key, mesh, 1 };
+        if (!key.empty()) byKey.emplace(key, handle);
+
+        return handle;
+    }
+
+    bool MeshArena::allocate(uint32_t vertexCount, uint32_t vertexStride, uint32_t indexCount, Mesh& mesh)
+    {
+        // Starting on a whole vertex of its own layout keeps vertexOffset exact
+        const uint32_t unitsPerVertex = vertexStride / VERTEX_UNIT;
+        const uint32_t vertexUnitCount = vertexCount * unitsPerVertex;
+
+        uint32_t vertexUnit, firstIndex;
+        if (!ranges->vertices.allocate(vertexUnitCount, unitsPerVertex, vertexUnit)) return false;
+        if (!ranges->indices.allocate(indexCount, 1, firstIndex))
+        {
+            ranges->vertices.free(vertexUnit, vertexUnitCount);
+            return false;
+        }
+
+        mesh.firstIndex = firstIndex;
+        mesh.vertexOffset = static_cast<int32_t>(vertexUnit / unitsPerVertex);
+        mesh.indexCount = indexCount;
+        mesh.vertexCount = vertexCount;
+        mesh.vertexStride = vertexStride;
+        return true;
+    }
+
+    void MeshArena::release(Handle handle)
+    {
+        if (handle == INVALID_HANDLE) return;
+
+        Entry& entry = entries[handle];
+        assert(entry.refs > 0 && "Mesh released more often than it was added");
+        if (--entry.refs > 0) return;
+
+        if (!entry.key.empty()) byKey.erase(entry.key);
+        freeHandles.push_back(handle);
+
+        // Frames already recorded may still draw from the range. If the arena is defragmented in the
+        // meantime the range isn't in the new buffers anyway, and the free is dropped.
+        std::shared_ptr<Ranges> shared = ranges;
+        uint32_t generation = ranges->generation;
+        Mesh mesh = entry.mesh;
+        engineDevice.deferDestroy([shared, generation, mesh] {
+            if (shared->generation != generation) return;
+            const uint32_t unitsPerVertex = mesh.vertexStride / VERTEX_UNIT;
+            shared->vertices.free(static_cast<uint32_t>(mesh.vertexOffset) * unitsPerVertex, mesh.vertexCount * unitsPerVertex);
+            shared->indices.free(mesh.firstIndex, mesh.indexCount);
+        });
+
+        entry = Entry{};
+    }
+
+    const MeshArena::Mesh* MeshArena::find(const std::string& key) const
+    {
+        auto it = byKey.find(key);
+        return it == byKey.end() ? nullptr : &entries[it->second].mesh;
+    }
+
+    /*
+    * Copies every live mesh into new buffers rather than sliding them down in place, regions of one
+    * vkCmdCopyBuffer mustn't overlap and frames in flight are still reading the old buffers anyway.
+    * Those are released through the deletion queue like any other buffer.
+    */
+    bool MeshArena::defragment()
+    {
+        if (ranges->vertices.packed() && ranges->indices.packed()) return false;
+
+        std::unique_ptr<AvengBuffer> newVertices;
+        std::unique_ptr<AvengBuffer> newIndices;
+        createBuffers(newVertices, newIndices);
+
+        std::vector<VkBufferCopy> vertexCopies;
+        std::vector<VkBufferCopy> indexCopies;
+        uint32_t vertexHead = 0;        // In VERTEX_UNITs
+        uint32_t indexHead = 0;
+
+        for (Entry& entry : entries)
+        {
+            if (entry.refs == 0) continue;
+            Mesh& mesh = entry.mesh;
+
+            // Round up to a whole vertex of this mesh's layout, see allocate()
+            const uint32_t unitsPerVertex = mesh.vertexStride / VERTEX_UNIT;
+            const uint32_t newVertexOffset = (vertexHead + unitsPerVertex - 1) / unitsPerVertex;
+
+            vertexCopies.push_back({
+                static_cast<VkDeviceSize>(mesh.vertexOffset) * mesh.vertexStride,
+                static_cast<VkDeviceSize>(newVertexOffset) * mesh.vertexStride,
+                static_cast<VkDeviceSize>(mesh.vertexCount) * mesh.vertexStride });
+            indexCopies.push_back({
+                mesh.firstIndex * sizeof(uint32_t),
+                indexHead * sizeof(uint32_t),
+                mesh.indexCount * sizeof(uint32_t) });
+
+            mesh.vertexOffset = static_cast<int32_t>(newVertexOffset);
+            mesh.firstIndex = indexHead;
+            vertexHead = (newVertexOffset + mesh.vertexCount) * unitsPerVertex;
+            indexHead += mesh.indexCount;
+        }
+
+        if (!vertexCopies.empty())
+        {
+            VkCommandBuffer commandBuffer = engineDevice.beginSingleTimeCommands();
+            vkCmdCopyBuffer(commandBuffer, vertexBuffer->getBuffer(), newVertices->getBuffer(), static_cast<uint32_t>(vertexCopies.size()), vertexCopies.data());
+            vkCmdCopyBuffer(commandBuffer, indexBuffer->getBuffer(), newIndices->getBuffer(), static_cast<uint32_t>(indexCopies.size()), indexCopies.data());
+            engineDevice.endSingleTimeCommands(commandBuffer);
+        }
+
+        vertexBuffer = std::move(newVertices);
+        indexBuffer = std::move(newIndices);
+
+        ranges->generation++;
+        ranges->vertices.reset(vertexHead);
+        ranges->indices.reset(indexHead);
+        return true;
+    }
+
+    void MeshArena::bind(VkCommandBuffer commandBuffer)
+    {
+        VkBuffer buffers[] = { vertexBuffer->getBuffer() };
+        VkDeviceSize offsets[] = { 0 };
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+    }
+
+    void MeshArena::upload(AvengBuffer& dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+    {
+        AvengBuffer stagingBuffer{
+            engineDevice,
+            size,
+            1,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+        };
+
+        stagingBuffer.map();
+        stagingBuffer.writeToBuffer(const_cast<void*>(data), size);
+
+        engineDevice.copyBuffer(stagingBuffer.getBuffer(), dst.getBuffer(), size, dstOffset);
+    }
+
+    MeshArena::RangeAllocator::RangeAllocator(uint32_t size)
+        : capacity{ size }, freeTotal{ size }
+    {
+        if (capacity > 0) blocks.push_back({ 0, capacity });
+    }
+
+    bool MeshArena::RangeAllocator::allocate(uint32_t count, uint32_t alignment, uint32_t& offset)
+    {
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            Block& block = blocks[i];
+            const uint32_t start = (block.offset + alignment - 1) / alignment * alignment;
+            const uint32_t padding = start - block.offset;
+            if (block.count < padding + count) continue;
+
+            const uint32_t end = block.offset + block.count;
+            offset = start;
+
+            if (padding == 0)
+            {
+                block.offset += count;
+                block.count -= count;
+                if (block.count == 0) blocks.erase(blocks.begin() + i);
+            }
+            else {
+                // The padding in front stays free, and so does whatever is left behind
+                block.count = padding;
+                if (start + count < end) blocks.insert(blocks.begin() + i + 1, Block{ start + count, end - start - count });
+            }
+
+            freeTotal -= count;
+            return true;
+        }
+        return false;
+    }
+
+    void MeshArena::RangeAllocator::free(uint32_t offset, uint32_t count)
+    {
+        if (count == 0) return;
+
+        // First block past the freed range
+        size_t next = 0;
+        while (next < blocks.size() && blocks[next].offset < offset) next++;
+
+        const bool joinsPrevious = next > 0 && blocks[next - 1].offset + blocks[next - 1].count == offset;
+        const bool joinsNext = next < blocks.size() && offset + count == blocks[next].offset;
+
+        if (joinsPrevious && joinsNext)
+        {
+            blocks[next - 1].count += count + blocks[next].count;
+            blocks.erase(blocks.begin() + next);
+        }
+        else if (joinsPrevious) {
+            blocks[next - 1].count += count;
+        }
+        else if (joinsNext) {
+            blocks[next].offset = offset;
+            blocks[next].count += count;
+        }
+        else {
+            blocks.insert(blocks.begin() + next, Block{ offset, count });
+        }
+
+        freeTotal += count;
+    }
+
+    void MeshArena::RangeAllocator::reset(uint32_t used)
+    {
+        blocks.clear();
+        if (used < capacity) blocks.push_back({ used, capacity - used });
+        freeTotal = capacity - used;
+    }
+
+}  // namespace aveng
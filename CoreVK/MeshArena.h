@@ -0,0 +1,139 @@
+#pragma once
+
+#include "EngineDevice.h"
+#include "aveng_buffer.h"
+
+// std lib headers
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+* @class MeshArena
+* One device local vertex buffer and one index buffer shared by every mesh placed in it. A mesh is a
+* { firstIndex, vertexOffset, indexCount } range, which is exactly what vkCmdDrawIndexed and a
+* VkDrawIndexedIndirectCommand need, so the arena is bound once per frame and any number of meshes are
+* drawn from it without rebinding.
+*
+* Meshes don't have to share a vertex layout. Each one sits at a multiple of its own stride, so its
+* vertexOffset counts whole vertices of its layout and the pipeline drawing it supplies the stride.
+*
+* Meshes are added under a key (the file path, usually) and reference counted; adding the same key again
+* hands back the mesh already uploaded. Ranges come from a first fit free list per buffer. Released ranges
+* go back to it once the frames that may still read them have finished, and when a mesh doesn't fit
+* anywhere although there's room in total, the arena is defragmented: every live mesh is copied, packed,
+* into a fresh pair of buffers.
+*/
+namespace aveng {
+
+    class MeshArena {
+    public:
+
+        using Handle = uint32_t;
+        static constexpr Handle INVALID_HANDLE = ~0u;
+
+        struct Mesh {
+            uint32_t firstIndex = 0;
+            int32_t  vertexOffset = 0;
+            uint32_t indexCount = 0;
+            uint32_t vertexCount = 0;
+            uint32_t vertexStride = 0;      // Bytes, vertexOffset counts in these
+
+            bool resident() const { return indexCount > 0; }
+        };
+
+        MeshArena(EngineDevice& device, VkDeviceSize vertexBytes, uint32_t maxIndices);
+
+        MeshArena(const MeshArena&) = delete;
+        MeshArena& operator=(const MeshArena&) = delete;
+
+        // Upload a mesh, or take another reference to the one already stored under key. An empty key is never
+        // shared. vertices is vertexCount * vertexStride bytes, the stride a multiple of 4. Throws if the arena is full
+        // even after defragmenting.
+        Handle add(const std::string& key, const void* vertices, uint32_t vertexCount, uint32_t vertexStride, const std::vector<uint32_t>& indices);
+
+        // Drop a reference. The last one frees the mesh's ranges after the frames in flight are done with them.
+        void release(Handle handle);
+
+        // Offsets change when the arena is defragmented, look them up when recording rather than keeping them
+        const Mesh& get(Handle handle) const { return entries[handle].mesh; }
+
+        // nullptr if nothing is stored under key
+        const Mesh* find(const std::string& key) const;
+
+        // Pack every live mesh to the front of new buffers. Waits on the queue, so not something for every frame.
+        // False if there was nothing to pack.
+        bool defragment();
+
+        // Bind both buffers. Every mesh in the arena is drawable after this.
+        void bind(VkCommandBuffer commandBuffer);
+
+        VkDeviceSize vertexBytesUsed() const { return static_cast<VkDeviceSize>(vertexUnits - ranges->vertices.available()) * VERTEX_UNIT; }
+        uint32_t indicesUsed() const { return maxIndices - ranges->indices.available(); }
+        uint32_t meshCount() const { return static_cast<uint32_t>(entries.size() - freeHandles.size()); }
+        uint32_t defragmentations() const { return ranges->generation; }
+
+    private:
+
+        // The vertex buffer is handed out in these, every stride is a multiple of it
+        static constexpr uint32_t VERTEX_UNIT = 4;
+
+        // First fit over a sorted list of free [offset, offset + count) blocks, neighbours merged on free
+        class RangeAllocator {
+        public:
+            explicit RangeAllocator(uint32_t capacity);
+
+            // offset comes back a multiple of alignment, which needn't be a power of two
+            bool allocate(uint32_t count, uint32_t alignment, uint32_t& offset);
+            void free(uint32_t offset, uint32_t count);
+
+            // Everything below used is taken, the rest is one free block
+            void reset(uint32_t used);
+
+            uint32_t available() const { return freeTotal; }
+            bool packed() const { return blocks.empty() || (blocks.size() == 1 && blocks[0].offset + blocks[0].count == capacity); }
+
+        private:
+            struct Block {
+                uint32_t offset;
+                uint32_t count;
+            };
+
+            std::vector<Block> blocks;
+            uint32_t capacity;
+            uint32_t freeTotal;
+        };
+
+        // Shared with the deferred frees, which may run after the arena is gone
+        struct Ranges {
+            RangeAllocator vertices;
+            RangeAllocator indices;
+            uint32_t generation = 0;        // Bumped by defragment(), frees from before it are stale
+        };
+
+        struct Entry {
+            std::string key;
+            Mesh mesh{};
+            uint32_t refs = 0;
+        };
+
+        void createBuffers(std::unique_ptr<AvengBuffer>& vertices, std::unique_ptr<AvengBuffer>& indices);
+        bool allocate(uint32_t vertexCount, uint32_t vertexStride, uint32_t indexCount, Mesh& mesh);
+        void upload(AvengBuffer& dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+
+        EngineDevice& engineDevice;
+        uint32_t vertexUnits;
+        uint32_t maxIndices;
+
+        std::unique_ptr<AvengBuffer> vertexBuffer;
+        std::unique_ptr<AvengBuffer> indexBuffer;
+
+        std::shared_ptr<Ranges> ranges;
+        std::vector<Entry> entries;
+        std::vector<Handle> freeHandles;
+        std::unordered_map<std::string, Handle> byKey;
+
+    };
+
+}  // namespace aveng
@@ -0,0 +1,432 @@
+#include "OffscreenTarget.h"
+
+// std
+#include <array>
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+
+namespace aveng {
+
+    OffscreenTarget::OffscreenTarget(EngineDevice& deviceRef, VkExtent2D targetExtent)
+        : device{ deviceRef }, extent{ targetExtent }
+    {
+        depthFormat = findDepthFormat();
+        createImages();
+        createRenderPass();
+        createFramebuffers();
+        createReadbackBuffers();
+        createSyncObjects();
+    }
+
+    OffscreenTarget::~OffscreenTarget()
+    {
+        vkWaitForFences(
+            device.device(),
+            static_cast<uint32_t>(inFlightFences.size()),
+            inFlightFences.data(),
+            VK_TRUE,
+            std::numeric_limits<uint64_t>::max()
+        );
+
+        for (auto& slot : readbacks) {
+            vkUnmapMemory(device.device(), slot.memory);
+            vkDestroyBuffer(device.device(), slot.buffer, nullptr);
+            vkFreeMemory(device.device(), slot.memory, nullptr);
+        }
+
+        for (auto framebuffer : framebuffers) {
+            vkDestroyFramebuffer(device.device(), framebuffer, nullptr);
+        }
+
+        for (size_t i = 0; i < colorImages.size(); i++) {
+            vkDestroyImageView(device.device(), colorImageViews[i], nullptr);
+            vkDestroyImage(device.device(), colorImages[i], nullptr);
+            vkFreeMemory(device.device(), colorImageMemorys[i], nullptr);
+
+            vkDestroyImageView(device.device(), depthImageViews[i], nullptr);
+            vkDestroyImage(device.device(), depthImages[i], nullptr);
+            vkFreeMemory(device.device(), depthImageMemorys[i], nullptr);
+        }
+
+        vkDestroyRenderPass(device.device(), renderPass, nullptr);
+
+        for (auto fence : inFlightFences) {
+            vkDestroyFence(device.device(), fence, nullptr);
+        }
+    }
+
+    /*
+    * Wait for this slot's previous frame, hand its pixels to the callback, and reuse the slot.
+    * There is no presentation engine to hand us an image, so the index is just the frame slot.
+    */
+    VkResult OffscreenTarget::acquireNextImage(uint32_t* imageIndex)
+    {
+        waitForFrameFence();
+        deliverReadback(currentFrame);
+
+        *imageIndex = static_cast<uint32_t>(currentFrame);
+        return VK_SUCCESS;
+    }
+
+    void OffscreenTarget::waitForFrameFence()
+    {
+        vkWaitForFences(
+            device.device(),
+            1,
+            &inFlightFences[currentFrame],
+            VK_TRUE,
+            std::numeric_limits<uint64_t>::max()
+        );
+    }
+
+    void OffscreenTarget::setFramesInFlight(uint32_t count)
+    {
+        assert(count >= 1 && count <= SwapChain::MAX_FRAMES_IN_FLIGHT && "Frames in flight out of range");
+        framesInFlight = count;
+        currentFrame %= framesInFlight;
+    }
+
+    VkResult OffscreenTarget::submitCommandBuffers(const VkCommandBuffer* buffers, uint32_t* imageIndex)
+    {
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = buffers;
+
+        vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
+        if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit offscreen command buffer!");
+        }
+
+        readbacks[*imageIndex].frameNumber = frameCounter++;
+        currentFrame = (currentFrame + 1) % framesInFlight;
+
+        return VK_SUCCESS;
+    }
+
+    void OffscreenTarget::recordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+    {
+        // The render pass already left the image in TRANSFER_SRC_OPTIMAL and made the writes visible to transfers
+        VkBufferImageCopy region{};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = { extent.width, extent.height, 1 };
+
+        vkCmdCopyImageToBuffer(
+            commandBuffer,
+            colorImages[imageIndex],
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            readbacks[imageIndex].buffer,
+            1,
+            &region
+        );
+
+        // Make the copy visible to the host once the fence signals
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = readbacks[imageIndex].buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            0,
+            0, nullptr,
+            1, &barrier,
+            0, nullptr
+        );
+
+        readbacks[imageIndex].pending = true;
+    }
+
+    void OffscreenTarget::flushReadbacks()
+    {
+        // Oldest first, so frames arrive in submission order
+        for (size_t i = 0; i < SwapChain::MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            size_t slot = (currentFrame + i) % SwapChain::MAX_FRAMES_IN_FLIGHT;
+            vkWaitForFences(device.device(), 1, &inFlightFences[slot], VK_TRUE, std::numeric_limits<uint64_t>::max());
+            deliverReadback(slot);
+        }
+    }
+
+    void OffscreenTarget::deliverReadback(size_t slot)
+    {
+        ReadbackSlot& readback = readbacks[slot];
+        if (!readback.pending) return;
+        readback.pending = false;
+
+        if (!onReadback) return;
+
+        if (!readback.coherent)
+        {
+            VkMappedMemoryRange range{};
+            range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+            range.memory = readback.memory;
+            range.offset = 0;
+            range.size = VK_WHOLE_SIZE;
+            vkInvalidateMappedMemoryRanges(device.device(), 1, &range);
+        }
+
+        Readback frame{};
+        frame.pixels = readback.mapped;
+        frame.width = extent.width;
+        frame.height = extent.height;
+        frame.rowPitch = extent.width * 4;
+        frame.format = colorFormat;
+        frame.frameNumber = readback.frameNumber;
+        onReadback(frame);
+    }
+
+    void OffscreenTarget::createImages()
+    {
+        size_t count = SwapChain::MAX_FRAMES_IN_FLIGHT;
+        colorImages.resize(count);
+        colorImageMemorys.resize(count);
+        colorImageViews.resize(count);
+        depthImages.resize(count);
+        depthImageMemorys.resize(count);
+        depthImageViews.resize(count);
+
+        auto createImage = [&](VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+                               VkImage& image, VkDeviceMemory& memory, VkImageView& view)
+        {
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.extent.width = extent.width;
+            imageInfo.extent.height = extent.height;
+            imageInfo.extent.depth = 1;
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.format = format;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            imageInfo.usage = usage;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.flags = 0;
+
+            device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory);
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = format;
+            viewInfo.subresourceRange.aspectMask = aspect;
+            viewInfo.subresourceRange.baseMipLevel = 0;
+            viewInfo.subresourceRange.levelCount = 1;
+            viewInfo.subresourceRange.baseArrayLayer = 0;
+            viewInfo.subresourceRange.layerCount = 1;
+
+            if (vkCreateImageView(device.device(), &viewInfo, nullptr, &view) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create offscreen image view!");
+            }
+        };
+
+        for (size_t i = 0; i < count; i++)
+        {
+            createImage(
+                colorFormat,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                VK_IMAGE_ASPECT_COLOR_BIT,
+                colorImages[i], colorImageMemorys[i], colorImageViews[i]);
+
+            createImage(
+                depthFormat,
+                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                VK_IMAGE_ASPECT_DEPTH_BIT,
+                depthImages[i], depthImageMemorys[i], depthImageViews[i]);
+        }
+    }
+
+    /*
+    * Identical to SwapChain's render pass apart from the color attachment's final layout, which is
+    * ready for a copy instead of a present. Layouts don't factor into render pass compatibility,
+    * so pipelines don't care which of the two they were built against.
+    */
+    void OffscreenTarget::createRenderPass()
+    {
+        VkAttachmentDescription depthAttachment{};
+        depthAttachment.format = depthFormat;
+        depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentReference depthAttachmentRef{};
+        depthAttachmentRef.attachment = 1;
+        depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentDescription colorAttachment = {};
+        colorAttachment.format = colorFormat;
+        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+        VkAttachmentReference colorAttachmentRef = {};
+        colorAttachmentRef.attachment = 0;
+        colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass = {};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &colorAttachmentRef;
+        subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+        std::array<VkSubpassDependency, 2> dependencies{};
+
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].srcAccessMask = 0;
+        dependencies[0].srcStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].dstStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependencies[0].dstAccessMask =
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        // Color writes must land before the readback copy
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+        std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
+        VkRenderPassCreateInfo renderPassInfo = {};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        renderPassInfo.pAttachments = attachments.data();
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        renderPassInfo.pDependencies = dependencies.data();
+
+        if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create offscreen render pass!");
+        }
+    }
+
+    void OffscreenTarget::createFramebuffers()
+    {
+        framebuffers.resize(imageCount());
+        for (size_t i = 0; i < imageCount(); i++) {
+            std::array<VkImageView, 2> attachments = { colorImageViews[i], depthImageViews[i] };
+
+            VkFramebufferCreateInfo framebufferInfo = {};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = renderPass;
+            framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+            framebufferInfo.pAttachments = attachments.data();
+            framebufferInfo.width = extent.width;
+            framebufferInfo.height = extent.height;
+            framebufferInfo.layers = 1;
+
+            if (vkCreateFramebuffer(device.device(), &framebufferInfo, nullptr, &framebuffers[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create offscreen framebuffer!");
+            }
+        }
+    }
+
+    /*
+    * One tightly packed BGRA8 buffer per frame slot, persistently mapped.
+    * Host cached memory reads back far faster; fall back to coherent if the device doesn't expose it.
+    */
+    void OffscreenTarget::createReadbackBuffers()
+    {
+        readbackSize = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+        readbacks.resize(imageCount());
+
+        for (auto& slot : readbacks)
+        {
+            VkBufferCreateInfo bufferInfo{};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = readbackSize;
+            bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            if (vkCreateBuffer(device.device(), &bufferInfo, nullptr, &slot.buffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create readback buffer!");
+            }
+
+            VkMemoryRequirements memRequirements;
+            vkGetBufferMemoryRequirements(device.device(), slot.buffer, &memRequirements);
+
+            VkMemoryAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.allocationSize = memRequirements.size;
+
+            try {
+                allocInfo.memoryTypeIndex = device.findMemoryType(
+                    memRequirements.memoryTypeBits,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+
+                VkPhysicalDeviceMemoryProperties memProperties;
+                vkGetPhysicalDeviceMemoryProperties(device.physicalDevice(), &memProperties);
+                slot.coherent = (memProperties.memoryTypes[allocInfo.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+            }
+            catch (const std::runtime_error&) {
+                allocInfo.memoryTypeIndex = device.findMemoryType(
+                    memRequirements.memoryTypeBits,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+                slot.coherent = true;
+            }
+
+            if (vkAllocateMemory(device.device(), &allocInfo, nullptr, &slot.memory) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate readback memory!");
+            }
+
+            vkBindBufferMemory(device.device(), slot.buffer, slot.memory, 0);
+            vkMapMemory(device.device(), slot.memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(&slot.mapped));
+        }
+    }
+
+    void OffscreenTarget::createSyncObjects()
+    {
+        inFlightFences.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+        for (size_t i = 0; i < inFlightFences.size(); i++) {
+            if (vkCreateFence(device.device(), &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create synchronization objects for an offscreen frame!");
+            }
+        }
+    }
+
+    VkFormat OffscreenTarget::findDepthFormat()
+    {
+        return device.findSupportedFormat(
+            { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+        );
+    }
+
+}  // namespace aveng
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "EngineDevice.h"
+#include "swapchain.h"
+
+// vulkan headers
+#include <vulkan/vulkan.h>
+
+// std lib headers
+#include <functional>
+#include <vector>
+
+/**
+* @class OffscreenTarget
+* Stands in for the SwapChain when the engine runs headless. Same render pass shape (color + depth,
+* same formats), one color/depth pair per frame in flight, so pipelines built against one are
+* compatible with the other and the frame loop doesn't need to know which it's talking to.
+*
+* Each frame can optionally be copied into a host visible readback buffer at the end of its command
+* buffer. The copy is picked up the next time that frame slot is acquired (its fence has signaled by
+* then), so reading back never stalls the GPU on the frame that was just submitted.
+*/
+namespace aveng {
+
+    class OffscreenTarget {
+    public:
+
+        // Handed to the readback callback. pixels is only valid for the duration of the call.
+        struct Readback {
+            const uint8_t* pixels;
+            uint32_t width;
+            uint32_t height;
+            uint32_t rowPitch;      // bytes
+            VkFormat format;
+            uint64_t frameNumber;
+        };
+
+        using ReadbackCallback = std::function<void(const Readback&)>;
+
+        OffscreenTarget(EngineDevice& deviceRef, VkExtent2D extent);
+        ~OffscreenTarget();
+
+        OffscreenTarget(const OffscreenTarget&) = delete;
+        OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+        uint32_t            width() { return extent.width; }
+        uint32_t            height() { return extent.height; }
+        size_t              imageCount() { return colorImages.size(); }
+        VkRenderPass        getRenderPass() { return renderPass; }
+        VkExtent2D          getSwapChainExtent() { return extent; }
+        VkFormat            getSwapChainImageFormat() { return colorFormat; }
+        VkFramebuffer       getFrameBuffer(int index) { return framebuffers[index]; }
+        VkImage&            getImage(int index) { return colorImages[index]; }
+
+        float extentAspectRatio() {
+            return static_cast<float>(extent.width) / static_cast<float>(extent.height);
+        }
+
+        // Same contract as SwapChain, minus the semaphores. The image index is always the frame slot.
+        VkResult            acquireNextImage(uint32_t* imageIndex);
+        VkResult            submitCommandBuffers(const VkCommandBuffer* buffers, uint32_t* imageIndex);
+
+        void                waitForFrameFence();
+        VkFence             getFrameFence(size_t frame) { return inFlightFences[frame]; }
+        void                setFramesInFlight(uint32_t count);
+
+        // Frames are only copied back while a callback is set
+        void setReadbackCallback(ReadbackCallback callback) { onReadback = std::move(callback); }
+        bool wantsReadback() const { return static_cast<bool>(onReadback); }
+
+        // Record the color image -> readback buffer copy. Call after the render pass, before ending the command buffer.
+        void recordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+        // Wait for every frame still in flight and deliver its readback. Call before shutting down.
+        void flushReadbacks();
+
+    private:
+
+        struct ReadbackSlot {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            uint8_t* mapped = nullptr;
+            bool coherent = true;
+            bool pending = false;
+            uint64_t frameNumber = 0;
+        };
+
+        void createImages();
+        void createRenderPass();
+        void createFramebuffers();
+        void createReadbackBuffers();
+        void createSyncObjects();
+        void deliverReadback(size_t slot);
+
+        VkFormat findDepthFormat();
+
+        EngineDevice& device;
+        VkExtent2D extent;
+
+        // Matches what SwapChain picks on every desktop surface we've seen, so render passes stay compatible
+        VkFormat colorFormat = VK_FORMAT_B8G8R8A8_SRGB;
+        VkFormat depthFormat;
+
+        VkRenderPass renderPass;
+        std::vector<VkFramebuffer> framebuffers;
+
+        std::vector<VkImage> colorImages;
+        std::vector<VkDeviceMemory> colorImageMemorys;
+        std::vector<VkImageView> colorImageViews;
+        std::vector<VkImage> depthImages;
+        std::vector<VkDeviceMemory> depthImageMemorys;
+        std::vector<VkImageView> depthImageViews;
+
+        std::vector<ReadbackSlot> readbacks;
+        ReadbackCallback onReadback;
+        VkDeviceSize readbackSize = 0;
+
+        std::vector<VkFence> inFlightFences;
+        size_t currentFrame = 0;
+        uint32_t framesInFlight = SwapChain::MAX_FRAMES_IN_FLIGHT;
+        uint64_t frameCounter = 0;
+
+    };
+
+}  // namespace aveng
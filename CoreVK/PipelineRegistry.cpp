@@ -0,0 +1,313 @@
+#include "PipelineRegistry.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+namespace aveng {
+
+	PipelineRegistry::PipelineRegistry(EngineDevice& device, ShaderLibrary& library, CreationMode mode)
+		: engineDevice{ device }, shaderLibrary{ library }, creationMode{ mode }
+	{
+		// Pipeline compilation is the expensive part, leave a core for the main thread
+		uint32_t cores = std::thread::hardware_concurrency();
+		threadPool.setThreadCount(std::max(1u, std::min(cores > 1 ? cores - 1 : 1u, 4u)));
+	}
+
+	PipelineRegistry::~PipelineRegistry()
+	{
+		threadPool.wait();
+	}
+
+	namespace {
+
+		template <typename... T>
+		void appendKey(std::string& key, const T&... values)
+		{
+			(key.append(reinterpret_cast<const char*>(&values), sizeof(values)), ...);
+		}
+
+		void appendKey(std::string& key, const std::string& path)
+		{
+			// Length first, so the two paths can't run into each other
+			appendKey(key, path.size());
+			key += path;
+		}
+
+	}
+
+	/*
+	* Only the state which ends up in VkGraphicsPipelineCreateInfo (specialization constants
+	* included) goes into the key. Two configs which would produce the same pipeline produce the same key.
+	*/
+	std::string PipelineRegistry::variantKey(const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfig& config)
+	{
+		std::string key;
+		appendKey(key, vertFilepath);
+		appendKey(key, fragFilepath);
+
+		appendKey(key, config.bindingDescriptions.size());
+		for (const auto& b : config.bindingDescriptions)
+			appendKey(key, b.binding, b.stride, b.inputRate);
+		appendKey(key, config.attributeDescriptions.size());
+		for (const auto& a : config.attributeDescriptions)
+			appendKey(key, a.location, a.binding, a.format, a.offset);
+
+		appendKey(key, config.inputAssemblyInfo.topology, config.inputAssemblyInfo.primitiveRestartEnable);
+
+		const auto& r = config.rasterizationInfo;
+		appendKey(key, r.depthClampEnable, r.rasterizerDiscardEnable, r.polygonMode, r.lineWidth, r.cullMode, r.frontFace,
+			r.depthBiasEnable, r.depthBiasConstantFactor, r.depthBiasClamp, r.depthBiasSlopeFactor);
+
+		const auto& m = config.multisampleInfo;
+		appendKey(key, m.rasterizationSamples, m.sampleShadingEnable, m.minSampleShading, m.alphaToCoverageEnable, m.alphaToOneEnable);
+
+		const auto& c = config.colorBlendAttachment;
+		appendKey(key, c.blendEnable, c.srcColorBlendFactor, c.dstColorBlendFactor, c.colorBlendOp,
+			c.srcAlphaBlendFactor, c.dstAlphaBlendFactor, c.alphaBlendOp, c.colorWriteMask);
+		appendKey(key, config.colorBlendInfo.logicOpEnable, config.colorBlendInfo.logicOp);
+
+		const auto& d = config.depthStencilInfo;
+		appendKey(key, d.depthTestEnable, d.depthWriteEnable, d.depthCompareOp, d.depthBoundsTestEnable, d.stencilTestEnable);
+
+		appendKey(key, config.dynamicStateEnables.size());
+		for (VkDynamicState state : config.dynamicStateEnables)
+			appendKey(key, state);
+
+		appendKey(key, config.pipelineLayout, config.renderPass, config.subpass);
+
+		appendKey(key, config.specializationConstants.size());
+		for (uint32_t constant : config.specializationConstants)
+			appendKey(key, constant);
+
+		return key;
+	}
+
+	PipelineHandle PipelineRegistry::add(const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfig& config)
+	{
+		std::string key = variantKey(vertFilepath, fragFilepath, config);
+		PipelineHandle handle = std::hash<std::string>{}(key);
+
+		// The same variant again gets the same pipeline. A different one which hashed the same moves on
+		// to the next free handle; handles never move once given out, so the probe finds it again later.
+		for (auto it = entries.find(handle); it != entries.end(); it = entries.find(++handle))
+		{
+			if (it->second->key == key) return handle;
+		}
+
+		auto entry = std::make_unique<Entry>();
+		entry->key = std::move(key);
+		entry->vertFilepath = vertFilepath;
+		entry->fragFilepath = fragFilepath;
+		GFXPipeline::copyPipelineConfig(config, entry->config);
+
+		entries.emplace(handle, std::move(entry));
+		return handle;
+	}
+
+	void PipelineRegistry::compileAll()
+	{
+		for (auto& kv : entries)
+		{
+			if (kv.second->state.load(std::memory_order_acquire) == PENDING)
+			{
+				queue(*kv.second);
+			}
+		}
+
+		threadPool.wait();
+
+		for (auto& kv : entries)
+		{
+			if (kv.second->state.load(std::memory_order_acquire) == FAILED)
+			{
+				throw std::runtime_error("failed to create pipeline variant: " + kv.second->vertFilepath + ", " + kv.second->fragFilepath);
+			}
+		}
+	}
+
+	void PipelineRegistry::setFallback(PipelineHandle handle)
+	{
+		assert(entries.count(handle) == 1 && "Fallback pipeline must be registered first");
+
+		Entry& entry = *entries[handle];
+		if (entry.state.load(std::memory_order_acquire) == PENDING)
+		{
+			build(entry);
+		}
+		else {
+			threadPool.wait();
+		}
+
+		if (entry.state.load(std::memory_order_acquire) != READY)
+		{
+			throw std::runtime_error("failed to create fallback pipeline: " + entry.vertFilepath + ", " + entry.fragFilepath);
+		}
+
+		fallback = handle;
+		hasFallback = true;
+	}
+
+	GFXPipeline* PipelineRegistry::get(PipelineHandle handle)
+	{
+		auto it = entries.find(handle);
+		assert(it != entries.end() && "Unknown pipeline variant");
+		Entry& entry = *it->second;
+
+		int state = entry.state.load(std::memory_order_acquire);
+		if (state == READY) return entry.pipeline.get();
+
+		if (state == PENDING)
+		{
+			if (creationMode == CreationMode::OnFirstUse && hasFallback)
+			{
+				queue(entry);
+			}
+			else {
+				// Nothing to fall back to, the caller has to wait for it
+				build(entry);
+				if (entry.state.load(std::memory_order_acquire) == READY) return entry.pipeline.get();
+			}
+		}
+		else if (state == COMPILING && !hasFallback)
+		{
+			threadPool.wait();
+			if (entry.state.load(std::memory_order_acquire) == READY) return entry.pipeline.get();
+		}
+
+		if (!hasFallback)
+		{
+			throw std::runtime_error("pipeline variant is unavailable and no fallback is set");
+		}
+
+		return entries[fallback]->pipeline.get();
+	}
+
+	bool PipelineRegistry::isReady(PipelineHandle handle) const
+	{
+		auto it = entries.find(handle);
+		return it != entries.end() && it->second->state.load(std::memory_order_acquire) == READY;
+	}
+
+	/*
+	* Hand the variant to the next worker. Entries are heap allocated and never erased
+	* while the pool is running, so the reference stays valid for the job's lifetime.
+	*/
+	void PipelineRegistry::queue(Entry& entry)
+	{
+		int expected = PENDING;
+		if (!entry.state.compare_exchange_strong(expected, COMPILING)) return;
+
+		Entry* target = &entry;
+		threadPool.threads[nextThread++ % threadPool.threads.size()]->addJob([this, target] { build(*target); });
+	}
+
+	void PipelineRegistry::build(Entry& entry)
+	{
+		// Worker threads can't throw across the pool, so failures are recorded in the entry
+		try {
+			ShaderLibrary::ScopedModule vertModule{ shaderLibrary, entry.vertFilepath };
+			ShaderLibrary::ScopedModule fragModule{ shaderLibrary, entry.fragFilepath };
+			entry.pipeline = std::make_unique<GFXPipeline>(engineDevice, vertModule.get(), fragModule.get(), entry.config);
+			entry.state.store(READY, std::memory_order_release);
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Pipeline variant failed: " << e.what() << std::endl;
+			entry.state.store(FAILED, std::memory_order_release);
+		}
+	}
+
+	void PipelineRegistry::reload(const std::vector<std::string>& changedFiles)
+	{
+		for (auto& kv : entries)
+		{
+			Entry& entry = *kv.second;
+
+			bool affected = false;
+			for (const auto& file : changedFiles)
+			{
+				affected |= ShaderLibrary::normalizePath(entry.vertFilepath) == file;
+				affected |= ShaderLibrary::normalizePath(entry.fragFilepath) == file;
+			}
+			if (!affected) continue;
+
+			// PENDING variants read the new code when they're built. The rest may be building from the old
+			// code right now, so they're marked and rebuilt as soon as nothing else is building them.
+			if (entry.state.load(std::memory_order_acquire) == PENDING) continue;
+			if (!entry.dirty)
+			{
+				entry.dirty = true;
+				dirtyEntries++;
+			}
+		}
+
+		queueDirty();
+	}
+
+	/*
+	* A variant still COMPILING, or with a rebuild already running, could have read the old code;
+	* rebuilding it on top would also race that build for the entry. It stays dirty and is
+	* picked up by a later swapReloaded() once the build in progress has finished.
+	*/
+	void PipelineRegistry::queueDirty()
+	{
+		if (dirtyEntries == 0) return;
+
+		for (auto& kv : entries)
+		{
+			Entry& entry = *kv.second;
+			if (!entry.dirty) continue;
+
+			int state = entry.state.load(std::memory_order_acquire);
+			if (state != READY && state != FAILED) continue;
+			if (entry.reloading.exchange(true)) continue;
+
+			entry.dirty = false;
+			dirtyEntries--;
+
+			Entry* target = &entry;
+			threadPool.threads[nextThread++ % threadPool.threads.size()]->addJob([this, target] { rebuild(*target); });
+		}
+	}
+
+	void PipelineRegistry::swapReloaded()
+	{
+		queueDirty();
+		if (pendingSwaps.load(std::memory_order_acquire) == 0) return;
+
+		// The replaced pipelines may still be referenced by a frame in flight; ~GFXPipeline defers their destruction
+
+		for (auto& kv : entries)
+		{
+			Entry& entry = *kv.second;
+			if (!entry.reloadReady.load(std::memory_order_acquire)) continue;
+
+			entry.pipeline = std::move(entry.reloaded);
+			entry.state.store(READY, std::memory_order_release);
+			entry.reloadReady = false;
+			entry.reloading = false;
+			pendingSwaps--;
+		}
+
+		// Edits which arrived while these were rebuilding
+		queueDirty();
+	}
+
+	void PipelineRegistry::rebuild(Entry& entry)
+	{
+		// A broken shader keeps the pipeline that is already running
+		try {
+			ShaderLibrary::ScopedModule vertModule{ shaderLibrary, entry.vertFilepath };
+			ShaderLibrary::ScopedModule fragModule{ shaderLibrary, entry.fragFilepath };
+			entry.reloaded = std::make_unique<GFXPipeline>(engineDevice, vertModule.get(), fragModule.get(), entry.config);
+			entry.reloadReady.store(true, std::memory_order_release);
+			pendingSwaps++;
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Pipeline reload failed: " << e.what() << std::endl;
+			entry.reloading = false;
+		}
+	}
+
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "GFXPipeline.h"
+#include "ShaderLibrary.h"
+#include "../Core/Utils/threadpool.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+* @class PipelineRegistry
+* Owns every variant of a render system's pipelines. A variant is identified by its shader paths
+* and the PipelineConfig state that reaches Vulkan, so asking for the same variant twice gives
+* back the same pipeline; the handle is a hash of that key. Pipelines are built on worker threads
+* and take their VkShaderModules from the ShaderLibrary, so variants using the same shader share
+* a module.
+*/
+namespace aveng {
+
+	using PipelineHandle = size_t;
+
+	class PipelineRegistry {
+
+	public:
+
+		enum class CreationMode {
+			Eager,		// compileAll() builds every variant in parallel and waits for them
+			OnFirstUse	// Variants are built in the background the first time get() asks for them
+		};
+
+		PipelineRegistry(EngineDevice& device, ShaderLibrary& library, CreationMode mode = CreationMode::Eager);
+		~PipelineRegistry();
+
+		PipelineRegistry(const PipelineRegistry&) = delete;
+		PipelineRegistry& operator=(const PipelineRegistry&) = delete;
+
+		// Register a variant. Nothing is compiled here; the config is copied so the caller's may go out of scope.
+		PipelineHandle add(const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfig& config);
+
+		// Build every registered variant that isn't built yet, in parallel, and wait for them to finish
+		void compileAll();
+
+		// The pipeline returned by get() while the requested variant is still compiling. Built immediately.
+		void setFallback(PipelineHandle handle);
+
+		// Returns the variant if it's ready, otherwise (OnFirstUse) queues it and returns the fallback
+		GFXPipeline* get(PipelineHandle handle);
+
+		bool isReady(PipelineHandle handle) const;
+
+		// Rebuild, in the background, every variant that uses one of these .spv files and has been built
+		// or is being built. Ones still building are rebuilt again once they finish.
+		void reload(const std::vector<std::string>& changedFiles);
+
+		// Call at a frame boundary, before anything is bound. Swaps in rebuilt pipelines.
+		void swapReloaded();
+
+		// Block until all queued work is done
+		void wait() { threadPool.wait(); }
+
+		// The bytes which identify a variant: paths, config state and specialization constants
+		static std::string variantKey(const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfig& config);
+
+	private:
+
+		enum State { PENDING = 0, COMPILING, READY, FAILED };
+
+		struct Entry {
+			std::string key;			// variantKey(), compared when two variants hash the same
+			std::string vertFilepath;
+			std::string fragFilepath;
+			PipelineConfig config{};
+			std::unique_ptr<GFXPipeline> pipeline;
+			std::atomic<int> state{ PENDING };
+
+			// Hot reload: the rebuilt pipeline waits here until swapReloaded()
+			std::unique_ptr<GFXPipeline> reloaded;
+			std::atomic<bool> reloading{ false };
+			std::atomic<bool> reloadReady{ false };
+			bool dirty = false;			// Its shaders changed while it was being built, main thread only
+		};
+
+		void queue(Entry& entry);
+		void build(Entry& entry);
+		void rebuild(Entry& entry);
+		void queueDirty();
+
+		EngineDevice& engineDevice;
+		ShaderLibrary& shaderLibrary;
+		CreationMode creationMode;
+		PipelineHandle fallback = 0;
+		bool hasFallback = false;
+		uint32_t nextThread = 0;
+
+		std::unordered_map<PipelineHandle, std::unique_ptr<Entry>> entries;
+		std::atomic<int> pendingSwaps{ 0 };
+		int dirtyEntries = 0;
+
+		// Declared last so its workers are joined before anything they touch is destroyed
+		ThreadPool threadPool;
+
+	};
+
+}
@@ -0,0 +1,293 @@
+#include "ShaderLibrary.h"
+#include "GFXPipeline.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+
+namespace fs = std::filesystem;
+
+namespace aveng {
+
+	// glslc from the Vulkan SDK if we can find it, otherwise whatever is on the PATH
+	static std::string glslcPath()
+	{
+		std::string sdk;
+#ifdef _MSC_VER
+		char* value = nullptr;
+		size_t length = 0;
+		if (_dupenv_s(&value, &length, "VULKAN_SDK") == 0 && value != nullptr)
+		{
+			sdk = value;
+			free(value);
+		}
+#else
+		if (const char* value = std::getenv("VULKAN_SDK")) sdk = value;
+#endif
+		if (sdk.empty()) return "glslc";
+		return (fs::path(sdk) / "Bin" / "glslc").string();
+	}
+
+	ShaderLibrary::ShaderLibrary(EngineDevice& device) : engineDevice{ device }
+	{}
+
+	ShaderLibrary::~ShaderLibrary()
+	{
+		stopWatching();
+
+		for (auto& kv : modules)
+		{
+			vkDestroyShaderModule(engineDevice.device(), kv.first, nullptr);
+		}
+	}
+
+	std::string ShaderLibrary::normalizePath(const std::string& filepath)
+	{
+		return fs::path(filepath).lexically_normal().generic_string();
+	}
+
+	VkShaderModule ShaderLibrary::getModule(const std::string& spvFilepath)
+	{
+		std::string key = normalizePath(spvFilepath);
+
+		std::lock_guard<std::mutex> lock(moduleMutex);
+
+		auto known = pathModules.find(key);
+		if (known != pathModules.end())
+		{
+			modules[known->second].users++;
+			return known->second;
+		}
+
+		std::vector<char> code = GFXPipeline::readFile(spvFilepath);
+		size_t hash = std::hash<std::string_view>{}(std::string_view(code.data(), code.size()));
+
+		VkShaderModule shaderModule = VK_NULL_HANDLE;
+		auto range = modulesByHash.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (modules[it->second].code == code)
+			{
+				shaderModule = it->second;
+				break;
+			}
+		}
+
+		if (shaderModule == VK_NULL_HANDLE)
+		{
+			GFXPipeline::createShaderModule(engineDevice, code, &shaderModule);
+			Module& created = modules[shaderModule];
+			created.code = std::move(code);
+			created.hash = hash;
+			modulesByHash.emplace(hash, shaderModule);
+		}
+
+		// One for the path, one for the caller
+		pathModules[key] = shaderModule;
+		modules[shaderModule].users += 2;
+		return shaderModule;
+	}
+
+	void ShaderLibrary::releaseModule(VkShaderModule shaderModule)
+	{
+		std::lock_guard<std::mutex> lock(moduleMutex);
+		release(shaderModule);
+	}
+
+	void ShaderLibrary::release(VkShaderModule shaderModule)
+	{
+		auto it = modules.find(shaderModule);
+		assert(it != modules.end() && it->second.users > 0 && "Releasing a shader module that isn't held");
+		if (--it->second.users > 0) return;
+
+		auto range = modulesByHash.equal_range(it->second.hash);
+		for (auto byHash = range.first; byHash != range.second; ++byHash)
+		{
+			if (byHash->second == shaderModule)
+			{
+				modulesByHash.erase(byHash);
+				break;
+			}
+		}
+		modules.erase(it);
+
+		EngineDevice& device = engineDevice;
+		engineDevice.deferDestroy([&device, shaderModule] {
+			vkDestroyShaderModule(device.device(), shaderModule, nullptr);
+		});
+	}
+
+	std::vector<fs::path> ShaderLibrary::staleSources(const std::string& directory)
+	{
+		std::vector<fs::path> stale;
+
+		std::error_code ec;
+		for (const auto& entry : fs::directory_iterator(directory, ec))
+		{
+			const fs::path& source = entry.path();
+			if (!entry.is_regular_file(ec) || !isShaderSource(source)) continue;
+
+			fs::path output = source;
+			output += ".spv";
+
+			std::error_code missing;
+			const fs::file_time_type built = fs::last_write_time(output, missing);
+			if (missing || built < fs::last_write_time(source, ec)) stale.push_back(source);
+		}
+
+		return stale;
+	}
+
+	void ShaderLibrary::compileStale(const std::string& directory)
+	{
+		// A failed compile keeps whatever .spv there is, and the pipelines report what's missing
+		for (const fs::path& source : staleSources(directory)) compile(source);
+	}
+
+	void ShaderLibrary::watch(const std::string& directory)
+	{
+		if (watching.exchange(true)) return;
+		watcher = std::thread(&ShaderLibrary::watchLoop, this, fs::path(directory));
+	}
+
+	void ShaderLibrary::stopWatching()
+	{
+		{
+			std::lock_guard<std::mutex> lock(watchMutex);
+			watching = false;
+		}
+		watchCondition.notify_one();
+
+		if (watcher.joinable()) watcher.join();
+	}
+
+	bool ShaderLibrary::pollChanges(std::vector<std::string>& changedFiles)
+	{
+		{
+			std::lock_guard<std::mutex> lock(changeMutex);
+			if (changed.empty()) return false;
+			changedFiles.swap(changed);
+			changed.clear();
+		}
+
+		// Forget which code these paths held so the next getModule() reads them again
+		std::lock_guard<std::mutex> lock(moduleMutex);
+		for (const auto& path : changedFiles)
+		{
+			auto it = pathModules.find(path);
+			if (it == pathModules.end()) continue;
+			release(it->second);
+			pathModules.erase(it);
+		}
+
+		return true;
+	}
+
+	/*
+	* Poll rather than use a platform notification API; it's the same code on every
+	* platform and a directory of shaders is cheap to stat twice a second.
+	* Sources are compiled in place, which bumps their .spv and gets reported on the
+	* next pass, so running compile.bat by hand is picked up the same way.
+	*/
+	void ShaderLibrary::watchLoop(fs::path directory)
+	{
+		std::unordered_map<std::string, fs::file_time_type> stamps;
+
+		auto scan = [&](bool report)
+		{
+			std::error_code ec;
+			for (const auto& entry : fs::directory_iterator(directory, ec))
+			{
+				if (!entry.is_regular_file(ec)) continue;
+
+				const fs::path& path = entry.path();
+				fs::file_time_type stamp = fs::last_write_time(path, ec);
+				if (ec) continue;
+
+				std::string key = path.lexically_normal().generic_string();
+				auto it = stamps.find(key);
+				if (it != stamps.end() && it->second == stamp) continue;
+				stamps[key] = stamp;
+
+				if (!report) continue;
+
+				if (isShaderSource(path))
+				{
+					compile(path);
+				}
+				else if (path.extension() == ".spv")
+				{
+					std::lock_guard<std::mutex> lock(changeMutex);
+					changed.push_back(key);
+				}
+			}
+		};
+
+		// Take the current state as the baseline, nothing has changed yet
+		scan(false);
+
+		std::unique_lock<std::mutex> lock(watchMutex);
+		while (watching)
+		{
+			watchCondition.wait_for(lock, std::chrono::milliseconds(500), [this] { return !watching; });
+			if (!watching) break;
+
+			lock.unlock();
+			scan(true);
+			lock.lock();
+		}
+	}
+
+	/*
+	* Compile next to the source, matching compile.bat. glslc writes a temporary first so a
+	* failed compile leaves the last good .spv alone and a reader never sees half a file.
+	*/
+	bool ShaderLibrary::compile(const fs::path& source)
+	{
+		fs::path output = source;
+		output += ".spv";
+		fs::path temporary = output;
+		temporary += ".tmp";
+
+		std::string command = "\"" + glslcPath() + "\" \"" + source.string() + "\" -o \"" + temporary.string() + "\"";
+#ifdef _WIN32
+		// cmd.exe strips the outer quotes of a command line that starts with one
+		command = "\"" + command + "\"";
+#endif
+
+		std::cout << "Recompiling " << source.generic_string() << std::endl;
+
+		std::error_code ec;
+		if (std::system(command.c_str()) != 0)
+		{
+			std::cerr << "Shader compile failed, keeping the previous " << output.generic_string() << std::endl;
+			fs::remove(temporary, ec);
+			return false;
+		}
+
+		fs::rename(temporary, output, ec);
+		if (ec)
+		{
+			std::cerr << "Could not replace " << output.generic_string() << ": " << ec.message() << std::endl;
+			fs::remove(temporary, ec);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool ShaderLibrary::isShaderSource(const fs::path& path)
+	{
+		static const char* extensions[] = { ".vert", ".frag", ".comp", ".geom", ".tesc", ".tese" };
+
+		std::string extension = path.extension().string();
+		for (const char* e : extensions)
+		{
+			if (extension == e) return true;
+		}
+		return false;
+	}
+
+}
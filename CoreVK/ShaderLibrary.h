@@ -0,0 +1,112 @@
+#pragma once
+
+#include "EngineDevice.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+* @class ShaderLibrary
+* Hands out VkShaderModules for .spv files. Modules are cached by the SPIR-V itself, so two
+* paths holding the same code share a module and a recompile that doesn't change the output
+* doesn't create a new one.
+*
+* A module is only needed while pipelines are created from it. Each getModule() is paired with
+* a releaseModule() once the pipeline is built, and a module nobody holds any more (its file has
+* changed since and no build is using it) goes to the deletion queue.
+*
+* The compiled SPIR-V is committed next to its source, built and validated by compile.bat.
+* staleSources() says which .spv files are missing or older than their GLSL; compileStale()
+* rebuilds them at startup when asked to (--compile-shaders), which needs glslc.
+*
+* watch() starts a background thread which polls a directory. Changed GLSL sources are
+* recompiled with glslc, and changed .spv files are reported through pollChanges() so the
+* render systems can rebuild their pipelines on the main thread.
+*/
+namespace aveng {
+
+	class ShaderLibrary {
+
+	public:
+
+		ShaderLibrary(EngineDevice& device);
+		~ShaderLibrary();
+
+		ShaderLibrary(const ShaderLibrary&) = delete;
+		ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+
+		// Safe to call from worker threads. The module stays valid until it's handed back.
+		VkShaderModule getModule(const std::string& spvFilepath);
+		void releaseModule(VkShaderModule shaderModule);
+
+		// Holds a module for as long as it's in scope, long enough to build a pipeline from it
+		class ScopedModule {
+		public:
+			ScopedModule(ShaderLibrary& library, const std::string& spvFilepath)
+				: shaderLibrary{ library }, shaderModule{ library.getModule(spvFilepath) } {}
+			~ScopedModule() { shaderLibrary.releaseModule(shaderModule); }
+
+			ScopedModule(const ScopedModule&) = delete;
+			ScopedModule& operator=(const ScopedModule&) = delete;
+
+			VkShaderModule get() const { return shaderModule; }
+
+		private:
+			ShaderLibrary& shaderLibrary;
+			VkShaderModule shaderModule;
+		};
+
+		// GLSL sources in directory whose .spv is missing or older than them
+		static std::vector<std::filesystem::path> staleSources(const std::string& directory);
+
+		// Compile every stale source in directory. Before any pipeline is built.
+		void compileStale(const std::string& directory);
+
+		void watch(const std::string& directory);
+		void stopWatching();
+
+		// Main thread, once per frame. Fills changedFiles with the .spv paths that changed since the last call.
+		bool pollChanges(std::vector<std::string>& changedFiles);
+
+		// Paths are compared in this form, "shaders\\a.vert.spv" and "shaders/a.vert.spv" are the same file
+		static std::string normalizePath(const std::string& filepath);
+
+	private:
+
+		void watchLoop(std::filesystem::path directory);
+		bool compile(const std::filesystem::path& source);
+		static bool isShaderSource(const std::filesystem::path& path);
+
+		EngineDevice& engineDevice;
+
+		struct Module {
+			std::vector<char> code;		// Compared when two modules hash the same
+			size_t hash = 0;
+			uint32_t users = 0;			// getModule() calls not yet released, plus one per path holding it
+		};
+
+		void release(VkShaderModule shaderModule);
+
+		std::mutex moduleMutex;
+		std::unordered_map<VkShaderModule, Module> modules;
+		std::unordered_multimap<size_t, VkShaderModule> modulesByHash;
+		std::unordered_map<std::string, VkShaderModule> pathModules;	// The code each path held when last read
+
+		// Written by the watcher, drained by pollChanges()
+		std::mutex changeMutex;
+		std::vector<std::string> changed;
+
+		std::thread watcher;
+		std::atomic<bool> watching{ false };
+		std::mutex watchMutex;
+		std::condition_variable watchCondition;
+
+	};
+
+}
@@ -64,8 +64,15 @@ namespace aveng {
     AvengBuffer::~AvengBuffer() 
     {
         unmap();
-        vkDestroyBuffer(engineDevice.device(), buffer, nullptr);
-        vkFreeMemory(engineDevice.device(), memory, nullptr);
+
+        // A frame in flight may still be reading it
+        EngineDevice& device = engineDevice;
+        VkBuffer deadBuffer = buffer;
+        VkDeviceMemory deadMemory = memory;
+        engineDevice.deferDestroy([&device, deadBuffer, deadMemory] {
+            vkDestroyBuffer(device.device(), deadBuffer, nullptr);
+            vkFreeMemory(device.device(), deadMemory, nullptr);
+        });
     }
 
     /**
@@ -152,7 +152,11 @@ namespace aveng {
 
     AvengDescriptorPool::~AvengDescriptorPool() 
     {
-        vkDestroyDescriptorPool(engineDevice.device(), descriptorPool, nullptr);
+        EngineDevice& device = engineDevice;
+        VkDescriptorPool pool = descriptorPool;
+        engineDevice.deferDestroy([&device, pool] {
+            vkDestroyDescriptorPool(device.device(), pool, nullptr);
+        });
     }
 
     bool AvengDescriptorPool::allocateDescriptors(const VkDescriptorSetLayout descriptorSetLayout, VkDescriptorSet& descriptor) const 
@@ -173,13 +177,22 @@ namespace aveng {
         return true;
     }
 
+    /*
+    * Sets bound by a frame in flight can't be freed yet. The pool's own destruction is deferred
+    * the same way and queued after this, so it always outlives the free.
+    */
     void AvengDescriptorPool::freeDescriptors(std::vector<VkDescriptorSet>& descriptors) const 
     {
-        vkFreeDescriptorSets(
-            engineDevice.device(),
-            descriptorPool,
-            static_cast<uint32_t>(descriptors.size()),
-            descriptors.data());
+        EngineDevice& device = engineDevice;
+        VkDescriptorPool pool = descriptorPool;
+        std::vector<VkDescriptorSet> sets = descriptors;
+        engineDevice.deferDestroy([&device, pool, sets] {
+            vkFreeDescriptorSets(
+                device.device(),
+                pool,
+                static_cast<uint32_t>(sets.size()),
+                sets.data());
+        });
     }
 
     void AvengDescriptorPool::resetPool() 
@@ -4,6 +4,7 @@
 
 // std
 #include <array>
+#include <cassert>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
@@ -14,16 +15,44 @@
 
 namespace aveng {
 
-    SwapChain::SwapChain(EngineDevice& deviceRef, VkExtent2D extent)
-        : device{ deviceRef }, windowExtent{ extent } {
+    VkPresentModeKHR PresentPolicy::toVk(Mode mode)
+    {
+        switch (mode)
+        {
+        case Mode::Mailbox:     return VK_PRESENT_MODE_MAILBOX_KHR;
+        case Mode::Immediate:   return VK_PRESENT_MODE_IMMEDIATE_KHR;
+        default:                return VK_PRESENT_MODE_FIFO_KHR;
+        }
+    }
+
+    const char* PresentPolicy::name(Mode mode)
+    {
+        switch (mode)
+        {
+        case Mode::Mailbox:     return "Mailbox";
+        case Mode::Immediate:   return "Immediate";
+        default:                return "V-Sync";
+        }
+    }
+
+    SwapChain::SwapChain(EngineDevice& deviceRef, VkExtent2D extent, PresentPolicy::Mode mode)
+        : device{ deviceRef }, windowExtent{ extent }, requestedPresentMode{ mode } {
         init();
     }
 
-    SwapChain::SwapChain(EngineDevice& deviceRef, VkExtent2D extent, std::shared_ptr<SwapChain> previous)
-        : device{ deviceRef }, windowExtent{ extent }, oldSwapChain{previous} {
+    SwapChain::SwapChain(EngineDevice& deviceRef, VkExtent2D extent, std::shared_ptr<SwapChain> previous, PresentPolicy::Mode mode)
+        : device{ deviceRef }, windowExtent{ extent }, requestedPresentMode{ mode }, oldSwapChain{previous} {
+
+        // The frame fences guard per frame resources that outlive any one swapchain (command buffers, uniform
+        // buffers), so they move over rather than being recreated signaled.
+        inFlightFences = std::move(previous->inFlightFences);
+        previous->inFlightFences.clear();
+        currentFrame = previous->currentFrame;
+        framesInFlight = previous->framesInFlight;
+
         init();
 
-        // clean up old swap chain
+        // The caller decides when the old swap chain is safe to destroy
         oldSwapChain = nullptr;
     }
 
@@ -62,16 +91,18 @@ namespace aveng {
 
         vkDestroyRenderPass(device.device(), renderPass, nullptr);
 
-        // cleanup synchronization objects
+        // cleanup synchronization objects. The fences may have been handed to a newer swap chain.
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
             vkDestroySemaphore(device.device(), renderFinishedSemaphores[i], nullptr);
             vkDestroySemaphore(device.device(), imageAvailableSemaphores[i], nullptr);
-            vkDestroyFence(device.device(), inFlightFences[i], nullptr);
+        }
+        for (auto fence : inFlightFences) {
+            vkDestroyFence(device.device(), fence, nullptr);
         }
     }
 
-    VkResult SwapChain::acquireNextImage(uint32_t* imageIndex) {
-
+    void SwapChain::waitForFrameFence()
+    {
         vkWaitForFences(
             device.device(),
             1,
@@ -79,6 +110,22 @@ namespace aveng {
             VK_TRUE,
             std::numeric_limits<uint64_t>::max()
         );
+    }
+
+    /*
+    * Takes effect from the next frame. Slots past the new count simply stop being used;
+    * their fences are left signaled (or will be), so growing again later is safe.
+    */
+    void SwapChain::setFramesInFlight(uint32_t count)
+    {
+        assert(count >= 1 && count <= MAX_FRAMES_IN_FLIGHT && "Frames in flight out of range");
+        framesInFlight = count;
+        currentFrame %= framesInFlight;
+    }
+
+    VkResult SwapChain::acquireNextImage(uint32_t* imageIndex) {
+
+        waitForFrameFence();
 
         VkResult result = vkAcquireNextImageKHR(
             device.device(),
@@ -137,7 +184,7 @@ namespace aveng {
 
         auto result = vkQueuePresentKHR(device.presentQueue(), &presentInfo);
 
-        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        currentFrame = (currentFrame + 1) % framesInFlight;
 
         return result;
     }
@@ -147,7 +194,7 @@ namespace aveng {
         SwapChainSupportDetails swapChainSupport = device.getSwapChainSupport();
 
         VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-        VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+        presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
         VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
         uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
@@ -187,7 +234,8 @@ namespace aveng {
         createInfo.presentMode = presentMode;
         createInfo.clipped = VK_TRUE;
 
-        createInfo.oldSwapchain == nullptr ? VK_NULL_HANDLE : oldSwapChain->swapChain;
+        // Lets the driver reuse the old swapchain's resources, and lets frames already queued on it present
+        createInfo.oldSwapchain = oldSwapChain == nullptr ? VK_NULL_HANDLE : oldSwapChain->swapChain;
 
         if (vkCreateSwapchainKHR(device.device(), &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
             throw std::runtime_error("failed to create swap chain!");
@@ -373,6 +421,9 @@ namespace aveng {
 
     void SwapChain::createSyncObjects() 
     {
+        // Inherited from the previous swap chain when there is one
+        bool createFences = inFlightFences.empty();
+
         imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
         renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
         inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
@@ -390,7 +441,7 @@ namespace aveng {
                 VK_SUCCESS ||
                 vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) !=
                 VK_SUCCESS ||
-                vkCreateFence(device.device(), &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+                (createFences && vkCreateFence(device.device(), &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS)) {
                 throw std::runtime_error("failed to create synchronization objects for a frame!");
             }
         }
@@ -412,25 +463,18 @@ namespace aveng {
 
     VkPresentModeKHR SwapChain::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) 
     {
-        //
-        //for (const auto& availablePresentMode : availablePresentModes) {
-        //    if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-        //        std::cout << "Present mode: Mailbox" << std::endl;
-        //        return availablePresentMode;
-        //    }
-        //}
-
         // Pro-Tip: Immediate mode will not work on most mobile devices
-        // for (const auto &availablePresentMode : availablePresentModes) {
-        //   if (availablePresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-        //     std::cout << "Present mode: Immediate" << std::endl;
-        //     return availablePresentMode;
-        //   }
-        // }
+        VkPresentModeKHR requested = PresentPolicy::toVk(requestedPresentMode);
+        for (const auto& availablePresentMode : availablePresentModes) {
+            if (availablePresentMode == requested) {
+                std::cout << "Present mode: " << PresentPolicy::name(requestedPresentMode) << std::endl;
+                return availablePresentMode;
+            }
+        }
 
+        // FIFO is the only mode the spec guarantees
         std::cout << "Present mode: V-Sync" << std::endl;
         return VK_PRESENT_MODE_FIFO_KHR;
-        //return VK_PRESENT_MODE_IMMEDIATE_KHR;
 
     }
 
@@ -13,12 +13,29 @@
 
 namespace aveng {
 
+    /*
+    * How frames are paced and presented. Latency sensitive setups want MAILBOX/IMMEDIATE, one frame in flight
+    * and late input sampling; throughput wants FIFO and the full MAX_FRAMES_IN_FLIGHT.
+    */
+    struct PresentPolicy {
+        enum class Mode { Fifo, Mailbox, Immediate };
+
+        Mode mode = Mode::Fifo;                 // Falls back to FIFO when the surface doesn't support the request
+        uint32_t framesInFlight = 2;            // 1 ... SwapChain::MAX_FRAMES_IN_FLIGHT
+        float fpsLimit = 0.f;                   // 0 is unlimited
+        bool lateInputSampling = false;         // Wait on the frame's fence before sampling input, not after
+
+        static VkPresentModeKHR toVk(Mode mode);
+        static const char* name(Mode mode);
+    };
+
     class SwapChain {
     public:
+        // Per frame resources are always allocated for this many; PresentPolicy::framesInFlight may use fewer
         static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
 
-        SwapChain(EngineDevice& deviceRef, VkExtent2D windowExtent);
-        SwapChain(EngineDevice& deviceRef, VkExtent2D windowExtent, std::shared_ptr<SwapChain> previous);
+        SwapChain(EngineDevice& deviceRef, VkExtent2D windowExtent, PresentPolicy::Mode presentMode = PresentPolicy::Mode::Fifo);
+        SwapChain(EngineDevice& deviceRef, VkExtent2D windowExtent, std::shared_ptr<SwapChain> previous, PresentPolicy::Mode presentMode = PresentPolicy::Mode::Fifo);
         ~SwapChain();
 
         SwapChain(const SwapChain&) = delete;
@@ -42,6 +59,12 @@ namespace aveng {
         VkResult            acquireNextImage(uint32_t* imageIndex);
         VkFormat            findDepthFormat();
 
+        // Block until the current frame slot's previous submission is done. acquireNextImage does this too.
+        void                waitForFrameFence();
+        VkFence             getFrameFence(size_t frame) { return inFlightFences[frame]; }
+        void                setFramesInFlight(uint32_t count);
+        VkPresentModeKHR    getPresentMode() { return presentMode; }
+
         void createTextureImageViews();
 
         float extentAspectRatio() {
@@ -71,6 +94,10 @@ namespace aveng {
             const std::vector<VkPresentModeKHR>& availablePresentModes);
         VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
 
+        PresentPolicy::Mode requestedPresentMode;
+        VkPresentModeKHR presentMode;
+        uint32_t framesInFlight = MAX_FRAMES_IN_FLIGHT;
+
         VkFormat swapChainImageFormat;
         VkFormat swapChainDepthFormat;
         VkExtent2D swapChainExtent;
@@ -63,8 +63,8 @@ namespace aveng {
         init_info.QueueFamily = device.getGraphicsQueueFamily();
         init_info.Queue = device.graphicsQueue();
 
-        // pipeline cache is a potential future optimization, ignoring for now
-        init_info.PipelineCache = VK_NULL_HANDLE;
+        // Share the device's pipeline cache so imgui's pipeline is cached across runs too
+        init_info.PipelineCache = device.pipelineCache();
         init_info.DescriptorPool = descriptorPool;
         // todo, Implement a memory allocator library (VMA) sooner than later
         init_info.Allocator = VK_NULL_HANDLE;
@@ -81,9 +81,11 @@ namespace aveng {
 
         // Cleanup the font object
         ImGui_ImplVulkan_DestroyFontUploadObjects();
+        initialized = true;
     }
 
     AvengImgui::~AvengImgui() {
+        if (!initialized) return;
         vkDestroyDescriptorPool(device.device(), descriptorPool, nullptr);
         ImGui_ImplVulkan_Shutdown();
         ImGui_ImplGlfw_Shutdown();
@@ -149,15 +151,60 @@ namespace aveng {
                 //(float*)&clear_color);  // Edit 3 floats representing a color
             
             if (ImGui::Button("GFX"))
-                WindowCallbacks::updatePipeline();
+                data.cur_pipe = (data.cur_pipe + 1) % MAX_PIPELINES;
 
             ImGui::SameLine();
             ImGui::Text("GFX-Pipe:\t%d", data.cur_pipe);
+            ImGui::Text("Point Lights:\t%d (dropped %d)", data.num_lights, data.light_overflow);
            
             ImGui::Text(
                 "Frame = %.3f ms/frame (%.1f FPS)",
                 1000.0f / ImGui::GetIO().Framerate,
             ImGui::GetIO().Framerate);
+
+            const char* presentModes[] = { "V-Sync", "Mailbox", "Immediate" };
+            ImGui::Combo("Present Mode", &data.present_mode, presentModes, IM_ARRAYSIZE(presentModes));
+            ImGui::SliderInt("Frames In Flight", &data.frames_in_flight, 1, 2);
+            ImGui::SliderFloat("FPS Limit", &data.fps_limit, 0.0f, 240.0f, data.fps_limit > 0.0f ? "%.0f" : "Off");
+            ImGui::Checkbox("Late Input Sampling", &data.late_input);
+            ImGui::Text(
+                "Input Latency:\t%.2f ms to present, %.2f ms to GPU done", data.input_to_present_ms, data.input_to_gpu_ms);
+            ImGui::Text(
+                "Fence Wait:\t%.2f ms", data.fence_wait_ms);
+            ImGui::Text(
+                "Frame Arena:\t%.1f KB", data.frame_arena_kb);
+            ImGui::Checkbox("Indirect Draw", &data.indirect_draw);
+            ImGui::SameLine();
+            ImGui::Text("Draw Calls:\t%d", data.draw_calls);
+            if (data.indirect_draw) {
+                ImGui::Checkbox("GPU Culling", &data.gpu_cull);
+                ImGui::SameLine();
+                ImGui::Checkbox("Verify", &data.verify_cull);
+                if (data.visible_objs >= 0) {
+                    ImGui::Text("Visible:\t%d of %d", data.visible_objs, data.num_objs);
+                }
+                if (data.verify_cull) {
+                    ImGui::Text("Cull Mismatches:\t%d of %d frames", data.cull_mismatches, data.cull_verified);
+                }
+            }
+            ImGui::Checkbox("LOD", &data.lod_select);
+            ImGui::SameLine();
+            ImGui::Text("Triangles:\t%d", data.triangles);
+            if (data.lod_select) {
+                ImGui::SliderFloat("LOD Error (px)", &data.lod_pixels, 0.25f, 8.0f, "%.2f");
+            }
+            ImGui::Text("Touching Pairs:\t%d", data.broadphase_pairs);
+            ImGui::Text(
+                "Simulation:\t%.0f Hz, %.1f us/step, alpha %.2f, %d skipped", data.sim_hz, data.sim_step_us, data.sim_alpha, data.sim_skipped);
+            if (data.picked_id >= 0) {
+                ImGui::Text(
+                    "Selected:\t%d at (%.03lf, %.03lf, %.03lf), %.1f us", data.picked_id, data.picked_point.x, data.picked_point.y, data.picked_point.z, data.pick_us);
+                ImGui::SameLine();
+                if (ImGui::Button("Clear")) data.picked_id = -1;
+            }
+            else {
+                ImGui::Text("Selected:\tnothing, click an object");
+            }
             //ImGui::Text("c = %d", counter);
             ImGui::End();
         }
@@ -3,7 +3,6 @@
 #include "../CoreVK/EngineDevice.h"
 #include "../Core/data.h"
 #include "../Core/aveng_window.h"
-#include "../Core/Events/window_callbacks.h"
 
 // libs
 #include <glm/glm.hpp>
@@ -42,5 +41,6 @@ namespace aveng {
 	private:
 		EngineDevice& device;
 		VkDescriptorPool descriptorPool;
+		bool initialized = false;	// Headless runs never call init
 	};
 }  // namespace lve
\ No newline at end of file
@@ -5,29 +5,92 @@
 #include "Core/Utils/aveng_utils.h"
 #include "Core/aveng_frame_content.h"
 #include "Core/Camera/aveng_camera.h"
-#include "Core/Events/window_callbacks.h"
 #include "Core/Player/GameplayFunctions.h"
+#include "Core/Scene/SceneFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 
 namespace aveng {
 
-	// Dynamic Helpers on window callback keys
-	int WindowCallbacks::current_pipeline{ 1 };
-	glm::vec3 WindowCallbacks::modRot{ 0.0f, 0.0f, 0.0f };
-	glm::vec3 WindowCallbacks::modTrans{ 0.0f, 0.0f, 0.0f };
-	int WindowCallbacks::posNeg = 1;
-	bool WindowCallbacks::flightMode = false;
-	float WindowCallbacks::modPI = PI;
+	namespace {
+
+		// Nearest rank percentiles, so every figure is a frame that really happened
+		void printFrameTimes(const std::string& name, std::vector<float> frameMs)
+		{
+			if (frameMs.empty()) return;
+			std::sort(frameMs.begin(), frameMs.end());
+
+			auto percentile = [&](float p) {
+				const size_t rank = static_cast<size_t>(std::ceil(p / 100.f * frameMs.size()));
+				return frameMs[std::min(std::max(rank, size_t{ 1 }), frameMs.size()) - 1];
+			};
+			const float mean = std::accumulate(frameMs.begin(), frameMs.end(), 0.f) / frameMs.size();
+
+			std::cout << name << ": " << frameMs.size() << " frames, mean " << mean << " ms, p50 " << percentile(50.f)
+				<< " ms, p90 " << percentile(90.f) << " ms, p95 " << percentile(95.f) << " ms, p99 " << percentile(99.f)
+				<< " ms, max " << frameMs.back() << " ms" << std::endl;
+		}
+
+	}
+
+	XOne::XOne() : XOne(LaunchOptions{}) {}
 
-	XOne::XOne() 
+	XOne::XOne(const LaunchOptions& launchOptions) : options{ launchOptions }
 	{
+		if (options.verifyCulling) {
+			data.indirect_draw = true;
+			data.gpu_cull = true;
+			data.verify_cull = true;
+		}
+
+		meshOptions.optimize = options.optimizeMeshes || options.optimizeOverdraw;
+		meshOptions.optimizeOverdraw = options.optimizeOverdraw;
+		meshOptions.report = meshOptions.optimize;
+		meshOptions.retainGeometry = !options.headless;	// Only windows have a mouse to pick with
+
+		// The pipelines built in Setup() want every shader compiled from its current source, compile.bat does that
+		if (options.compileShaders) {
+			shaderLibrary.compileStale("shaders");
+		}
+		else {
+			for (const auto& source : ShaderLibrary::staleSources("shaders"))
+			{
+				std::cout << source.string() << ".spv is missing or older than its source, run compile.bat or pass --compile-shaders" << std::endl;
+			}
+		}
+
 		Setup();
 		loadAppObjects();
+		loadLights();
 	}
 
 	void XOne::run()
 	{
-		// Set callback functions for keys bound to the window
-		glfwSetKeyCallback(aveng_window.getGLFWwindow(), WindowCallbacks::testKeyCallback);
+		const bool headless = options.headless;
+
+		// Input arrives as events from the window's callbacks, see InputSystem, or from a recorded run
+		keyboardController.bind(inputSystem);
+		inputSystem.bindMouseButton(GLFW_MOUSE_BUTTON_LEFT, InputAction::Select);
+		inputSystem.bindCommand(InputAction::NextPipeline, std::make_unique<NextPipelineCommand>(data));
+		inputSystem.bindCommand(InputAction::ToggleFlight, std::make_unique<ToggleFlightCommand>(data));
+
+		const bool replaying = !options.replayInput.empty();
+		const bool recording = !options.recordInput.empty() && !replaying;
+		if (replaying)
+		{
+			inputLog = InputLog::load(options.replayInput);
+			if (inputLog.frameCount() == 0) throw std::runtime_error(options.replayInput + " has no frames to replay");
+			replayFrameMs.reserve(inputLog.frameCount());
+		}
+
+		if (!headless) {
+			inputSystem.attach(aveng_window);
+		}
+		else if (!options.dumpDir.empty()) {
+			renderer.setReadbackCallback([this](const OffscreenTarget::Readback& frame) { dumpFrame(frame); });
+		}
 
 		//camera.setViewTarget(glm::vec3(-1.f, -2.f, -20.f), glm::vec3(0.f, 0.f, 3.5f));
 
@@ -37,20 +100,68 @@ namespace aveng {
 		viewerObject.transform.translation.z = -5.5f;
 		viewerObject.transform.translation.y = -2.5f;
 
+		// Recompile and reload shaders as they're edited
+		if (!headless) shaderLibrary.watch("shaders");
+		std::vector<std::string> changedShaders;
+
+		auto startTime = currentTime;
+		uint32_t framesRendered = 0;
+
+		// Headless runs and replays step the simulation from the loop, so it sees the same frame times every run
+		simulation.init(appObjects, pointLights, options.simulationHz, simulate);
+		if (!headless && !replaying) simulation.start();
+
 		// Keep the window open until shouldClose is truthy
 		while (!aveng_window.shouldClose()) {
 
-			// Potentially blocking
-			glfwPollEvents();
+			// Throttle before reading input rather than after, so the frame carries the freshest input we can give it
+			applyPresentPolicy();
+			if (renderer.getPresentPolicy().lateInputSampling) renderer.waitForFrame();
+
+			// Potentially blocking. The callbacks queue what happened, sample() makes it this frame's input.
+			if (!headless) glfwPollEvents();
+			inputSystem.sample();
 
-			// Calculate time between iterations
+			// Calculate time between iterations. Headless runs step a fixed 60hz so their output is reproducible.
 			auto newTime = std::chrono::high_resolution_clock::now();
-			frameTime = std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
+			const float elapsed = std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
+			frameTime = headless ? 1.f / 60.f : elapsed;
 			currentTime = newTime;
 
+			// A replay overrides what was sampled and when. The first frame's elapsed time is mostly setup.
+			if (replaying)
+			{
+				inputSystem.setState(inputLog.state(replayFrame));
+				frameTime = options.replayDt > 0.f ? options.replayDt : inputLog.frameTime(replayFrame);
+				if (replayFrame > 0) replayFrameMs.push_back(1000.f * elapsed);
+				if (++replayFrame == inputLog.frameCount()) aveng_window.requestClose();
+			}
+			else if (recording) {
+				inputLog.record(inputSystem.state(), frameTime);
+			}
+
+			inputSystem.dispatch(viewerObject, frameTime);
+
 			// Data & Debug
 			updateCamera(frameTime, viewerObject, keyboardController, camera);
+			renderer.markInputSampled();
+
+			// The world one simulation step behind, blended to where this frame falls in the step
+			if (!simulation.isRunning()) simulation.advance(frameTime);
+			simulation.apply();
+
 			updateData();
+			objectIndex.update(appObjects);
+			broadphase.update();
+			data.broadphase_pairs = static_cast<int>(broadphase.getPairs().size());
+			if (!headless) pickObject();
+
+			// Rebuilt pipelines are swapped in by the render systems before they bind
+			if (shaderLibrary.pollChanges(changedShaders)) {
+				objectRenderSystem.reloadShaders(changedShaders);
+				pointLightSystem.reloadShaders(changedShaders);
+				changedShaders.clear();
+			}
 
 			// Get a command buffer for this frame
 			VkCommandBuffer commandBuffer = renderer.beginFrame();
@@ -59,118 +170,250 @@ namespace aveng {
 
 				int frameIndex = renderer.getFrameIndex();
 
+				// Last time's cull results are still in the slot's arena, check them before it's reset
+				if (data.verify_cull) objectRenderSystem.verifyCulling(frameIndex, data);
+
+				// The slot's fence has signaled, last time's transient data is free to overwrite. The object table
+				// and indirect commands grow with the scene, the slot is made big enough for them first.
+				frameArena.begin(frameIndex, FRAME_ARENA_SIZE + ObjectRenderSystem::frameArenaBytes(appObjects.size()));
+				if (arenaGenerations[frameIndex] != frameArena.getGeneration(frameIndex)) writeFrameDescriptors(frameIndex);
+
 				FrameContent frame_content = {
 					frameIndex,
 					frameTime,
 					commandBuffer,
 					camera,
 					globalDescriptorSets[frameIndex],
-					fragDescriptorSets[frameIndex],
-					appObjects
+					appObjects,
+					frameArena,
+					0,
+					meshArena,
+					renderer.getSwapChainExtent(),
+					objectIndex
 				};
 
+				// Assign this frame's lights to clusters and upload them
+				pointLightSystem.update(frame_content, pointLights, renderer.getSwapChainExtent());
+
 				// Pack our vertex shader uniform buffer
 				ubo.projection = camera.getProjection();
 				ubo.view = camera.getView();
+				ubo.clusters = pointLightSystem.clusterParams();
 
 				// Update our global uniform buffer 
-				uboBuffers[frameIndex]->writeToBuffer(&ubo);
-				uboBuffers[frameIndex]->flush();
+				frame_content.globalUboOffset = frameArena.push(ubo).dynamicOffset();
+
+				// Object table, indirect commands and culling, which can't go inside the render pass
+				objectRenderSystem.update(frame_content, data);
 
 				// Render
 				renderer.beginSwapChainRenderPass(commandBuffer);
 
-				objectRenderSystem.render(frame_content, data, *fragBuffers[frameIndex]);
+				objectRenderSystem.render(frame_content, data);
 				pointLightSystem.render(frame_content);
 
-				aveng_imgui.newFrame();
-				aveng_imgui.runGUI(data);
-				aveng_imgui.render(commandBuffer);
+				if (!headless) {
+					aveng_imgui.newFrame();
+					aveng_imgui.runGUI(data);
+					aveng_imgui.render(commandBuffer);
+				}
 
 				renderer.endSwapChainRenderPass(commandBuffer);
+
+				frameArena.flush();
+				data.frame_arena_kb = static_cast<float>(frameArena.used()) / 1024.f;
 				renderer.endFrame();
+
+				if (headless && ++framesRendered >= options.frameCount) {
+					aveng_window.requestClose();
+				}
 				
 			}
 
 		}
 
+		simulation.stop();
+
+		if (recording)
+		{
+			inputLog.save(options.recordInput);
+			std::cout << options.recordInput << ": " << inputLog.frameCount() << " frames of input recorded" << std::endl;
+		}
+		if (replaying) printFrameTimes(options.replayInput, replayFrameMs);
+
 		// Block until all GPU operations quit.
+		renderer.flushReadbacks();
 		vkDeviceWaitIdle(engineDevice.device());
+
+		if (data.verify_cull)
+		{
+			// The frames still in flight at exit
+			for (int i = 0; i < SwapChain::MAX_FRAMES_IN_FLIGHT; i++) {
+				objectRenderSystem.verifyCulling(i, data);
+			}
+
+			std::cout << "GPU culling: " << data.cull_verified << " frames checked against the CPU, "
+				<< data.cull_mismatches << " disagreed" << std::endl;
+		}
+
+		if (headless)
+		{
+			float seconds = std::chrono::duration<float, std::chrono::seconds::period>(
+				std::chrono::high_resolution_clock::now() - startTime).count();
+
+			std::cout << "Headless: " << framesRendered << " frames in " << seconds << " s ("
+				<< framesRendered / seconds << " FPS, "
+				<< 1000.f * seconds / framesRendered << " ms/frame, "
+				<< renderer.getLatency().inputToGpuDone << " ms update to GPU done)" << std::endl;
+
+			// Fail the run, so CI notices
+			if (options.verifyCulling && (data.cull_verified == 0 || data.cull_mismatches > 0))
+			{
+				throw std::runtime_error("GPU culling verification failed");
+			}
+		}
 	}
 
 	/*
-	* 
+	* Write a finished headless frame out as a binary PPM. The offscreen target is BGRA8, PPM wants RGB.
 	*/
-	void XOne::loadAppObjects() 
+	void XOne::dumpFrame(const OffscreenTarget::Readback& frame)
 	{
+		char name[32];
+		snprintf(name, sizeof(name), "frame_%05llu.ppm", static_cast<unsigned long long>(frame.frameNumber));
 
-		//auto triangle = AvengAppObject::createAppObject(THEME_1);
-		//triangle.meta.type = SCENE;
-		//triangle.model = AvengModel::drawTriangle(engineDevice);
-		//appObjects.push_back(std::move(triangle));
-
-		for (size_t i = 0; i < 1; i++)
+		std::ofstream file{ options.dumpDir + "/" + name, std::ios::binary };
+		if (!file)
 		{
+			throw std::runtime_error("failed to open " + options.dumpDir + "/" + name);
+		}
+
+		file << "P6\n" << frame.width << " " << frame.height << "\n255\n";
 
-			for (size_t j = 0; j < 1; j++)
+		std::vector<uint8_t> row(frame.width * 3);
+		for (uint32_t y = 0; y < frame.height; y++)
+		{
+			const uint8_t* src = frame.pixels + static_cast<size_t>(y) * frame.rowPitch;
+			for (uint32_t x = 0; x < frame.width; x++)
 			{
+				row[x * 3 + 0] = src[x * 4 + 2];
+				row[x * 3 + 1] = src[x * 4 + 1];
+				row[x * 3 + 2] = src[x * 4 + 0];
+			}
+			file.write(reinterpret_cast<const char*>(row.data()), row.size());
+		}
+	}
 
-				auto grid = AvengAppObject::createAppObject(THEME_2);
-				grid.meta.type = GROUND;
-				grid.model = AvengModel::createModelFromFile(engineDevice, "3D/plane.obj");
-				grid.transform.translation = { 136.0f * i, -.1f, 0.0f};
-				appObjects.emplace(grid.getId(), std::move(grid));
+	void XOne::loadAppObjects() 
+	{
+		loadScene(options.scene);
+	}
 
-				auto grid2 = AvengAppObject::createAppObject(THEME_1);
-				grid2.meta.type = GROUND;
-				grid2.model = AvengModel::createModelFromFile(engineDevice, "3D/plane.obj");
-				grid2.transform.translation = { 150.0f, -.1f, 170.0f };
-				appObjects.emplace(grid2.getId(), std::move(grid2));
+	/*
+	* Every mesh is loaded once and shared by the objects drawing it, then the objects go in as one batch
+	* straight from the scene's arrays.
+	*/
+	void XOne::loadScene(const std::string& filepath)
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
 
-			}
+		const Scene scene = Scene::load(filepath);
 
+		std::vector<std::shared_ptr<AvengModel>> models;
+		models.reserve(scene.meshes.size());
+		for (const std::string& mesh : scene.meshes)
+		{
+			models.push_back(AvengModel::createModelFromFile(engineDevice, meshArena, mesh, meshOptions));
 		}
 
-		//for (size_t i = 0; i < 10; i++) {
-		//	for (size_t j = 0; j < 15; j++) {
-		//		for (size_t k = 0; k < 5; k++) {
+		const size_t count = scene.objectCount();
+		appObjects.reserve(appObjects.size() + count);
 
-		//			auto triangle = AvengAppObject::createAppObject(NO_TEXTURE);
-		//			triangle.meta.type = SCENE;
-		//			triangle.model = AvengModel::drawTriangle(engineDevice, {static_cast<float>(i), static_cast<float>(j) * -1.0f, static_cast<float>(k) });
-		//			appObjects.push_back(std::move(triangle));
+		for (size_t i = 0; i < count; i++)
+		{
+			auto obj = AvengAppObject::createAppObject(scene.texture[i]);
+			obj.meta.type = scene.type[i];
+			obj.model = models[scene.mesh[i]];
+			obj.transform.translation = scene.translation[i];
+			obj.transform.rotation = scene.rotation[i];
+			obj.transform.scale = scene.scale[i];
+
+			// A sphere about the origin holding the model's bounding sphere, whichever way it's turned
+			const glm::vec4& sphere = obj.model->getBoundingSphere();
+			const float radius = glm::length(glm::vec3(sphere)) + sphere.w;
+
+			AvengAppObject& placed = appObjects.emplace(obj.getId(), std::move(obj)).first->second;
+			broadphase.add(placed.transform, radius);
+		}
 
-		//		}
-		//	}
-		//}
+		const auto end = std::chrono::high_resolution_clock::now();
+		std::cout << filepath << ": " << count << " objects, " << scene.meshes.size() << " meshes in "
+			<< std::chrono::duration<float, std::chrono::milliseconds::period>(end - start).count() << " ms" << std::endl;
+	}
 
-		for (size_t i = 0; i < 10; i++)
+	/*
+	* The light which used to live in the GlobalUbo, plus a few rings of coloured lights
+	* circling over the spheres.
+	*/
+	void XOne::loadLights()
+	{
+		PointLight sun{};
+		sun.position = glm::vec4{ 5.0f, -1.0f, 2.8f, 25.f };
+		sun.color = glm::vec4{ 1.f, 1.f, 1.f, 1.f };
+		pointLights.push_back(sun);
+
+		const std::array<glm::vec3, 6> colors{
+			glm::vec3{ 1.f, .1f, .1f },
+			glm::vec3{ .1f, .1f, 1.f },
+			glm::vec3{ .1f, 1.f, .1f },
+			glm::vec3{ 1.f, 1.f, .1f },
+			glm::vec3{ .1f, 1.f, 1.f },
+			glm::vec3{ 1.f, 1.f, 1.f }
+		};
+
+		for (int r = 0; r < LIGHT_RINGS; r++)
 		{
-			
-			for (size_t j = 0; j < 10; j++) 
+			float ringRadius = 2.f + 2.5f * r;
+			for (int i = 0; i < LIGHTS_PER_RING; i++)
 			{
+				float angle = glm::two_pi<float>() * i / LIGHTS_PER_RING;
 
-				for (size_t k = 0; k < 4; k++) {
-					auto sphere = AvengAppObject::createAppObject(NO_TEXTURE);
-					sphere.meta.type = SCENE;
-					sphere.model = AvengModel::createModelFromFile(engineDevice, "3D/sphere.obj");
-					sphere.transform.translation = { static_cast<float>(i) * 1.5f, static_cast<float>(j) * -1.0f, static_cast<float>(k) * 2.0f };
-					sphere.transform.scale = {0.1f, 0.1f, 0.1f};
-					appObjects.emplace(sphere.getId(), std::move(sphere));
-				
-				}
-			
+				PointLight light{};
+				light.position = glm::vec4{ ringRadius * glm::cos(angle), -1.5f - .5f * r, ringRadius * glm::sin(angle), 1.5f };
+				light.color = glm::vec4{ colors[(i + r) % colors.size()], .4f };
+				pointLights.push_back(light);
 			}
+		}
+	}
 
+	/*
+	* One fixed step of the simulation, on its thread. Moving objects carry on at their velocity and the
+	* light rings spin about the y axis, alternating direction. The first light stays put.
+	*/
+	void XOne::simulate(Simulation::State& state, float dt)
+	{
+		for (size_t i = 0; i < state.translation.size(); i++)
+		{
+			state.translation[i] += state.velocity[i] * dt;
 		}
 
+		for (size_t i = 1; i < state.lights.size(); i++)
+		{
+			int ring = static_cast<int>((i - 1) / LIGHTS_PER_RING);
+			float speed = (ring % 2 == 0 ? .3f : -.3f) * dt;
+
+			glm::vec4& p = state.lights[i];
+			float c = glm::cos(speed);
+			float s = glm::sin(speed);
+			p = glm::vec4{ c * p.x - s * p.z, p.y, s * p.x + c * p.z, p.w };
+		}
 	}
 
 	void XOne::updateCamera(float frameTime, AvengAppObject& viewerObject, KeyboardController& keyboardController, AvengCamera& camera)
 	{
 		aspect = renderer.getAspectRatio();
 		// Updates the viewer object transform component based on key input, proportional to the time elapsed since the last frame
-		keyboardController.moveCameraXZ(aveng_window.getGLFWwindow(), frameTime);
+		keyboardController.moveCameraXZ(inputSystem.state(), frameTime);
 		camera.setViewYXZ(viewerObject.transform.translation + glm::vec3(0.f, 0.f, -.80f), viewerObject.transform.rotation + glm::vec3());
 		camera.setPerspectiveProjection(glm::radians(50.f), aspect, 0.1f, 1000.f);
 	}
@@ -180,7 +423,62 @@ namespace aveng {
 		data.cameraView = camera.getCameraView();
 		data.cameraPos  = viewerObject.transform.translation;
 		data.cameraRot  = viewerObject.transform.rotation;
-		data.fly_mode   = WindowCallbacks::flightMode;
+
+		const Renderer::FrameLatency& latency = renderer.getLatency();
+		data.input_to_present_ms = latency.inputToPresent;
+		data.input_to_gpu_ms     = latency.inputToGpuDone;
+		data.fence_wait_ms       = latency.fenceWait;
+
+		data.num_lights = static_cast<int>(pointLights.size());
+		data.light_overflow = static_cast<int>(pointLightSystem.clusterOverflow());
+
+		data.sim_hz      = simulation.getRate();
+		data.sim_alpha   = simulation.getAlpha();
+		data.sim_step_us = simulation.getStepMicros();
+		data.sim_skipped = static_cast<int>(simulation.getSkippedSteps());
+	}
+
+	/*
+	* A left click on the scene (not on the GUI) selects the nearest object under the cursor, timed in
+	* microseconds for the debug panel.
+	*/
+	void XOne::pickObject()
+	{
+		const ActionState& input = inputSystem.state();
+		if (!input.wasPressed(InputAction::Select) || ImGui::GetIO().WantCaptureMouse) return;
+
+		int width, height;
+		glfwGetWindowSize(aveng_window.getGLFWwindow(), &width, &height);
+		if (width == 0 || height == 0) return;
+
+		const auto start = std::chrono::high_resolution_clock::now();
+
+		glm::vec3 origin, direction;
+		camera.screenRay({ 2.f * input.cursor.x / width - 1.f, 2.f * input.cursor.y / height - 1.f }, origin, direction);
+
+		ObjectIndex::RayHit hit;
+		const bool found = objectIndex.raycast(origin, direction, hit);
+
+		data.pick_us = std::chrono::duration<float, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+		data.picked_id = found ? static_cast<int>(hit.object->getId()) : -1;
+		data.picked_point = hit.point;
+	}
+
+	// Push the GUI's presentation settings to the renderer when they change
+	void XOne::applyPresentPolicy()
+	{
+		PresentPolicy policy = renderer.getPresentPolicy();
+		PresentPolicy wanted = policy;
+		wanted.mode = static_cast<PresentPolicy::Mode>(data.present_mode);
+		wanted.framesInFlight = static_cast<uint32_t>(data.frames_in_flight);
+		wanted.fpsLimit = data.fps_limit;
+		wanted.lateInputSampling = data.late_input;
+
+		if (wanted.mode != policy.mode || wanted.framesInFlight != policy.framesInFlight ||
+			wanted.fpsLimit != policy.fpsLimit || wanted.lateInputSampling != policy.lateInputSampling)
+		{
+			renderer.setPresentPolicy(wanted);
+		}
 	}
 
 	/*
@@ -199,83 +497,82 @@ namespace aveng {
 			.setMaxSets(SwapChain::MAX_FRAMES_IN_FLIGHT * 4)
 			// Type							// Max no. of descriptor sets
 			.addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, SwapChain::MAX_FRAMES_IN_FLIGHT * 8)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, SwapChain::MAX_FRAMES_IN_FLIGHT)
 			.addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, SwapChain::MAX_FRAMES_IN_FLIGHT * 16)
-			//.addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, SwapChain::MAX_FRAMES_IN_FLIGHT * 8)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, SwapChain::MAX_FRAMES_IN_FLIGHT * 4)
 			.build();
 
-		// Create global uniform buffers mapped into device memory
-		uboBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
-		fragBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
-		for (int i = 0; i < uboBuffers.size(); i++) {
-			uboBuffers[i] = std::make_unique<AvengBuffer>(engineDevice,
-				sizeof(GlobalUbo),
-				1,
-				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-			uboBuffers[i]->map();
-		}
-		for (int i = 0; i < fragBuffers.size(); i++) {
-			fragBuffers[i] = std::make_unique<AvengBuffer>(engineDevice,
-				sizeof(ObjectRenderSystem::FragUbo) * 8000,
-				1,
-				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-			fragBuffers[i]->map();
-		}
-
 		// Descriptor Layout 0 -- Global
-		std::unique_ptr<AvengDescriptorSetLayout> globalDescriptorSetLayout =
+		globalDescriptorSetLayout =
 			AvengDescriptorSetLayout::Builder(engineDevice)
-			.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS)
+			.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_ALL_GRAPHICS)	// GlobalUbo, in the frame arena
 			.addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 8)
+			.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS)	// Point lights
+			.addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)	// Cluster grid
+			.addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)	// Cluster light indices
+			.addBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)	// Object table, the whole frame arena
 			//.addBinding(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
 			.build();	// Initialize the Descriptor Set Layout
 
-		// Descriptor Set 1 -- Per object
-		std::unique_ptr<AvengDescriptorSetLayout> fragDescriptorSetLayout =
-			AvengDescriptorSetLayout::Builder(engineDevice)
-			.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_FRAGMENT_BIT)
-			.build();
-
 		// Write our descriptors according to the layout's bindings once for every possible frame in flight
-		globalDescriptorSets.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
-		fragDescriptorSets.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+		globalDescriptorSets.resize(SwapChain::MAX_FRAMES_IN_FLIGHT, VK_NULL_HANDLE);
+		arenaGenerations.resize(SwapChain::MAX_FRAMES_IN_FLIGHT, 0);
 
 		for (int i = 0; i < SwapChain::MAX_FRAMES_IN_FLIGHT; i++)
 		{
-			// Write first set - Uniform Buffer containing our UBO and our Imager Sampler
-			auto bufferInfo = uboBuffers[i]->descriptorInfo();
-			auto imageInfo = imageSystem.descriptorInfoForAllImages();
-			AvengDescriptorSetWriter(*globalDescriptorSetLayout, *globalPool)
-				.writeBuffer(0, &bufferInfo)	// First Binding
-				.writeImage(1, imageInfo.data(), imageSystem.texture_paths.size()) // Second Binding
-				.build(globalDescriptorSets[i]);
-
-			// Write second set - Also a uniform buffer
-			auto fragBufferInfo = fragBuffers[i]->descriptorInfo(sizeof(ObjectRenderSystem::FragUbo), 0);
-			AvengDescriptorSetWriter(*fragDescriptorSetLayout, *globalPool)
-				.writeBuffer(0, &fragBufferInfo)
-				.build(fragDescriptorSets[i]);
+			writeFrameDescriptors(i);
 		}
 
 		// Rendering subsystem initializers
 		objectRenderSystem.initialize(
 			renderer.getSwapChainRenderPass(),
 			globalDescriptorSetLayout->getDescriptorSetLayout(),
-			fragDescriptorSetLayout->getDescriptorSetLayout()
+			frameArena
 		);
 		pointLightSystem.initialize(
 			renderer.getSwapChainRenderPass(),
 			globalDescriptorSetLayout->getDescriptorSetLayout()
 		);
 		// GUI
-		aveng_imgui.init(
+		if (!options.headless) aveng_imgui.init(
 			aveng_window,
 			renderer.getSwapChainRenderPass(),
 			renderer.getImageCount()
 		);
 	}
 
+	/*
+	* The global set points into the slot's frame arena buffer. Written at setup, and again whenever the arena
+	* has replaced that buffer with a bigger one; the slot's last frame is done with them by then.
+	*/
+	void XOne::writeFrameDescriptors(int i)
+	{
+		// Write first set - Uniform Buffer containing our UBO and our Imager Sampler
+		auto bufferInfo = frameArena.descriptorInfo(i, sizeof(GlobalUbo));
+		auto imageInfo = imageSystem.descriptorInfoForAllImages();
+		auto lightsInfo = pointLightSystem.lightsInfo(i);
+		auto clustersInfo = pointLightSystem.clustersInfo(i);
+		auto lightIndicesInfo = pointLightSystem.lightIndicesInfo(i);
+		auto objectTableInfo = frameArena.descriptorInfo(i, VK_WHOLE_SIZE);
+		AvengDescriptorSetWriter globalWriter(*globalDescriptorSetLayout, *globalPool);
+		globalWriter
+			.writeBuffer(0, &bufferInfo)	// First Binding
+			.writeImage(1, imageInfo.data(), imageSystem.texture_paths.size()) // Second Binding
+			.writeBuffer(2, &lightsInfo)
+			.writeBuffer(3, &clustersInfo)
+			.writeBuffer(4, &lightIndicesInfo)
+			.writeBuffer(5, &objectTableInfo);
+
+		if (globalDescriptorSets[i] == VK_NULL_HANDLE) {
+			globalWriter.build(globalDescriptorSets[i]);
+		}
+		else {
+			globalWriter.overwrite(globalDescriptorSets[i]);
+		}
+
+		arenaGenerations[i] = frameArena.getGeneration(i);
+	}
+
 	void XOne::pendulum(EngineDevice& engineDevice, int _max_rows)
 	{
 
@@ -287,16 +584,15 @@ namespace aveng {
 		int max_rows = _max_rows;
 		int row_modifier = 0;
 
-		//std::unique_ptr<AvengModel> coloredCubeModel = AvengModel::createModelFromFile(engineDevice, "3D/colored_cube.obj");
+		std::shared_ptr<AvengModel> coloredCubeModel = AvengModel::createModelFromFile(engineDevice, meshArena, "3D/colored_cube.obj", meshOptions);
 
 		for (size_t i = 0; i < max_rows; i++)
 		{
 			//row_modifier = row_modifier % static_cast<int>(ceil(max_rows / 2) + 1);
 			for (size_t j = 0; j < 1; j++) {
 				auto gameObj = AvengAppObject::createAppObject(1000);
-				//gameObj.model = coloredCubeModel;
-				gameObj.model = AvengModel::createModelFromFile(engineDevice, "3D/colored_cube.obj");
-				gameObj.meta.type = SCENE;
+				gameObj.model = coloredCubeModel;
+				gameObj.meta.type = BACKDROP;
 
 				if (i >= std::floor(max_rows / 2))
 					gameObj.visual.pendulum_row = max_rows - row_modifier;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "Core/Renderer/ObjectRenderSystem.h"
@@ -8,12 +9,20 @@
 #include "Core/Renderer/AvengImageSystem.h"
 #include "Core/Renderer/PointLightSystem.h"
 #include "Core/Scene/app_object.h"
+#include "Core/Scene/ObjectIndex.h"
+#include "Core/Scene/Simulation.h"
+#include "Core/Spatial/Broadphase.h"
 #include "GUI/aveng_imgui.h"
 #include "Core/aveng_window.h"
 #include "CoreVK/EngineDevice.h"
+#include "CoreVK/ShaderLibrary.h"
 #include "CoreVk/aveng_buffer.h"
+#include "CoreVK/FrameArena.h"
+#include "CoreVK/MeshArena.h"
 #include "Core/Renderer/Renderer.h"
 #include "Core/Peripheral/KeyboardController.h"
+#include "Core/Events/InputSystem.h"
+#include "Core/Events/InputLog.h"
 
 namespace aveng {
 
@@ -27,12 +36,35 @@ namespace aveng {
 			glm::mat4 projection{ 1.f };
 			glm::mat4 view{ 1.f };
 			glm::vec4 ambientLightColor{0.f, 0.f, 1.f, .04f};
-			glm::vec3 lightPosition{ 5.0f, -1.0f, 2.8f };
-			alignas(16) glm::vec4 lightColor{ 1.f, 1.f, 1.f, 1.f };
+			LightClusters::ShaderParams clusters{};	// The lights themselves are in storage buffers
 			//alignas(16) glm::vec3 lightDirection = glm::normalize(glm::vec3{ -1.f, -3.f, 1.f });
 		};
 
+		// Command line switches, see main.cpp
+		struct LaunchOptions {
+			bool headless = false;		// Render offscreen with no window, for CI and benchmarking
+			uint32_t frameCount = 600;	// Headless runs stop after this many frames
+			std::string dumpDir{};		// Headless only. When set, every frame is written here as a .ppm
+			bool verifyCulling = false;	// Draw indirect with GPU culling and check every frame against the CPU
+			bool optimizeMeshes = false;	// Reorder meshes for the vertex cache as they load and report the ACMR/ATVR
+			bool optimizeOverdraw = false;	// With optimizeMeshes, also order their triangles against overdraw
+			std::string benchDedup{};	// Time vertex welding on this OBJ instead of running, see AvengModel::benchmarkDedup
+			std::string benchObj{};		// Time loading this OBJ instead of running, see AvengModel::benchmarkObjReader
+			uint32_t benchBvh = 0;		// Time BVH queries over this many boxes instead of running, see BVH::benchmark
+			uint32_t benchBroadphase = 0;	// Check and time the broadphase over this many spheres instead of running, see Broadphase::benchmark
+			uint32_t benchPick = 0;		// Time ray casts against a mesh of this many triangles instead of running, see TriangleBVH::benchmark
+			float simulationHz = 60.f;	// Fixed rate of the simulation thread, see Simulation
+			std::string recordInput{};	// Write every frame's input and frame time here at exit, see InputLog
+			std::string replayInput{};	// Play a recorded run back instead of taking input, then report its frame times
+			float replayDt = 0.f;		// With replayInput, step every frame by this many seconds rather than as recorded
+			std::string scene = "scenes/default.scene";	// Text or binary, see Core/Scene/SceneFile.h
+			std::string compileScene{};	// Compile this text scene to compiledScene instead of running
+			std::string compiledScene{};
+			bool compileShaders = false;	// Rebuild out of date .spv files with glslc before starting, rather than warn about them
+		};
+
 		XOne();
+		XOne(const LaunchOptions& options);
 		~XOne(){};
 
 		XOne(const XOne&) = delete;
@@ -46,12 +78,22 @@ namespace aveng {
 	private:
 
 		void loadAppObjects();
+		void loadScene(const std::string& filepath);
+		void loadLights();
+		static void simulate(Simulation::State& state, float dt);
 		void Setup();
+		void writeFrameDescriptors(int frameIndex);
 		void updateCamera(float frameTime, AvengAppObject& viewerObject, KeyboardController& cameraController, AvengCamera& camera);
 		void updateData();
+		void pickObject();
+		void applyPresentPolicy();
+		void dumpFrame(const OffscreenTarget::Readback& frame);
+
+		LaunchOptions options;
+		AvengModel::LoadOptions meshOptions{};
 
 		// The window API - Stack allocated
-		AvengWindow aveng_window{ WIDTH, HEIGHT, "Vulkan 0" };
+		AvengWindow aveng_window{ WIDTH, HEIGHT, "Vulkan 0", options.headless };
 		glm::vec3 clear_color = { 0.0f, 0.0f, 0.0f };
 
 		/*
@@ -61,26 +103,39 @@ namespace aveng {
 		Data data;
 		AvengAppObject viewerObject{ AvengAppObject::createAppObject(1000) };
 		EngineDevice engineDevice{ aveng_window };
+		ShaderLibrary shaderLibrary{ engineDevice };
 		ImageSystem imageSystem{ engineDevice };
 		Renderer renderer{ aveng_window, engineDevice };
 		AvengImgui aveng_imgui{ engineDevice };
 		AvengCamera camera{};
 		GlobalUbo ubo{};
-		ObjectRenderSystem objectRenderSystem{ engineDevice, viewerObject };
-		PointLightSystem pointLightSystem{ engineDevice };
+		static constexpr int LIGHT_RINGS = 4;			// Of coloured lights around the scene, after the first light, see loadLights
+		static constexpr int LIGHTS_PER_RING = 64;
+		static constexpr VkDeviceSize FRAME_ARENA_SIZE = 4 * 1024 * 1024;	// Before the per object data, see ObjectRenderSystem::frameArenaBytes
+		FrameArena frameArena{ engineDevice, FRAME_ARENA_SIZE };	// Per frame uniforms, see FrameArena
+		MeshArena meshArena{ engineDevice, 16 * 1024 * 1024, 1 << 20 };	// Geometry of every model
+		ObjectRenderSystem objectRenderSystem{ engineDevice, shaderLibrary, viewerObject };
+		PointLightSystem pointLightSystem{ engineDevice, shaderLibrary };
 		KeyboardController keyboardController{ viewerObject, data };
+		InputSystem inputSystem;
+		InputLog inputLog;				// Being recorded or played back
+		size_t replayFrame = 0;
+		std::vector<float> replayFrameMs;	// What each replayed frame really took
 
 		float aspect;
 		float frameTime;
 		AvengAppObject::Map appObjects;
+		ObjectIndex objectIndex;
+		Broadphase broadphase{ 2.f, 0 };		// Which objects touch, every object registers as it's loaded
+		std::vector<PointLight> pointLights;
+		Simulation simulation;		// Moves the objects and lights above, on its own thread when there's a window
 
 		// This declaration must occur after the renderer initializes
 		std::unique_ptr<AvengDescriptorPool> globalPool{};
 
-		std::vector<std::unique_ptr<AvengBuffer>> uboBuffers;
-		std::vector<std::unique_ptr<AvengBuffer>> fragBuffers;
+		std::unique_ptr<AvengDescriptorSetLayout> globalDescriptorSetLayout{};
 		std::vector<VkDescriptorSet> globalDescriptorSets;
-		std::vector<VkDescriptorSet> fragDescriptorSets;
+		std::vector<uint32_t> arenaGenerations;		// The frame arena generation each slot's sets were written for
 
 	};
 
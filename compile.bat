@@ -1,7 +1,18 @@
-C:\VulkanSDK\1.2.189.2\Bin\glslc.exe shaders\simple_shader.vert -o shaders\simple_shader.vert.spv
-C:\VulkanSDK\1.2.189.2\Bin\glslc.exe shaders\simple_shader.frag -o shaders\simple_shader.frag.spv
-C:\VulkanSDK\1.2.189.2\Bin\glslc.exe shaders\simple_shader2.vert -o shaders\simple_shader2.vert.spv
-C:\VulkanSDK\1.2.189.2\Bin\glslc.exe shaders\simple_shader2.frag -o shaders\simple_shader2.frag.spv
-C:\VulkanSDK\1.2.189.2\Bin\glslc.exe shaders\point_light.vert -o shaders\point_light.vert.spv
-C:\VulkanSDK\1.2.189.2\Bin\glslc.exe shaders\point_light.frag -o shaders\point_light.frag.spv
-pause
\ No newline at end of file
+@echo off
+rem Builds every shader to SPIR-V next to its source and validates it. The .spv files are committed, rerun this after editing a shader.
+set GLSLC="%VULKAN_SDK%\Bin\glslc.exe"
+set SPIRV_VAL="%VULKAN_SDK%\Bin\spirv-val.exe"
+
+for %%s in (simple_shader.vert simple_shader.frag simple_shader2.vert simple_shader2.frag object_table.vert object_table2.vert cull.comp point_light.vert point_light.frag) do (
+	%GLSLC% shaders\%%s -o shaders\%%s.spv || goto failed
+	%SPIRV_VAL% --target-env vulkan1.0 shaders\%%s.spv || goto failed
+)
+
+echo All shaders compiled and validated
+pause
+exit /b 0
+
+:failed
+echo Shader compilation failed
+pause
+exit /b 1
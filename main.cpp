@@ -1,13 +1,172 @@
 #include "XOne.h"
 #include "avpch.h"
+#include <cstring>
+#include <string>
+#include "Core/Scene/SceneFile.h"
+#include "Core/Spatial/BVH.h"
+#include "Core/Spatial/Broadphase.h"
+#include "Core/Spatial/TriangleBVH.h"
 // #include "Apps/Gravity.h"
 
 #define LOG(a) std::cout << a << std::endl
 
-int main(void)
+/*
+* --headless [frames]	Render offscreen without a window and exit after [frames] frames (default 600)
+* --dump <dir>			With --headless, write every frame to <dir> as a .ppm
+* --verify-cull			Draw indirect with GPU culling and check each frame against the CPU. Headless runs fail on a mismatch.
+* --optimize-meshes		Reorder meshes for the vertex cache as they load, printing the ACMR/ATVR before and after
+* --optimize-overdraw	As --optimize-meshes, and order the triangles against overdraw too
+* --bench-dedup <obj>	Time vertex welding on <obj>, std::unordered_map against the flat table, and exit
+* --bench-obj <obj>		Time loading <obj>, tinyobjloader against ObjReader, and exit. Writes a 1M triangle <obj> if there's none.
+* --bench-bvh [count]	Time BVH builds, refits and queries over [count] random boxes (default 100000) against a linear scan, and exit
+* --bench-broadphase [count]	Check the broadphase's pairs against brute force over [count] moving spheres (default 20000) and time both, and exit
+* --bench-pick [count]	Cast rays at a sphere of [count] triangles (default 1000000) through its TriangleBVH and by testing every triangle, and exit
+* --sim-hz <hz>			Step the simulation <hz> times a second (default 60)
+* --record <file>		Write the run's input, frame by frame, to <file> at exit
+* --replay <file>		Play back input recorded with --record instead of taking any, print the frame time distribution and exit
+* --replay-dt <seconds>	With --replay, step every frame by <seconds> rather than by the recorded frame times
+* --scene <file>		Load the scene from <file>, text or binary (default scenes/default.scene)
+* --compile-scene <in> <out>	Write text scene <in> out as binary scene <out>, and exit
+* --compile-shaders		Rebuild any shaders/*.spv older than its source with glslc before starting, for shader work without compile.bat
+*/
+static aveng::XOne::LaunchOptions parseArgs(int argc, char* argv[])
 {
-	std::vector<int> int_vec;
-	aveng::XOne app{};
+	aveng::XOne::LaunchOptions options{};
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--headless") == 0)
+		{
+			options.headless = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				options.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+			}
+		}
+		else if (std::strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+		{
+			options.dumpDir = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--verify-cull") == 0)
+		{
+			options.verifyCulling = true;
+		}
+		else if (std::strcmp(argv[i], "--optimize-meshes") == 0)
+		{
+			options.optimizeMeshes = true;
+		}
+		else if (std::strcmp(argv[i], "--optimize-overdraw") == 0)
+		{
+			options.optimizeOverdraw = true;
+		}
+		else if (std::strcmp(argv[i], "--bench-dedup") == 0 && i + 1 < argc)
+		{
+			options.benchDedup = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--bench-obj") == 0 && i + 1 < argc)
+		{
+			options.benchObj = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--bench-bvh") == 0)
+		{
+			options.benchBvh = 100000;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				options.benchBvh = static_cast<uint32_t>(std::stoul(argv[++i]));
+			}
+		}
+		else if (std::strcmp(argv[i], "--bench-broadphase") == 0)
+		{
+			options.benchBroadphase = 20000;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				options.benchBroadphase = static_cast<uint32_t>(std::stoul(argv[++i]));
+			}
+		}
+		else if (std::strcmp(argv[i], "--bench-pick") == 0)
+		{
+			options.benchPick = 1000000;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				options.benchPick = static_cast<uint32_t>(std::stoul(argv[++i]));
+			}
+		}
+		else if (std::strcmp(argv[i], "--sim-hz") == 0 && i + 1 < argc)
+		{
+			options.simulationHz = std::stof(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+		{
+			options.recordInput = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+		{
+			options.replayInput = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--replay-dt") == 0 && i + 1 < argc)
+		{
+			options.replayDt = std::stof(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+		{
+			options.scene = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--compile-scene") == 0 && i + 2 < argc)
+		{
+			options.compileScene = argv[++i];
+			options.compiledScene = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--compile-shaders") == 0)
+		{
+			options.compileShaders = true;
+		}
+		else
+		{
+			LOG("Ignoring unknown argument " << argv[i]);
+		}
+	}
+
+	return options;
+}
+
+int main(int argc, char* argv[])
+{
+	aveng::XOne::LaunchOptions options{};
+
+	try {
+		options = parseArgs(argc, argv);
+	}
+	catch (const std::exception& e)
+	{
+		LOG("Bad arguments: " << e.what());
+		return -1;
+	}
+
+	// No window or device needed
+	if (!options.benchDedup.empty() || !options.benchObj.empty() || options.benchBvh > 0 || options.benchBroadphase > 0 || options.benchPick > 0 || !options.compileScene.empty())
+	{
+		try {
+			if (!options.benchDedup.empty()) aveng::AvengModel::benchmarkDedup(options.benchDedup);
+			if (!options.benchObj.empty()) aveng::AvengModel::benchmarkObjReader(options.benchObj);
+			if (options.benchBvh > 0) aveng::BVH::benchmark(options.benchBvh);
+			if (options.benchBroadphase > 0) aveng::Broadphase::benchmark(options.benchBroadphase);
+			if (options.benchPick > 0) aveng::TriangleBVH::benchmark(options.benchPick);
+			if (!options.compileScene.empty())
+			{
+				const aveng::Scene scene = aveng::Scene::loadText(options.compileScene);
+				scene.saveBinary(options.compiledScene);
+				LOG(options.compiledScene << ": " << scene.objectCount() << " objects, " << scene.meshes.size() << " meshes");
+			}
+		}
+		catch (const std::exception& e)
+		{
+			LOG(e.what());
+			return -1;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	aveng::XOne app{ options };
 
 	try {
 		app.run();
@@ -20,4 +179,4 @@ int main(void)
 
 	return EXIT_SUCCESS;
 
-}
\ No newline at end of file
+}
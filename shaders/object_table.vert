@@ -0,0 +1,61 @@
+#version 450
+
+// simple_shader.vert for the indirect draw path. Transforms come from the object table rather than
+// push constants; each command's firstInstance is its first object, so gl_InstanceIndex indexes it.
+
+// Input from the vertex buffer (the shared MeshArena)
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 v_fragColor;
+layout(location = 2) in vec3 normal;
+layout(location = 3) in vec2 v_fragTexCoord;
+
+layout(location = 0) out vec3 f_fragColor;
+layout(location = 1) out vec3 f_fragPosWorld;
+layout(location = 2) out vec3 f_fragNormalWorld;
+layout(location = 3) out vec2 f_fragTexCoord;
+layout(location = 4) flat out uint f_texIndex;
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+	mat4 projection;
+	mat4 view;
+	vec4 ambientLightColor; // w is intensity
+	uvec4 clusterCounts;    // xyz cluster grid, w light count
+	vec4 clusterDepth;      // x slice scale, y slice bias, z near, w far
+	vec4 screenSize;        // xy framebuffer size
+} ubo;
+
+// ObjectRenderSystem::ObjectData
+struct ObjectData {
+	mat4 modelMatrix;
+	vec4 normalMatrix[3];   // Columns of the 3x3 normal matrix
+	uvec4 params;           // x texture index
+};
+
+// The whole frame arena, indexed in ObjectData sized steps
+layout(std430, set = 0, binding = 5) readonly buffer ObjectTable {
+	ObjectData objects[];
+};
+
+// AvengModel::PackedVertex stores the normal octahedral encoded in .xy, the pipeline says which one it has
+layout(constant_id = 3) const bool PACKED_NORMALS = false;
+
+vec3 octDecode(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
+void main() {
+	ObjectData object = objects[gl_InstanceIndex];
+
+	vec4 positionWorld = object.modelMatrix * vec4(position, 1.0);
+	gl_Position = ubo.projection * ubo.view * positionWorld;
+
+	mat3 normalMatrix = mat3(object.normalMatrix[0].xyz, object.normalMatrix[1].xyz, object.normalMatrix[2].xyz);
+
+	f_fragNormalWorld = normalize(normalMatrix * (PACKED_NORMALS ? octDecode(normal.xy) : normal));
+	f_fragPosWorld    = positionWorld.xyz;
+	f_fragColor       = v_fragColor;
+	f_fragTexCoord    = v_fragTexCoord;
+	f_texIndex        = object.params.x;
+}
@@ -0,0 +1,56 @@
+#version 450
+
+// simple_shader2.vert for the indirect draw path. Transforms come from the object table rather than
+// push constants; each command's firstInstance is its first object, so gl_InstanceIndex indexes it.
+
+// How our vertex buffers are read
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 color;
+layout(location = 2) in vec3 normal;
+layout(location = 3) in vec2 uv;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+// Camera direction and light, read the same way simple_shader2.vert does
+layout(set = 0, binding = 0) uniform GlobalUbo {
+  mat4 projectionViewMatrix;
+  vec3 directionToLight;
+} ubo;
+
+// ObjectRenderSystem::ObjectData
+struct ObjectData {
+  mat4 modelMatrix;
+  vec4 normalMatrix[3];   // Columns of the 3x3 normal matrix
+  uvec4 params;           // x texture index
+};
+
+// The whole frame arena, indexed in ObjectData sized steps
+layout(std430, set = 0, binding = 5) readonly buffer ObjectTable {
+  ObjectData objects[];
+};
+
+// AvengModel::PackedVertex stores the normal octahedral encoded in .xy, the pipeline says which one it has
+layout(constant_id = 3) const bool PACKED_NORMALS = false;
+
+vec3 octDecode(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  return normalize(n);
+}
+
+const float AMBIENT = 0.02;
+
+void main() {
+  ObjectData object = objects[gl_InstanceIndex];
+
+  gl_Position = ubo.projectionViewMatrix * object.modelMatrix * vec4(position, 1.0);
+
+  mat3 normalMatrix = mat3(object.normalMatrix[0].xyz, object.normalMatrix[1].xyz, object.normalMatrix[2].xyz);
+  vec3 normalWorldSpace = normalize(normalMatrix * (PACKED_NORMALS ? octDecode(normal.xy) : normal));
+
+  float lightIntensity = AMBIENT + max(dot(normalWorldSpace, ubo.directionToLight), 0);
+
+  fragColor = lightIntensity * color;
+  fragTexCoord = uv;
+}
@@ -1,14 +1,16 @@
 #version 450
 
 layout(location=0) in vec2 fragOffset;
+layout(location=1) in vec3 fragColor;
 layout(location=0) out vec4 outColor;
 
 layout(set = 0, binding = 0) uniform GlobalUbo {
 	mat4 projection;
 	mat4 view;
 	vec4 ambientLightColor; // w is intensity
-	vec3 lightPosition;
-	vec4 lightColor;
+	uvec4 clusterCounts;    // xyz cluster grid, w light count
+	vec4 clusterDepth;      // x slice scale, y slice bias, z near, w far
+	vec4 screenSize;        // xy framebuffer size
 } ubo;
 
 void main() 
@@ -17,5 +19,5 @@ void main()
 	if (dis >= 1.0) {	// This effectively means anything beyond a 1 unit radius gets discarded, turning our square into a circle
 		discard;	// fragment shader keyword
 	}
-	outColor = vec4(ubo.lightColor.xyz, 1.0);
+	outColor = vec4(fragColor, 1.0);
 }
\ No newline at end of file
@@ -10,22 +10,37 @@ const vec2 OFFSETS[6] = vec2[](
 );
 
 layout (location = 0) out vec2 fragOffset;
+layout (location = 1) out vec3 fragColor;
 
 layout(set = 0, binding = 0) uniform GlobalUbo {
 	mat4 projection;
 	mat4 view;
 	vec4 ambientLightColor; // w is intensity
-	vec3 lightPosition;
-	vec4 lightColor;
+	uvec4 clusterCounts;    // xyz cluster grid, w light count
+	vec4 clusterDepth;      // x slice scale, y slice bias, z near, w far
+	vec4 screenSize;        // xy framebuffer size
 } ubo;
 
-const float LIGHT_RADIUS = 0.561; // Can be a push constant?
+struct PointLight {
+	vec4 position;  // w is the radius of influence
+	vec4 color;     // w is intensity
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer LightBuffer {
+	PointLight lights[];
+};
+
+const float LIGHT_RADIUS = 0.1; // Billboard size, not the light's radius of influence
 
 void main() {
 
 	fragOffset = OFFSETS[gl_VertexIndex]; // gl_VertexIndex contains the index of the current vertex being processed
 
-	vec4 lightCameraSpace = ubo.view * vec4(ubo.lightPosition, 1.0);
+	// Drawn instanced, one billboard per light
+	PointLight light = lights[gl_InstanceIndex];
+	fragColor = light.color.xyz;
+
+	vec4 lightCameraSpace = ubo.view * vec4(light.position.xyz, 1.0);
 	vec4 positionCameraSpace = lightCameraSpace + LIGHT_RADIUS * vec4(fragOffset, 0.0, 0.0);
 
 	gl_Position = ubo.projection * positionCameraSpace;
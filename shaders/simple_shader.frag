@@ -5,6 +5,7 @@ layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec3 fragPosWorld;
 layout(location = 2) in vec3 fragNormalWorld;
 layout(location = 3) in vec2 fragTexCoord;
+layout(location = 4) flat in uint fragTexIndex;
 
 layout(location = 0) out vec4 outColor;
 
@@ -12,32 +13,78 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
 	mat4 projection;
 	mat4 view;
 	vec4 ambientLightColor; // w is intensity
-	vec3 lightPosition;
-	vec4 lightColor;
+	uvec4 clusterCounts;    // xyz cluster grid, w light count
+	vec4 clusterDepth;      // x slice scale, y slice bias, z near, w far
+	vec4 screenSize;        // xy framebuffer size
 } ubo;
 
-layout(set = 1, binding = 0) uniform FragUbo {
-    uint imDex;
-} fubo;
+struct PointLight {
+	vec4 position;  // w is the radius of influence
+	vec4 color;     // w is intensity
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer LightBuffer {
+	PointLight lights[];
+};
+
+// Per cluster { offset, count } into lightIndices, see LightClusters
+layout(std430, set = 0, binding = 3) readonly buffer ClusterGrid {
+	uvec2 clusters[];
+};
+
+layout(std430, set = 0, binding = 4) readonly buffer LightIndices {
+	uint lightIndices[];
+};
+
+// Set per pipeline (PipelineConfig::specializationConstants), the branches below fold away
+layout(constant_id = 0) const bool TEXTURED = true;     // false: vertex colors only
+layout(constant_id = 1) const float GAMMA = 1.1;        // 1.0 skips the pow
+layout(constant_id = 2) const int LIGHT_COUNT = 256;    // Most lights evaluated per fragment, 0 is unlit
 
 void main() {
 
     vec4 result = vec4(fragColor, 1.0);
 
-    if (fubo.imDex != 8) {  // 8 will omit texture and default to vertex colors
-        result = texture(texSampler[fubo.imDex], fragTexCoord);
+    // From the push constants or the object table, whichever the vertex shader reads
+    if (TEXTURED) {
+        result = texture(texSampler[fragTexIndex], fragTexCoord);
     }
 
     // Gamma correction
-    float gamma = 1.1;
-    result.rgb = pow(result.rgb, vec3(1.0 / gamma));
+    if (GAMMA != 1.0) {
+        result.rgb = pow(result.rgb, vec3(1.0 / GAMMA));
+    }
+
+    if (LIGHT_COUNT == 0) {
+        outColor = vec4(result.rgb, 1.0);
+        return;
+    }
+
+	// Find our cluster: screen tile from the fragment position, depth slice from view space z
+	float viewZ = (ubo.view * vec4(fragPosWorld, 1.0)).z;
+	uvec2 tile = min(uvec2(gl_FragCoord.xy / ubo.screenSize.xy * vec2(ubo.clusterCounts.xy)), ubo.clusterCounts.xy - 1);
+	uint slice = uint(clamp(log(max(viewZ, ubo.clusterDepth.z)) * ubo.clusterDepth.x + ubo.clusterDepth.y, 0.0, float(ubo.clusterCounts.z - 1)));
+	uvec2 cluster = clusters[tile.x + ubo.clusterCounts.x * (tile.y + ubo.clusterCounts.y * slice)];
+
+	vec3 normal = normalize(fragNormalWorld);
+	vec3 diffuseLight = vec3(0.0);
+
+	uint count = min(cluster.y, uint(LIGHT_COUNT));
+	for (uint i = 0; i < count; i++) {
+		PointLight light = lights[lightIndices[cluster.x + i]];
+
+		vec3 directionToLight = light.position.xyz - fragPosWorld;
+		float distanceSquared = dot(directionToLight, directionToLight);
+
+		// Inverse square, windowed so the light reaches exactly zero at its radius
+		float window = clamp(1.0 - pow(distanceSquared / (light.position.w * light.position.w), 2.0), 0.0, 1.0);
+		float attenuation = window * window / max(distanceSquared, 0.0001);
 
-	vec3 directionToLight = ubo.lightPosition - fragPosWorld;
-	float attenuation = 1.0 / dot(directionToLight, directionToLight); 
+		float cosAngle = max(dot(normal, normalize(directionToLight)), 0);
+		diffuseLight += light.color.xyz * light.color.w * attenuation * cosAngle;
+	}
 
-	vec3 lightColor = ubo.lightColor.xyz * ubo.lightColor.w * attenuation;
 	vec3 ambientLight = ubo.ambientLightColor.xyz * ubo.ambientLightColor.w;
-	vec3 diffuseLight = lightColor * max(dot(normalize(fragNormalWorld), normalize(directionToLight)), 0);
 
     outColor = vec4((diffuseLight + ambientLight) * result.rgb, 1.0);
     
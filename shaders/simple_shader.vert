@@ -10,27 +10,39 @@ layout(location = 0) out vec3 f_fragColor;
 layout(location = 1) out vec3 f_fragPosWorld;
 layout(location = 2) out vec3 f_fragNormalWorld;
 layout(location = 3) out vec2 f_fragTexCoord;
+layout(location = 4) flat out uint f_texIndex;
 
 layout(set = 0, binding = 0) uniform GlobalUbo {
 	mat4 projection;
 	mat4 view;
 	vec4 ambientLightColor; // w is intensity
-	vec3 lightPosition;
-	vec4 lightColor;
+	uvec4 clusterCounts;    // xyz cluster grid, w light count
+	vec4 clusterDepth;      // x slice scale, y slice bias, z near, w far
+	vec4 screenSize;        // xy framebuffer size
 } ubo;
 
-// Model matrix and a pretty normal matrix
+// Model matrix and a pretty normal matrix. The normal only needs its 3x3, the last column's x is the texture index.
 layout(push_constant) uniform Push {
 	mat4 modelMatrix;
 	mat4 normalMatrix;
 } push;
 
+// AvengModel::PackedVertex stores the normal octahedral encoded in .xy, the pipeline says which one it has
+layout(constant_id = 3) const bool PACKED_NORMALS = false;
+
+vec3 octDecode(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
 void main() {
 	vec4 positionWorld = push.modelMatrix * vec4(position, 1.0);	// Translate this vertex from model space to world space
 	gl_Position = ubo.projection * ubo.view * positionWorld;
 
-	f_fragNormalWorld = normalize(mat3(push.normalMatrix) * normal);
+	f_fragNormalWorld = normalize(mat3(push.normalMatrix) * (PACKED_NORMALS ? octDecode(normal.xy) : normal));
 	f_fragPosWorld    = positionWorld.xyz;
 	f_fragColor		  = v_fragColor;
 	f_fragTexCoord    = v_fragTexCoord;
+	f_texIndex        = uint(push.normalMatrix[3].x);
 }
@@ -21,12 +21,21 @@ layout(push_constant) uniform Push {
   mat4 normalMatrix;
 } push;
 
+// AvengModel::PackedVertex stores the normal octahedral encoded in .xy, the pipeline says which one it has
+layout(constant_id = 3) const bool PACKED_NORMALS = false;
+
+vec3 octDecode(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  return normalize(n);
+}
+
 const float AMBIENT = 0.02;
 
 void main() {
   gl_Position = ubo.projectionViewMatrix * push.modelMatrix * vec4(position, 1.0);
 
-  vec3 normalWorldSpace = normalize(mat3(push.normalMatrix) * normal);
+  vec3 normalWorldSpace = normalize(mat3(push.normalMatrix) * (PACKED_NORMALS ? octDecode(normal.xy) : normal));
 
   float lightIntensity = AMBIENT + max(dot(normalWorldSpace, ubo.directionToLight), 0);
 